@@ -0,0 +1,112 @@
+/*
+ * Bump allocator for data that lives until the end of the assembly.
+ * Memory is handed out from large chunks by moving a pointer, nothing
+ * is freed individually, all chunks go back in one release.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "arena.h"
+#include "errors.h"
+#include "context.h"
+
+#define ARENA_ALIGN           (sizeof (void *))
+
+/*
+ * Initialize an empty arena of the context
+ */
+void arena_init(struct asm65_context *ac, struct arena *a, size_t chunk_size)
+{
+  a->ac = ac;
+  a->chunk = NULL;
+  a->chunk_size = chunk_size;
+  a->allocated = 0;
+  a->reserved = 0;
+  a->num_chunks = 0;
+  a->peak_allocated = 0;
+  a->peak_reserved = 0;
+  a->peak_chunks = 0;
+}
+
+/*
+ * Get a new chunk large enough for at least size bytes
+ */
+static struct arena_chunk *arena_new_chunk(struct arena *a, size_t size)
+{
+  struct arena_chunk *chunk;
+
+  if (size < a->chunk_size)
+    size = a->chunk_size;
+
+  chunk = (struct arena_chunk *)malloc(sizeof (struct arena_chunk) + size);
+  if (!chunk)
+    out_of_memory(a->ac);
+  chunk->next = a->chunk;
+  chunk->size = size;
+  chunk->used = 0;
+  a->chunk = chunk;
+
+  a->reserved += size;
+  a->num_chunks++;
+  a->ac->stats.arena_chunks++;
+  a->ac->stats.arena_bytes += size;
+  if (a->reserved > a->peak_reserved)
+    a->peak_reserved = a->reserved;
+  if (a->num_chunks > a->peak_chunks)
+    a->peak_chunks = a->num_chunks;
+
+  return chunk;
+}
+
+/*
+ * Allocate memory from the arena, the memory is pointer aligned
+ */
+void *arena_alloc(struct arena *a, size_t size)
+{
+  struct arena_chunk *chunk = a->chunk;
+  void *p;
+
+  size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+  if (!chunk || chunk->size - chunk->used < size)
+    chunk = arena_new_chunk(a, size);
+
+  p = &chunk->data[chunk->used];
+  chunk->used += size;
+
+  a->allocated += size;
+  if (a->allocated > a->peak_allocated)
+    a->peak_allocated = a->allocated;
+
+  return p;
+}
+
+/*
+ * Give all memory in the arena back in one go.
+ * The high water marks are kept.
+ */
+void arena_release(struct arena *a)
+{
+  struct arena_chunk *chunk = a->chunk;
+  struct arena_chunk *next;
+
+  while (chunk) {
+    next = chunk->next;
+    free(chunk);
+    chunk = next;
+  }
+  a->chunk = NULL;
+  a->allocated = 0;
+  a->reserved = 0;
+  a->num_chunks = 0;
+}
+
+/*
+ * Print the high water marks of the arena
+ */
+void arena_report(struct arena *a, char *name)
+{
+  log_printf(a->ac, "%s arena: peak %lu bytes used, %lu bytes reserved in "
+             "%d chunks of %lu bytes\n", name,
+             (unsigned long)a->peak_allocated, (unsigned long)a->peak_reserved,
+             a->peak_chunks, (unsigned long)a->chunk_size);
+}
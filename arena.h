@@ -0,0 +1,35 @@
+/*
+ * Bump allocator for data that lives until the end of the assembly
+ */
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+#include <stddef.h>
+
+struct arena_chunk;
+struct arena_chunk {
+  struct arena_chunk *next;
+  size_t size;
+  size_t used;
+  char data[];
+};
+
+struct asm65_context;
+struct arena {
+  struct asm65_context *ac;   /* Context the memory is counted for */
+  struct arena_chunk *chunk;  /* Chunk currently handing out memory */
+  size_t chunk_size;          /* Default size of new chunks */
+  size_t allocated;           /* Bytes handed out since the last release */
+  size_t reserved;            /* Bytes held in chunks since the last release */
+  int num_chunks;             /* Chunks held since the last release */
+  size_t peak_allocated;      /* High water marks over the arena lifetime */
+  size_t peak_reserved;
+  int peak_chunks;
+};
+
+void arena_init(struct asm65_context *ac, struct arena *a, size_t chunk_size);
+void *arena_alloc(struct arena *a, size_t size);
+void arena_release(struct arena *a);
+void arena_report(struct arena *a, char *name);
+
+#endif // __ARENA_H__
@@ -0,0 +1,508 @@
+/*
+ * Embeddable assembler, libasm65.
+ * The context holds the state of every module, so an assembly only ever
+ * touches its own context. What is set up for a context, the include
+ * path, the output files, the log and the cache, is kept for every
+ * assembly. The state of an assembly is released when the next one
+ * starts or the context is destroyed, a source assembled from memory
+ * copies what is to be kept and releases it right away. Errors are kept
+ * in the context with their message, the caller reports them.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <setjmp.h>
+
+#include "asm65.h"
+#include "global.h"
+#include "assembler.h"
+#include "errors.h"
+#include "include.h"
+#include "output.h"
+#include "object.h"
+#include "symbols.h"
+#include "stats.h"
+#include "cache.h"
+#include "listing.h"
+#include "log.h"
+#include "context.h"
+
+#define ASM65_NAME_LENGTH     512
+
+/*
+ * Create a context with the ASM65_ flags, NULL if out of memory
+ */
+struct asm65_context *asm65_create(int flags)
+{
+  struct asm65_context *ctx;
+
+  ctx = (struct asm65_context *)calloc(1, sizeof (struct asm65_context));
+  if (!ctx)
+    return NULL;
+  ctx->flags = flags;
+  ctx->low = ASM65_IMAGE_SIZE;
+  ctx->high = -1;
+  log_init(ctx, NULL);
+  stats_init(ctx);
+  return ctx;
+}
+
+void asm65_set_flags(struct asm65_context *ctx, int flags)
+{
+  ctx->flags = flags;
+}
+
+/*
+ * Add a directory to look for included files in.
+ * Returns 0, or -1 if the path is full or out of memory.
+ */
+int asm65_add_include_path(struct asm65_context *ctx, const char *dir)
+{
+  return inc_add_path(ctx, dir);
+}
+
+/*
+ * Log to file, NULL for no log. The levels are those of -d.
+ */
+void asm65_set_log(struct asm65_context *ctx, FILE *file)
+{
+  log_flush(ctx);
+  ctx->log.file = file;
+}
+
+/*
+ * Set log levels from a list like expr=trace,sym=debug.
+ * Returns 0, or -1 if a module or level is not known.
+ */
+int asm65_set_log_levels(struct asm65_context *ctx, const char *levels)
+{
+  return log_select(ctx, levels);
+}
+
+/*
+ * Replace a file name kept in the context, NULL for none.
+ * Returns 0, or -1 if out of memory.
+ */
+static int asm65_set_name(char **name, const char *file_name)
+{
+  char *copy = NULL;
+
+  if (file_name && !(copy = strdup(file_name)))
+    return -1;
+  free(*name);
+  *name = copy;
+  return 0;
+}
+
+/*
+ * Write the image of asm65_assemble_file to a file in the named format,
+ * named after the source if file_name is NULL.
+ * Returns 0, or -1 if the format is unknown or there are too many files.
+ */
+int asm65_add_output(struct asm65_context *ctx, const char *format,
+                     const char *file_name)
+{
+  return output_add_sink(ctx, format, file_name);
+}
+
+/*
+ * Name of an output format, NULL past the last one
+ */
+const char *asm65_output_format(int index)
+{
+  int i;
+
+  for (i = 0; i < index && output_formats[i].name; i++)
+    ;
+  return output_formats[i].name;
+}
+
+/*
+ * Object file written with ASM65_OBJECT, NULL to name it after the
+ * source. Returns 0, or -1 if out of memory.
+ */
+int asm65_set_object_file(struct asm65_context *ctx, const char *file_name)
+{
+  return asm65_set_name(&ctx->obj_file_name, file_name);
+}
+
+/*
+ * Listing file, NULL for none. Returns 0, or -1 if out of memory.
+ */
+int asm65_set_listing(struct asm65_context *ctx, const char *file_name)
+{
+  return asm65_set_name(&ctx->lst_file_name, file_name);
+}
+
+/*
+ * Cache the results of asm65_assemble_file in dir, kept below kbytes.
+ * NULL for no cache. Returns 0, or -1 if out of memory.
+ */
+int asm65_set_cache(struct asm65_context *ctx, const char *dir, long kbytes)
+{
+  return cache_set_dir(ctx, dir, kbytes);
+}
+
+/*
+ * Chrome trace file written by asm65_write_trace, NULL for none.
+ * Returns 0, or -1 if out of memory.
+ */
+int asm65_set_trace(struct asm65_context *ctx, const char *file_name)
+{
+  return stats_trace(ctx, file_name);
+}
+
+/*
+ * Forget the result and the error of the last assembly
+ */
+static void asm65_reset(struct asm65_context *ctx)
+{
+  memset(ctx->image, 0, sizeof (ctx->image));
+  ctx->low = ASM65_IMAGE_SIZE;
+  ctx->high = -1;
+  free(ctx->symbols);
+  free(ctx->names);
+  ctx->symbols = NULL;
+  ctx->names = NULL;
+  ctx->num_symbols = 0;
+  ctx->error = OK;
+  ctx->error_line = 0;
+  ctx->error_file[0] = '\0';
+  ctx->error_text = NULL;
+  ctx->message[0] = '\0';
+}
+
+/*
+ * Release the state of the last assembly, if it wasn't already
+ */
+static void asm65_release(struct asm65_context *ctx)
+{
+  if (!ctx->assembled)
+    return;
+  ctx->assembled = 0;
+  ctx->cached = 0;
+  asm_clean_up(ctx);
+  cache_clean_up(ctx);
+  stats_clean_up(ctx);
+}
+
+/*
+ * Start an assembly with the options of the flags
+ */
+static void asm65_start(struct asm65_context *ctx, int object_mode)
+{
+  ctx->single_pass = (ctx->flags & ASM65_SINGLE_PASS) != 0;
+  /* Relocation and relaxation need all symbols known, forward ones too */
+  ctx->relax = !ctx->single_pass && (ctx->flags & ASM65_RELAX);
+  ctx->object_mode = !ctx->single_pass && object_mode;
+  stats_init(ctx);
+  asm_init(ctx);
+  ctx->assembled = 1;
+}
+
+/*
+ * Keep the error and the line it occurred on. A failure to access a file
+ * already has its message.
+ */
+static void asm65_keep_error(struct asm65_context *ctx, int error)
+{
+  if (error == FILE_ACCESS_FAILED)
+    return;
+  ctx->error = error;
+  ctx->error_line = ctx->line;
+  ctx->error_text = (const char *)error_msgs[error];
+  ctx->error_file[0] = '\0';
+  if (ctx->cur_file && ctx->cur_file != ctx->src_root) {
+    snprintf(ctx->error_file, sizeof (ctx->error_file), "%s",
+             ctx->cur_file->path);
+    snprintf(ctx->message, sizeof (ctx->message), "%s, on line %d of %s",
+             ctx->error_text, ctx->line, ctx->cur_file->path);
+  } else {
+    snprintf(ctx->message, sizeof (ctx->message), "%s, on line %d",
+             ctx->error_text, ctx->line);
+  }
+}
+
+/*
+ * Keep the image and the defined symbols.
+ * Returns OK, or OUT_OF_MEMORY if they can't be copied.
+ */
+static int asm65_keep_result(struct asm65_context *ctx)
+{
+  struct output_state *os = &ctx->output;
+  struct symbol_entry *se;
+  size_t length = 0;
+  char *name;
+  int i;
+
+  if (os->high >= os->low)
+    memcpy(&ctx->image[os->low], &os->image[os->low],
+           os->high - os->low + 1);
+  ctx->low = os->low;
+  ctx->high = os->high;
+
+  for (se = ctx->sym.se_first; se; se = sym_next_symbol(se))
+    if (se->defined)
+      length += se->name_length + 1;
+  ctx->symbols = (struct asm65_symbol *)malloc((ctx->sym.num_symbols + 1) *
+                                               sizeof (struct asm65_symbol));
+  ctx->names = (char *)malloc(length + 1);
+  if (!ctx->symbols || !ctx->names)
+    return OUT_OF_MEMORY;
+
+  name = ctx->names;
+  i = 0;
+  for (se = ctx->sym.se_first; se; se = sym_next_symbol(se)) {
+    if (!se->defined)
+      continue;
+    memcpy(name, se->symbol_name, se->name_length);
+    name[se->name_length] = '\0';
+    ctx->symbols[i].name = name;
+    ctx->symbols[i++].value = se->value;
+    name += se->name_length + 1;
+  }
+  ctx->num_symbols = i;
+  return OK;
+}
+
+/*
+ * Assemble length bytes of source text. The image and the symbols are
+ * kept in the context on success.
+ * Returns OK or the error, asm65_error() tells where it occurred.
+ */
+int asm65_assemble(struct asm65_context *ctx, const char *source,
+                   size_t length)
+{
+  jmp_buf recovery;
+  int error;
+
+  asm65_release(ctx);
+  asm65_reset(ctx);
+
+  /* Running out of memory anywhere below comes back here */
+  if (setjmp(recovery)) {
+    ctx->error_recovery = NULL;
+    asm65_keep_error(ctx, OUT_OF_MEMORY);
+    asm65_release(ctx);
+    log_flush(ctx);
+    return OUT_OF_MEMORY;
+  }
+  ctx->error_recovery = &recovery;
+
+  asm65_start(ctx, 0);
+  ctx->src_root = inc_open_buffer(ctx, ASM65_SOURCE_NAME, source, length);
+  /* Every included file must be there before anything is assembled */
+  error = inc_check(ctx, ctx->src_root);
+  if (!error)
+    error = asm_assemble(ctx);
+  if (!error)
+    error = asm65_keep_result(ctx);
+  if (error)
+    asm65_keep_error(ctx, error);
+
+  ctx->error_recovery = NULL;
+  asm65_release(ctx);
+  log_flush(ctx);
+  return error;
+}
+
+/*
+ * Assemble a source file, from the cache if it has the result and no
+ * listing is wanted. The state is kept for asm65_write and the reports
+ * until the next assembly.
+ * Returns OK or the error, asm65_error_detail() tells where it occurred.
+ */
+int asm65_assemble_file(struct asm65_context *ctx, const char *file_name)
+{
+  struct symbol_entry *se;
+  jmp_buf recovery;
+  int error = OK;
+
+  asm65_release(ctx);
+  asm65_reset(ctx);
+
+  if (setjmp(recovery)) {
+    ctx->error_recovery = NULL;
+    asm65_keep_error(ctx, OUT_OF_MEMORY);
+    log_flush(ctx);
+    return OUT_OF_MEMORY;
+  }
+  ctx->error_recovery = &recovery;
+
+  LOG(ctx, LOG_PARSE, LOG_INFO, "Mag6502 Assembler V0.0001\n");
+  LOG(ctx, LOG_PARSE, LOG_INFO, "Assembling source file %s\n", file_name);
+  asm65_start(ctx, (ctx->flags & ASM65_OBJECT) != 0);
+  if (ctx->cache.dir)
+    error = cache_open(ctx);
+
+  if (!error) {
+    stats_begin(ctx, STATS_READ);
+    ctx->src_root = inc_open(ctx, (char *)file_name);
+    if (!ctx->src_root)
+      error = error_report(ctx, "Could not find file");
+    /* The listing needs the lines assembled, so it always misses */
+    if (!error && ctx->cache.dir) {
+      cache_key(ctx, ctx->src_root);
+      ctx->cached = !ctx->lst_file_name && !cache_load(ctx);
+    }
+    /* Every included file must be there before anything is assembled */
+    if (!error && !ctx->cached)
+      error = inc_check(ctx, ctx->src_root);
+    stats_end(ctx, STATS_READ);
+  }
+  if (!error && !ctx->cached)
+    error = asm_assemble(ctx);
+  if (!error)
+    error = asm65_keep_result(ctx);
+  if (error)
+    asm65_keep_error(ctx, error);
+
+  if (LOG_ENABLED(ctx, LOG_SYM, LOG_DEBUG)) {
+    for (se = ctx->sym.se_first; se; se = sym_next_symbol(se))
+      log_printf(ctx, "Symbol: %s, name length: %d, Value 0x%x\n",
+                 se->symbol_name, se->name_length, se->value);
+    sym_report(ctx);
+  }
+  ctx->error_recovery = NULL;
+  log_flush(ctx);
+  return error;
+}
+
+/*
+ * Write what the last asm65_assemble_file put out: the object file with
+ * ASM65_OBJECT, the output files otherwise, then the listing. Files not
+ * named are named base_name with the extension of their kind. A result
+ * not from the cache is stored in it.
+ * Returns OK or FILE_ACCESS_FAILED, asm65_error_detail() has the message.
+ */
+int asm65_write(struct asm65_context *ctx, const char *base_name)
+{
+  char obj_file_name[ASM65_NAME_LENGTH];
+  jmp_buf recovery;
+  FILE *file;
+  int error;
+
+  if (setjmp(recovery)) {
+    ctx->error_recovery = NULL;
+    asm65_keep_error(ctx, OUT_OF_MEMORY);
+    log_flush(ctx);
+    return OUT_OF_MEMORY;
+  }
+  ctx->error_recovery = &recovery;
+
+  if (ctx->obj_file_name)
+    snprintf(obj_file_name, sizeof (obj_file_name), "%s", ctx->obj_file_name);
+  else
+    snprintf(obj_file_name, sizeof (obj_file_name), "%s%s", base_name,
+             OBJ_EXTENSION);
+
+  stats_begin(ctx, STATS_WRITE);
+  if (ctx->object_mode && ctx->cached)
+    error = cache_write_object(ctx, obj_file_name);
+  else if (ctx->object_mode)
+    error = obj_write(ctx, obj_file_name);
+  else
+    error = output_write(ctx, base_name);
+
+  if (!error && ctx->lst_file_name) {
+    file = fopen(ctx->lst_file_name, "w");
+    if (!file || lst_write(ctx, file, ctx->src_root) || fclose(file))
+      error = error_report(ctx, "Could not write listing file %s",
+                           ctx->lst_file_name);
+  }
+
+  if (!error && ctx->cache.dir && !ctx->cached)
+    cache_store(ctx, obj_file_name);
+  stats_end(ctx, STATS_WRITE);
+
+  ctx->error_recovery = NULL;
+  log_flush(ctx);
+  return error;
+}
+
+/*
+ * Log the time of every phase and what was counted
+ */
+void asm65_report_stats(struct asm65_context *ctx)
+{
+  stats_report(ctx);
+  log_flush(ctx);
+}
+
+/*
+ * Write the trace file set with asm65_set_trace, if any.
+ * Returns OK or FILE_ACCESS_FAILED, asm65_error_detail() has the message.
+ */
+int asm65_write_trace(struct asm65_context *ctx)
+{
+  return stats_write_trace(ctx);
+}
+
+/*
+ * The image of the last assembly, the bytes from low to high are the
+ * ones output. The image is indexed by address.
+ */
+const unsigned char *asm65_get_image(struct asm65_context *ctx, int *low,
+                                     int *high)
+{
+  if (low)
+    *low = ctx->low;
+  if (high)
+    *high = ctx->high;
+  return ctx->image;
+}
+
+/*
+ * The symbols defined by the last assembly, in the order of the symbol
+ * table. Returns their number.
+ */
+int asm65_get_symbols(struct asm65_context *ctx,
+                      const struct asm65_symbol **symbols)
+{
+  *symbols = ctx->symbols;
+  return ctx->num_symbols;
+}
+
+/*
+ * The message of the last error, NULL if the last call succeeded
+ */
+const char *asm65_error(struct asm65_context *ctx, int *line_number)
+{
+  if (line_number)
+    *line_number = ctx->error_line;
+  return ctx->error ? ctx->message : NULL;
+}
+
+/*
+ * The last error in parts: the text of the error, the line it occurred
+ * on, 0 if it isn't on a line, and the included file the line is in, NULL
+ * for the source itself. Returns the error, OK if there is none.
+ */
+int asm65_error_detail(struct asm65_context *ctx, const char **text,
+                       int *line_number, const char **file_name)
+{
+  if (text)
+    *text = ctx->error_text;
+  if (line_number)
+    *line_number = ctx->error_line;
+  if (file_name)
+    *file_name = ctx->error_file[0] ? ctx->error_file : NULL;
+  return ctx->error;
+}
+
+void asm65_destroy(struct asm65_context *ctx)
+{
+  if (!ctx)
+    return;
+  asm65_release(ctx);
+  asm65_reset(ctx);
+  log_flush(ctx);
+  inc_clear_paths(ctx);
+  inc_clear_files(ctx);
+  sym_clear_names(ctx);
+  cache_set_dir(ctx, NULL, 0);
+  stats_trace(ctx, NULL);
+  free(ctx->obj_file_name);
+  free(ctx->lst_file_name);
+  free(ctx);
+}
@@ -0,0 +1,67 @@
+/*
+ * Embeddable assembler, libasm65.
+ * A context assembles a source held in memory or a file and keeps the
+ * image and the symbols of the last assembly until the next one. Contexts
+ * don't share anything, several may assemble at once on different
+ * threads, but a context must only be used by one thread at a time.
+ */
+#ifndef __ASM65_H__
+#define __ASM65_H__
+
+#include <stddef.h>
+#include <stdio.h>
+
+/* Flags of asm65_create() */
+#define ASM65_SINGLE_PASS     0x0001    /* Patch forward references, like -1 */
+#define ASM65_RELAX           0x0002    /* Relax branches out of range, like -r,
+                                           not with ASM65_SINGLE_PASS */
+#define ASM65_OBJECT          0x0004    /* Write an object file, like -c, not
+                                           with ASM65_SINGLE_PASS */
+
+#define ASM65_IMAGE_SIZE      0x10000
+#define ASM65_MAX_PATHS       16
+#define ASM65_MESSAGE_LENGTH  512
+#define ASM65_CACHE_DEFAULT_SIZE (16 * 1024)   /* KBytes */
+
+/* Name the source is reported as, included files are looked for from it */
+#define ASM65_SOURCE_NAME     "<memory>"
+
+struct asm65_symbol {
+  char *name;
+  int value;
+};
+
+struct asm65_context;
+
+struct asm65_context *asm65_create(int flags);
+void asm65_set_flags(struct asm65_context *ctx, int flags);
+int asm65_add_include_path(struct asm65_context *ctx, const char *dir);
+int asm65_assemble(struct asm65_context *ctx, const char *source,
+                   size_t length);
+const unsigned char *asm65_get_image(struct asm65_context *ctx, int *low,
+                                     int *high);
+int asm65_get_symbols(struct asm65_context *ctx,
+                      const struct asm65_symbol **symbols);
+const char *asm65_error(struct asm65_context *ctx, int *line_number);
+void asm65_destroy(struct asm65_context *ctx);
+
+/* Logging, nothing is logged unless a file is set */
+void asm65_set_log(struct asm65_context *ctx, FILE *file);
+int asm65_set_log_levels(struct asm65_context *ctx, const char *levels);
+
+/* Assembling a file and writing what comes out of it */
+int asm65_add_output(struct asm65_context *ctx, const char *format,
+                     const char *file_name);
+const char *asm65_output_format(int index);
+int asm65_set_object_file(struct asm65_context *ctx, const char *file_name);
+int asm65_set_listing(struct asm65_context *ctx, const char *file_name);
+int asm65_set_cache(struct asm65_context *ctx, const char *dir, long kbytes);
+int asm65_set_trace(struct asm65_context *ctx, const char *file_name);
+int asm65_assemble_file(struct asm65_context *ctx, const char *file_name);
+int asm65_write(struct asm65_context *ctx, const char *base_name);
+void asm65_report_stats(struct asm65_context *ctx);
+int asm65_write_trace(struct asm65_context *ctx);
+int asm65_error_detail(struct asm65_context *ctx, const char **text,
+                       int *line_number, const char **file_name);
+
+#endif // __ASM65_H__
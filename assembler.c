@@ -0,0 +1,1465 @@
+/*
+ * Attempting to parse some simple assembly instructions
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "global.h"
+#include "assembler.h"
+#include "expr.h"
+#include "utils.h"
+#include "symbols.h"
+#include "errors.h"
+#include "output.h"
+#include "source.h"
+#include "lexer.h"
+#include "ir.h"
+#include "fixup.h"
+#include "log.h"
+#include "object.h"
+#include "include.h"
+#include "macro.h"
+#include "sizing.h"
+#include "stats.h"
+#include "context.h"
+
+enum cpu_models_id {
+  CPUUNDEF,
+  CPU6502,
+  CPU65C02,
+  CPU65C816,
+};
+
+/*
+ * Assembler directive
+ */
+struct asm_directive {
+  char *directive;
+  int (*func)(struct asm65_context *ac, struct token *tok);
+};
+
+/*
+ * Assembler mnemonics.
+ * amodes has a bit for every addressing mode the mnemonic can use and
+ * opcodes the opcode for each of them, indexed by MODE_INDEX().
+ */
+struct asm_mnemonic {
+  char *mnemonic;
+  unsigned int amodes;
+  unsigned char opcodes[MODE_NUM_MODES];
+};
+
+/* Indexes into the directive table */
+enum directive_ids {
+  DIR_CPU,
+  DIR_ORG,
+  DIR_BYTE,
+  DIR_WORD,
+  DIR_END,
+  DIR_INCLUDE,
+  DIR_MACRO,
+  DIR_ENDM,
+  DIR_NUM_DIRECTIVES
+};
+
+/* Indexes into the mnemonic tables, the union of all supported CPUs */
+enum mnemonic_ids {
+  MN_ADC, MN_AND, MN_ASL, MN_BCC, MN_BCS, MN_BEQ, MN_BIT, MN_BMI,
+  MN_BNE, MN_BPL, MN_BRA, MN_BRK, MN_BRL, MN_BVC, MN_BVS, MN_CLC,
+  MN_CLD, MN_CLI, MN_CLV, MN_CMP, MN_COP, MN_CPX, MN_CPY, MN_DEC,
+  MN_DEX, MN_DEY, MN_EOR, MN_INC, MN_INX, MN_INY, MN_JML, MN_JMP,
+  MN_JSL, MN_JSR, MN_LDA, MN_LDX, MN_LDY, MN_LSR, MN_MVN, MN_MVP,
+  MN_NOP, MN_ORA, MN_PEA, MN_PEI, MN_PER, MN_PHA, MN_PHB, MN_PHD,
+  MN_PHK, MN_PHP, MN_PHX, MN_PHY, MN_PLA, MN_PLB, MN_PLD, MN_PLP,
+  MN_PLX, MN_PLY, MN_REP, MN_ROL, MN_ROR, MN_RTI, MN_RTL, MN_RTS,
+  MN_SBC, MN_SEC, MN_SED, MN_SEI, MN_SEP, MN_STA, MN_STP, MN_STX,
+  MN_STY, MN_STZ, MN_TAX, MN_TAY, MN_TCD, MN_TCS, MN_TDC, MN_TRB,
+  MN_TSB, MN_TSC, MN_TSX, MN_TXA, MN_TXS, MN_TXY, MN_TYA, MN_TYX,
+  MN_WAI, MN_XBA, MN_XCE,
+  MN_NUM_MNEMONICS
+};
+
+/* Assembler directive and mnemonic prototypes */
+int dir_cpu(struct asm65_context *ac, struct token *tok);
+int dir_org(struct asm65_context *ac, struct token *tok);
+int dir_byte(struct asm65_context *ac, struct token *tok);
+int dir_word(struct asm65_context *ac, struct token *tok);
+int dir_dword(struct asm65_context *ac, struct token *tok);
+int dir_end(struct asm65_context *ac, struct token *tok);
+int dir_include(struct asm65_context *ac, struct token *tok);
+int dir_macro(struct asm65_context *ac, struct token *tok);
+int dir_endm(struct asm65_context *ac, struct token *tok);
+
+
+struct asm_directive ad[] =
+{
+  [DIR_CPU]  = { "CPU", dir_cpu },
+  [DIR_ORG]  = { "ORG", dir_org },
+  [DIR_BYTE] = { "BYTE", dir_byte },
+  [DIR_WORD] = { "WORD", dir_word },
+  [DIR_END]  = { "END", dir_end },
+  [DIR_INCLUDE] = { "INCLUDE", dir_include },
+  [DIR_MACRO] = { "MACRO", dir_macro },
+  [DIR_ENDM] = { "ENDM", dir_endm },
+  [DIR_NUM_DIRECTIVES] = { NULL, NULL },
+};
+
+/*
+ * Opcode matrices, one per CPU with a row per mnemonic and a column per
+ * addressing mode in the order of the mode bits. NO marks a mode the
+ * mnemonic can't use, the amodes mask is built from the same row. The
+ * 65C02 and 65C816 add columns for their new modes:
+ *   zpi  (zp)         aix  (abs,X)      al   long         alx  long,X
+ *   ild  [dp]         ildy [dp],Y       ial  [abs]        sr   sr,S
+ *   sriy (sr,S),Y     rell long branch  bm   block move
+ */
+#define NO                    -1
+#define OPCODE_MODE(op, mode) ((op) < 0 ? 0 : (mode))
+#define OPCODES_65C816(acc, abs, abx, aby, imm, imp, ind, inx, iny, rel,     \
+                       zp, zpx, zpy, zpi, aix, al, alx, ild, ildy, ial, sr,  \
+                       sriy, rell, bm)                                       \
+  OPCODE_MODE(acc, MODE_ACCUMULATOR) | OPCODE_MODE(abs, MODE_ABSOLUTE) |     \
+  OPCODE_MODE(abx, MODE_ABSOLUTE_IX) | OPCODE_MODE(aby, MODE_ABSOLUTE_IY) |  \
+  OPCODE_MODE(imm, MODE_IMMEDIATE) | OPCODE_MODE(imp, MODE_IMPLIED) |        \
+  OPCODE_MODE(ind, MODE_INDIRECT) | OPCODE_MODE(inx, MODE_INDIRECT_IX) |     \
+  OPCODE_MODE(iny, MODE_INDIRECT_IY) | OPCODE_MODE(rel, MODE_RELATIVE) |     \
+  OPCODE_MODE(zp, MODE_ZEROPAGE) | OPCODE_MODE(zpx, MODE_ZEROPAGE_IX) |      \
+  OPCODE_MODE(zpy, MODE_ZEROPAGE_IY) | OPCODE_MODE(zpi, MODE_ZEROPAGE_IND) | \
+  OPCODE_MODE(aix, MODE_ABSOLUTE_IND_IX) | OPCODE_MODE(al, MODE_LONG) |      \
+  OPCODE_MODE(alx, MODE_LONG_IX) | OPCODE_MODE(ild, MODE_INDIRECT_LONG) |    \
+  OPCODE_MODE(ildy, MODE_INDIRECT_LONG_IY) |                                 \
+  OPCODE_MODE(ial, MODE_ABSOLUTE_IND_LONG) | OPCODE_MODE(sr, MODE_STACK) |   \
+  OPCODE_MODE(sriy, MODE_STACK_IND_IY) |                                     \
+  OPCODE_MODE(rell, MODE_RELATIVE_LONG) | OPCODE_MODE(bm, MODE_BLOCK_MOVE),  \
+  { (acc) & 0xff, (abs) & 0xff, (abx) & 0xff, (aby) & 0xff, (imm) & 0xff,    \
+    (imp) & 0xff, (ind) & 0xff, (inx) & 0xff, (iny) & 0xff, (rel) & 0xff,    \
+    (zp) & 0xff, (zpx) & 0xff, (zpy) & 0xff, (zpi) & 0xff, (aix) & 0xff,     \
+    (al) & 0xff, (alx) & 0xff, (ild) & 0xff, (ildy) & 0xff, (ial) & 0xff,    \
+    (sr) & 0xff, (sriy) & 0xff, (rell) & 0xff, (bm) & 0xff }
+#define OPCODES_65C02(acc, abs, abx, aby, imm, imp, ind, inx, iny, rel,      \
+                      zp, zpx, zpy, zpi, aix)                                \
+  OPCODES_65C816(acc, abs, abx, aby, imm, imp, ind, inx, iny, rel, zp, zpx,  \
+                 zpy, zpi, aix, NO, NO, NO, NO, NO, NO, NO, NO, NO)
+#define OPCODES(acc, abs, abx, aby, imm, imp, ind, inx, iny, rel, zp, zpx,   \
+                zpy)                                                         \
+  OPCODES_65C02(acc, abs, abx, aby, imm, imp, ind, inx, iny, rel, zp, zpx,   \
+                zpy, NO, NO)
+
+struct asm_mnemonic am_6502[] =
+{
+  /*                           acc   abs   abx   aby   imm   imp   ind   inx   iny   rel    zp   zpx   zpy */
+  [MN_ADC] = { "ADC", OPCODES(  NO, 0x6D, 0x7D, 0x79, 0x69,   NO,   NO, 0x61, 0x71,   NO, 0x65, 0x75,   NO) }, // .... add with carry
+  [MN_AND] = { "AND", OPCODES(  NO, 0x2D, 0x3D, 0x39, 0x29,   NO,   NO, 0x21, 0x31,   NO, 0x25, 0x35,   NO) }, // .... and (with accumulator)
+  [MN_ASL] = { "ASL", OPCODES(0x0A, 0x0E, 0x1E,   NO,   NO,   NO,   NO,   NO,   NO,   NO, 0x06, 0x16,   NO) }, // .... arithmetic shift left
+  [MN_BCC] = { "BCC", OPCODES(  NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO, 0x90,   NO,   NO,   NO) }, // .... branch on carry clear
+  [MN_BCS] = { "BCS", OPCODES(  NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO, 0xB0,   NO,   NO,   NO) }, // .... branch on carry set
+  [MN_BEQ] = { "BEQ", OPCODES(  NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO, 0xF0,   NO,   NO,   NO) }, // .... branch on equal (zero set)
+  [MN_BIT] = { "BIT", OPCODES(  NO, 0x2C,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO, 0x24,   NO,   NO) }, // .... bit test
+  [MN_BMI] = { "BMI", OPCODES(  NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO, 0x30,   NO,   NO,   NO) }, // .... branch on minus (negative set)
+  [MN_BNE] = { "BNE", OPCODES(  NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO, 0xD0,   NO,   NO,   NO) }, // .... branch on not equal (zero clear)
+  [MN_BPL] = { "BPL", OPCODES(  NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO, 0x10,   NO,   NO,   NO) }, // .... branch on plus (negative clear)
+  [MN_BRK] = { "BRK", OPCODES(  NO,   NO,   NO,   NO,   NO, 0x00,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... interrupt
+  [MN_BVC] = { "BVC", OPCODES(  NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO, 0x50,   NO,   NO,   NO) }, // .... branch on overflow clear
+  [MN_BVS] = { "BVS", OPCODES(  NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO, 0x70,   NO,   NO,   NO) }, // .... branch on overflow set
+  [MN_CLC] = { "CLC", OPCODES(  NO,   NO,   NO,   NO,   NO, 0x18,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... clear carry
+  [MN_CLD] = { "CLD", OPCODES(  NO,   NO,   NO,   NO,   NO, 0xD8,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... clear decimal
+  [MN_CLI] = { "CLI", OPCODES(  NO,   NO,   NO,   NO,   NO, 0x58,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... clear interrupt disable
+  [MN_CLV] = { "CLV", OPCODES(  NO,   NO,   NO,   NO,   NO, 0xB8,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... clear overflow
+  [MN_CMP] = { "CMP", OPCODES(  NO, 0xCD, 0xDD, 0xD9, 0xC9,   NO,   NO, 0xC1, 0xD1,   NO, 0xC5, 0xD5,   NO) }, // .... compare (with accumulator)
+  [MN_CPX] = { "CPX", OPCODES(  NO, 0xEC,   NO,   NO, 0xE0,   NO,   NO,   NO,   NO,   NO, 0xE4,   NO,   NO) }, // .... compare with X
+  [MN_CPY] = { "CPY", OPCODES(  NO, 0xCC,   NO,   NO, 0xC0,   NO,   NO,   NO,   NO,   NO, 0xC4,   NO,   NO) }, // .... compare with Y
+  [MN_DEC] = { "DEC", OPCODES(  NO, 0xCE, 0xDE,   NO,   NO,   NO,   NO,   NO,   NO,   NO, 0xC6, 0xD6,   NO) }, // .... decrement
+  [MN_DEX] = { "DEX", OPCODES(  NO,   NO,   NO,   NO,   NO, 0xCA,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... decrement X
+  [MN_DEY] = { "DEY", OPCODES(  NO,   NO,   NO,   NO,   NO, 0x88,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... decrement Y
+  [MN_EOR] = { "EOR", OPCODES(  NO, 0x4D, 0x5D, 0x59, 0x49,   NO,   NO, 0x41, 0x51,   NO, 0x45, 0x55,   NO) }, // .... exclusive or (with accumulator)
+  [MN_INC] = { "INC", OPCODES(  NO, 0xEE, 0xFE,   NO,   NO,   NO,   NO,   NO,   NO,   NO, 0xE6, 0xF6,   NO) }, // .... increment
+  [MN_INX] = { "INX", OPCODES(  NO,   NO,   NO,   NO,   NO, 0xE8,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... increment X
+  [MN_INY] = { "INY", OPCODES(  NO,   NO,   NO,   NO,   NO, 0xC8,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... increment Y
+  [MN_JMP] = { "JMP", OPCODES(  NO, 0x4C,   NO,   NO,   NO,   NO, 0x6C,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... jump
+  [MN_JSR] = { "JSR", OPCODES(  NO, 0x20,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... jump subroutine
+  [MN_LDA] = { "LDA", OPCODES(  NO, 0xAD, 0xBD, 0xB9, 0xA9,   NO,   NO, 0xA1, 0xB1,   NO, 0xA5, 0xB5,   NO) }, // .... load accumulator
+  [MN_LDX] = { "LDX", OPCODES(  NO, 0xAE,   NO, 0xBE, 0xA2,   NO,   NO,   NO,   NO,   NO, 0xA6,   NO, 0xB6) }, // .... load X
+  [MN_LDY] = { "LDY", OPCODES(  NO, 0xAC, 0xBC,   NO, 0xA0,   NO,   NO,   NO,   NO,   NO, 0xA4, 0xB4,   NO) }, // .... load Y
+  [MN_LSR] = { "LSR", OPCODES(0x4A, 0x4E, 0x5E,   NO,   NO,   NO,   NO,   NO,   NO,   NO, 0x46, 0x56,   NO) }, // .... logical shift right
+  [MN_NOP] = { "NOP", OPCODES(  NO,   NO,   NO,   NO,   NO, 0xEA,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... no operation
+  [MN_ORA] = { "ORA", OPCODES(  NO, 0x0D, 0x1D, 0x19, 0x09,   NO,   NO, 0x01, 0x11,   NO, 0x05, 0x15,   NO) }, // .... or with accumulator
+  [MN_PHA] = { "PHA", OPCODES(  NO,   NO,   NO,   NO,   NO, 0x48,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... push accumulator
+  [MN_PHP] = { "PHP", OPCODES(  NO,   NO,   NO,   NO,   NO, 0x08,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... push processor status (SR)
+  [MN_PLA] = { "PLA", OPCODES(  NO,   NO,   NO,   NO,   NO, 0x68,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... pull accumulator
+  [MN_PLP] = { "PLP", OPCODES(  NO,   NO,   NO,   NO,   NO, 0x28,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... pull processor status (SR)
+  [MN_ROL] = { "ROL", OPCODES(0x2A, 0x2E, 0x3E,   NO,   NO,   NO,   NO,   NO,   NO,   NO, 0x26, 0x36,   NO) }, // .... rotate left
+  [MN_ROR] = { "ROR", OPCODES(0x6A, 0x6E, 0x7E,   NO,   NO,   NO,   NO,   NO,   NO,   NO, 0x66, 0x76,   NO) }, // .... rotate right
+  [MN_RTI] = { "RTI", OPCODES(  NO,   NO,   NO,   NO,   NO, 0x40,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... return from interrupt
+  [MN_RTS] = { "RTS", OPCODES(  NO,   NO,   NO,   NO,   NO, 0x60,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... return from subroutine
+  [MN_SBC] = { "SBC", OPCODES(  NO, 0xED, 0xFD, 0xF9, 0xE9,   NO,   NO, 0xE1, 0xF1,   NO, 0xE5, 0xF5,   NO) }, // .... subtract with carry
+  [MN_SEC] = { "SEC", OPCODES(  NO,   NO,   NO,   NO,   NO, 0x38,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... set carry
+  [MN_SED] = { "SED", OPCODES(  NO,   NO,   NO,   NO,   NO, 0xF8,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... set decimal
+  [MN_SEI] = { "SEI", OPCODES(  NO,   NO,   NO,   NO,   NO, 0x78,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... set interrupt disable
+  [MN_STA] = { "STA", OPCODES(  NO, 0x8D, 0x9D, 0x99,   NO,   NO,   NO, 0x81, 0x91,   NO, 0x85, 0x95,   NO) }, // .... store accumulator
+  [MN_STX] = { "STX", OPCODES(  NO, 0x8E,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO, 0x86,   NO, 0x96) }, // .... store X
+  [MN_STY] = { "STY", OPCODES(  NO, 0x8C,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO, 0x84, 0x94,   NO) }, // .... store Y
+  [MN_TAX] = { "TAX", OPCODES(  NO,   NO,   NO,   NO,   NO, 0xAA,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... transfer accumulator to X
+  [MN_TAY] = { "TAY", OPCODES(  NO,   NO,   NO,   NO,   NO, 0xA8,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... transfer accumulator to Y
+  [MN_TSX] = { "TSX", OPCODES(  NO,   NO,   NO,   NO,   NO, 0xBA,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... transfer stack pointer to X
+  [MN_TXA] = { "TXA", OPCODES(  NO,   NO,   NO,   NO,   NO, 0x8A,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... transfer X to accumulator
+  [MN_TXS] = { "TXS", OPCODES(  NO,   NO,   NO,   NO,   NO, 0x9A,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... transfer X to stack pointer
+  [MN_TYA] = { "TYA", OPCODES(  NO,   NO,   NO,   NO,   NO, 0x98,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... transfer Y to accumulator
+  [MN_NUM_MNEMONICS] = { NULL },
+};
+
+struct asm_mnemonic am_65c02[] =
+{
+  /*                                 acc   abs   abx   aby   imm   imp   ind   inx   iny   rel    zp   zpx   zpy   zpi   aix */
+  [MN_ADC] = { "ADC", OPCODES_65C02(  NO, 0x6D, 0x7D, 0x79, 0x69,   NO,   NO, 0x61, 0x71,   NO, 0x65, 0x75,   NO, 0x72,   NO) }, // .... add with carry
+  [MN_AND] = { "AND", OPCODES_65C02(  NO, 0x2D, 0x3D, 0x39, 0x29,   NO,   NO, 0x21, 0x31,   NO, 0x25, 0x35,   NO, 0x32,   NO) }, // .... and (with accumulator)
+  [MN_ASL] = { "ASL", OPCODES_65C02(0x0A, 0x0E, 0x1E,   NO,   NO,   NO,   NO,   NO,   NO,   NO, 0x06, 0x16,   NO,   NO,   NO) }, // .... arithmetic shift left
+  [MN_BCC] = { "BCC", OPCODES_65C02(  NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO, 0x90,   NO,   NO,   NO,   NO,   NO) }, // .... branch on carry clear
+  [MN_BCS] = { "BCS", OPCODES_65C02(  NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO, 0xB0,   NO,   NO,   NO,   NO,   NO) }, // .... branch on carry set
+  [MN_BEQ] = { "BEQ", OPCODES_65C02(  NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO, 0xF0,   NO,   NO,   NO,   NO,   NO) }, // .... branch on equal (zero set)
+  [MN_BIT] = { "BIT", OPCODES_65C02(  NO, 0x2C, 0x3C,   NO, 0x89,   NO,   NO,   NO,   NO,   NO, 0x24, 0x34,   NO,   NO,   NO) }, // .... bit test
+  [MN_BMI] = { "BMI", OPCODES_65C02(  NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO, 0x30,   NO,   NO,   NO,   NO,   NO) }, // .... branch on minus (negative set)
+  [MN_BNE] = { "BNE", OPCODES_65C02(  NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO, 0xD0,   NO,   NO,   NO,   NO,   NO) }, // .... branch on not equal (zero clear)
+  [MN_BPL] = { "BPL", OPCODES_65C02(  NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO, 0x10,   NO,   NO,   NO,   NO,   NO) }, // .... branch on plus (negative clear)
+  [MN_BRA] = { "BRA", OPCODES_65C02(  NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO, 0x80,   NO,   NO,   NO,   NO,   NO) }, // .... branch always
+  [MN_BRK] = { "BRK", OPCODES_65C02(  NO,   NO,   NO,   NO,   NO, 0x00,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... interrupt
+  [MN_BVC] = { "BVC", OPCODES_65C02(  NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO, 0x50,   NO,   NO,   NO,   NO,   NO) }, // .... branch on overflow clear
+  [MN_BVS] = { "BVS", OPCODES_65C02(  NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO, 0x70,   NO,   NO,   NO,   NO,   NO) }, // .... branch on overflow set
+  [MN_CLC] = { "CLC", OPCODES_65C02(  NO,   NO,   NO,   NO,   NO, 0x18,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... clear carry
+  [MN_CLD] = { "CLD", OPCODES_65C02(  NO,   NO,   NO,   NO,   NO, 0xD8,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... clear decimal
+  [MN_CLI] = { "CLI", OPCODES_65C02(  NO,   NO,   NO,   NO,   NO, 0x58,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... clear interrupt disable
+  [MN_CLV] = { "CLV", OPCODES_65C02(  NO,   NO,   NO,   NO,   NO, 0xB8,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... clear overflow
+  [MN_CMP] = { "CMP", OPCODES_65C02(  NO, 0xCD, 0xDD, 0xD9, 0xC9,   NO,   NO, 0xC1, 0xD1,   NO, 0xC5, 0xD5,   NO, 0xD2,   NO) }, // .... compare (with accumulator)
+  [MN_CPX] = { "CPX", OPCODES_65C02(  NO, 0xEC,   NO,   NO, 0xE0,   NO,   NO,   NO,   NO,   NO, 0xE4,   NO,   NO,   NO,   NO) }, // .... compare with X
+  [MN_CPY] = { "CPY", OPCODES_65C02(  NO, 0xCC,   NO,   NO, 0xC0,   NO,   NO,   NO,   NO,   NO, 0xC4,   NO,   NO,   NO,   NO) }, // .... compare with Y
+  [MN_DEC] = { "DEC", OPCODES_65C02(0x3A, 0xCE, 0xDE,   NO,   NO,   NO,   NO,   NO,   NO,   NO, 0xC6, 0xD6,   NO,   NO,   NO) }, // .... decrement
+  [MN_DEX] = { "DEX", OPCODES_65C02(  NO,   NO,   NO,   NO,   NO, 0xCA,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... decrement X
+  [MN_DEY] = { "DEY", OPCODES_65C02(  NO,   NO,   NO,   NO,   NO, 0x88,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... decrement Y
+  [MN_EOR] = { "EOR", OPCODES_65C02(  NO, 0x4D, 0x5D, 0x59, 0x49,   NO,   NO, 0x41, 0x51,   NO, 0x45, 0x55,   NO, 0x52,   NO) }, // .... exclusive or (with accumulator)
+  [MN_INC] = { "INC", OPCODES_65C02(0x1A, 0xEE, 0xFE,   NO,   NO,   NO,   NO,   NO,   NO,   NO, 0xE6, 0xF6,   NO,   NO,   NO) }, // .... increment
+  [MN_INX] = { "INX", OPCODES_65C02(  NO,   NO,   NO,   NO,   NO, 0xE8,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... increment X
+  [MN_INY] = { "INY", OPCODES_65C02(  NO,   NO,   NO,   NO,   NO, 0xC8,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... increment Y
+  [MN_JMP] = { "JMP", OPCODES_65C02(  NO, 0x4C,   NO,   NO,   NO,   NO, 0x6C,   NO,   NO,   NO,   NO,   NO,   NO,   NO, 0x7C) }, // .... jump
+  [MN_JSR] = { "JSR", OPCODES_65C02(  NO, 0x20,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... jump subroutine
+  [MN_LDA] = { "LDA", OPCODES_65C02(  NO, 0xAD, 0xBD, 0xB9, 0xA9,   NO,   NO, 0xA1, 0xB1,   NO, 0xA5, 0xB5,   NO, 0xB2,   NO) }, // .... load accumulator
+  [MN_LDX] = { "LDX", OPCODES_65C02(  NO, 0xAE,   NO, 0xBE, 0xA2,   NO,   NO,   NO,   NO,   NO, 0xA6,   NO, 0xB6,   NO,   NO) }, // .... load X
+  [MN_LDY] = { "LDY", OPCODES_65C02(  NO, 0xAC, 0xBC,   NO, 0xA0,   NO,   NO,   NO,   NO,   NO, 0xA4, 0xB4,   NO,   NO,   NO) }, // .... load Y
+  [MN_LSR] = { "LSR", OPCODES_65C02(0x4A, 0x4E, 0x5E,   NO,   NO,   NO,   NO,   NO,   NO,   NO, 0x46, 0x56,   NO,   NO,   NO) }, // .... logical shift right
+  [MN_NOP] = { "NOP", OPCODES_65C02(  NO,   NO,   NO,   NO,   NO, 0xEA,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... no operation
+  [MN_ORA] = { "ORA", OPCODES_65C02(  NO, 0x0D, 0x1D, 0x19, 0x09,   NO,   NO, 0x01, 0x11,   NO, 0x05, 0x15,   NO, 0x12,   NO) }, // .... or with accumulator
+  [MN_PHA] = { "PHA", OPCODES_65C02(  NO,   NO,   NO,   NO,   NO, 0x48,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... push accumulator
+  [MN_PHP] = { "PHP", OPCODES_65C02(  NO,   NO,   NO,   NO,   NO, 0x08,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... push processor status (SR)
+  [MN_PHX] = { "PHX", OPCODES_65C02(  NO,   NO,   NO,   NO,   NO, 0xDA,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... push X
+  [MN_PHY] = { "PHY", OPCODES_65C02(  NO,   NO,   NO,   NO,   NO, 0x5A,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... push Y
+  [MN_PLA] = { "PLA", OPCODES_65C02(  NO,   NO,   NO,   NO,   NO, 0x68,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... pull accumulator
+  [MN_PLP] = { "PLP", OPCODES_65C02(  NO,   NO,   NO,   NO,   NO, 0x28,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... pull processor status (SR)
+  [MN_PLX] = { "PLX", OPCODES_65C02(  NO,   NO,   NO,   NO,   NO, 0xFA,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... pull X
+  [MN_PLY] = { "PLY", OPCODES_65C02(  NO,   NO,   NO,   NO,   NO, 0x7A,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... pull Y
+  [MN_ROL] = { "ROL", OPCODES_65C02(0x2A, 0x2E, 0x3E,   NO,   NO,   NO,   NO,   NO,   NO,   NO, 0x26, 0x36,   NO,   NO,   NO) }, // .... rotate left
+  [MN_ROR] = { "ROR", OPCODES_65C02(0x6A, 0x6E, 0x7E,   NO,   NO,   NO,   NO,   NO,   NO,   NO, 0x66, 0x76,   NO,   NO,   NO) }, // .... rotate right
+  [MN_RTI] = { "RTI", OPCODES_65C02(  NO,   NO,   NO,   NO,   NO, 0x40,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... return from interrupt
+  [MN_RTS] = { "RTS", OPCODES_65C02(  NO,   NO,   NO,   NO,   NO, 0x60,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... return from subroutine
+  [MN_SBC] = { "SBC", OPCODES_65C02(  NO, 0xED, 0xFD, 0xF9, 0xE9,   NO,   NO, 0xE1, 0xF1,   NO, 0xE5, 0xF5,   NO, 0xF2,   NO) }, // .... subtract with carry
+  [MN_SEC] = { "SEC", OPCODES_65C02(  NO,   NO,   NO,   NO,   NO, 0x38,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... set carry
+  [MN_SED] = { "SED", OPCODES_65C02(  NO,   NO,   NO,   NO,   NO, 0xF8,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... set decimal
+  [MN_SEI] = { "SEI", OPCODES_65C02(  NO,   NO,   NO,   NO,   NO, 0x78,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... set interrupt disable
+  [MN_STA] = { "STA", OPCODES_65C02(  NO, 0x8D, 0x9D, 0x99,   NO,   NO,   NO, 0x81, 0x91,   NO, 0x85, 0x95,   NO, 0x92,   NO) }, // .... store accumulator
+  [MN_STX] = { "STX", OPCODES_65C02(  NO, 0x8E,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO, 0x86,   NO, 0x96,   NO,   NO) }, // .... store X
+  [MN_STY] = { "STY", OPCODES_65C02(  NO, 0x8C,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO, 0x84, 0x94,   NO,   NO,   NO) }, // .... store Y
+  [MN_STZ] = { "STZ", OPCODES_65C02(  NO, 0x9C, 0x9E,   NO,   NO,   NO,   NO,   NO,   NO,   NO, 0x64, 0x74,   NO,   NO,   NO) }, // .... store zero
+  [MN_TAX] = { "TAX", OPCODES_65C02(  NO,   NO,   NO,   NO,   NO, 0xAA,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... transfer accumulator to X
+  [MN_TAY] = { "TAY", OPCODES_65C02(  NO,   NO,   NO,   NO,   NO, 0xA8,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... transfer accumulator to Y
+  [MN_TRB] = { "TRB", OPCODES_65C02(  NO, 0x1C,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO, 0x14,   NO,   NO,   NO,   NO) }, // .... test and reset bits
+  [MN_TSB] = { "TSB", OPCODES_65C02(  NO, 0x0C,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO, 0x04,   NO,   NO,   NO,   NO) }, // .... test and set bits
+  [MN_TSX] = { "TSX", OPCODES_65C02(  NO,   NO,   NO,   NO,   NO, 0xBA,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... transfer stack pointer to X
+  [MN_TXA] = { "TXA", OPCODES_65C02(  NO,   NO,   NO,   NO,   NO, 0x8A,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... transfer X to accumulator
+  [MN_TXS] = { "TXS", OPCODES_65C02(  NO,   NO,   NO,   NO,   NO, 0x9A,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... transfer X to stack pointer
+  [MN_TYA] = { "TYA", OPCODES_65C02(  NO,   NO,   NO,   NO,   NO, 0x98,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... transfer Y to accumulator
+  [MN_NUM_MNEMONICS] = { NULL },
+};
+
+struct asm_mnemonic am_65c816[] =
+{
+  /*                                  acc   abs   abx   aby   imm   imp   ind   inx   iny   rel    zp   zpx   zpy   zpi   aix    al   alx   ild  ildy   ial    sr  sriy  rell    bm */
+  [MN_ADC] = { "ADC", OPCODES_65C816(  NO, 0x6D, 0x7D, 0x79, 0x69,   NO,   NO, 0x61, 0x71,   NO, 0x65, 0x75,   NO, 0x72,   NO, 0x6F, 0x7F, 0x67, 0x77,   NO, 0x63, 0x73,   NO,   NO) }, // .... add with carry
+  [MN_AND] = { "AND", OPCODES_65C816(  NO, 0x2D, 0x3D, 0x39, 0x29,   NO,   NO, 0x21, 0x31,   NO, 0x25, 0x35,   NO, 0x32,   NO, 0x2F, 0x3F, 0x27, 0x37,   NO, 0x23, 0x33,   NO,   NO) }, // .... and (with accumulator)
+  [MN_ASL] = { "ASL", OPCODES_65C816(0x0A, 0x0E, 0x1E,   NO,   NO,   NO,   NO,   NO,   NO,   NO, 0x06, 0x16,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... arithmetic shift left
+  [MN_BCC] = { "BCC", OPCODES_65C816(  NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO, 0x90,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... branch on carry clear
+  [MN_BCS] = { "BCS", OPCODES_65C816(  NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO, 0xB0,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... branch on carry set
+  [MN_BEQ] = { "BEQ", OPCODES_65C816(  NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO, 0xF0,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... branch on equal (zero set)
+  [MN_BIT] = { "BIT", OPCODES_65C816(  NO, 0x2C, 0x3C,   NO, 0x89,   NO,   NO,   NO,   NO,   NO, 0x24, 0x34,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... bit test
+  [MN_BMI] = { "BMI", OPCODES_65C816(  NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO, 0x30,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... branch on minus (negative set)
+  [MN_BNE] = { "BNE", OPCODES_65C816(  NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO, 0xD0,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... branch on not equal (zero clear)
+  [MN_BPL] = { "BPL", OPCODES_65C816(  NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO, 0x10,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... branch on plus (negative clear)
+  [MN_BRA] = { "BRA", OPCODES_65C816(  NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO, 0x80,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... branch always
+  [MN_BRK] = { "BRK", OPCODES_65C816(  NO,   NO,   NO,   NO,   NO, 0x00,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... interrupt
+  [MN_BRL] = { "BRL", OPCODES_65C816(  NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO, 0x82,   NO) }, // .... branch always long
+  [MN_BVC] = { "BVC", OPCODES_65C816(  NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO, 0x50,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... branch on overflow clear
+  [MN_BVS] = { "BVS", OPCODES_65C816(  NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO, 0x70,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... branch on overflow set
+  [MN_CLC] = { "CLC", OPCODES_65C816(  NO,   NO,   NO,   NO,   NO, 0x18,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... clear carry
+  [MN_CLD] = { "CLD", OPCODES_65C816(  NO,   NO,   NO,   NO,   NO, 0xD8,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... clear decimal
+  [MN_CLI] = { "CLI", OPCODES_65C816(  NO,   NO,   NO,   NO,   NO, 0x58,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... clear interrupt disable
+  [MN_CLV] = { "CLV", OPCODES_65C816(  NO,   NO,   NO,   NO,   NO, 0xB8,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... clear overflow
+  [MN_CMP] = { "CMP", OPCODES_65C816(  NO, 0xCD, 0xDD, 0xD9, 0xC9,   NO,   NO, 0xC1, 0xD1,   NO, 0xC5, 0xD5,   NO, 0xD2,   NO, 0xCF, 0xDF, 0xC7, 0xD7,   NO, 0xC3, 0xD3,   NO,   NO) }, // .... compare (with accumulator)
+  [MN_COP] = { "COP", OPCODES_65C816(  NO,   NO,   NO,   NO, 0x02,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... coprocessor
+  [MN_CPX] = { "CPX", OPCODES_65C816(  NO, 0xEC,   NO,   NO, 0xE0,   NO,   NO,   NO,   NO,   NO, 0xE4,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... compare with X
+  [MN_CPY] = { "CPY", OPCODES_65C816(  NO, 0xCC,   NO,   NO, 0xC0,   NO,   NO,   NO,   NO,   NO, 0xC4,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... compare with Y
+  [MN_DEC] = { "DEC", OPCODES_65C816(0x3A, 0xCE, 0xDE,   NO,   NO,   NO,   NO,   NO,   NO,   NO, 0xC6, 0xD6,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... decrement
+  [MN_DEX] = { "DEX", OPCODES_65C816(  NO,   NO,   NO,   NO,   NO, 0xCA,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... decrement X
+  [MN_DEY] = { "DEY", OPCODES_65C816(  NO,   NO,   NO,   NO,   NO, 0x88,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... decrement Y
+  [MN_EOR] = { "EOR", OPCODES_65C816(  NO, 0x4D, 0x5D, 0x59, 0x49,   NO,   NO, 0x41, 0x51,   NO, 0x45, 0x55,   NO, 0x52,   NO, 0x4F, 0x5F, 0x47, 0x57,   NO, 0x43, 0x53,   NO,   NO) }, // .... exclusive or (with accumulator)
+  [MN_INC] = { "INC", OPCODES_65C816(0x1A, 0xEE, 0xFE,   NO,   NO,   NO,   NO,   NO,   NO,   NO, 0xE6, 0xF6,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... increment
+  [MN_INX] = { "INX", OPCODES_65C816(  NO,   NO,   NO,   NO,   NO, 0xE8,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... increment X
+  [MN_INY] = { "INY", OPCODES_65C816(  NO,   NO,   NO,   NO,   NO, 0xC8,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... increment Y
+  [MN_JML] = { "JML", OPCODES_65C816(  NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO, 0x5C,   NO,   NO,   NO, 0xDC,   NO,   NO,   NO,   NO) }, // .... jump long
+  [MN_JMP] = { "JMP", OPCODES_65C816(  NO, 0x4C,   NO,   NO,   NO,   NO, 0x6C,   NO,   NO,   NO,   NO,   NO,   NO,   NO, 0x7C, 0x5C,   NO,   NO,   NO, 0xDC,   NO,   NO,   NO,   NO) }, // .... jump
+  [MN_JSL] = { "JSL", OPCODES_65C816(  NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO, 0x22,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... jump subroutine long
+  [MN_JSR] = { "JSR", OPCODES_65C816(  NO, 0x20,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO, 0xFC, 0x22,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... jump subroutine
+  [MN_LDA] = { "LDA", OPCODES_65C816(  NO, 0xAD, 0xBD, 0xB9, 0xA9,   NO,   NO, 0xA1, 0xB1,   NO, 0xA5, 0xB5,   NO, 0xB2,   NO, 0xAF, 0xBF, 0xA7, 0xB7,   NO, 0xA3, 0xB3,   NO,   NO) }, // .... load accumulator
+  [MN_LDX] = { "LDX", OPCODES_65C816(  NO, 0xAE,   NO, 0xBE, 0xA2,   NO,   NO,   NO,   NO,   NO, 0xA6,   NO, 0xB6,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... load X
+  [MN_LDY] = { "LDY", OPCODES_65C816(  NO, 0xAC, 0xBC,   NO, 0xA0,   NO,   NO,   NO,   NO,   NO, 0xA4, 0xB4,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... load Y
+  [MN_LSR] = { "LSR", OPCODES_65C816(0x4A, 0x4E, 0x5E,   NO,   NO,   NO,   NO,   NO,   NO,   NO, 0x46, 0x56,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... logical shift right
+  [MN_MVN] = { "MVN", OPCODES_65C816(  NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO, 0x54) }, // .... block move negative
+  [MN_MVP] = { "MVP", OPCODES_65C816(  NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO, 0x44) }, // .... block move positive
+  [MN_NOP] = { "NOP", OPCODES_65C816(  NO,   NO,   NO,   NO,   NO, 0xEA,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... no operation
+  [MN_ORA] = { "ORA", OPCODES_65C816(  NO, 0x0D, 0x1D, 0x19, 0x09,   NO,   NO, 0x01, 0x11,   NO, 0x05, 0x15,   NO, 0x12,   NO, 0x0F, 0x1F, 0x07, 0x17,   NO, 0x03, 0x13,   NO,   NO) }, // .... or with accumulator
+  [MN_PEA] = { "PEA", OPCODES_65C816(  NO, 0xF4,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... push effective absolute address
+  [MN_PEI] = { "PEI", OPCODES_65C816(  NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO, 0xD4,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... push effective indirect address
+  [MN_PER] = { "PER", OPCODES_65C816(  NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO, 0x62,   NO) }, // .... push effective relative address
+  [MN_PHA] = { "PHA", OPCODES_65C816(  NO,   NO,   NO,   NO,   NO, 0x48,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... push accumulator
+  [MN_PHB] = { "PHB", OPCODES_65C816(  NO,   NO,   NO,   NO,   NO, 0x8B,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... push data bank
+  [MN_PHD] = { "PHD", OPCODES_65C816(  NO,   NO,   NO,   NO,   NO, 0x0B,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... push direct page
+  [MN_PHK] = { "PHK", OPCODES_65C816(  NO,   NO,   NO,   NO,   NO, 0x4B,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... push program bank
+  [MN_PHP] = { "PHP", OPCODES_65C816(  NO,   NO,   NO,   NO,   NO, 0x08,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... push processor status (SR)
+  [MN_PHX] = { "PHX", OPCODES_65C816(  NO,   NO,   NO,   NO,   NO, 0xDA,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... push X
+  [MN_PHY] = { "PHY", OPCODES_65C816(  NO,   NO,   NO,   NO,   NO, 0x5A,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... push Y
+  [MN_PLA] = { "PLA", OPCODES_65C816(  NO,   NO,   NO,   NO,   NO, 0x68,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... pull accumulator
+  [MN_PLB] = { "PLB", OPCODES_65C816(  NO,   NO,   NO,   NO,   NO, 0xAB,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... pull data bank
+  [MN_PLD] = { "PLD", OPCODES_65C816(  NO,   NO,   NO,   NO,   NO, 0x2B,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... pull direct page
+  [MN_PLP] = { "PLP", OPCODES_65C816(  NO,   NO,   NO,   NO,   NO, 0x28,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... pull processor status (SR)
+  [MN_PLX] = { "PLX", OPCODES_65C816(  NO,   NO,   NO,   NO,   NO, 0xFA,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... pull X
+  [MN_PLY] = { "PLY", OPCODES_65C816(  NO,   NO,   NO,   NO,   NO, 0x7A,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... pull Y
+  [MN_REP] = { "REP", OPCODES_65C816(  NO,   NO,   NO,   NO, 0xC2,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... reset processor status bits
+  [MN_ROL] = { "ROL", OPCODES_65C816(0x2A, 0x2E, 0x3E,   NO,   NO,   NO,   NO,   NO,   NO,   NO, 0x26, 0x36,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... rotate left
+  [MN_ROR] = { "ROR", OPCODES_65C816(0x6A, 0x6E, 0x7E,   NO,   NO,   NO,   NO,   NO,   NO,   NO, 0x66, 0x76,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... rotate right
+  [MN_RTI] = { "RTI", OPCODES_65C816(  NO,   NO,   NO,   NO,   NO, 0x40,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... return from interrupt
+  [MN_RTL] = { "RTL", OPCODES_65C816(  NO,   NO,   NO,   NO,   NO, 0x6B,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... return from subroutine long
+  [MN_RTS] = { "RTS", OPCODES_65C816(  NO,   NO,   NO,   NO,   NO, 0x60,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... return from subroutine
+  [MN_SBC] = { "SBC", OPCODES_65C816(  NO, 0xED, 0xFD, 0xF9, 0xE9,   NO,   NO, 0xE1, 0xF1,   NO, 0xE5, 0xF5,   NO, 0xF2,   NO, 0xEF, 0xFF, 0xE7, 0xF7,   NO, 0xE3, 0xF3,   NO,   NO) }, // .... subtract with carry
+  [MN_SEC] = { "SEC", OPCODES_65C816(  NO,   NO,   NO,   NO,   NO, 0x38,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... set carry
+  [MN_SED] = { "SED", OPCODES_65C816(  NO,   NO,   NO,   NO,   NO, 0xF8,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... set decimal
+  [MN_SEI] = { "SEI", OPCODES_65C816(  NO,   NO,   NO,   NO,   NO, 0x78,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... set interrupt disable
+  [MN_SEP] = { "SEP", OPCODES_65C816(  NO,   NO,   NO,   NO, 0xE2,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... set processor status bits
+  [MN_STA] = { "STA", OPCODES_65C816(  NO, 0x8D, 0x9D, 0x99,   NO,   NO,   NO, 0x81, 0x91,   NO, 0x85, 0x95,   NO, 0x92,   NO, 0x8F, 0x9F, 0x87, 0x97,   NO, 0x83, 0x93,   NO,   NO) }, // .... store accumulator
+  [MN_STP] = { "STP", OPCODES_65C816(  NO,   NO,   NO,   NO,   NO, 0xDB,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... stop the processor
+  [MN_STX] = { "STX", OPCODES_65C816(  NO, 0x8E,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO, 0x86,   NO, 0x96,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... store X
+  [MN_STY] = { "STY", OPCODES_65C816(  NO, 0x8C,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO, 0x84, 0x94,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... store Y
+  [MN_STZ] = { "STZ", OPCODES_65C816(  NO, 0x9C, 0x9E,   NO,   NO,   NO,   NO,   NO,   NO,   NO, 0x64, 0x74,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... store zero
+  [MN_TAX] = { "TAX", OPCODES_65C816(  NO,   NO,   NO,   NO,   NO, 0xAA,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... transfer accumulator to X
+  [MN_TAY] = { "TAY", OPCODES_65C816(  NO,   NO,   NO,   NO,   NO, 0xA8,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... transfer accumulator to Y
+  [MN_TCD] = { "TCD", OPCODES_65C816(  NO,   NO,   NO,   NO,   NO, 0x5B,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... transfer accumulator to direct page
+  [MN_TCS] = { "TCS", OPCODES_65C816(  NO,   NO,   NO,   NO,   NO, 0x1B,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... transfer accumulator to stack pointer
+  [MN_TDC] = { "TDC", OPCODES_65C816(  NO,   NO,   NO,   NO,   NO, 0x7B,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... transfer direct page to accumulator
+  [MN_TRB] = { "TRB", OPCODES_65C816(  NO, 0x1C,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO, 0x14,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... test and reset bits
+  [MN_TSB] = { "TSB", OPCODES_65C816(  NO, 0x0C,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO, 0x04,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... test and set bits
+  [MN_TSC] = { "TSC", OPCODES_65C816(  NO,   NO,   NO,   NO,   NO, 0x3B,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... transfer stack pointer to accumulator
+  [MN_TSX] = { "TSX", OPCODES_65C816(  NO,   NO,   NO,   NO,   NO, 0xBA,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... transfer stack pointer to X
+  [MN_TXA] = { "TXA", OPCODES_65C816(  NO,   NO,   NO,   NO,   NO, 0x8A,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... transfer X to accumulator
+  [MN_TXS] = { "TXS", OPCODES_65C816(  NO,   NO,   NO,   NO,   NO, 0x9A,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... transfer X to stack pointer
+  [MN_TXY] = { "TXY", OPCODES_65C816(  NO,   NO,   NO,   NO,   NO, 0x9B,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... transfer X to Y
+  [MN_TYA] = { "TYA", OPCODES_65C816(  NO,   NO,   NO,   NO,   NO, 0x98,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... transfer Y to accumulator
+  [MN_TYX] = { "TYX", OPCODES_65C816(  NO,   NO,   NO,   NO,   NO, 0xBB,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... transfer Y to X
+  [MN_WAI] = { "WAI", OPCODES_65C816(  NO,   NO,   NO,   NO,   NO, 0xCB,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... wait for interrupt
+  [MN_XBA] = { "XBA", OPCODES_65C816(  NO,   NO,   NO,   NO,   NO, 0xEB,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... exchange B and A
+  [MN_XCE] = { "XCE", OPCODES_65C816(  NO,   NO,   NO,   NO,   NO, 0xFB,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO,   NO) }, // .... exchange carry and emulation
+  [MN_NUM_MNEMONICS] = { NULL },
+};
+
+/*
+ * Keyword lookup tables, one for each CPU holding the directives and the
+ * mnemonics of that CPU.
+ * Every keyword is placed at the slot given by the perfect hash of its
+ * packed key (see keyword_key() in utils.c). The tables are laid out by
+ * the compiler, a collision between two keywords shows up as an
+ * overridden initializer which the Makefile turns into an error. If that
+ * happens, pick a new multiplier for the table that spreads all its keys
+ * to unique slots.
+ */
+#define KW_HASH(key, mul, bits) ((unsigned int)(((key) * (mul)) >> (64 - (bits))))
+
+struct keyword {
+  unsigned long long key;
+  struct asm_directive *ad;
+  struct asm_mnemonic *am;
+};
+
+#define KW_SLOT(key)          KW_HASH(key, KW_HASH_MUL, KW_HASH_BITS)
+#define DIRECTIVE(key, id)    [KW_SLOT(key)] = { key, &ad[id], NULL }
+#define MNEMONIC(key, id)     [KW_SLOT(key)] = { key, NULL, &AM[id] }
+
+#define KW_6502_MUL           0x8d103ed3cc667e97ULL
+#define KW_6502_BITS          8
+#define KW_HASH_MUL           KW_6502_MUL
+#define KW_HASH_BITS          KW_6502_BITS
+#define AM                    am_6502
+
+static const struct keyword kwt_6502[1 << KW_HASH_BITS] =
+{
+  DIRECTIVE(KEY3('C', 'P', 'U'), DIR_CPU),
+  DIRECTIVE(KEY3('O', 'R', 'G'), DIR_ORG),
+  DIRECTIVE(KEY4('B', 'Y', 'T', 'E'), DIR_BYTE),
+  DIRECTIVE(KEY4('W', 'O', 'R', 'D'), DIR_WORD),
+  DIRECTIVE(KEY3('E', 'N', 'D'), DIR_END),
+  DIRECTIVE(KEY7('I', 'N', 'C', 'L', 'U', 'D', 'E'), DIR_INCLUDE),
+  DIRECTIVE(KEY5('M', 'A', 'C', 'R', 'O'), DIR_MACRO),
+  DIRECTIVE(KEY4('E', 'N', 'D', 'M'), DIR_ENDM),
+  MNEMONIC(KEY3('A', 'D', 'C'), MN_ADC),
+  MNEMONIC(KEY3('A', 'N', 'D'), MN_AND),
+  MNEMONIC(KEY3('A', 'S', 'L'), MN_ASL),
+  MNEMONIC(KEY3('B', 'C', 'C'), MN_BCC),
+  MNEMONIC(KEY3('B', 'C', 'S'), MN_BCS),
+  MNEMONIC(KEY3('B', 'E', 'Q'), MN_BEQ),
+  MNEMONIC(KEY3('B', 'I', 'T'), MN_BIT),
+  MNEMONIC(KEY3('B', 'M', 'I'), MN_BMI),
+  MNEMONIC(KEY3('B', 'N', 'E'), MN_BNE),
+  MNEMONIC(KEY3('B', 'P', 'L'), MN_BPL),
+  MNEMONIC(KEY3('B', 'R', 'K'), MN_BRK),
+  MNEMONIC(KEY3('B', 'V', 'C'), MN_BVC),
+  MNEMONIC(KEY3('B', 'V', 'S'), MN_BVS),
+  MNEMONIC(KEY3('C', 'L', 'C'), MN_CLC),
+  MNEMONIC(KEY3('C', 'L', 'D'), MN_CLD),
+  MNEMONIC(KEY3('C', 'L', 'I'), MN_CLI),
+  MNEMONIC(KEY3('C', 'L', 'V'), MN_CLV),
+  MNEMONIC(KEY3('C', 'M', 'P'), MN_CMP),
+  MNEMONIC(KEY3('C', 'P', 'X'), MN_CPX),
+  MNEMONIC(KEY3('C', 'P', 'Y'), MN_CPY),
+  MNEMONIC(KEY3('D', 'E', 'C'), MN_DEC),
+  MNEMONIC(KEY3('D', 'E', 'X'), MN_DEX),
+  MNEMONIC(KEY3('D', 'E', 'Y'), MN_DEY),
+  MNEMONIC(KEY3('E', 'O', 'R'), MN_EOR),
+  MNEMONIC(KEY3('I', 'N', 'C'), MN_INC),
+  MNEMONIC(KEY3('I', 'N', 'X'), MN_INX),
+  MNEMONIC(KEY3('I', 'N', 'Y'), MN_INY),
+  MNEMONIC(KEY3('J', 'M', 'P'), MN_JMP),
+  MNEMONIC(KEY3('J', 'S', 'R'), MN_JSR),
+  MNEMONIC(KEY3('L', 'D', 'A'), MN_LDA),
+  MNEMONIC(KEY3('L', 'D', 'X'), MN_LDX),
+  MNEMONIC(KEY3('L', 'D', 'Y'), MN_LDY),
+  MNEMONIC(KEY3('L', 'S', 'R'), MN_LSR),
+  MNEMONIC(KEY3('N', 'O', 'P'), MN_NOP),
+  MNEMONIC(KEY3('O', 'R', 'A'), MN_ORA),
+  MNEMONIC(KEY3('P', 'H', 'A'), MN_PHA),
+  MNEMONIC(KEY3('P', 'H', 'P'), MN_PHP),
+  MNEMONIC(KEY3('P', 'L', 'A'), MN_PLA),
+  MNEMONIC(KEY3('P', 'L', 'P'), MN_PLP),
+  MNEMONIC(KEY3('R', 'O', 'L'), MN_ROL),
+  MNEMONIC(KEY3('R', 'O', 'R'), MN_ROR),
+  MNEMONIC(KEY3('R', 'T', 'I'), MN_RTI),
+  MNEMONIC(KEY3('R', 'T', 'S'), MN_RTS),
+  MNEMONIC(KEY3('S', 'B', 'C'), MN_SBC),
+  MNEMONIC(KEY3('S', 'E', 'C'), MN_SEC),
+  MNEMONIC(KEY3('S', 'E', 'D'), MN_SED),
+  MNEMONIC(KEY3('S', 'E', 'I'), MN_SEI),
+  MNEMONIC(KEY3('S', 'T', 'A'), MN_STA),
+  MNEMONIC(KEY3('S', 'T', 'X'), MN_STX),
+  MNEMONIC(KEY3('S', 'T', 'Y'), MN_STY),
+  MNEMONIC(KEY3('T', 'A', 'X'), MN_TAX),
+  MNEMONIC(KEY3('T', 'A', 'Y'), MN_TAY),
+  MNEMONIC(KEY3('T', 'S', 'X'), MN_TSX),
+  MNEMONIC(KEY3('T', 'X', 'A'), MN_TXA),
+  MNEMONIC(KEY3('T', 'X', 'S'), MN_TXS),
+  MNEMONIC(KEY3('T', 'Y', 'A'), MN_TYA),
+};
+
+#undef KW_HASH_MUL
+#undef KW_HASH_BITS
+#undef AM
+
+#define KW_65C02_MUL          0x9b559a6f7507cc8dULL
+#define KW_65C02_BITS         8
+#define KW_HASH_MUL           KW_65C02_MUL
+#define KW_HASH_BITS          KW_65C02_BITS
+#define AM                    am_65c02
+
+static const struct keyword kwt_65c02[1 << KW_HASH_BITS] =
+{
+  DIRECTIVE(KEY3('C', 'P', 'U'), DIR_CPU),
+  DIRECTIVE(KEY3('O', 'R', 'G'), DIR_ORG),
+  DIRECTIVE(KEY4('B', 'Y', 'T', 'E'), DIR_BYTE),
+  DIRECTIVE(KEY4('W', 'O', 'R', 'D'), DIR_WORD),
+  DIRECTIVE(KEY3('E', 'N', 'D'), DIR_END),
+  DIRECTIVE(KEY7('I', 'N', 'C', 'L', 'U', 'D', 'E'), DIR_INCLUDE),
+  DIRECTIVE(KEY5('M', 'A', 'C', 'R', 'O'), DIR_MACRO),
+  DIRECTIVE(KEY4('E', 'N', 'D', 'M'), DIR_ENDM),
+  MNEMONIC(KEY3('A', 'D', 'C'), MN_ADC),
+  MNEMONIC(KEY3('A', 'N', 'D'), MN_AND),
+  MNEMONIC(KEY3('A', 'S', 'L'), MN_ASL),
+  MNEMONIC(KEY3('B', 'C', 'C'), MN_BCC),
+  MNEMONIC(KEY3('B', 'C', 'S'), MN_BCS),
+  MNEMONIC(KEY3('B', 'E', 'Q'), MN_BEQ),
+  MNEMONIC(KEY3('B', 'I', 'T'), MN_BIT),
+  MNEMONIC(KEY3('B', 'M', 'I'), MN_BMI),
+  MNEMONIC(KEY3('B', 'N', 'E'), MN_BNE),
+  MNEMONIC(KEY3('B', 'P', 'L'), MN_BPL),
+  MNEMONIC(KEY3('B', 'R', 'A'), MN_BRA),
+  MNEMONIC(KEY3('B', 'R', 'K'), MN_BRK),
+  MNEMONIC(KEY3('B', 'V', 'C'), MN_BVC),
+  MNEMONIC(KEY3('B', 'V', 'S'), MN_BVS),
+  MNEMONIC(KEY3('C', 'L', 'C'), MN_CLC),
+  MNEMONIC(KEY3('C', 'L', 'D'), MN_CLD),
+  MNEMONIC(KEY3('C', 'L', 'I'), MN_CLI),
+  MNEMONIC(KEY3('C', 'L', 'V'), MN_CLV),
+  MNEMONIC(KEY3('C', 'M', 'P'), MN_CMP),
+  MNEMONIC(KEY3('C', 'P', 'X'), MN_CPX),
+  MNEMONIC(KEY3('C', 'P', 'Y'), MN_CPY),
+  MNEMONIC(KEY3('D', 'E', 'C'), MN_DEC),
+  MNEMONIC(KEY3('D', 'E', 'X'), MN_DEX),
+  MNEMONIC(KEY3('D', 'E', 'Y'), MN_DEY),
+  MNEMONIC(KEY3('E', 'O', 'R'), MN_EOR),
+  MNEMONIC(KEY3('I', 'N', 'C'), MN_INC),
+  MNEMONIC(KEY3('I', 'N', 'X'), MN_INX),
+  MNEMONIC(KEY3('I', 'N', 'Y'), MN_INY),
+  MNEMONIC(KEY3('J', 'M', 'P'), MN_JMP),
+  MNEMONIC(KEY3('J', 'S', 'R'), MN_JSR),
+  MNEMONIC(KEY3('L', 'D', 'A'), MN_LDA),
+  MNEMONIC(KEY3('L', 'D', 'X'), MN_LDX),
+  MNEMONIC(KEY3('L', 'D', 'Y'), MN_LDY),
+  MNEMONIC(KEY3('L', 'S', 'R'), MN_LSR),
+  MNEMONIC(KEY3('N', 'O', 'P'), MN_NOP),
+  MNEMONIC(KEY3('O', 'R', 'A'), MN_ORA),
+  MNEMONIC(KEY3('P', 'H', 'A'), MN_PHA),
+  MNEMONIC(KEY3('P', 'H', 'P'), MN_PHP),
+  MNEMONIC(KEY3('P', 'H', 'X'), MN_PHX),
+  MNEMONIC(KEY3('P', 'H', 'Y'), MN_PHY),
+  MNEMONIC(KEY3('P', 'L', 'A'), MN_PLA),
+  MNEMONIC(KEY3('P', 'L', 'P'), MN_PLP),
+  MNEMONIC(KEY3('P', 'L', 'X'), MN_PLX),
+  MNEMONIC(KEY3('P', 'L', 'Y'), MN_PLY),
+  MNEMONIC(KEY3('R', 'O', 'L'), MN_ROL),
+  MNEMONIC(KEY3('R', 'O', 'R'), MN_ROR),
+  MNEMONIC(KEY3('R', 'T', 'I'), MN_RTI),
+  MNEMONIC(KEY3('R', 'T', 'S'), MN_RTS),
+  MNEMONIC(KEY3('S', 'B', 'C'), MN_SBC),
+  MNEMONIC(KEY3('S', 'E', 'C'), MN_SEC),
+  MNEMONIC(KEY3('S', 'E', 'D'), MN_SED),
+  MNEMONIC(KEY3('S', 'E', 'I'), MN_SEI),
+  MNEMONIC(KEY3('S', 'T', 'A'), MN_STA),
+  MNEMONIC(KEY3('S', 'T', 'X'), MN_STX),
+  MNEMONIC(KEY3('S', 'T', 'Y'), MN_STY),
+  MNEMONIC(KEY3('S', 'T', 'Z'), MN_STZ),
+  MNEMONIC(KEY3('T', 'A', 'X'), MN_TAX),
+  MNEMONIC(KEY3('T', 'A', 'Y'), MN_TAY),
+  MNEMONIC(KEY3('T', 'R', 'B'), MN_TRB),
+  MNEMONIC(KEY3('T', 'S', 'B'), MN_TSB),
+  MNEMONIC(KEY3('T', 'S', 'X'), MN_TSX),
+  MNEMONIC(KEY3('T', 'X', 'A'), MN_TXA),
+  MNEMONIC(KEY3('T', 'X', 'S'), MN_TXS),
+  MNEMONIC(KEY3('T', 'Y', 'A'), MN_TYA),
+};
+
+#undef KW_HASH_MUL
+#undef KW_HASH_BITS
+#undef AM
+
+#define KW_65C816_MUL         0xd06ae58771359d55ULL
+#define KW_65C816_BITS        9
+#define KW_HASH_MUL           KW_65C816_MUL
+#define KW_HASH_BITS          KW_65C816_BITS
+#define AM                    am_65c816
+
+static const struct keyword kwt_65c816[1 << KW_HASH_BITS] =
+{
+  DIRECTIVE(KEY3('C', 'P', 'U'), DIR_CPU),
+  DIRECTIVE(KEY3('O', 'R', 'G'), DIR_ORG),
+  DIRECTIVE(KEY4('B', 'Y', 'T', 'E'), DIR_BYTE),
+  DIRECTIVE(KEY4('W', 'O', 'R', 'D'), DIR_WORD),
+  DIRECTIVE(KEY3('E', 'N', 'D'), DIR_END),
+  DIRECTIVE(KEY7('I', 'N', 'C', 'L', 'U', 'D', 'E'), DIR_INCLUDE),
+  DIRECTIVE(KEY5('M', 'A', 'C', 'R', 'O'), DIR_MACRO),
+  DIRECTIVE(KEY4('E', 'N', 'D', 'M'), DIR_ENDM),
+  MNEMONIC(KEY3('A', 'D', 'C'), MN_ADC),
+  MNEMONIC(KEY3('A', 'N', 'D'), MN_AND),
+  MNEMONIC(KEY3('A', 'S', 'L'), MN_ASL),
+  MNEMONIC(KEY3('B', 'C', 'C'), MN_BCC),
+  MNEMONIC(KEY3('B', 'C', 'S'), MN_BCS),
+  MNEMONIC(KEY3('B', 'E', 'Q'), MN_BEQ),
+  MNEMONIC(KEY3('B', 'I', 'T'), MN_BIT),
+  MNEMONIC(KEY3('B', 'M', 'I'), MN_BMI),
+  MNEMONIC(KEY3('B', 'N', 'E'), MN_BNE),
+  MNEMONIC(KEY3('B', 'P', 'L'), MN_BPL),
+  MNEMONIC(KEY3('B', 'R', 'A'), MN_BRA),
+  MNEMONIC(KEY3('B', 'R', 'K'), MN_BRK),
+  MNEMONIC(KEY3('B', 'R', 'L'), MN_BRL),
+  MNEMONIC(KEY3('B', 'V', 'C'), MN_BVC),
+  MNEMONIC(KEY3('B', 'V', 'S'), MN_BVS),
+  MNEMONIC(KEY3('C', 'L', 'C'), MN_CLC),
+  MNEMONIC(KEY3('C', 'L', 'D'), MN_CLD),
+  MNEMONIC(KEY3('C', 'L', 'I'), MN_CLI),
+  MNEMONIC(KEY3('C', 'L', 'V'), MN_CLV),
+  MNEMONIC(KEY3('C', 'M', 'P'), MN_CMP),
+  MNEMONIC(KEY3('C', 'O', 'P'), MN_COP),
+  MNEMONIC(KEY3('C', 'P', 'X'), MN_CPX),
+  MNEMONIC(KEY3('C', 'P', 'Y'), MN_CPY),
+  MNEMONIC(KEY3('D', 'E', 'C'), MN_DEC),
+  MNEMONIC(KEY3('D', 'E', 'X'), MN_DEX),
+  MNEMONIC(KEY3('D', 'E', 'Y'), MN_DEY),
+  MNEMONIC(KEY3('E', 'O', 'R'), MN_EOR),
+  MNEMONIC(KEY3('I', 'N', 'C'), MN_INC),
+  MNEMONIC(KEY3('I', 'N', 'X'), MN_INX),
+  MNEMONIC(KEY3('I', 'N', 'Y'), MN_INY),
+  MNEMONIC(KEY3('J', 'M', 'L'), MN_JML),
+  MNEMONIC(KEY3('J', 'M', 'P'), MN_JMP),
+  MNEMONIC(KEY3('J', 'S', 'L'), MN_JSL),
+  MNEMONIC(KEY3('J', 'S', 'R'), MN_JSR),
+  MNEMONIC(KEY3('L', 'D', 'A'), MN_LDA),
+  MNEMONIC(KEY3('L', 'D', 'X'), MN_LDX),
+  MNEMONIC(KEY3('L', 'D', 'Y'), MN_LDY),
+  MNEMONIC(KEY3('L', 'S', 'R'), MN_LSR),
+  MNEMONIC(KEY3('M', 'V', 'N'), MN_MVN),
+  MNEMONIC(KEY3('M', 'V', 'P'), MN_MVP),
+  MNEMONIC(KEY3('N', 'O', 'P'), MN_NOP),
+  MNEMONIC(KEY3('O', 'R', 'A'), MN_ORA),
+  MNEMONIC(KEY3('P', 'E', 'A'), MN_PEA),
+  MNEMONIC(KEY3('P', 'E', 'I'), MN_PEI),
+  MNEMONIC(KEY3('P', 'E', 'R'), MN_PER),
+  MNEMONIC(KEY3('P', 'H', 'A'), MN_PHA),
+  MNEMONIC(KEY3('P', 'H', 'B'), MN_PHB),
+  MNEMONIC(KEY3('P', 'H', 'D'), MN_PHD),
+  MNEMONIC(KEY3('P', 'H', 'K'), MN_PHK),
+  MNEMONIC(KEY3('P', 'H', 'P'), MN_PHP),
+  MNEMONIC(KEY3('P', 'H', 'X'), MN_PHX),
+  MNEMONIC(KEY3('P', 'H', 'Y'), MN_PHY),
+  MNEMONIC(KEY3('P', 'L', 'A'), MN_PLA),
+  MNEMONIC(KEY3('P', 'L', 'B'), MN_PLB),
+  MNEMONIC(KEY3('P', 'L', 'D'), MN_PLD),
+  MNEMONIC(KEY3('P', 'L', 'P'), MN_PLP),
+  MNEMONIC(KEY3('P', 'L', 'X'), MN_PLX),
+  MNEMONIC(KEY3('P', 'L', 'Y'), MN_PLY),
+  MNEMONIC(KEY3('R', 'E', 'P'), MN_REP),
+  MNEMONIC(KEY3('R', 'O', 'L'), MN_ROL),
+  MNEMONIC(KEY3('R', 'O', 'R'), MN_ROR),
+  MNEMONIC(KEY3('R', 'T', 'I'), MN_RTI),
+  MNEMONIC(KEY3('R', 'T', 'L'), MN_RTL),
+  MNEMONIC(KEY3('R', 'T', 'S'), MN_RTS),
+  MNEMONIC(KEY3('S', 'B', 'C'), MN_SBC),
+  MNEMONIC(KEY3('S', 'E', 'C'), MN_SEC),
+  MNEMONIC(KEY3('S', 'E', 'D'), MN_SED),
+  MNEMONIC(KEY3('S', 'E', 'I'), MN_SEI),
+  MNEMONIC(KEY3('S', 'E', 'P'), MN_SEP),
+  MNEMONIC(KEY3('S', 'T', 'A'), MN_STA),
+  MNEMONIC(KEY3('S', 'T', 'P'), MN_STP),
+  MNEMONIC(KEY3('S', 'T', 'X'), MN_STX),
+  MNEMONIC(KEY3('S', 'T', 'Y'), MN_STY),
+  MNEMONIC(KEY3('S', 'T', 'Z'), MN_STZ),
+  MNEMONIC(KEY3('T', 'A', 'X'), MN_TAX),
+  MNEMONIC(KEY3('T', 'A', 'Y'), MN_TAY),
+  MNEMONIC(KEY3('T', 'C', 'D'), MN_TCD),
+  MNEMONIC(KEY3('T', 'C', 'S'), MN_TCS),
+  MNEMONIC(KEY3('T', 'D', 'C'), MN_TDC),
+  MNEMONIC(KEY3('T', 'R', 'B'), MN_TRB),
+  MNEMONIC(KEY3('T', 'S', 'B'), MN_TSB),
+  MNEMONIC(KEY3('T', 'S', 'C'), MN_TSC),
+  MNEMONIC(KEY3('T', 'S', 'X'), MN_TSX),
+  MNEMONIC(KEY3('T', 'X', 'A'), MN_TXA),
+  MNEMONIC(KEY3('T', 'X', 'S'), MN_TXS),
+  MNEMONIC(KEY3('T', 'X', 'Y'), MN_TXY),
+  MNEMONIC(KEY3('T', 'Y', 'A'), MN_TYA),
+  MNEMONIC(KEY3('T', 'Y', 'X'), MN_TYX),
+  MNEMONIC(KEY3('W', 'A', 'I'), MN_WAI),
+  MNEMONIC(KEY3('X', 'B', 'A'), MN_XBA),
+  MNEMONIC(KEY3('X', 'C', 'E'), MN_XCE),
+};
+
+#undef KW_HASH_MUL
+#undef KW_HASH_BITS
+#undef AM
+
+/*
+ * The supported CPUs with the keyword table to use for each of them.
+ * The CPU directive makes one of them the current one.
+ */
+struct cpu_models {
+  char *cpu;
+  int cpu_id;
+  const struct keyword *kwt;
+  unsigned long long hash_mul;
+  int hash_bits;
+};
+
+struct cpu_models cm[] = {
+  { "6502", CPU6502, kwt_6502, KW_6502_MUL, KW_6502_BITS },
+  { "65C02", CPU65C02, kwt_65c02, KW_65C02_MUL, KW_65C02_BITS },
+  { "65C816", CPU65C816, kwt_65c816, KW_65C816_MUL, KW_65C816_BITS },
+  { NULL, 0 },
+};
+
+/******************************************************************************
+ *                    Assembler directive handlers
+ *****************************************************************************/
+/* The cpu directive */
+int dir_cpu(struct asm65_context *ac, struct token *tok)
+{
+  int i = -1;
+
+  /* The cpu name need not be a valid token, 65C02 isn't a number */
+  if (tok[1].kind != TK_END)
+    return ASM_UNEXPECTED_CHARACTER;
+  
+  /* See if the CPU is found in the table of supported cpu's */
+  while(cm[++i].cpu) {
+    if (tok->length == strlen(cm[i].cpu) &&
+        !strncasecmp(tok->text, cm[i].cpu, tok->length)) {
+      ac->cpu = cm[i].cpu_id;
+      ac->cur_cpu = &cm[i];
+      return OK;
+    }
+  }
+  /* CPU not found in table */
+  return CPU_NOT_SUPPORTED;
+}
+
+/* The org directive */
+int dir_org(struct asm65_context *ac, struct token *tok) 
+{
+  struct ir_line *ir = &ac->ir.lines[ac->ir.num_lines - 1];
+  int address;
+  int error;
+  
+  /* Get the argument for the org directive */
+  error = expr_compile(ac, tok, &tok);
+  if (!error)
+    error = expr_run(ac, ac->expr_ctx.code, &address);
+  if (error)
+    return error;
+  if (tok->kind != TK_END)
+    return ASM_UNEXPECTED_CHARACTER;
+  /* Kept to place the code after it again if code before it grows */
+  ir->expr = ir_store_expr(ac, ac->expr_ctx.code);
+  size_org(ac, ir, EXPR_CONSTANT(ir->expr));
+  /* In an object file the code from here on is placed at the address */
+  if (ac->object_mode)
+    obj_section(ac, address, 0);
+  ac->PC = address;
+  LOG(ac, LOG_PARSE, LOG_INFO, "ORG directive set PC to $%x\n", ac->PC);
+     
+  return OK;
+}
+
+int dir_byte(struct asm65_context *ac, struct token *tok)
+{
+  LOG(ac, LOG_PARSE, LOG_DEBUG, "Reached %s !\n", __FUNCTION__);
+  return 0;
+}
+
+int dir_word(struct asm65_context *ac, struct token *tok)
+{
+  LOG(ac, LOG_PARSE, LOG_DEBUG, "Reached %s !\n", __FUNCTION__);
+  return 0;
+}
+
+int dir_end(struct asm65_context *ac, struct token *tok)
+{
+  LOG(ac, LOG_PARSE, LOG_DEBUG, "Reached %s !\n", __FUNCTION__);
+  return 0;
+}
+
+/* A MACRO line with a name is handled before it gets here */
+int dir_macro(struct asm65_context *ac, struct token *tok)
+{
+  return MACRO_NAME_EXPECTED;
+}
+
+/* The end of a macro body is found when the macro is defined */
+int dir_endm(struct asm65_context *ac, struct token *tok)
+{
+  return MACRO_ENDM_WITHOUT_MACRO;
+}
+
+static int assemble_file(struct asm65_context *ac, struct inc_file *file);
+
+/* The include directive, the file was found when the includes were checked */
+int dir_include(struct asm65_context *ac, struct token *tok)
+{
+  struct inc_file *file = ac->cur_file;
+  int at = ac->line;
+  int error;
+
+  error = assemble_file(ac, file->includes[at - 1]);
+  if (error)
+    return error;
+  ac->cur_file = file;
+  ac->line = at;
+  return OK;
+}
+
+/******************************************************************************
+ *                       Assembler mnemonics
+ *****************************************************************************/
+/* Opcodes a relaxed branch is made of */
+#define JMP_ABSOLUTE          0x4c
+#define BRA_RELATIVE          0x80
+
+/*
+ * Evaluate the operand of an instruction in an object file and add the
+ * relocation it needs. A branch can only be relocated along with its
+ * target, so it must stay within its section.
+ */
+static int relocate(struct asm65_context *ac, struct ir_line *ir, int *value)
+{
+  struct expr_reloc rv;
+  int width = ir->relaxed ? 2 : ir->size - 1;
+  int symbol = -1;
+  int error;
+
+  error = expr_reloc(ac, ir->expr, ir->section, &rv);
+  if (error)
+    return error;
+  *value = rv.value;
+  if (rv.section < 0 && !rv.import)
+    return OK;
+
+  if (ir->mode & (MODE_RELATIVE | MODE_RELATIVE_LONG)) {
+    if (rv.import || rv.section != ir->section)
+      return OBJECT_NOT_RELOCATABLE;
+    return OK;
+  }
+  if (width != (rv.part == OBJ_RELOC_WORD ? 2 : 1))
+    return OBJECT_NOT_RELOCATABLE;
+  if (rv.import)
+    symbol = obj_import(ac, rv.import);
+  return obj_add_reloc(ac, ir->section, ir->address + ir->size - width, rv.part,
+                       symbol, rv.section, rv.address);
+}
+
+/*
+ * Give an equate in an object file its value and section. It can be an
+ * address in a section but not refer to an imported symbol.
+ */
+static int equate_reloc(struct asm65_context *ac, struct ir_line *ir)
+{
+  struct expr_reloc rv;
+  int error;
+
+  error = expr_reloc(ac, ir->expr, ir->section, &rv);
+  if (!error && (rv.import || rv.part != OBJ_RELOC_WORD))
+    error = OBJECT_NOT_RELOCATABLE;
+  if (error)
+    return error;
+  ir->label->value = rv.value;
+  ir->label->section = rv.section;
+  ir->label->defined = 1;
+  return OK;
+}
+
+/*
+ * Encode an instruction in pass 2.
+ * The opcode and size were settled in pass 1, so all that is left is to
+ * evaluate the operand. In single pass mode an operand referring to a
+ * symbol defined further down is left as 0 and patched once the symbol
+ * is defined.
+ */
+static int encode(struct asm65_context *ac, struct ir_line *ir)
+{
+  struct output_descriptor od;
+  unsigned char data[5];
+  unsigned char *operand = &data[1];
+  int value;
+  int error;
+
+  data[0] = ir->opcode;
+  od.data = data;
+  od.length = ir->size;
+  if (!ir->expr)
+    return output(ac, &od);
+  /* The inverse branch skips the JMP to the target */
+  if (ir->relaxed) {
+    data[1] = 3;
+    data[2] = JMP_ABSOLUTE;
+    operand = &data[3];
+  }
+
+  if (ac->object_mode)
+    error = relocate(ac, ir, &value);
+  else
+    error = expr_run(ac, ir->expr, &value);
+  if (error == SYMBOL_NOT_FOUND && ac->single_pass) {
+    data[1] = data[2] = data[3] = 0;
+    error = fixup_add_operand(ac, ir->expr, ir->mode, ir->size);
+  } else if (!error) {
+    LOG(ac, LOG_PARSE, LOG_DEBUG, "Addressing mode %d, value = %d\n",
+        ir->mode, value);
+    error = operand_bytes(ir->mode, ir->address, value, operand);
+  }
+  if (error)
+    return error;
+  return output(ac, &od);
+}
+
+/*
+ * Size of an instruction using the addressing mode
+ */
+static const unsigned char mode_sizes[MODE_NUM_MODES] = {
+  1, 3, 3, 3, 2, 1, 3, 2, 2, 2, 2, 2, 2,  /* 6502 */
+  2, 3,                                   /* 65C02 */
+  4, 4, 2, 2, 3, 2, 2, 3, 3               /* 65C816 */
+};
+
+static int mode_size(int mode)
+{
+  return mode_sizes[MODE_INDEX(mode)];
+}
+
+/*
+ * Fit the addressing mode found in the operand to the modes the
+ * mnemonic supports. Branches take an address but encode it relative,
+ * indexed modes only available in zero page use that and the 65C02 and
+ * 65C816 have indirect and long modes sharing the shape of another one.
+ * Returns 0 if the mnemonic can't use the mode.
+ */
+static int fit_mode(int mode, struct asm_mnemonic *am)
+{
+  int alternatives;
+
+  if (mode & am->amodes)
+    return mode;
+
+  switch (mode) {
+    case MODE_IMPLIED:
+      alternatives = MODE_ACCUMULATOR;
+      break;
+    case MODE_ABSOLUTE:
+      alternatives = MODE_RELATIVE | MODE_RELATIVE_LONG | MODE_LONG;
+      break;
+    case MODE_ABSOLUTE_IX:
+      alternatives = MODE_ZEROPAGE_IX | MODE_LONG_IX;
+      break;
+    case MODE_ABSOLUTE_IY:
+      alternatives = MODE_ZEROPAGE_IY;
+      break;
+    case MODE_INDIRECT:
+      alternatives = MODE_ZEROPAGE_IND;
+      break;
+    case MODE_INDIRECT_IX:
+      alternatives = MODE_ABSOLUTE_IND_IX;
+      break;
+    case MODE_INDIRECT_LONG:
+      alternatives = MODE_ABSOLUTE_IND_LONG;
+      break;
+    default:
+      return 0;
+  }
+  /* No mnemonic has more than one of the alternatives */
+  alternatives &= am->amodes;
+  return alternatives & -alternatives;
+}
+
+/*
+ * Zero page form of an absolute mode, 0 if the mnemonic has none
+ */
+static int zp_mode(int mode, struct asm_mnemonic *am)
+{
+  switch (mode) {
+    case MODE_ABSOLUTE:
+      return MODE_ZEROPAGE & am->amodes;
+    case MODE_ABSOLUTE_IX:
+      return MODE_ZEROPAGE_IX & am->amodes;
+    case MODE_ABSOLUTE_IY:
+      return MODE_ZEROPAGE_IY & am->amodes;
+  }
+  return 0;
+}
+
+/*
+ * Absolute form of a zero page mode, 0 if the mnemonic has none
+ */
+static int abs_mode(int mode, struct asm_mnemonic *am)
+{
+  switch (mode) {
+    case MODE_ZEROPAGE:
+      return MODE_ABSOLUTE & am->amodes;
+    case MODE_ZEROPAGE_IX:
+      return MODE_ABSOLUTE_IX & am->amodes;
+    case MODE_ZEROPAGE_IY:
+      return MODE_ABSOLUTE_IY & am->amodes;
+  }
+  return 0;
+}
+
+static void set_mode(struct ir_line *ir, int mode)
+{
+  ir->mode = mode;
+  ir->opcode = ir->am->opcodes[MODE_INDEX(mode)];
+  ir->size = mode_size(mode);
+}
+
+/*
+ * Does the operand of an instruction fit in zero page with the symbols
+ * as they are. In an object file an address in a section or an imported
+ * symbol never does, the linker may put it anywhere.
+ */
+static int zp_fits(struct asm65_context *ac, struct ir_line *ir)
+{
+  struct expr_reloc rv;
+  int value;
+
+  if (ac->object_mode) {
+    if (expr_reloc(ac, ir->expr, ir->section, &rv) || rv.section >= 0 ||
+        rv.import)
+      return 0;
+    value = rv.value;
+  } else if (expr_run(ac, ir->expr, &value)) {
+    return 0;
+  }
+  return value >= 0 && value <= 255;
+}
+
+/*
+ * Put an instruction having both a zero page and an absolute form in
+ * zero page if its operand may fit. In single pass mode the operand has
+ * to be known to fit, the bytes go out right away. Otherwise an operand
+ * not known yet is taken to fit, and the instruction is tracked to be
+ * checked once all symbols are defined. So is one whose operand depends
+ * on labels, they move when code before them grows. An operand using the
+ * PC, which moves too, stays absolute. When relaxing, every branch is
+ * tracked as it may end up out of reach.
+ */
+static void size_instruction(struct asm65_context *ac, struct ir_line *ir,
+                             int known)
+{
+  int zp = zp_mode(ir->mode, ir->am);
+
+  if (ir->mode == MODE_RELATIVE && ac->relax) {
+    size_track(ac, ir, 1);
+    return;
+  }
+
+  if (!zp || (known && !zp_fits(ac, ir)))
+    return;
+  if (ac->single_pass) {
+    if (known)
+      set_mode(ir, zp);
+    return;
+  }
+  if (expr_uses_pc(ir->expr))
+    return;
+  set_mode(ir, zp);
+  if (!EXPR_CONSTANT(ir->expr))
+    size_track(ac, ir, 0);
+}
+
+/*
+ * Does a branch reach its target from where it is now. In an object file
+ * the target must be in the same section too.
+ */
+static int branch_fits(struct asm65_context *ac, struct ir_line *ir)
+{
+  struct expr_reloc rv;
+  int offset;
+
+  if (ac->object_mode) {
+    /* Anything that can't be relocated at all is reported in pass 2 */
+    if (expr_reloc(ac, ir->expr, ir->section, &rv))
+      return 1;
+    if (rv.import || (rv.section >= 0 && rv.section != ir->section))
+      return 0;
+  } else if (expr_run(ac, ir->expr, &rv.value)) {
+    return 1;
+  }
+  offset = rv.value - (ir->address + 2);
+  return offset >= -128 && offset <= 127;
+}
+
+/*
+ * Mnemonic of a conditional branch opcode, for the report
+ */
+static char *branch_name(int opcode)
+{
+  struct asm_mnemonic *am;
+  int i;
+
+  for (i = 0; i < MN_NUM_MNEMONICS; i++) {
+    am = &am_6502[i];
+    if ((am->amodes & MODE_RELATIVE) &&
+        am->opcodes[MODE_INDEX(MODE_RELATIVE)] == opcode)
+      return am->mnemonic;
+  }
+  return "";
+}
+
+/*
+ * Rewrite a branch that can't reach its target. BRA becomes a JMP, a
+ * conditional branch the inverse branch over a JMP. The conditional
+ * branches come in pairs with opcodes differing in bit 5 only. Every
+ * rewrite is reported with what it costs, page crossings left aside.
+ */
+static void relax_branch(struct asm65_context *ac, struct ir_line *ir)
+{
+  char *of = ir->file != ac->src_root ? " of " : "";
+  char *path = ir->file != ac->src_root ? ir->file->path : "";
+
+  ir->mode = MODE_ABSOLUTE;
+  if (ir->opcode == BRA_RELATIVE) {
+    ir->opcode = JMP_ABSOLUTE;
+    ir->size = 3;
+    LOG(ac, LOG_PARSE, LOG_INFO, "Relaxed BRA on line %d%s%s to JMP, "
+        "1 more byte, same cycles\n", ir->line, of, path);
+    return;
+  }
+  ir->opcode ^= 0x20;
+  ir->relaxed = 1;
+  ir->size = 5;
+  LOG(ac, LOG_PARSE, LOG_INFO, "Relaxed %s on line %d%s%s to %s *+5 and "
+      "JMP, 3 more bytes, 2 more cycles taken, 1 more not taken\n",
+      ir->am->mnemonic,
+      ir->line, of, path, branch_name(ir->opcode));
+}
+
+/*
+ * Look at a tracked instruction or an equate again once all symbols are
+ * defined. An instruction whose operand doesn't fit in zero page after
+ * all grows to the absolute form, a branch that doesn't reach its target
+ * is relaxed. An equate is evaluated again, in an
+ * object file along with the section it is relative to. Returns non-zero
+ * if the line changed.
+ */
+static int resize(struct asm65_context *ac, struct ir_line *ir)
+{
+  struct expr_reloc rv;
+  int mode;
+
+  if (ir->kind == IR_EQUATE) {
+    rv.section = ir->label->section;
+    if (ac->object_mode ? expr_reloc(ac, ir->expr, ir->section, &rv) :
+                          expr_run(ac, ir->expr, &rv.value))
+      return 0;
+    if (rv.value == ir->label->value && rv.section == ir->label->section)
+      return 0;
+    ir->label->value = rv.value;
+    ir->label->section = rv.section;
+    return 1;
+  }
+
+  if (ir->mode == MODE_RELATIVE) {
+    if (branch_fits(ac, ir))
+      return 0;
+    relax_branch(ac, ir);
+    return 1;
+  }
+
+  mode = abs_mode(ir->mode, ir->am);
+  if (!mode || zp_fits(ac, ir))
+    return 0;
+  set_mode(ir, mode);
+  return 1;
+}
+
+/*
+ * Parse an instruction into the IR.
+ * Only the addressing mode and thus the size are needed in pass 1,
+ * the operand may refer to symbols defined further down.
+ */
+static int parse_instruction(struct asm65_context *ac, struct token *tok,
+                             struct asm_mnemonic *am,
+                             struct symbol_entry *label)
+{
+  struct address_mode mode;
+  struct ir_line *ir;
+  int error;
+
+  error = evaluate_address(ac, tok, &mode);
+  if (error && error != SYMBOL_NOT_FOUND)
+    return error;
+
+  ir = ir_new_line(ac, IR_INSTRUCTION);
+  ir->label = label;
+  ir->am = am;
+  ir->mode = fit_mode(mode.mode, am);
+  if (!ir->mode)
+    return ASM_INVALID_ADDRESSING_MODE;
+  set_mode(ir, ir->mode);
+  if (mode.expr) {
+    ir->expr = ir_store_expr(ac, mode.expr);
+    size_instruction(ac, ir, error == OK);
+  }
+
+  ac->PC += ir->size;
+  return OK;
+}
+
+static int process_line(struct asm65_context *ac, struct token *tok,
+                        struct source_line *sl);
+
+/*
+ * Parse current line
+ */
+static int parse(struct asm65_context *ac, struct token *tok,
+                 struct symbol_entry *label)
+{
+  const struct cpu_models *model = ac->cur_cpu;
+  const struct keyword *kw;
+  unsigned long long key = 0;
+  struct ir_line *ir;
+
+  /* One pass over the word gives both the upper cased key and its slot */
+  if (tok->kind == TK_IDENT)
+    key = keyword_key(tok->text, NULL);
+  kw = &model->kwt[KW_HASH(key, model->hash_mul, model->hash_bits)];
+  if (!key || kw->key != key) {
+    if (tok->kind == TK_IDENT && tok->sym->macro) {
+      ir = ir_new_line(ac, IR_EMPTY);
+      ir->label = label;
+      return mac_expand(ac, tok->sym->macro, tok + 1, process_line);
+    }
+    return NO_VALID_DIRECTIVE_OR_MNEMONIC;
+  }
+
+  if (kw->ad) {
+    ir = ir_new_line(ac, IR_DIRECTIVE);
+    ir->label = label;
+    ir->ad = kw->ad;
+    return kw->ad->func(ac, tok + 1);
+  }
+  return parse_instruction(ac, tok + 1, kw->am, label);
+}
+
+/*
+ * Parse the tokens of a line without a label into the IR, through the
+ * keyword lookup and the dispatch the assembly uses
+ */
+int asm_parse_line(struct asm65_context *ac, struct token *tok)
+{
+  return parse(ac, tok, NULL);
+}
+
+/*
+ * Parse an equate, label = expression, into the IR.
+ * The value is set right away, unless the expression refers to symbols
+ * not defined yet. Then it is given its value once they are.
+ */
+static int process_equate(struct asm65_context *ac, struct token *tok)
+{
+  struct symbol_entry *se;
+  struct ir_line *ir;
+  int error;
+
+  se = sym_new_symbol(ac, tok->sym);
+  if (!se)
+    return SYMBOL_ALREADY_EXIST;
+
+  error = expr_compile(ac, tok + 2, &tok);
+  if (error)
+    return error;
+  if (tok->kind != TK_END)
+    return ASM_UNEXPECTED_CHARACTER;
+  ir = ir_new_line(ac, IR_EQUATE);
+  ir->label = se;
+  ir->expr = ir_store_expr(ac, ac->expr_ctx.code);
+
+  error = expr_run(ac, ir->expr, &se->value);
+  if (error == SYMBOL_NOT_FOUND)
+    return fixup_add_equate(ac, se, ir->expr);
+  if (error)
+    return error;
+  se->defined = 1;
+  return fixup_resolve(ac, se->name);
+}
+
+/*
+ * Process incomming line, pass 1.
+ * The line is a slice of the source file, it is not zero terminated but
+ * always ends on a line terminator. The line is parsed into the IR,
+ * labels get their values and equates are evaluated if they can be.
+ */
+static int process_line(struct asm65_context *ac, struct token *tok,
+                        struct source_line *sl)
+{
+  struct symbol_entry *se = NULL;
+  struct ir_line *ir;
+  int error;
+
+  ac->stats.lines++;
+
+  /* Check first token to see if we have a
+     label defined here. */
+  if (tok->flags & TF_LABEL) {
+    /* or the name of a macro */
+    if (tok[1].kind == TK_IDENT &&
+        keyword_key(tok[1].text, NULL) == KEY5('M', 'A', 'C', 'R', 'O'))
+      return mac_define(ac, tok, ac->cur_file, &ac->line);
+    /* Check if we have an assignment here */
+    if (tok[1].kind == TK_EQUALS ||
+        (tok[1].kind == TK_IDENT && keyword_key(tok[1].text, NULL) == KEY3('E', 'Q', 'U'))) {
+      LOG(ac, LOG_PARSE, LOG_DEBUG, "Evaluating expression %.*s!\n", sl->length,
+          sl->text);
+      return process_equate(ac, tok);
+    }
+    error = read_and_store_label(ac, tok, &se);
+    if (error)
+      return error;
+    tok++;
+  }
+
+  /* Is it a comment or end of line ? */
+  if (tok->kind == TK_END) {
+    ir = ir_new_line(ac, IR_EMPTY);
+    ir->label = se;
+    return OK;
+  }
+
+  return parse(ac, tok, se);
+}
+
+/*
+ * Process a line of the IR, pass 2.
+ * Evaluates and encodes the line, the source is not looked at again.
+ */
+static int process_ir_line(struct asm65_context *ac, struct ir_line *ir)
+{
+  int error;
+
+  switch (ir->kind) {
+    case IR_EQUATE:
+      /* In single pass mode the equate got its value when parsed */
+      if (ac->single_pass)
+        return OK;
+      if (ac->object_mode)
+        return equate_reloc(ac, ir);
+      error = expr_run(ac, ir->expr, &ir->label->value);
+      if (error)
+        return error;
+      ir->label->defined = 1;
+      return OK;
+
+    case IR_INSTRUCTION:
+      return encode(ac, ir);
+  }
+  return OK;
+}
+
+/*
+ * Parse the lines of a file into the IR. In single pass mode every line
+ * is encoded as soon as it has been parsed. An INCLUDE line assembles
+ * the included file right there. On error cur_file and line are left at
+ * the line at fault, in whatever file that is.
+ */
+static int assemble_file(struct asm65_context *ac, struct inc_file *file)
+{
+  int error;
+  int pc;
+
+  ac->cur_file = file;
+  for (ac->line = 1; ac->line <= file->num_lines; ac->line++) {
+    error = process_line(ac, INC_TOKENS(file, ac->line),
+                         &file->lines[ac->line - 1]);
+    for (; !error && ac->single_pass && ac->num_encoded < ac->ir.num_lines;
+         ac->num_encoded++) {
+      pc = ac->PC;
+      ac->PC = ac->ir.lines[ac->num_encoded].address;
+      error = process_ir_line(ac, &ac->ir.lines[ac->num_encoded]);
+      ac->PC = pc;
+    }
+    if (error)
+      return error;
+  }
+  return OK;
+}
+
+/*
+ * Start an assembly, with every module empty. The options single_pass,
+ * object_mode and relax are left as they were set.
+ */
+void asm_init(struct asm65_context *ac)
+{
+  ac->cpu = CPUUNDEF;
+  ac->cur_cpu = &cm[0];
+  ac->PC = 0;
+  ac->line = 1;
+  ac->cur_file = NULL;
+  ac->pass = 1;
+  ac->src_root = NULL;
+
+  /* Initialize the symbol table, the lexer interns names in it */
+  sym_init(ac);
+  expr_init(ac);
+  ir_init(ac);
+  fixup_init(ac);
+  output_init(ac);
+  obj_init(ac);
+  mac_init(ac);
+  size_init(ac);
+}
+
+/*
+ * Assemble src_root, the first pass parses it into the IR and the second
+ * encodes from the IR. On error cur_file and line are left at the line
+ * at fault.
+ */
+int asm_assemble(struct asm65_context *ac)
+{
+  int error;
+  int i;
+
+  /* Code before the first ORG of an object file is relocatable */
+  if (ac->object_mode)
+    obj_section(ac, ac->PC, 1);
+
+  /* Pass 1, parse the source and the files it includes into the IR */
+  stats_begin(ac, STATS_PASS1);
+  ac->num_encoded = 0;
+  error = assemble_file(ac, ac->src_root);
+  if (!error && ac->single_pass)
+    error = fixup_check(ac);
+  stats_end(ac, STATS_PASS1);
+  if (error)
+    return error;
+
+  /* Pass 2, evaluate and encode from the IR */
+  if (!ac->single_pass) {
+    /* With all symbols defined the zero page guesses can be checked */
+    stats_begin(ac, STATS_SIZING);
+    size_settle(ac, resize);
+    stats_end(ac, STATS_SIZING);
+    stats_begin(ac, STATS_PASS2);
+    ac->pass = 2;
+    if (ac->object_mode) {
+      obj_end(ac);
+      /* The equates must know their sections before they are used */
+      for (i = 0; i < ac->ir.num_lines && !error; i++) {
+        ac->line = ac->ir.lines[i].line;
+        ac->cur_file = ac->ir.lines[i].file;
+        ac->PC = ac->ir.lines[i].address;
+        if (ac->ir.lines[i].kind == IR_EQUATE)
+          error = process_ir_line(ac, &ac->ir.lines[i]);
+      }
+    }
+    for (i = 0; !error && i < ac->ir.num_lines; i++) {
+      ac->line = ac->ir.lines[i].line;
+      ac->cur_file = ac->ir.lines[i].file;
+      ac->PC = ac->ir.lines[i].address;
+      error = process_ir_line(ac, &ac->ir.lines[i]);
+    }
+    stats_end(ac, STATS_PASS2);
+  }
+  return error;
+}
+
+/*
+ * Release everything the assembly kept, the image included. The names
+ * and the files that haven't changed are kept for the next one.
+ */
+void asm_clean_up(struct asm65_context *ac)
+{
+  sym_clean_up(ac);
+  ir_clean_up(ac);
+  fixup_clean_up(ac);
+  obj_clean_up(ac);
+  mac_clean_up(ac);
+  size_clean_up(ac);
+  expr_free(ac);
+  inc_clean_up(ac);
+  output_clean_up(ac);
+  ac->src_root = NULL;
+  ac->cur_file = NULL;
+}
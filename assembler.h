@@ -0,0 +1,22 @@
+/*
+ * The assembler proper, from the source to the image and the symbols.
+ * Writing the files is left to the caller.
+ */
+#ifndef __ASSEMBLER_H__
+#define __ASSEMBLER_H__
+
+struct asm65_context;
+struct token;
+
+/*
+ * The file assembled, src_root of the context, is opened by the caller
+ * between asm_init and asm_assemble
+ */
+void asm_init(struct asm65_context *ac);
+int asm_assemble(struct asm65_context *ac);
+void asm_clean_up(struct asm65_context *ac);
+
+/* One line, for measuring the dispatch alone */
+int asm_parse_line(struct asm65_context *ac, struct token *tok);
+
+#endif // __ASSEMBLER_H__
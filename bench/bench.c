@@ -0,0 +1,307 @@
+/*
+ * Throughput benchmark of the assembler.
+ * Generates a source for each configuration with gensrc, assembles it
+ * with asm65 and reports lines and megabytes a second and the peak
+ * memory of the assembler. The results are appended to a tab separated
+ * file, labelled, so runs of different commits can be compared.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#define BENCH_NAME_LENGTH     1024
+#define BENCH_MAX_ARGS        16
+
+/*
+ * Shape of a generated source, 0 leaves the default of gensrc
+ */
+struct bench_config {
+  char *name;
+  long lines;
+  long symbols;
+  int forward;
+  int depth;
+  int includes;
+};
+
+static struct bench_config configs[] = {
+  { "10k",       10000,    0, 10, 3, 0 },
+  { "100k",      100000,   0, 10, 3, 0 },
+  { "100k-fwd",  100000,   0, 60, 3, 0 },
+  { "100k-deep", 100000,   0, 10, 7, 0 },
+  { "100k-inc",  100000,   0, 10, 3, 32 },
+  { "1m",        1000000,  0, 10, 3, 0 },
+  { "10m",       10000000, 0, 10, 3, 0 },
+};
+
+#define BENCH_NUM_CONFIGS     (sizeof (configs) / sizeof (configs[0]))
+
+struct bench_result {
+  double seconds;               /* Best of the runs */
+  long peak_rss;                /* Largest of the runs, in KB */
+  long long bytes;              /* Of the source and the included files */
+};
+
+static char *assembler = "./asm65";
+static char *generator = "bench/gensrc";
+static char *workdir = "bench/work";
+static char *results = "bench/results.tsv";
+static char *label = "unknown";
+static long max_lines = 1000000;
+static int runs = 3;
+
+/*
+ * Run a program and wait for it, with the standard output sent to
+ * /dev/null if quiet. Returns the exit status, -1 if it didn't exit
+ * normally, and fills usage.
+ */
+static int bench_spawn(char **argv, int quiet, struct rusage *usage)
+{
+  int status;
+  pid_t pid;
+  int fd;
+
+  fflush(stdout);
+  pid = fork();
+  if (pid < 0) {
+    printf("Could not start %s !\n", argv[0]);
+    exit(1);
+  }
+  if (!pid) {
+    if (quiet && (fd = open("/dev/null", O_WRONLY)) >= 0) {
+      dup2(fd, STDOUT_FILENO);
+      close(fd);
+    }
+    execv(argv[0], argv);
+    printf("Could not run %s !\n", argv[0]);
+    _exit(127);
+  }
+  if (wait4(pid, &status, 0, usage) < 0 || !WIFEXITED(status))
+    return -1;
+  return WEXITSTATUS(status);
+}
+
+static double bench_now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static long long bench_size(char *name)
+{
+  struct stat st;
+
+  return stat(name, &st) ? 0 : st.st_size;
+}
+
+/*
+ * Generate the source of a configuration, returns its size with the
+ * included files
+ */
+static long long bench_generate(struct bench_config *config, char *source)
+{
+  char args[5][32];
+  char name[BENCH_NAME_LENGTH];
+  char *argv[BENCH_MAX_ARGS];
+  struct rusage usage;
+  long long bytes;
+  int argc = 0;
+  int i;
+
+  snprintf(args[0], sizeof (args[0]), "%ld", config->lines);
+  snprintf(args[1], sizeof (args[1]), "%ld", config->symbols);
+  snprintf(args[2], sizeof (args[2]), "%d", config->forward);
+  snprintf(args[3], sizeof (args[3]), "%d", config->depth);
+  snprintf(args[4], sizeof (args[4]), "%d", config->includes);
+  argv[argc++] = generator;
+  argv[argc++] = "-n";
+  argv[argc++] = args[0];
+  if (config->symbols) {
+    argv[argc++] = "-s";
+    argv[argc++] = args[1];
+  }
+  argv[argc++] = "-f";
+  argv[argc++] = args[2];
+  argv[argc++] = "-d";
+  argv[argc++] = args[3];
+  argv[argc++] = "-i";
+  argv[argc++] = args[4];
+  argv[argc++] = source;
+  argv[argc] = NULL;
+  if (bench_spawn(argv, 0, &usage)) {
+    printf("Could not generate %s !\n", source);
+    exit(1);
+  }
+
+  bytes = bench_size(source);
+  for (i = 1; i <= config->includes; i++) {
+    snprintf(name, sizeof (name), "%s/%s-%d.inc", workdir, config->name, i);
+    bytes += bench_size(name);
+  }
+  return bytes;
+}
+
+/*
+ * Assemble the source runs times, keeping the best time and the largest
+ * peak memory
+ */
+static void bench_assemble(char *source, struct bench_result *result)
+{
+  char output[BENCH_NAME_LENGTH];
+  char *argv[BENCH_MAX_ARGS];
+  struct rusage usage;
+  double start;
+  double seconds;
+  int i;
+
+  snprintf(output, sizeof (output), "%s/out.bin", workdir);
+  argv[0] = assembler;
+  argv[1] = "-o";
+  argv[2] = output;
+  argv[3] = source;
+  argv[4] = NULL;
+
+  result->seconds = 0;
+  result->peak_rss = 0;
+  for (i = 0; i < runs; i++) {
+    start = bench_now();
+    if (bench_spawn(argv, 1, &usage)) {
+      printf("Could not assemble %s !\n", source);
+      exit(1);
+    }
+    seconds = bench_now() - start;
+    if (!i || seconds < result->seconds)
+      result->seconds = seconds;
+    if (usage.ru_maxrss > result->peak_rss)
+      result->peak_rss = usage.ru_maxrss;
+  }
+}
+
+static void bench_report(FILE *f, struct bench_config *config,
+                         struct bench_result *result)
+{
+  double lines_per_sec = config->lines / result->seconds;
+  double mb_per_sec = result->bytes / result->seconds / (1024 * 1024);
+
+  printf("%-10s %9ld %12lld %9.3f %12.0f %9.2f %10ld\n", config->name,
+         config->lines, result->bytes, result->seconds, lines_per_sec,
+         mb_per_sec, result->peak_rss);
+  fprintf(f, "%s\t%s\t%ld\t%lld\t%.6f\t%.0f\t%.3f\t%ld\n", label,
+          config->name, config->lines, result->bytes, result->seconds,
+          lines_per_sec, mb_per_sec, result->peak_rss);
+}
+
+static void usage(char *name)
+{
+  unsigned int i;
+
+  printf("Usage: %s [-a asm65] [-g gensrc] [-d workdir] [-o results] [-t label] [-m maxlines] [-r runs] [config...]\n", name);
+  printf("  -a asm65     Assembler to measure, default %s\n", assembler);
+  printf("  -g gensrc    Source generator, default %s\n", generator);
+  printf("  -d workdir   Where the sources are generated, default %s\n", workdir);
+  printf("  -o results   Tab separated file the results are appended to, default %s\n", results);
+  printf("  -t label     Label of the results, like the commit measured\n");
+  printf("  -m maxlines  Skip the configurations with more lines, default %ld\n", max_lines);
+  printf("  -r runs      Runs of each configuration, the best time is kept, default %d\n", runs);
+  printf("Configurations, all of them up to maxlines if none is given:\n");
+  for (i = 0; i < BENCH_NUM_CONFIGS; i++)
+    printf("  %-10s %ld lines, %d%% forward references, depth %d, %d included files\n",
+           configs[i].name, configs[i].lines, configs[i].forward,
+           configs[i].depth, configs[i].includes);
+  exit(1);
+}
+
+int main(int argc, char **argv)
+{
+  char source[BENCH_NAME_LENGTH];
+  struct bench_result result;
+  struct bench_config *config;
+  unsigned int i;
+  FILE *f;
+  int opt;
+  int j;
+
+  while ((opt = getopt(argc, argv, "a:g:d:o:t:m:r:")) != -1) {
+    switch (opt) {
+      case 'a':
+        assembler = optarg;
+        break;
+      case 'g':
+        generator = optarg;
+        break;
+      case 'd':
+        workdir = optarg;
+        break;
+      case 'o':
+        results = optarg;
+        break;
+      case 't':
+        label = optarg;
+        break;
+      case 'm':
+        max_lines = atol(optarg);
+        break;
+      case 'r':
+        runs = atoi(optarg);
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+  if (runs <= 0 || strlen(workdir) >= BENCH_NAME_LENGTH - 64)
+    usage(argv[0]);
+  for (j = optind; j < argc; j++) {
+    for (i = 0; i < BENCH_NUM_CONFIGS && strcmp(configs[i].name, argv[j]); i++)
+      ;
+    if (i == BENCH_NUM_CONFIGS)
+      usage(argv[0]);
+  }
+
+  if (mkdir(workdir, 0777) && access(workdir, W_OK)) {
+    printf("Could not create %s !\n", workdir);
+    exit(1);
+  }
+  f = fopen(results, "a");
+  if (!f) {
+    printf("Could not open %s !\n", results);
+    exit(1);
+  }
+  if (!ftell(f))
+    fprintf(f, "label\tconfig\tlines\tbytes\tseconds\tlines_per_sec\tmb_per_sec\tpeak_rss_kb\n");
+
+  printf("Benchmark of %s, %s, best of %d runs\n", assembler, label, runs);
+  printf("%-10s %9s %12s %9s %12s %9s %10s\n", "config", "lines", "bytes",
+         "seconds", "lines/s", "MB/s", "peak KB");
+  for (i = 0; i < BENCH_NUM_CONFIGS; i++) {
+    config = &configs[i];
+    if (optind < argc) {
+      for (j = optind; j < argc && strcmp(config->name, argv[j]); j++)
+        ;
+      if (j == argc)
+        continue;
+    } else if (config->lines > max_lines) {
+      continue;
+    }
+    snprintf(source, sizeof (source), "%s/%s.asm", workdir, config->name);
+    result.bytes = bench_generate(config, source);
+    bench_assemble(source, &result);
+    bench_report(f, config, &result);
+    fflush(f);
+  }
+
+  if (ferror(f) || fclose(f)) {
+    printf("Could not write %s !\n", results);
+    exit(1);
+  }
+  return 0;
+}
@@ -0,0 +1,328 @@
+/*
+ * Generator of synthetic assembler sources for the benchmark.
+ * The same parameters and seed always give the same source. The shape is
+ * set by the number of lines and symbols, the share of references to
+ * symbols defined further down, the depth of the expressions and the
+ * number of included files the lines are spread over.
+ *
+ * The code has to fit in the 64K address space, so once that is used up
+ * the lines left are equates, comments and empty lines, which still have
+ * to be read, lexed and evaluated.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define GEN_CODE_START        0x0200
+#define GEN_CODE_END          0xff00
+#define GEN_MAX_INSTRUCTION   5
+#define GEN_BRANCH_REACH      100
+#define GEN_NAME_LENGTH       1024
+
+struct gen_params {
+  long lines;
+  long symbols;
+  int forward;                  /* Percentage of forward references */
+  int depth;                    /* Nesting of the expressions */
+  int includes;                 /* Files the lines are spread over */
+  unsigned long long seed;
+};
+
+static struct gen_params params = { 10000, 0, 10, 3, 0, 1 };
+
+static unsigned long long state;
+
+/*
+ * Which symbols are labels, decided up front. An equate only refers
+ * forward to labels, so the equates never depend on each other in a
+ * cycle.
+ */
+static unsigned char *is_label;
+
+/* Symbols defined so far and the last label, for the branches */
+static long defined;
+static int defining;            /* Set while the expression of an equate is made */
+static long last_label = -1;
+static int last_label_pc;
+static int pc = GEN_CODE_START;
+
+/*
+ * xorshift64*, the same sequence on every platform
+ */
+static unsigned int gen_random(void)
+{
+  state ^= state >> 12;
+  state ^= state << 25;
+  state ^= state >> 27;
+  return (state * 0x2545f4914f6cdd1dULL) >> 32;
+}
+
+static int gen_percent(int percent)
+{
+  return (int)(gen_random() % 100) < percent;
+}
+
+/*
+ * A symbol to refer to, one defined further down for the share of
+ * forward references. Returns -1 if there is none.
+ */
+static long gen_symbol(void)
+{
+  long first = defined + defining;
+  long sym;
+
+  if (first < params.symbols && (!defined || gen_percent(params.forward))) {
+    sym = first + gen_random() % (params.symbols - first);
+    while (defining && sym < params.symbols && !is_label[sym])
+      sym++;
+    if (sym < params.symbols)
+      return sym;
+  }
+  if (!defined)
+    return -1;
+  return gen_random() % defined;
+}
+
+static void gen_operand(FILE *f)
+{
+  long sym;
+
+  if (gen_percent(50) && (sym = gen_symbol()) >= 0)
+    fprintf(f, "S%ld", sym);
+  else if (gen_percent(50))
+    fprintf(f, "$%X", gen_random() & 0xffff);
+  else
+    fprintf(f, "%u", gen_random() & 0xff);
+}
+
+/*
+ * An expression nested depth deep. Only operators that can't overflow or
+ * divide by zero are used.
+ */
+static void gen_expr(FILE *f, int depth)
+{
+  /* The exclusive or of this assembler is ':', '^' is the power */
+  static const char *ops[] = { "+", "-", "&", "|", ":", "+" };
+
+  if (depth <= 0) {
+    gen_operand(f);
+    return;
+  }
+  fputc('(', f);
+  gen_expr(f, depth - 1 - gen_random() % 2);
+  fprintf(f, " %s ", ops[gen_random() % 6]);
+  gen_expr(f, depth - 1 - gen_random() % 2);
+  fputc(')', f);
+}
+
+/*
+ * Define the next symbol, as an equate or as a label, on an instruction
+ * while there is room for code
+ */
+static void gen_definition(FILE *f)
+{
+  if (is_label[defined] && pc < GEN_CODE_END) {
+    fprintf(f, "S%ld\tnop\n", defined);
+    last_label = defined;
+    last_label_pc = pc++;
+  } else if (is_label[defined]) {
+    fprintf(f, "S%ld\n", defined);
+  } else {
+    fprintf(f, "S%ld = ", defined);
+    defining = 1;
+    gen_expr(f, params.depth);
+    defining = 0;
+    fprintf(f, " & $FFFF\n");
+  }
+  defined++;
+}
+
+static void gen_instruction(FILE *f)
+{
+  static const char *implied[] = { "nop", "inx", "dex", "iny", "dey", "clc",
+                                   "sec", "tax", "tay", "txa", "tya", "pha",
+                                   "pla" };
+  /* The first nine have an immediate mode */
+  static const char *memory[] = { "lda", "ldx", "ldy", "adc", "sbc", "and",
+                                  "ora", "eor", "cmp", "sta", "inc", "dec" };
+  static const char *branches[] = { "bne", "beq", "bcc", "bcs", "bpl",
+                                    "bmi" };
+  const char *mnemonic;
+  long sym;
+
+  switch (gen_random() % 6) {
+    case 0:
+      fprintf(f, "\t%s\n", implied[gen_random() % 13]);
+      pc += 1;
+      return;
+    case 1:
+    case 2:
+      fprintf(f, "\t%s #", memory[gen_random() % 9]);
+      gen_expr(f, params.depth);
+      fprintf(f, " & $FF\n");
+      pc += 2;
+      return;
+    case 3:
+      if ((sym = gen_symbol()) >= 0) {
+        mnemonic = memory[gen_random() % 12];
+        fprintf(f, "\t%s S%ld%s\n", mnemonic, sym, !gen_percent(30) ? "" :
+                strcmp(mnemonic, "ldx") ? ",X" : ",Y");
+        pc += 3;
+        return;
+      }
+      break;
+    case 4:
+      if (last_label >= 0 && pc - last_label_pc < GEN_BRANCH_REACH) {
+        fprintf(f, "\t%s S%ld\n", branches[gen_random() % 6], last_label);
+        pc += 2;
+        return;
+      }
+      break;
+  }
+  fprintf(f, "\tlda $%X,Y\n", gen_random() & 0xffff);
+  pc += 3;
+}
+
+static void gen_line(FILE *f, long line)
+{
+  int kind;
+
+  /* Spread the definitions evenly over the lines */
+  if (defined < params.symbols &&
+      defined * params.lines < (line + 1) * params.symbols) {
+    gen_definition(f);
+    return;
+  }
+
+  kind = gen_random() % 100;
+  if (kind < 8)
+    fprintf(f, "; Comment %u for line %ld, nothing to assemble here\n",
+            gen_random(), line);
+  else if (kind < 12)
+    fprintf(f, "\n");
+  else if (pc + GEN_MAX_INSTRUCTION < GEN_CODE_END)
+    gen_instruction(f);
+  else if (kind < 40)
+    fprintf(f, "\t\t\t; Code space used up, line %ld\n", line);
+  else
+    fprintf(f, "; %08X %08X %08X\n", gen_random(), gen_random(), gen_random());
+}
+
+static FILE *gen_open(char *name)
+{
+  FILE *f = fopen(name, "w");
+
+  if (!f) {
+    printf("Could not open %s !\n", name);
+    exit(1);
+  }
+  return f;
+}
+
+static void gen_close(FILE *f, char *name)
+{
+  if (ferror(f) || fclose(f)) {
+    printf("Could not write %s !\n", name);
+    exit(1);
+  }
+}
+
+static void usage(char *name)
+{
+  printf("Usage: %s [-n lines] [-s symbols] [-f forward] [-d depth] [-i includes] [-S seed] output\n", name);
+  printf("  -n lines     Lines to generate, default 10000\n");
+  printf("  -s symbols   Symbols to define, default a fifth of the lines\n");
+  printf("  -f forward   Percentage of references to symbols defined further down, default 10\n");
+  printf("  -d depth     Nesting of the expressions, default 3\n");
+  printf("  -i includes  Files the lines are spread over, included from the output, default 0\n");
+  printf("  -S seed      Seed of the random numbers, default 1\n");
+  printf("The included files are named after the output, output-1.inc and so on\n");
+  exit(1);
+}
+
+int main(int argc, char **argv)
+{
+  char name[GEN_NAME_LENGTH];
+  char *base;
+  char *dot;
+  int stem;
+  FILE *main_file;
+  FILE *f;
+  long line = 0;
+  long count;
+  int opt;
+  int i;
+
+  while ((opt = getopt(argc, argv, "n:s:f:d:i:S:")) != -1) {
+    switch (opt) {
+      case 'n':
+        params.lines = atol(optarg);
+        break;
+      case 's':
+        params.symbols = atol(optarg);
+        break;
+      case 'f':
+        params.forward = atoi(optarg);
+        break;
+      case 'd':
+        params.depth = atoi(optarg);
+        break;
+      case 'i':
+        params.includes = atoi(optarg);
+        break;
+      case 'S':
+        params.seed = strtoull(optarg, NULL, 0);
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+  if (optind != argc - 1 || params.lines <= 0 || params.symbols < 0 ||
+      params.forward < 0 || params.forward > 100 || params.depth < 0 ||
+      params.includes < 0 || strlen(argv[optind]) >= GEN_NAME_LENGTH - 16)
+    usage(argv[0]);
+  if (!params.symbols)
+    params.symbols = params.lines / 5;
+  if (params.symbols > params.lines)
+    params.symbols = params.lines;
+  state = params.seed ? params.seed : 1;
+
+  is_label = (unsigned char *)malloc(params.symbols + 1);
+  if (!is_label) {
+    printf("Could not allocate necessary memory, terminating !\n");
+    exit(1);
+  }
+  for (count = 0; count < params.symbols; count++)
+    is_label[count] = gen_percent(30);
+
+  main_file = gen_open(argv[optind]);
+  fprintf(main_file, "; Generated by gensrc -n %ld -s %ld -f %d -d %d -i %d -S %llu\n",
+          params.lines, params.symbols, params.forward, params.depth,
+          params.includes, params.seed);
+  fprintf(main_file, "\tORG $%04X\n", GEN_CODE_START);
+
+  /* The included files are named after the output without its extension */
+  base = strrchr(argv[optind], '/');
+  base = base ? base + 1 : argv[optind];
+  dot = strrchr(base, '.');
+  stem = dot ? (int)(dot - base) : (int)strlen(base);
+
+  /* The lines go in order, into the main file or the included ones */
+  f = main_file;
+  for (i = 0; i <= params.includes; i++) {
+    if (i) {
+      snprintf(name, sizeof (name), "%.*s-%d.inc",
+               (int)(base - argv[optind]) + stem, argv[optind], i);
+      fprintf(main_file, "\tINCLUDE \"%.*s-%d.inc\"\n", stem, base, i);
+      f = gen_open(name);
+    }
+    count = params.lines * (i + 1) / (params.includes + 1) - line;
+    while (count--)
+      gen_line(f, line++);
+    if (i)
+      gen_close(f, name);
+  }
+  gen_close(main_file, argv[optind]);
+  return 0;
+}
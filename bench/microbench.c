@@ -0,0 +1,606 @@
+/*
+ * Microbenchmarks of the kernels of the assembler, each run alone on
+ * inputs set up ahead, so a change to expr.c, symbols.c, utils.c, the
+ * lexer or the keyword dispatch can be measured without the rest of the
+ * assembly around it.
+ * Every kernel is warmed up, then timed over a number of samples, each
+ * long enough for the clock not to matter. The mean, the standard
+ * deviation and the best of the samples are reported in nanoseconds an
+ * operation.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "global.h"
+#include "assembler.h"
+#include "expr.h"
+#include "lexer.h"
+#include "symbols.h"
+#include "utils.h"
+#include "context.h"
+
+#define MB_NAME_LENGTH        32
+#define MB_MAX_SAMPLES        1000
+#define MB_PICKS              65536
+
+/* The kernels run in one context, set up by each of them */
+static struct asm65_context *ac;
+
+/* Results go here, so the work can't be optimized away */
+static volatile long sink;
+
+/******************************************************************************
+ *                       Expressions
+ *****************************************************************************/
+static struct token_list tl;
+static struct expr *compiled;
+
+static char expr_shallow[] = "Label1 + 2 * 3";
+
+/* Nested 16 deep, with symbols, numbers in every base and most operators */
+static char expr_deep[] =
+  "((((((((((((((((Label1 + 1) * 2) - Label2) & $FFFF) | 3) : $55) << 1) >> 1)"
+  " + Label3) - (Label1 & 7)) * 3) / 2) + %1010) - 17) + $41) & $FFFF)";
+
+static void mb_define(char *name, int value)
+{
+  struct symbol_entry *se;
+
+  se = sym_new_symbol(ac, sym_intern(ac, name, strlen(name)));
+
+  se->value = value;
+  se->defined = 1;
+}
+
+static void mb_expr_setup(char *text)
+{
+  sym_init(ac);
+  mb_define("Label1", 0x1234);
+  mb_define("Label2", 0x0042);
+  mb_define("Label3", 0x0100);
+  expr_init(ac);
+  lex_init(&tl);
+  if (lex_line(ac, &tl, text, strlen(text))) {
+    printf("Could not lex %s !\n", text);
+    exit(1);
+  }
+}
+
+static void mb_expr_shallow_setup(void)
+{
+  mb_expr_setup(expr_shallow);
+}
+
+static void mb_expr_deep_setup(void)
+{
+  mb_expr_setup(expr_deep);
+}
+
+static void mb_expr_run_setup(void)
+{
+  struct token *end;
+  size_t size;
+
+  mb_expr_setup(expr_deep);
+  if (expr_compile(ac, tl.tokens, &end)) {
+    printf("Could not compile %s !\n", expr_deep);
+    exit(1);
+  }
+  size = sizeof (struct expr) +
+         ac->expr_ctx.code->length * sizeof (union expr_code);
+  compiled = (struct expr *)malloc(size);
+  if (!compiled) {
+    printf("Could not allocate necessary memory, terminating !\n");
+    exit(1);
+  }
+  memcpy(compiled, ac->expr_ctx.code, size);
+}
+
+static void mb_expr_teardown(void)
+{
+  free(compiled);
+  compiled = NULL;
+  lex_free(&tl);
+  expr_free(ac);
+  sym_clean_up(ac);
+  sym_clear_names(ac);
+}
+
+/* Compile and evaluate */
+static void mb_eval_expr(long n)
+{
+  struct token *end;
+  int value;
+
+  while (n--) {
+    eval_expr(ac, tl.tokens, &end, &value);
+    sink += value;
+  }
+}
+
+/* Evaluate code compiled ahead */
+static void mb_expr_run(long n)
+{
+  int value;
+
+  while (n--) {
+    expr_run(ac, compiled, &value);
+    sink += value;
+  }
+}
+
+/******************************************************************************
+ *                       Symbols
+ *****************************************************************************/
+static char *names;
+static int *picks;
+static int pick_length;
+
+/*
+ * Define count symbols and pick the names to look up at random, all of
+ * them padded to the same length so the picks are simple offsets
+ */
+static void mb_sym_setup(int count)
+{
+  unsigned int state = 12345;
+  char *name;
+  int i;
+
+  pick_length = 16;
+  names = (char *)malloc((size_t)count * pick_length);
+  picks = (int *)malloc(MB_PICKS * sizeof (int));
+  if (!names || !picks) {
+    printf("Could not allocate necessary memory, terminating !\n");
+    exit(1);
+  }
+  sym_init(ac);
+  for (i = 0; i < count; i++) {
+    name = names + (size_t)i * pick_length;
+    snprintf(name, pick_length, "Sym_%u", i * 2654435761u);
+    mb_define(name, i);
+  }
+  for (i = 0; i < MB_PICKS; i++) {
+    state = state * 1103515245 + 12345;
+    picks[i] = (state >> 8) % count;
+  }
+}
+
+static void mb_sym_1k_setup(void)
+{
+  mb_sym_setup(1000);
+}
+
+static void mb_sym_100k_setup(void)
+{
+  mb_sym_setup(100000);
+}
+
+static void mb_sym_1m_setup(void)
+{
+  mb_sym_setup(1000000);
+}
+
+static void mb_sym_teardown(void)
+{
+  free(names);
+  free(picks);
+  names = NULL;
+  picks = NULL;
+  sym_clean_up(ac);
+  sym_clear_names(ac);
+}
+
+static void mb_sym_lookup(long n)
+{
+  struct symbol_entry *se;
+  int i = 0;
+
+  while (n--) {
+    se = sym_look_for_symbol(ac, names + (size_t)picks[i] * pick_length, NULL);
+    sink += se->value;
+    i = (i + 1) & (MB_PICKS - 1);
+  }
+}
+
+/******************************************************************************
+ *                       Scanning
+ *****************************************************************************/
+/* Mnemonics and directives of the 6502, as the dispatch sees them */
+static char *keywords[] = {
+  "LDA", "sta", "LDX", "ldy", "JSR", "rts", "BNE", "beq", "ADC", "sbc",
+  "CMP", "inc", "DEX", "iny", "JMP", "nop", "ORG", "byte", "WORD", "include",
+  "MACRO", "endm", "PHA", "pla", "BCC", "clc", "TAX", "tya", "ROL", "lsr",
+  "END", "cpu",
+};
+
+#define MB_NUM_KEYWORDS       (sizeof (keywords) / sizeof (keywords[0]))
+
+static char line_text[] = "Loop\tLDA ($12),Y\t\t; Load through the pointer";
+static char white_text[] = "  \t      \t   \t  LDA #$12";
+static char arg_text[] = "  Table_Start,X ; Index into the table";
+static char hex_text[] = " $BEEF";
+static char dec_text[] = " 48879";
+
+static void mb_lex_setup(void)
+{
+  sym_init(ac);
+  lex_init(&tl);
+}
+
+static void mb_lex_teardown(void)
+{
+  lex_free(&tl);
+  sym_clean_up(ac);
+  sym_clear_names(ac);
+}
+
+static void mb_keyword(long n)
+{
+  unsigned int i = 0;
+
+  while (n--) {
+    sink += keyword_key(keywords[i], NULL);
+    if (++i == MB_NUM_KEYWORDS)
+      i = 0;
+  }
+}
+
+static void mb_lex_line(long n)
+{
+  int length = strlen(line_text);
+
+  while (n--) {
+    lex_line(ac, &tl, line_text, length);
+    sink += tl.num_tokens;
+  }
+}
+
+static void mb_skip_white(long n)
+{
+  while (n--)
+    sink += *skip_white(white_text);
+}
+
+static void mb_getarg(long n)
+{
+  char arg[256];
+
+  while (n--)
+    sink += *getarg(arg, arg_text);
+}
+
+static void mb_getvalue_hex(long n)
+{
+  while (n--)
+    sink += getvalue(hex_text);
+}
+
+static void mb_getvalue_dec(long n)
+{
+  while (n--)
+    sink += getvalue(dec_text);
+}
+
+/******************************************************************************
+ *                       Dispatch
+ *****************************************************************************/
+/*
+ * Lines of each class of mnemonic, and directives, for the 6502 the
+ * assembly starts with. They are lexed ahead and parsed round robin.
+ */
+static char *implied_lines[] = {
+  " NOP", " rts", " INX", " pha", " CLC", " tay", " DEY", " plp", NULL
+};
+
+static char *immediate_lines[] = {
+  " LDA #$12", " ldx #0", " CMP #%1010", " and #$7F", " LDY #255",
+  " adc #1", NULL
+};
+
+static char *zeropage_lines[] = {
+  " LDA $12", " sta ($20),Y", " LDX $30,Y", " inc $40,X", " LDA ($22,X)",
+  " asl $50", NULL
+};
+
+static char *absolute_lines[] = {
+  " STA $1234", " jmp $C000", " LDA $1234,X", " inc $D020", " JMP ($FFFC)",
+  " jsr $FFD2", NULL
+};
+
+static char *branch_lines[] = {
+  " BNE *+2", " beq *-4", " BCC *+$10", " bcs *", " BPL *+6", " bmi *-8",
+  NULL
+};
+
+static char *directive_lines[] = {
+  " BYTE $12,$34", " word $1234", " BYTE 1,2,3,4", " word *+2", NULL
+};
+
+/* Parsed before the IR is emptied, the time it takes is spread over them */
+#define MB_PARSE_BATCH        16384
+
+static struct token **parse_lines;
+static int num_parse_lines;
+
+static void mb_parse_setup(char **lines)
+{
+  int i;
+
+  asm_init(ac);
+  lex_init(&tl);
+  for (num_parse_lines = 0; lines[num_parse_lines]; num_parse_lines++)
+    ;
+  parse_lines = (struct token **)malloc(num_parse_lines *
+                                        sizeof (struct token *));
+  if (!parse_lines) {
+    printf("Could not allocate necessary memory, terminating !\n");
+    exit(1);
+  }
+  for (i = 0; i < num_parse_lines; i++) {
+    lex_line(ac, &tl, lines[i], strlen(lines[i]));
+    parse_lines[i] = (struct token *)malloc(tl.num_tokens *
+                                            sizeof (struct token));
+    if (!parse_lines[i]) {
+      printf("Could not allocate necessary memory, terminating !\n");
+      exit(1);
+    }
+    memcpy(parse_lines[i], tl.tokens, tl.num_tokens * sizeof (struct token));
+    /* Only keywords, a line that doesn't parse would time the error */
+    if (asm_parse_line(ac, parse_lines[i])) {
+      printf("Could not parse%s !\n", lines[i]);
+      exit(1);
+    }
+  }
+}
+
+static void mb_implied_setup(void)
+{
+  mb_parse_setup(implied_lines);
+}
+
+static void mb_immediate_setup(void)
+{
+  mb_parse_setup(immediate_lines);
+}
+
+static void mb_zeropage_setup(void)
+{
+  mb_parse_setup(zeropage_lines);
+}
+
+static void mb_absolute_setup(void)
+{
+  mb_parse_setup(absolute_lines);
+}
+
+static void mb_branch_setup(void)
+{
+  mb_parse_setup(branch_lines);
+}
+
+static void mb_directive_setup(void)
+{
+  mb_parse_setup(directive_lines);
+}
+
+static void mb_parse_teardown(void)
+{
+  int i;
+
+  for (i = 0; i < num_parse_lines; i++)
+    free(parse_lines[i]);
+  free(parse_lines);
+  parse_lines = NULL;
+  lex_free(&tl);
+  asm_clean_up(ac);
+  sym_clear_names(ac);
+}
+
+static void mb_parse(long n)
+{
+  int i = 0;
+
+  while (n--) {
+    if (ac->ir.num_lines == MB_PARSE_BATCH) {
+      asm_clean_up(ac);
+      asm_init(ac);
+    }
+    sink += asm_parse_line(ac, parse_lines[i]);
+    if (++i == num_parse_lines)
+      i = 0;
+  }
+}
+
+/******************************************************************************
+ *                       Harness
+ *****************************************************************************/
+struct mb_kernel {
+  char *name;
+  char *what;
+  void (*setup)(void);
+  void (*run)(long n);
+  void (*teardown)(void);
+};
+
+static struct mb_kernel kernels[] = {
+  { "expr_shallow", "eval_expr on a short expression",
+    mb_expr_shallow_setup, mb_eval_expr, mb_expr_teardown },
+  { "expr_deep",    "eval_expr on an expression nested 16 deep",
+    mb_expr_deep_setup, mb_eval_expr, mb_expr_teardown },
+  { "expr_run",     "expr_run on the deep expression compiled ahead",
+    mb_expr_run_setup, mb_expr_run, mb_expr_teardown },
+  { "sym_1k",       "sym_look_for_symbol among 1K symbols",
+    mb_sym_1k_setup, mb_sym_lookup, mb_sym_teardown },
+  { "sym_100k",     "sym_look_for_symbol among 100K symbols",
+    mb_sym_100k_setup, mb_sym_lookup, mb_sym_teardown },
+  { "sym_1m",       "sym_look_for_symbol among 1M symbols",
+    mb_sym_1m_setup, mb_sym_lookup, mb_sym_teardown },
+  { "keyword",      "keyword_key, the key the mnemonics are dispatched on",
+    NULL, mb_keyword, NULL },
+  { "parse_implied", "asm_parse_line of implied instructions",
+    mb_implied_setup, mb_parse, mb_parse_teardown },
+  { "parse_immediate", "asm_parse_line of immediate instructions",
+    mb_immediate_setup, mb_parse, mb_parse_teardown },
+  { "parse_zeropage", "asm_parse_line of zero page instructions",
+    mb_zeropage_setup, mb_parse, mb_parse_teardown },
+  { "parse_absolute", "asm_parse_line of absolute instructions",
+    mb_absolute_setup, mb_parse, mb_parse_teardown },
+  { "parse_branch", "asm_parse_line of branches",
+    mb_branch_setup, mb_parse, mb_parse_teardown },
+  { "parse_directive", "asm_parse_line of data directives",
+    mb_directive_setup, mb_parse, mb_parse_teardown },
+  { "lex_line",     "lex_line on an instruction line",
+    mb_lex_setup, mb_lex_line, mb_lex_teardown },
+  { "skip_white",   "skip_white over 16 blanks",
+    NULL, mb_skip_white, NULL },
+  { "getarg",       "getarg of an indexed operand",
+    NULL, mb_getarg, NULL },
+  { "getvalue_hex", "getvalue of a hexadecimal number",
+    NULL, mb_getvalue_hex, NULL },
+  { "getvalue_dec", "getvalue of a decimal number",
+    NULL, mb_getvalue_dec, NULL },
+};
+
+#define MB_NUM_KERNELS        (sizeof (kernels) / sizeof (kernels[0]))
+
+static int samples = 20;
+static double sample_time = 0.01;
+
+static double mb_now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * Run the kernel until it has been running for a while, doubling the
+ * operations, to warm it up and find how many operations make a sample
+ */
+static long mb_calibrate(struct mb_kernel *k)
+{
+  double start = mb_now();
+  double elapsed;
+  long n = 1;
+
+  for (;;) {
+    elapsed = mb_now();
+    k->run(n);
+    elapsed = mb_now() - elapsed;
+    if (elapsed >= sample_time && mb_now() - start >= 2 * sample_time)
+      break;
+    n *= 2;
+  }
+  return n * (sample_time / elapsed) + 1;
+}
+
+static void mb_run(struct mb_kernel *k)
+{
+  double ns[MB_MAX_SAMPLES];
+  double start;
+  double mean = 0;
+  double var = 0;
+  double best;
+  long n;
+  int i;
+
+  if (k->setup)
+    k->setup();
+  n = mb_calibrate(k);
+  for (i = 0; i < samples; i++) {
+    start = mb_now();
+    k->run(n);
+    ns[i] = (mb_now() - start) * 1e9 / n;
+    mean += ns[i];
+  }
+  if (k->teardown)
+    k->teardown();
+
+  mean /= samples;
+  best = ns[0];
+  for (i = 0; i < samples; i++) {
+    var += (ns[i] - mean) * (ns[i] - mean);
+    if (ns[i] < best)
+      best = ns[i];
+  }
+  var = samples > 1 ? var / (samples - 1) : 0;
+  printf("%-16s %10.2f %8.2f %10.2f %12ld\n", k->name, mean, sqrt(var),
+         best, n);
+  fflush(stdout);
+}
+
+static void usage(char *name)
+{
+  printf("Usage: %s [-s samples] [-t ms] [-l] [kernel...]\n", name);
+  printf("  -s samples   Samples of each kernel, default %d\n", samples);
+  printf("  -t ms        Length of a sample, default %.0f\n", sample_time * 1000);
+  printf("  -l           List the kernels\n");
+  printf("All the kernels are run if none is given\n");
+  exit(1);
+}
+
+static void mb_list(void)
+{
+  unsigned int i;
+
+  for (i = 0; i < MB_NUM_KERNELS; i++)
+    printf("%-16s %s\n", kernels[i].name, kernels[i].what);
+  exit(0);
+}
+
+int main(int argc, char **argv)
+{
+  unsigned int i;
+  int opt;
+  int j;
+
+  ac = asm65_create(0);
+  if (!ac) {
+    printf("Could not allocate necessary memory, terminating !\n");
+    exit(1);
+  }
+  while ((opt = getopt(argc, argv, "s:t:l")) != -1) {
+    switch (opt) {
+      case 's':
+        samples = atoi(optarg);
+        break;
+      case 't':
+        sample_time = atof(optarg) / 1000;
+        break;
+      case 'l':
+        mb_list();
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+  if (samples <= 0 || samples > MB_MAX_SAMPLES || sample_time <= 0)
+    usage(argv[0]);
+  for (j = optind; j < argc; j++) {
+    for (i = 0; i < MB_NUM_KERNELS && strcmp(kernels[i].name, argv[j]); i++)
+      ;
+    if (i == MB_NUM_KERNELS) {
+      printf("No kernel %s !\n", argv[j]);
+      usage(argv[0]);
+    }
+  }
+
+  printf("%-16s %10s %8s %10s %12s\n", "kernel", "ns/op", "stddev", "best",
+         "ops/sample");
+  for (i = 0; i < MB_NUM_KERNELS; i++) {
+    if (optind < argc) {
+      for (j = optind; j < argc && strcmp(kernels[i].name, argv[j]); j++)
+        ;
+      if (j == argc)
+        continue;
+    }
+    mb_run(&kernels[i]);
+  }
+  asm65_destroy(ac);
+  return 0;
+}
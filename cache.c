@@ -0,0 +1,627 @@
+/*
+ * On disk cache of assembled sources.
+ * Before a source is assembled its key is looked up in the cache
+ * directory. The entry lists the files the source included, each is
+ * found again and compared with the hash it had. On a hit the entry is
+ * mapped and its code replayed into the output image, or copied to the
+ * object file, without lexing or encoding a single line. On a miss the
+ * result is stored once it has been written. The directory is kept
+ * below its size limit by removing the least recently used entries, a
+ * hit counts as a use.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include "global.h"
+#include "errors.h"
+#include "cache.h"
+#include "include.h"
+#include "output.h"
+#include "symbols.h"
+#include "context.h"
+
+/*
+ * Use dir for the cache, the entries are kept below max_kbytes. NULL
+ * goes without a cache. The directory is only looked at by cache_open.
+ * Returns 0, or -1 if out of memory.
+ */
+int cache_set_dir(struct asm65_context *ac, const char *dir, long max_kbytes)
+{
+  struct cache_state *cs = &ac->cache;
+
+  free(cs->dir);
+  cs->dir = NULL;
+  if (dir && !(cs->dir = strdup(dir)))
+    return -1;
+  cs->max_size = max_kbytes * 1024;
+  return 0;
+}
+
+/*
+ * Get the cache directory ready, created if it doesn't exist.
+ * Returns OK or the error with its message in the context.
+ */
+int cache_open(struct asm65_context *ac)
+{
+  char *dir = ac->cache.dir;
+  struct stat st;
+
+  /* Room for the entry names */
+  if (strlen(dir) > CACHE_PATH_LENGTH - 64)
+    return error_report(ac, "Cache directory name %s is too long", dir);
+  if (mkdir(dir, 0777) && errno != EEXIST)
+    return error_report(ac, "Could not create cache directory %s", dir);
+  if (stat(dir, &st) || !S_ISDIR(st.st_mode))
+    return error_report(ac, "Cache directory %s is not a directory", dir);
+  return OK;
+}
+
+/*
+ * 64 bit FNV-1a hash of data, continuing from hash
+ */
+static unsigned long long cache_hash(unsigned long long hash, void *data,
+                                     size_t length)
+{
+  unsigned char *p = (unsigned char *)data;
+
+  while (length--) {
+    hash ^= *p++;
+    hash *= 0x100000001b3ull;
+  }
+  return hash;
+}
+
+/*
+ * Hash of the bytes of a file, the include module takes it when it maps
+ * the file
+ */
+static unsigned long long cache_hash_file(struct inc_file *file)
+{
+  return file->hash;
+}
+
+/*
+ * Work out the key of the source about to be assembled. Only the source
+ * itself is hashed, the files it includes are checked against the entry.
+ */
+void cache_key(struct asm65_context *ac, struct inc_file *file)
+{
+  struct cache_state *cs = &ac->cache;
+  int options[5] = {CACHE_VERSION, ac->cpu, ac->single_pass, ac->object_mode,
+                    ac->relax};
+  char *build = __DATE__ " " __TIME__;
+  int size = file->sf.size;
+
+  cs->key = cache_hash(0xcbf29ce484222325ull, build, strlen(build));
+  cs->key = cache_hash(cs->key, options, sizeof (options));
+  cs->key = cache_hash(cs->key, &size, sizeof (size));
+  cs->key = cache_hash(cs->key, file->sf.data, file->sf.size);
+  cs->root = file;
+  LOG(ac, LOG_OUTPUT, LOG_DEBUG, "Cache key %016llx\n", cs->key);
+}
+
+static void cache_path(struct cache_state *cs, char *path, char *suffix)
+{
+  snprintf(path, CACHE_PATH_LENGTH, "%s/%016llx%s", cs->dir, cs->key, suffix);
+}
+
+/******************************************************************************
+ *                       Loading
+ *****************************************************************************/
+struct reader {
+  unsigned char *p;
+  unsigned char *end;
+  int error;
+};
+
+static int get_word(struct reader *rd)
+{
+  unsigned char *p = rd->p;
+
+  if (rd->end - p < 4) {
+    rd->error = 1;
+    return 0;
+  }
+  rd->p += 4;
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+static unsigned char *get_bytes(struct reader *rd, int length)
+{
+  unsigned char *p = rd->p;
+
+  if (length < 0 || rd->end - p < length) {
+    rd->error = 1;
+    return NULL;
+  }
+  rd->p += length;
+  return p;
+}
+
+/*
+ * Find the files included by the entry and compare them with it. Each is
+ * included by the source, 0, or by one listed before it. A file included
+ * more than once is only hashed the first time.
+ * Returns 0 if they are unchanged, 1 if not and -1 if the list is corrupt.
+ */
+static int cache_includes(struct asm65_context *ac, struct reader *rd)
+{
+  char name[INC_PATH_LENGTH];
+  struct inc_file **found;
+  unsigned long long *hashes;
+  unsigned char *text;
+  int count;
+  int from;
+  int length;
+  int size;
+  int result = 0;
+  int i;
+  int j;
+
+  count = get_word(rd);
+  /* Every include takes at least 20 bytes */
+  if (rd->error || count < 0 || count > (rd->end - rd->p) / 20)
+    return -1;
+  found = (struct inc_file **)malloc((count + 1) * sizeof (struct inc_file *));
+  hashes = (unsigned long long *)malloc((count + 1) *
+                                        sizeof (unsigned long long));
+  if (!found || !hashes)
+    out_of_memory(ac);
+
+  found[0] = ac->cache.root;
+  for (i = 1; i <= count && !result; i++) {
+    from = get_word(rd);
+    length = get_word(rd);
+    text = get_bytes(rd, length);
+    size = get_word(rd);
+    hashes[i] = (unsigned int)get_word(rd);
+    hashes[i] |= (unsigned long long)(unsigned int)get_word(rd) << 32;
+    if (rd->error || from < 0 || from >= i || length >= INC_PATH_LENGTH) {
+      result = -1;
+      break;
+    }
+    memcpy(name, text, length);
+    name[length] = '\0';
+
+    found[i] = inc_find(ac, name, found[from]);
+    if (!found[i] || found[i]->sf.size != size) {
+      result = 1;
+      break;
+    }
+    for (j = 1; j < i && found[j] != found[i]; j++)
+      ;
+    if (j < i ? hashes[j] != hashes[i] : cache_hash_file(found[i]) != hashes[i])
+      result = 1;
+  }
+  free(found);
+  free(hashes);
+  return result;
+}
+
+/*
+ * Go through the code of an image entry, replaying it into the image
+ * and the symbol table if apply is set. The entry is checked without
+ * applying it first, so a corrupt entry leaves no trace.
+ */
+static int cache_image(struct asm65_context *ac, struct reader *rd,
+                       int apply)
+{
+  struct output_descriptor od;
+  struct symbol_entry *se;
+  unsigned char *name;
+  int count;
+  int address;
+  int value;
+  int i;
+
+  count = get_word(rd);
+  for (i = 0; i < count && !rd->error; i++) {
+    address = get_word(rd);
+    od.length = get_word(rd);
+    od.data = get_bytes(rd, od.length);
+    if (address < 0 || address + od.length > OUTPUT_IMAGE_SIZE)
+      rd->error = 1;
+    if (apply && !rd->error) {
+      ac->PC = address;
+      if (output(ac, &od))
+        rd->error = 1;
+    }
+  }
+
+  count = get_word(rd);
+  for (i = 0; i < count && !rd->error; i++) {
+    value = get_word(rd);
+    od.length = get_word(rd);
+    name = get_bytes(rd, od.length);
+    if (apply && name) {
+      se = sym_new_symbol(ac, sym_intern(ac, (char *)name, od.length));
+      if (se) {
+        se->value = value;
+        se->defined = 1;
+      }
+    }
+  }
+  return rd->error ? -1 : 0;
+}
+
+/*
+ * Keep the object file of an entry, it is written in place of the one
+ * that would have been assembled
+ */
+static int cache_object(struct asm65_context *ac, struct reader *rd)
+{
+  struct cache_state *cs = &ac->cache;
+  unsigned char *data;
+  int length;
+
+  length = get_word(rd);
+  data = get_bytes(rd, length);
+  if (rd->error)
+    return -1;
+  cs->object = (unsigned char *)malloc(length ? length : 1);
+  if (!cs->object)
+    out_of_memory(ac);
+  memcpy(cs->object, data, length);
+  cs->object_length = length;
+  return 0;
+}
+
+/*
+ * Write the object file of a hit.
+ * Returns OK or the error with its message in the context.
+ */
+int cache_write_object(struct asm65_context *ac, char *obj_file_name)
+{
+  struct cache_state *cs = &ac->cache;
+  FILE *file;
+
+  file = fopen(obj_file_name, "wb");
+  if (!file || (fwrite(cs->object, 1, cs->object_length, file) !=
+                (size_t)cs->object_length) | fclose(file))
+    return error_report(ac, "Could not write object file %s", obj_file_name);
+  return OK;
+}
+
+/*
+ * Use the cached result of the source if there is one.
+ * Returns 0 on a hit, with the image and symbols in place or the object
+ * file kept for cache_write_object.
+ */
+int cache_load(struct asm65_context *ac)
+{
+  struct cache_state *cs = &ac->cache;
+  char path[CACHE_PATH_LENGTH];
+  struct reader rd;
+  struct stat st;
+  unsigned char *data;
+  unsigned char *body;
+  int error = -1;
+  int fd;
+
+  cache_path(cs, path, CACHE_EXTENSION);
+  fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    LOG(ac, LOG_OUTPUT, LOG_DEBUG, "Cache miss %s\n", path);
+    return -1;
+  }
+  if (fstat(fd, &st) || st.st_size < 16) {
+    close(fd);
+    return -1;
+  }
+  data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED)
+    return -1;
+
+  rd.p = data;
+  rd.end = data + st.st_size;
+  rd.error = 0;
+  if (!memcmp(get_bytes(&rd, 4), CACHE_MAGIC, 4) &&
+      get_word(&rd) == CACHE_VERSION &&
+      (unsigned int)get_word(&rd) == (unsigned int)cs->key &&
+      (unsigned int)get_word(&rd) == (unsigned int)(cs->key >> 32) &&
+      !(error = cache_includes(ac, &rd))) {
+    error = -1;
+    switch (get_word(&rd)) {
+      case CACHE_IMAGE:
+        if (ac->object_mode)
+          break;
+        body = rd.p;
+        if (!cache_image(ac, &rd, 0)) {
+          rd.p = body;
+          error = cache_image(ac, &rd, 1);
+        }
+        break;
+      case CACHE_OBJECT:
+        if (ac->object_mode)
+          error = cache_object(ac, &rd);
+        break;
+    }
+  }
+  munmap(data, st.st_size);
+
+  if (error > 0) {
+    LOG(ac, LOG_OUTPUT, LOG_DEBUG, "Cache entry %s is out of date\n", path);
+    return -1;
+  }
+  if (error) {
+    LOG(ac, LOG_OUTPUT, LOG_INFO, "Ignoring corrupt cache entry %s\n", path);
+    return -1;
+  }
+  /* Keep it from being evicted for a while */
+  utimes(path, NULL);
+  LOG(ac, LOG_OUTPUT, LOG_INFO, "Using cached result %s\n", path);
+  return 0;
+}
+
+/******************************************************************************
+ *                       Storing
+ *****************************************************************************/
+static void put_bytes(struct asm65_context *ac, void *data, int length)
+{
+  struct cache_state *cs = &ac->cache;
+
+  if (cs->buf_used + length > cs->buf_max) {
+    while (cs->buf_used + length > cs->buf_max)
+      cs->buf_max = cs->buf_max ? cs->buf_max * 2 : 64 * 1024;
+    cs->buf = realloc(cs->buf, cs->buf_max);
+    if (!cs->buf)
+      out_of_memory(ac);
+  }
+  memcpy(cs->buf + cs->buf_used, data, length);
+  cs->buf_used += length;
+}
+
+/*
+ * Overwrite the word at offset, for counts only known afterwards
+ */
+static void set_word(struct asm65_context *ac, int offset, int value)
+{
+  unsigned char *buf = ac->cache.buf;
+
+  buf[offset] = value & 0xff;
+  buf[offset + 1] = (value >> 8) & 0xff;
+  buf[offset + 2] = (value >> 16) & 0xff;
+  buf[offset + 3] = (value >> 24) & 0xff;
+}
+
+static void put_word(struct asm65_context *ac, int value)
+{
+  put_bytes(ac, &value, 4);
+  set_word(ac, ac->cache.buf_used - 4, value);
+}
+
+/*
+ * The written runs of the image and the defined symbols
+ */
+static void put_image(struct asm65_context *ac)
+{
+  struct output_state *os = &ac->output;
+  struct symbol_entry *se;
+  int count = 0;
+  int count_at;
+  int address;
+  int end;
+
+  count_at = ac->cache.buf_used;
+  put_word(ac, 0);
+  for (address = os->low; address <= os->high; address = end) {
+    for (end = address; end <= os->high && output_written(ac, end); end++)
+      ;
+    if (end == address) {
+      end++;
+      continue;
+    }
+    put_word(ac, address);
+    put_word(ac, end - address);
+    put_bytes(ac, &os->image[address], end - address);
+    count++;
+  }
+  set_word(ac, count_at, count);
+
+  count = 0;
+  for (se = ac->sym.se_first; se; se = se->next)
+    if (se->defined)
+      count++;
+  put_word(ac, count);
+  for (se = ac->sym.se_first; se; se = se->next) {
+    if (se->defined) {
+      put_word(ac, se->value);
+      put_word(ac, se->name_length);
+      put_bytes(ac, se->symbol_name, se->name_length);
+    }
+  }
+}
+
+/*
+ * The files included by file and by those it includes, in the order
+ * they are included. from is the number of file in the list.
+ */
+static void put_includes(struct asm65_context *ac, struct inc_file *file,
+                         int from, int *count)
+{
+  char name[INC_PATH_LENGTH];
+  unsigned long long hash;
+  struct inc_file *inc;
+  int i;
+
+  for (i = 0; i < file->num_lines; i++) {
+    inc = file->includes[i];
+    if (!inc)
+      continue;
+    inc_include_name(file, i + 1, name);
+    hash = cache_hash_file(inc);
+    put_word(ac, from);
+    put_word(ac, strlen(name));
+    put_bytes(ac, name, strlen(name));
+    put_word(ac, inc->sf.size);
+    put_word(ac, (unsigned int)hash);
+    put_word(ac, (unsigned int)(hash >> 32));
+    put_includes(ac, inc, ++*count, count);
+  }
+}
+
+/*
+ * The object file just written
+ */
+static int put_object(struct asm65_context *ac, char *obj_file_name)
+{
+  unsigned char chunk[4096];
+  FILE *file;
+  int length_at;
+  int length = 0;
+  size_t n;
+
+  file = fopen(obj_file_name, "rb");
+  if (!file)
+    return -1;
+  length_at = ac->cache.buf_used;
+  put_word(ac, 0);
+  while ((n = fread(chunk, 1, sizeof (chunk), file)) > 0) {
+    put_bytes(ac, chunk, n);
+    length += n;
+  }
+  fclose(file);
+  set_word(ac, length_at, length);
+  return 0;
+}
+
+struct cache_file {
+  char name[CACHE_PATH_LENGTH];
+  time_t used;
+  off_t size;
+};
+
+static int cache_older(const void *a, const void *b)
+{
+  const struct cache_file *fa = a;
+  const struct cache_file *fb = b;
+
+  return (fa->used > fb->used) - (fa->used < fb->used);
+}
+
+/*
+ * Remove the least recently used entries until the directory is below
+ * its limit. The entry just stored is always kept.
+ */
+static void cache_evict(struct asm65_context *ac, char *keep)
+{
+  struct cache_state *cs = &ac->cache;
+  struct cache_file *files = NULL;
+  int num_files = 0;
+  int max_files = 0;
+  struct dirent *de;
+  struct stat st;
+  off_t total = 0;
+  size_t length;
+  DIR *dir;
+  int i;
+
+  dir = opendir(cs->dir);
+  if (!dir)
+    return;
+  while ((de = readdir(dir))) {
+    length = strlen(de->d_name);
+    if (length <= strlen(CACHE_EXTENSION) ||
+        strcmp(de->d_name + length - strlen(CACHE_EXTENSION), CACHE_EXTENSION))
+      continue;
+    if (num_files == max_files) {
+      max_files = max_files ? max_files * 2 : 64;
+      files = realloc(files, max_files * sizeof (struct cache_file));
+      if (!files)
+        out_of_memory(ac);
+    }
+    snprintf(files[num_files].name, CACHE_PATH_LENGTH, "%s/%s", cs->dir,
+             de->d_name);
+    if (stat(files[num_files].name, &st))
+      continue;
+    files[num_files].used = st.st_mtime;
+    files[num_files].size = st.st_size;
+    total += st.st_size;
+    num_files++;
+  }
+  closedir(dir);
+
+  qsort(files, num_files, sizeof (struct cache_file), cache_older);
+  for (i = 0; i < num_files && total > cs->max_size; i++) {
+    if (!strcmp(files[i].name, keep))
+      continue;
+    if (!unlink(files[i].name)) {
+      LOG(ac, LOG_OUTPUT, LOG_DEBUG, "Evicted %s\n", files[i].name);
+      total -= files[i].size;
+    }
+  }
+  free(files);
+}
+
+/*
+ * Store the result of the assembly just done. It is written under a
+ * temporary name and renamed, so other assemblies sharing the directory
+ * never see a partial entry. Failing to store is not an error.
+ */
+void cache_store(struct asm65_context *ac, char *obj_file_name)
+{
+  struct cache_state *cs = &ac->cache;
+  char path[CACHE_PATH_LENGTH];
+  char tmp[CACHE_PATH_LENGTH];
+  char suffix[32];
+  FILE *file;
+  int error = 0;
+  int count = 0;
+  int count_at;
+
+  cs->buf_used = 0;
+  put_bytes(ac, CACHE_MAGIC, 4);
+  put_word(ac, CACHE_VERSION);
+  put_word(ac, (unsigned int)cs->key);
+  put_word(ac, (unsigned int)(cs->key >> 32));
+  count_at = cs->buf_used;
+  put_word(ac, 0);
+  put_includes(ac, cs->root, 0, &count);
+  set_word(ac, count_at, count);
+  if (ac->object_mode) {
+    put_word(ac, CACHE_OBJECT);
+    error = put_object(ac, obj_file_name);
+  } else {
+    put_word(ac, CACHE_IMAGE);
+    put_image(ac);
+  }
+
+  cache_path(cs, path, CACHE_EXTENSION);
+  snprintf(suffix, sizeof (suffix), ".%d.tmp", (int)getpid());
+  cache_path(cs, tmp, suffix);
+  if (!error) {
+    file = fopen(tmp, "wb");
+    error = !file ||
+            (fwrite(cs->buf, 1, cs->buf_used, file) != (size_t)cs->buf_used) |
+            fclose(file) || rename(tmp, path);
+  }
+  if (error) {
+    LOG(ac, LOG_OUTPUT, LOG_INFO, "Could not store %s in the cache\n", path);
+    unlink(tmp);
+  } else {
+    LOG(ac, LOG_OUTPUT, LOG_DEBUG, "Stored %s\n", path);
+    cache_evict(ac, path);
+  }
+  free(cs->buf);
+  cs->buf = NULL;
+  cs->buf_used = cs->buf_max = 0;
+}
+
+/*
+ * Forget the object file of a hit, the directory is kept
+ */
+void cache_clean_up(struct asm65_context *ac)
+{
+  free(ac->cache.object);
+  ac->cache.object = NULL;
+  ac->cache.object_length = 0;
+}
@@ -0,0 +1,54 @@
+/*
+ * On disk cache of assembled sources
+ */
+#ifndef __CACHE_H__
+#define __CACHE_H__
+
+struct inc_file;
+struct asm65_context;
+
+#define CACHE_MAGIC           "A65C"
+#define CACHE_VERSION         2
+#define CACHE_EXTENSION       ".a65c"
+#define CACHE_PATH_LENGTH     512
+
+/*
+ * An entry is named after the hash of the bytes of the source, the CPU
+ * the assembly starts with, the options that change the code and the
+ * assembler build. It lists the files included, in the order they are
+ * included, each as the number of the file including it, the name given
+ * to INCLUDE, its size and the 64 bit hash of its bytes, so the entry
+ * can be checked without lexing them. Then comes the code, either as
+ * the written runs of the image followed by the defined symbols, or as
+ * the bytes of the object file written with -c, which carries the
+ * exported symbols itself. All numbers are stored as 32 bit little
+ * endian words.
+ */
+enum cache_kinds {
+  CACHE_IMAGE,
+  CACHE_OBJECT,
+};
+
+struct cache_state {
+  char *dir;                    /* NULL while there is no cache */
+  long max_size;
+  unsigned long long key;
+  struct inc_file *root;
+  /* Entry being built before it is written in one go */
+  unsigned char *buf;
+  int buf_used;
+  int buf_max;
+  /* Object file of a hit, written in place of the one assembled */
+  unsigned char *object;
+  int object_length;
+};
+
+int cache_set_dir(struct asm65_context *ac, const char *dir, long max_kbytes);
+int cache_open(struct asm65_context *ac);
+void cache_key(struct asm65_context *ac, struct inc_file *file);
+int cache_load(struct asm65_context *ac);
+int cache_write_object(struct asm65_context *ac, char *obj_file_name);
+void cache_store(struct asm65_context *ac, char *obj_file_name);
+void cache_clean_up(struct asm65_context *ac);
+
+#endif // __CACHE_H__
@@ -0,0 +1,87 @@
+/*
+ * The assembly context, everything an assembly works on. Every module
+ * is handed the context and keeps its state in it, so contexts don't
+ * share anything but constant tables. The include path, the output
+ * files, the log and the cache are set up once and kept for every
+ * assembly, like the source files read and the names interned from them.
+ * The rest is set up by asm_init and released by asm_clean_up.
+ */
+#ifndef __CONTEXT_H__
+#define __CONTEXT_H__
+
+#include <setjmp.h>
+
+#include "asm65.h"
+#include "log.h"
+#include "stats.h"
+#include "symbols.h"
+#include "include.h"
+#include "expr.h"
+#include "ir.h"
+#include "fixup.h"
+#include "macro.h"
+#include "sizing.h"
+#include "object.h"
+#include "output.h"
+#include "cache.h"
+#include "listing.h"
+
+struct cpu_models;
+
+struct asm65_context {
+  int flags;                    /* ASM65_ flags */
+
+  /* The assembly in progress */
+  int cpu;
+  const struct cpu_models *cur_cpu;
+  int PC;
+  int line;                     /* Line of cur_file being assembled */
+  struct inc_file *cur_file;
+  struct inc_file *src_root;    /* The file assembled */
+  int pass;
+  int single_pass;
+  int object_mode;
+  int relax;
+  struct expr_context expr_ctx;
+  int num_encoded;              /* IR lines encoded in single pass mode */
+  /* Running out of memory jumps here, exits if NULL */
+  jmp_buf *error_recovery;
+
+  /* State of the modules */
+  struct log_state log;
+  struct stats stats;
+  struct stats_trace trace;
+  struct sym_state sym;
+  struct inc_state inc;
+  struct ir_state ir;
+  struct fixup_state fixup;
+  struct mac_state mac;
+  struct size_state size;
+  struct obj_state obj;
+  struct output_state output;
+  struct cache_state cache;
+  struct lst_state lst;
+
+  /* Files written by asm65_write */
+  char *lst_file_name;
+  char *obj_file_name;          /* NULL for the base name */
+  int cached;                   /* The result came from the cache */
+  int assembled;                /* There is an assembly to clean up */
+
+  /* Result of the last assembly from memory */
+  unsigned char image[ASM65_IMAGE_SIZE];
+  int low;                      /* low > high while nothing is output */
+  int high;
+  struct asm65_symbol *symbols;
+  int num_symbols;
+  char *names;                  /* Text of the symbol names */
+
+  /* The last error */
+  int error;
+  int error_line;               /* 0 if not on a line */
+  char error_file[ASM65_MESSAGE_LENGTH];
+  const char *error_text;
+  char message[ASM65_MESSAGE_LENGTH];
+};
+
+#endif // __CONTEXT_H__
@@ -1,6 +1,12 @@
 /*
  * Handle error messages
  */
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+
+#include "errors.h"
+#include "context.h"
 
 #if 0
  enum error_ids {
@@ -34,5 +40,59 @@ unsigned char *error_msgs[] = {
   "Found unexpected characted",
   "Invalid addressing mode for this opcode",
   "The indirect mode was specified incorrectly",
+  "Trying to address zero page with an address larger than 255",
+  "Expression has too many nested paranthesis",
+  "Expression is too complex",
+  "Branch target is out of range",
+  "Code extends beyond the end of memory",
+  "Code overlaps code already output",
+  "Expression can't be relocated",
+  "Include file name expected",
+  "Include file not found",
+  "File includes itself",
+  "Include files nested too deeply",
+  "Macro name expected",
+  "MACRO without ENDM",
+  "ENDM without MACRO",
+  "Macro defined inside a macro",
+  "Macro expands itself",
+  "Too many macro arguments",
+  "Division by zero",
+  "Result of the division is too large",
+  "Trying to address an absolute address larger than $FFFF",
+  "Trying to address a long address larger than $FFFFFF",
+  "Trying to move a block in a bank larger than 255",
+  "Out of memory",
+  "Could not access a file",
 };
 
+/*
+ * Give up when memory runs out. An embedded assembly is abandoned and
+ * returns OUT_OF_MEMORY, otherwise the process terminates.
+ */
+void out_of_memory(struct asm65_context *ac)
+{
+  if (ac->error_recovery)
+    longjmp(*ac->error_recovery, 1);
+  printf("Could not allocate necessary memory, terminating !\n");
+  exit(1);
+}
+
+/*
+ * Keep the message of a failure that isn't on a line of the source, like
+ * a file that can't be written, for the caller to report.
+ * Returns FILE_ACCESS_FAILED.
+ */
+int error_report(struct asm65_context *ac, const char *fmt, ...)
+{
+  va_list ap;
+
+  va_start(ap, fmt);
+  vsnprintf(ac->message, sizeof (ac->message), fmt, ap);
+  va_end(ap);
+  ac->error = FILE_ACCESS_FAILED;
+  ac->error_line = 0;
+  ac->error_file[0] = '\0';
+  ac->error_text = ac->message;
+  return FILE_ACCESS_FAILED;
+}
@@ -12,7 +12,37 @@ enum error_ids {
   ASM_UNEXPECTED_CHARACTER,
   ASM_INVALID_ADDRESSING_MODE,
   ASM_INDIRECT_MODE_INVALID,
+  ASM_ADDR_ZEROPAGE_TO_BIG,
+  EXPR_NESTING_TOO_DEEP,
+  EXPR_TOO_COMPLEX,
+  ASM_BRANCH_OUT_OF_RANGE,
+  OUTPUT_OUT_OF_RANGE,
+  OUTPUT_OVERLAP,
+  OBJECT_NOT_RELOCATABLE,
+  INCLUDE_NAME_EXPECTED,
+  INCLUDE_NOT_FOUND,
+  INCLUDE_RECURSIVE,
+  INCLUDE_NESTED_TOO_DEEP,
+  MACRO_NAME_EXPECTED,
+  MACRO_WITHOUT_ENDM,
+  MACRO_ENDM_WITHOUT_MACRO,
+  MACRO_NESTED,
+  MACRO_RECURSIVE,
+  MACRO_TOO_MANY_ARGUMENTS,
+  EXPR_DIVISION_BY_ZERO,
+  EXPR_DIVISION_OVERFLOW,
+  ASM_ADDR_ABSOLUTE_TO_BIG,
+  ASM_ADDR_LONG_TO_BIG,
+  ASM_ADDR_BANK_TO_BIG,
+  OUT_OF_MEMORY,
+  FILE_ACCESS_FAILED,
 };
 
 extern unsigned char *error_msgs[];
 
+struct asm65_context;
+
+void out_of_memory(struct asm65_context *ac) __attribute__ ((noreturn));
+int error_report(struct asm65_context *ac, const char *fmt, ...)
+  __attribute__ ((format (printf, 2, 3)));
+
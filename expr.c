@@ -6,37 +6,32 @@
 #include <string.h>
 #include <ctype.h>
 #include <errno.h>
+#include <limits.h>
 
 #include "global.h"
 #include "expr.h"
+#include "lexer.h"
 #include "utils.h"
 #include "symbols.h"
 #include "errors.h"
-
-#define DEBUG_EXPR
-#ifdef DEBUG_EXPR
-#define DBG(x) x
-#else
-#define DBG(x)
-#endif
-
-#define MAXOPSTACK 256
-#define MAXNUMSTACK 256
-
-int eval_not(int a1, int a2);
-int eval_inv(int a1, int a2);
-int eval_mul(int a1, int a2);
-int eval_div(int a1, int a2);
-int eval_mod(int a1, int a2);
-int eval_add(int a1, int a2);
-int eval_sub(int a1, int a2);
-int eval_shift_up(int a1, int a2);
-int eval_shift_dn(int a1, int a2);
-int eval_and(int a1, int a2);
-int eval_exp(int a1, int a2);
-int eval_or(int a1, int a2);
-int eval_xor(int a1, int a2);
-int eval_comma(int a1, int a2);
+#include "object.h"
+#include "context.h"
+
+int eval_not(struct asm65_context *ac, int a1, int a2);
+int eval_inv(struct asm65_context *ac, int a1, int a2);
+int eval_mul(struct asm65_context *ac, int a1, int a2);
+int eval_div(struct asm65_context *ac, int a1, int a2);
+int eval_mod(struct asm65_context *ac, int a1, int a2);
+int eval_add(struct asm65_context *ac, int a1, int a2);
+int eval_sub(struct asm65_context *ac, int a1, int a2);
+int eval_shift_up(struct asm65_context *ac, int a1, int a2);
+int eval_shift_dn(struct asm65_context *ac, int a1, int a2);
+int eval_and(struct asm65_context *ac, int a1, int a2);
+int eval_exp(struct asm65_context *ac, int a1, int a2);
+int eval_or(struct asm65_context *ac, int a1, int a2);
+int eval_xor(struct asm65_context *ac, int a1, int a2);
+int eval_neg(struct asm65_context *ac, int a1, int a2);
+int eval_banks(struct asm65_context *ac, int a1, int a2);
 
 enum {
   ASSOC_NONE=0, 
@@ -50,487 +45,977 @@ struct op_s {
   int assoc;
   int level;
   int unary;
-  int (*eval)(int a1, int a2);
-};
-
-enum op_ids {
-  OP_NOT_USED,
-  OP_PARANTHESIS_OPEN,
-  OP_PARANTHESIS_CLOSE,
-  OP_COMMA,
-  OP_NOT,
-  OP_INV,
-  OP_MUL,
-  OP_DIV,
-  OP_MOD,
-  OP_ADD,
-  OP_SUB,
-  OP_SHIFT_UP,
-  OP_SHIFT_DOWN,
-  OP_AND,
-  OP_EXP,
-  OP_OR,
-  OP_XOR
+  int (*eval)(struct asm65_context *ac, int a1, int a2);
 };
 
 struct op_s ops[] = {
-  { "(", OP_PARANTHESIS_OPEN,  ASSOC_NONE, 20, 0, NULL },
-  { ")", OP_PARANTHESIS_CLOSE, ASSOC_NONE, 20, 0, NULL },
-  { ",", OP_COMMA,             ASSOC_LEFT,  1, 0, eval_comma },
-  { "!", OP_NOT,               ASSOC_RIGHT, 2, 1, eval_not },
-  { "~", OP_INV,               ASSOC_RIGHT, 2, 1, eval_inv },
-  { "*", OP_MUL,               ASSOC_LEFT,  3, 0, eval_mul },
-  { "/", OP_DIV,               ASSOC_LEFT,  3, 0, eval_div },
-  { "%", OP_MOD,               ASSOC_LEFT,  3, 0, eval_mod },
-  { "+", OP_ADD,               ASSOC_LEFT,  4, 0, eval_add },
-  { "-", OP_SUB,               ASSOC_LEFT,  4, 0, eval_sub },
-  { "<<", OP_SHIFT_UP,         ASSOC_LEFT,  5, 0, eval_shift_up },
-  { ">>", OP_SHIFT_DOWN,       ASSOC_LEFT,  6, 0, eval_shift_dn },
-  { "&", OP_AND,               ASSOC_LEFT,  8, 0, eval_and },
-  { "^", OP_EXP,               ASSOC_LEFT,  9, 0, eval_exp },
-  { "|", OP_OR,                ASSOC_LEFT, 10, 0, eval_or },
-  { ":", OP_XOR,               ASSOC_LEFT, 11, 0, eval_xor },
-  { "", 0 }
+  [OP_PARANTHESIS_OPEN]  = { "(", OP_PARANTHESIS_OPEN,  ASSOC_NONE, 20, 0, NULL },
+  [OP_PARANTHESIS_CLOSE] = { ")", OP_PARANTHESIS_CLOSE, ASSOC_NONE, 20, 0, NULL },
+  [OP_NOT]               = { "!", OP_NOT,               ASSOC_RIGHT, 2, 1, eval_not },
+  [OP_INV]               = { "~", OP_INV,               ASSOC_RIGHT, 2, 1, eval_inv },
+  [OP_MUL]               = { "*", OP_MUL,               ASSOC_LEFT,  3, 0, eval_mul },
+  [OP_DIV]               = { "/", OP_DIV,               ASSOC_LEFT,  3, 0, eval_div },
+  [OP_MOD]               = { "%", OP_MOD,               ASSOC_LEFT,  3, 0, eval_mod },
+  [OP_ADD]               = { "+", OP_ADD,               ASSOC_LEFT,  4, 0, eval_add },
+  [OP_SUB]               = { "-", OP_SUB,               ASSOC_LEFT,  4, 0, eval_sub },
+  [OP_SHIFT_UP]          = { "<<", OP_SHIFT_UP,         ASSOC_LEFT,  5, 0, eval_shift_up },
+  [OP_SHIFT_DOWN]        = { ">>", OP_SHIFT_DOWN,       ASSOC_LEFT,  6, 0, eval_shift_dn },
+  [OP_AND]               = { "&", OP_AND,               ASSOC_LEFT,  8, 0, eval_and },
+  [OP_EXP]               = { "^", OP_EXP,               ASSOC_LEFT,  9, 0, eval_exp },
+  [OP_OR]                = { "|", OP_OR,                ASSOC_LEFT, 10, 0, eval_or },
+  [OP_XOR]               = { ":", OP_XOR,               ASSOC_LEFT, 11, 0, eval_xor },
+  /* Unary minus, a - where an operand is expected */
+  [OP_NEG]               = { "-", OP_NEG,               ASSOC_RIGHT, 2, 1, eval_neg },
+  /* The src,dst banks of a block move, only emitted by compile_operand */
+  [OP_BANKS]             = { "", OP_BANKS,              ASSOC_LEFT,  0, 0, eval_banks },
+  [OP_NUM_OPS]           = { "", 0 }
 };
 
-struct op_s *opstack[MAXOPSTACK];
-int nopstack=0;
-
-int numstack[MAXNUMSTACK];
-int nnumstack=0;
+/*
+ * Operators by their first character. The two character operators
+ * also need their second character to match.
+ */
+static const unsigned char op_dispatch[256] = {
+  ['('] = OP_PARANTHESIS_OPEN,
+  [')'] = OP_PARANTHESIS_CLOSE,
+  ['!'] = OP_NOT,
+  ['~'] = OP_INV,
+  ['*'] = OP_MUL,
+  ['/'] = OP_DIV,
+  ['%'] = OP_MOD,
+  ['+'] = OP_ADD,
+  ['-'] = OP_SUB,
+  ['<'] = OP_SHIFT_UP,
+  ['>'] = OP_SHIFT_DOWN,
+  ['&'] = OP_AND,
+  ['^'] = OP_EXP,
+  ['|'] = OP_OR,
+  [':'] = OP_XOR,
+};
 
 /*
  * Helper functions for evaluating expressions
  */
-int eval_not(int a1, int a2)
+int eval_not(struct asm65_context *ac, int a1, int a2)
 {
-  DBG(printf ("!%d = %d\n", a1, !a1));
+  LOG(ac, LOG_EXPR, LOG_TRACE, "!%d = %d\n", a1, !a1);
 	return !a1;
 }
 
-int eval_inv(int a1, int a2)
+int eval_inv(struct asm65_context *ac, int a1, int a2)
 {
-  DBG(printf ("~%d = %d\n", a1, ~a1));
+  LOG(ac, LOG_EXPR, LOG_TRACE, "~%d = %d\n", a1, ~a1);
 	return ~a1;
 }
 
-int eval_mul(int a1, int a2)
+int eval_mul(struct asm65_context *ac, int a1, int a2)
 {
-  DBG(printf ("%d * %d = %d\n", a1, a2, a1 * a2));
+  LOG(ac, LOG_EXPR, LOG_TRACE, "%d * %d = %d\n", a1, a2, a1 * a2);
 	return a1*a2;
 }
 
-int eval_div(int a1, int a2)
+/* The operands of eval_div and eval_mod were checked with div_error() */
+int eval_div(struct asm65_context *ac, int a1, int a2)
 {
-	if(!a2) {
-		fprintf(stderr, "ERROR: Division by zero\n");
-		exit(EXIT_FAILURE);
-	}
-  DBG(printf ("%d / %d = %d\n", a1, a2, a1 / a2));
+  LOG(ac, LOG_EXPR, LOG_TRACE, "%d / %d = %d\n", a1, a2, a1 / a2);
 	return a1 / a2;
 }
 
-int eval_mod(int a1, int a2)
+int eval_mod(struct asm65_context *ac, int a1, int a2)
 {
-	if(!a2) {
-		fprintf(stderr, "ERROR: Division by zero\n");
-		exit(EXIT_FAILURE);
-	}
 	return a1 % a2;
 }
 
-int eval_add(int a1, int a2)
+int eval_add(struct asm65_context *ac, int a1, int a2)
 {
-  DBG(printf ("%d + %d = %d\n", a1, a2, a1 + a2));
+  LOG(ac, LOG_EXPR, LOG_TRACE, "%d + %d = %d\n", a1, a2, a1 + a2);
 	return a1 + a2;
 }
 
-int eval_sub(int a1, int a2)
+int eval_sub(struct asm65_context *ac, int a1, int a2)
 {
-  DBG(printf ("%d - %d = %d\n", a1, a2, a1 - a2));
+  LOG(ac, LOG_EXPR, LOG_TRACE, "%d - %d = %d\n", a1, a2, a1 - a2);
 	return a1 - a2;
 }
 
-int eval_shift_up(int a1, int a2)
+/* A count outside 0 to 31 shifts every bit out */
+int eval_shift_up(struct asm65_context *ac, int a1, int a2)
 {
-  DBG(printf ("%d << %d = %d\n", a1, a2, a1 << a2));
-	return a1 << a2;
+	int value = a2 < 0 || a2 > 31 ? 0 : (int)((unsigned int)a1 << a2);
+
+  LOG(ac, LOG_EXPR, LOG_TRACE, "%d << %d = %d\n", a1, a2, value);
+	return value;
 }
 
-int eval_shift_dn(int a1, int a2)
+int eval_shift_dn(struct asm65_context *ac, int a1, int a2)
 {
-  DBG(printf ("%d >> %d = %d\n", a1, a2, a1 >> a2));
-	return a1 >> a2;
+	int value = a2 < 0 || a2 > 31 ? (a1 < 0 ? -1 : 0) : a1 >> a2;
+
+  LOG(ac, LOG_EXPR, LOG_TRACE, "%d >> %d = %d\n", a1, a2, value);
+	return value;
 }
 
-int eval_and(int a1, int a2)
+int eval_and(struct asm65_context *ac, int a1, int a2)
 {
-  DBG(printf ("%d & %d = %d\n", a1, a2, a1 & a2));
+  LOG(ac, LOG_EXPR, LOG_TRACE, "%d & %d = %d\n", a1, a2, a1 & a2);
 	return a1 & a2;
 }
 
-int eval_exp(int a1, int a2)
+/* Square and multiply, a negative exponent gives 0 */
+int eval_exp(struct asm65_context *ac, int a1, int a2)
 {
-	return a2 < 0 ? 0 : (a2 == 0 ? 1 : a1 * eval_exp(a1, a2 - 1));
+	unsigned int base = a1;
+	unsigned int value = 1;
+
+	if (a2 < 0)
+		return 0;
+	for (; a2; a2 >>= 1) {
+		if (a2 & 1)
+			value *= base;
+		base *= base;
+	}
+	return (int)value;
 }
 
-int eval_or(int a1, int a2)
+int eval_or(struct asm65_context *ac, int a1, int a2)
 {
-  DBG(printf ("%d | %d = %d\n", a1, a2, a1 | a2));
+  LOG(ac, LOG_EXPR, LOG_TRACE, "%d | %d = %d\n", a1, a2, a1 | a2);
 	return a1 | a2;
 }
 
-int eval_xor(int a1, int a2)
+int eval_xor(struct asm65_context *ac, int a1, int a2)
 {
-  DBG(printf ("%d ^ %d = %d\n", a1, a2, a1 ^ a2));
+  LOG(ac, LOG_EXPR, LOG_TRACE, "%d ^ %d = %d\n", a1, a2, a1 ^ a2);
 	return a1 ^ a2;
 }
 
-int eval_comma(int a1, int a2)
+int eval_neg(struct asm65_context *ac, int a1, int a2)
 {
-  DBG(printf ("%d = %d\n", a1, a1));
-	return a1;
+  LOG(ac, LOG_EXPR, LOG_TRACE, "-%d = %d\n", a1, -a1);
+	return -a1;
 }
 
-void push_opstack(struct op_s *op)
+/* dst | src << 8, or -1 if a bank isn't a byte */
+int eval_banks(struct asm65_context *ac, int a1, int a2)
 {
-  DBG(printf ("PSH: %s\n", op->operator));
-	if(nopstack>MAXOPSTACK-1) {
-		fprintf(stderr, "ERROR: Push Operator stack overflow\n");
-		exit(EXIT_FAILURE);
-	}
-	opstack[nopstack++]=op;
+	if (a1 < 0 || a1 > 255 || a2 < 0 || a2 > 255)
+		return -1;
+	return a2 | a1 << 8;
 }
 
-struct op_s *pop_opstack(void)
+/*
+ * Check the operands of a division or a modulo, the divisor can't be 0
+ * and the quotient of the smallest int by -1 doesn't fit in an int
+ */
+static int div_error(int op, int a1, int a2)
 {
-  DBG(printf ("POP: %s\n", opstack[nopstack-1]->operator));
-	if(!nopstack) {
-		fprintf(stderr, "ERROR: Pop Operator stack empty\n");
-		exit(EXIT_FAILURE);
-	}
-	return opstack[--nopstack];
+  if (op != OP_DIV && op != OP_MOD)
+    return OK;
+  if (!a2)
+    return EXPR_DIVISION_BY_ZERO;
+  if (a1 == INT_MIN && a2 == -1)
+    return EXPR_DIVISION_OVERFLOW;
+  return OK;
 }
 
-struct op_s *peek_opstack(void)
+/*
+ * Check for an operator token
+ */
+static int is_op(struct token *tok, int op_id)
 {
-	if(!nopstack) {
-		fprintf(stderr, "ERROR: Peek Operator stack empty\n");
-		exit(EXIT_FAILURE);
-	}
-	return opstack[nopstack-1];
+  return tok->kind == TK_OPERATOR && tok->value == op_id;
 }
 
-void push_numstack(int num)
+/*
+ * Initialize the expression compiler of the context
+ */
+void expr_init(struct asm65_context *ac)
 {
-  DBG(printf("PSH: %d\n", num));
-	if(nnumstack>MAXNUMSTACK-1) {
-		fprintf(stderr, "ERROR: Number stack overflow\n");
-		exit(EXIT_FAILURE);
-	}
-	numstack[nnumstack++]=num;
+  memset(&ac->expr_ctx, 0, sizeof (struct expr_context));
 }
 
-int pop_numstack()
+/*
+ * Release the code buffer of the expression compiler
+ */
+void expr_free(struct asm65_context *ac)
 {
-  DBG(printf ("POP: %d\n", numstack[nnumstack-1]));
-	if(!nnumstack) {
-		fprintf(stderr, "ERROR: Number stack empty\n");
-		exit(EXIT_FAILURE);
-	}
-	return numstack[--nnumstack];
+  free(ac->expr_ctx.code);
+  expr_init(ac);
+}
+
+static int push_op(struct asm65_context *ac, int op_id)
+{
+  struct expr_context *ctx = &ac->expr_ctx;
+
+  LOG(ac, LOG_EXPR, LOG_TRACE, "PSH: %s\n", ops[op_id].operator);
+  if (ctx->nops == EXPR_MAX_STACK)
+    return EXPR_TOO_COMPLEX;
+  ctx->ops[ctx->nops++] = op_id;
+  return OK;
+}
+
+static int push_operand(struct asm65_context *ac, int constant, int value,
+                        int start)
+{
+  struct expr_context *ctx = &ac->expr_ctx;
+
+  LOG(ac, LOG_EXPR, LOG_TRACE, "PSH: %d%s\n", value,
+      constant ? "" : " (run time)");
+  if (ctx->nnums == EXPR_MAX_STACK)
+    return EXPR_TOO_COMPLEX;
+  ctx->nums[ctx->nnums].constant = constant;
+  ctx->nums[ctx->nnums].value = value;
+  ctx->nums[ctx->nnums++].start = start;
+  return OK;
 }
 
 /*
- * Check if the next section is a valid operator
+ * Add a word at the end of the code
  */
-int is_operator(char *buf, struct op_s **p_ret)
+static union expr_code *emit(struct asm65_context *ac)
 {
-  char operator[5];
-  struct op_s *op = ops;
-  
-  memset(operator, 0, sizeof operator);
-  getarg(operator, buf);
-  /* Look for the operator */
-  while (op->level) {
-    if (!strncmp(buf, op->operator, strlen(op->operator))) {
-      *p_ret = op;
-      return 1;
-    }
-    op++;
+  struct expr_context *ctx = &ac->expr_ctx;
+
+  if (ctx->code->length == ctx->max_code) {
+    ctx->max_code *= 2;
+    ctx->code = (struct expr *)realloc(ctx->code, sizeof (struct expr) +
+                                       ctx->max_code * sizeof (union expr_code));
+    if (!ctx->code)
+      out_of_memory(ac);
   }
-  /* No valid operator found */
-  return 0;
+  return &ctx->code->code[ctx->code->length++];
 }
 
-void doop(struct op_s *p)
+/*
+ * Check if the next section is a valid operator.
+ * Returns the operator id and its length, or 0 if it isn't an operator.
+ */
+int is_operator(char *buf, int *length)
 {
-  int a1, a2, r;
-  struct op_s *op_se;
-  
-  /* Peek at the current top entry of the opstack */
-  op_se = peek_opstack();
-  if (p->assoc == ASSOC_LEFT) {
-    while (nopstack && (p->level > op_se->level)){
-      op_se = pop_opstack();
-      a2 = pop_numstack();
-      if (op_se->unary) {
-        r = op_se->eval(a2, 0);
-      } else {
-        a1 = pop_numstack();
-        r = op_se->eval(a1, a2);
-      }
-      push_numstack(r);
-      op_se = peek_opstack();
-    }
+  int op_id = op_dispatch[(unsigned char)*buf];
+
+  if (!op_id)
+    return 0;
+  if (ops[op_id].operator[1]) {
+    if (buf[1] != ops[op_id].operator[1])
+      return 0;
+    *length = 2;
   } else {
-    while (nopstack && (p->level >= op_se->level)){
-      op_se = pop_opstack();
-      a2 = pop_numstack();
-      if (op_se->unary) {
-        r = op_se->eval(a2, 0);
-      } else {
-        a1 = pop_numstack();
-        r = op_se->eval(a1, a2);
-      }
-      push_numstack(r);
-      op_se = peek_opstack();
-    }
+    *length = 1;
   }
-  push_opstack(p);
+  return op_id;
 }
 
 /*
- * Evaluate an expression
- * Based on the Shunting Yard algorithm.
- * More information can be found here: http://en.literateprograms.org/Shunting_yard_algorithm_(C)
- * Source Example: http://en.literateprograms.org/index.php?title=Special:DownloadCode/Shunting_yard_algorithm_(C)&oldid=18970
+ * Apply the operator on top of the operator stack to the operands
+ * on top of the number stack. When the operands are all constants the
+ * operator is evaluated right away and their code is replaced by the
+ * result, otherwise the operator is emitted.
+ * Popping at least one operand leaves room for the result.
  */
-int eval_expr(char *buf, char **outptr, int *value, int op_expected, int *reg)
-{
-  struct op_s *p;
-  int base = 10;
-  int pos = 0;
-  int level = 0;
-  int tmp;
-  int j;
-  int a1, a2, r;
+static void reduce(struct asm65_context *ac)
+{
+  struct expr_context *ctx = &ac->expr_ctx;
   struct op_s *op_se;
-  int op_e = 0;
-
-  buf = skip_white(buf);
-  DBG(printf ("1:%c\n", *buf));
-  /* First check if we are looking at a symbol */
-  if (!op_expected && isalpha(*buf)) {
-    struct built_in_symbol *bis;
-    struct symbol_entry *se = sym_look_for_symbol(buf, &buf);
-    if (se) {
-      push_numstack(se->value);
-    } else {
-      /* Check if it is a built in SYMBOL */
-      bis = check_built_in_symbol(buf, &buf); 
-      if (!bis)
-        return SYMBOL_NOT_FOUND;
-      else {
-        push_numstack(bis->getvalue());
-        if (reg)
-          *reg = bis->getvalue();
-      }
+  struct expr_operand a1, a2;
+
+  op_se = &ops[ctx->ops[--ctx->nops]];
+  a2 = ctx->nums[--ctx->nnums];
+  if (op_se->unary) {
+    a1 = a2;
+  } else {
+    a1 = ctx->nums[--ctx->nnums];
+    a1.constant = a1.constant && a2.constant;
+  }
+
+  /* A division that can't be done is left to fail when it is run */
+  if (a1.constant && !op_se->unary &&
+      div_error(op_se->op_id, a1.value, a2.value))
+    a1.constant = 0;
+
+  if (a1.constant) {
+    a1.value = op_se->unary ? op_se->eval(ac, a2.value, 0) :
+                              op_se->eval(ac, a1.value, a2.value);
+    ctx->code->length = a1.start;
+    emit(ac)->op = EC_CONST;
+    emit(ac)->value = a1.value;
+  } else {
+    emit(ac)->op = op_se->op_id;
+  }
+  push_operand(ac, a1.constant, a1.value, a1.start);
+}
+
+/*
+ * Check if the operator on top of the stack is to be applied before op
+ * is pushed. An open paranthesis is never applied here.
+ */
+static int binds_tighter(struct asm65_context *ac, struct op_s *op)
+{
+  struct expr_context *ctx = &ac->expr_ctx;
+  struct op_s *top = &ops[ctx->ops[ctx->nops - 1]];
+
+  return top->level < op->level ||
+         (top->level == op->level && op->assoc == ASSOC_LEFT);
+}
+
+/*
+ * Compile the expression starting at tok to postfix code in ctx->code.
+ * Precedence climbing with explicit stacks: operands are emitted as they
+ * are read, and an operator waits on the stack until one binding less
+ * tight, a closing paranthesis or the end of the expression comes along.
+ * Symbols are compiled as references, they are looked up when the code
+ * is run since their values may change between the passes.
+ * The code is added at the end of ctx->code.
+ */
+static int compile(struct asm65_context *ac, struct token *tok,
+                   struct token **outtok)
+{
+  struct expr_context *ctx = &ac->expr_ctx;
+  struct built_in_symbol *bis;
+  struct op_s *op;
+  int depth = 0;
+  int op_id;
+  int start;
+  int error;
+
+  ctx->nops = 0;
+  ctx->nnums = 0;
+
+  for (;;) {
+    /* Prefix operators and open paranthesis come before an operand */
+    while (tok->kind == TK_OPERATOR && tok->value != OP_MUL) {
+      op_id = tok->value;
+      tok++;
+      if (op_id == OP_ADD)
+        continue;
+      if (op_id == OP_SUB)
+        op_id = OP_NEG;
+      else if (op_id == OP_PARANTHESIS_OPEN && ++depth > EXPR_MAX_DEPTH)
+        return EXPR_NESTING_TOO_DEEP;
+      else if (op_id != OP_PARANTHESIS_OPEN && !ops[op_id].unary)
+        return ASM_UNEXPECTED_CHARACTER;
+      error = push_op(ac, op_id);
+      if (error)
+        return error;
     }
-    printf("!!%c\n", *buf);
-  } else if (!op_expected && (isdigit(*buf) ||
-      *buf == '-' ||
-      *buf == '+' ||
-      *buf == '$' ||
-      *buf == '%' ||
-      *buf == '&')) {
-    if (*buf == '+' || *buf == '-') {
-      if (!isdigit(*(buf+1)))
+
+    /* The operand itself */
+    LOG(ac, LOG_EXPR, LOG_TRACE, "1:%.*s\n", tok->length, tok->text);
+    start = ctx->code->length;
+    switch (tok->kind) {
+      case TK_NUMBER:
+        emit(ac)->op = EC_CONST;
+        emit(ac)->value = tok->value;
+        error = push_operand(ac, 1, tok->value, start);
+        break;
+
+      case TK_IDENT:
+        bis = tok->sym->builtin;
+        if (bis && bis->id == BUILT_IN_PC && !tok->sym->symbol) {
+          emit(ac)->op = EC_PC;
+        } else {
+          emit(ac)->op = EC_SYMBOL;
+          emit(ac)->sym = tok->sym;
+        }
+        error = push_operand(ac, 0, 0, start);
+        break;
+
+      case TK_OPERATOR:
+        /* * in place of an operand is the current PC */
+        emit(ac)->op = EC_PC;
+        error = push_operand(ac, 0, 0, start);
+        break;
+
+      case TK_INVALID:
         return NOT_A_VALID_NUMBER;
+
+      default:
+        return ASM_UNEXPECTED_CHARACTER;
     }
-    /* it's a number, read it */
-    if (*buf == '$') {
-      base = 16;
-      buf++;
-      if (!isxdigit(*buf))
-        return NOT_A_VALID_NUMBER;      
-    } else if (*buf == '%') {
-      base = 2;
-      buf++;
-      if (!isdigit(*buf))
-        return NOT_A_VALID_NUMBER;            
-    } else if (*buf == '&') {
-      base = 8;
-      buf++;
-      if (!isdigit(*buf))
-        return NOT_A_VALID_NUMBER;            
+    if (error)
+      return error;
+    tok++;
+
+    /* Close paranthesis, an unmatched one ends the expression */
+    while (depth && is_op(tok, OP_PARANTHESIS_CLOSE)) {
+      LOG(ac, LOG_EXPR, LOG_TRACE, "PAR: Close found.\n");
+      while (ctx->ops[ctx->nops - 1] != OP_PARANTHESIS_OPEN)
+        reduce(ac);
+      ctx->nops--;
+      depth--;
+      tok++;
     }
-    errno = 0;
-    *value = strtoul(buf, &buf, base);
-    if (errno)
-      return NOT_A_VALID_NUMBER;
-      
-    push_numstack(*value);
+
+    /* A binary operator continues the expression, anything else ends it */
+    if (tok->kind != TK_OPERATOR || tok->value == OP_PARANTHESIS_OPEN ||
+        tok->value == OP_PARANTHESIS_CLOSE || ops[tok->value].unary)
+      break;
+    op = &ops[tok->value];
+    LOG(ac, LOG_EXPR, LOG_TRACE, "CUR: %s, level %d\n", op->operator,
+        op->level);
+    while (ctx->nops && binds_tighter(ac, op))
+      reduce(ac);
+    error = push_op(ac, op->op_id);
+    if (error)
+      return error;
+    tok++;
   }
-  
-  /* Make it to the next section */
-  buf=skip_white(buf);
-  DBG(printf ("2:%c - 0x%x\n", *buf, *buf));
-  
-  /* Check for a valid operator */
-  if (is_operator(buf, &p)) {
-    DBG(printf("CUR: %s, level %d\n", p->operator, p->level));
-    /* yes it was a valid operator */
-    /* Peek on the top stack operator (if any) */
-    if (nopstack) {
-      op_se = peek_opstack();
-      DBG(printf("PEK: %s, level %d\n", op_se->operator, op_se->level));
-    }
-    
-    if (p->op_id == OP_PARANTHESIS_OPEN) {
-      push_opstack(p);
-    } else if (p->op_id == OP_PARANTHESIS_CLOSE) {
-      DBG(printf("PAR: Close found.\n"));
-      op_e = 1;
-      while (nopstack && (peek_opstack()->op_id != OP_PARANTHESIS_OPEN)) {
-        op_se = peek_opstack();
-        if (p->assoc == ASSOC_LEFT) {
-          while (nopstack && (p->level > op_se->level)){
-            op_se = pop_opstack();
-            a2 = pop_numstack();
-            if (op_se->unary) {
-              r = op_se->eval(a2, 0);
-            } else {
-              a1 = pop_numstack();
-              r = op_se->eval(a1, a2);
-            }
-            push_numstack(r);
-            op_se = peek_opstack();
-          }
-        } else {
-          while (nopstack && (p->level >= op_se->level)){
-            op_se = pop_opstack();
-            a2 = pop_numstack();
-            if (op_se->unary) {
-              r = op_se->eval(a2, 0);
-            } else {
-              a1 = pop_numstack();
-              r = op_se->eval(a1, a2);
-            }
-            push_numstack(r);
-            op_se = peek_opstack();
-          }
+
+  if (depth)
+    return PARANTHESIS_MISSMATCH;
+  LOG(ac, LOG_EXPR, LOG_TRACE, "1: nops = %d, nnums = %d\n", ctx->nops,
+      ctx->nnums);
+  while (ctx->nops)
+    reduce(ac);
+  if (outtok)
+    *outtok = tok;
+  return OK;
+}
+
+/*
+ * Compile the expression starting at tok to postfix code in ctx->code.
+ * On success outtok is set to the first token after the expression, the
+ * code is valid until the next expression is compiled with ctx.
+ */
+int expr_compile(struct asm65_context *ac, struct token *tok,
+                 struct token **outtok)
+{
+  struct expr_context *ctx = &ac->expr_ctx;
+
+  if (!ctx->code) {
+    ctx->max_code = 64;
+    ctx->code = (struct expr *)malloc(sizeof (struct expr) +
+                                      ctx->max_code * sizeof (union expr_code));
+    if (!ctx->code)
+      out_of_memory(ac);
+  }
+  ctx->code->length = 0;
+  ac->stats.expr_compiles++;
+  return compile(ac, tok, outtok);
+}
+
+/*
+ * Run compiled expression code.
+ * The code was checked when it was compiled so the stack can neither
+ * overflow nor run empty. Returns SYMBOL_NOT_FOUND if a symbol in the
+ * expression has no value yet, EXPR_DIVISION_BY_ZERO if a divisor is 0
+ * or EXPR_DIVISION_OVERFLOW if the quotient doesn't fit.
+ */
+int expr_run(struct asm65_context *ac, struct expr *expr, int *value)
+{
+  union expr_code *pc = expr->code;
+  union expr_code *end = expr->code + expr->length;
+  struct symbol_entry *se;
+  int stack[EXPR_MAX_STACK];
+  int sp = 0;
+  struct op_s *op;
+  int error;
+
+  ac->stats.expr_runs++;
+  while (pc < end) {
+    switch (pc->op) {
+      case EC_CONST:
+        stack[sp++] = pc[1].value;
+        pc += 2;
+        break;
+
+      case EC_SYMBOL:
+        se = pc[1].sym->symbol;
+        if (!se || !se->defined)
+          return SYMBOL_NOT_FOUND;
+        stack[sp++] = se->value;
+        pc += 2;
+        break;
+
+      case EC_PC:
+        stack[sp++] = ac->PC;
+        pc++;
+        break;
+
+      default:
+        op = &ops[pc->op];
+        if (op->unary)
+          stack[sp - 1] = op->eval(ac, stack[sp - 1], 0);
+        else {
+          error = div_error(pc->op, stack[sp - 2], stack[sp - 1]);
+          if (error)
+            return error;
+          sp--;
+          stack[sp - 1] = op->eval(ac, stack[sp - 1], stack[sp]);
         }
-        push_opstack(p);
+        pc++;
+        break;
+    }
+  }
+  *value = stack[0];
+  LOG(ac, LOG_EXPR, LOG_TRACE, "Result = %d\n", *value);
+  return OK;
+}
+
+#define IS_RELOC(r)   ((r)->section >= 0 || (r)->import)
+
+/*
+ * Find what the result of a binary operator is relative to, the value
+ * itself is computed as usual.
+ */
+static int reloc_binary(int op, struct expr_reloc *a, struct expr_reloc *b)
+{
+  if (!IS_RELOC(a) && !IS_RELOC(b))
+    return OK;
+  /* Nothing more can be done with a single byte of an address */
+  if (a->part != OBJ_RELOC_WORD || b->part != OBJ_RELOC_WORD)
+    return OBJECT_NOT_RELOCATABLE;
+
+  switch (op) {
+    case OP_ADD:
+      if (IS_RELOC(a) && IS_RELOC(b))
+        return OBJECT_NOT_RELOCATABLE;
+      if (IS_RELOC(b)) {
+        a->section = b->section;
+        a->import = b->import;
       }
-      if (nopstack) {
-        op_se = pop_opstack();
-        if (op_se->op_id != OP_PARANTHESIS_OPEN)
-          return PARANTHESIS_MISSMATCH;
-      } else
-        return PARANTHESIS_MISSMATCH;
-    } else {
-      if (p->assoc == ASSOC_LEFT) {
-        while (nopstack && (p->level > op_se->level)){
-          op_se = pop_opstack();
-          a2 = pop_numstack();
-          if (op_se->unary) {
-            r = op_se->eval(a2,0);
-          } else {
-            a1 = pop_numstack();
-            r = op_se->eval(a1, a2);
-          }
-          push_numstack(r);
-        }
-        push_opstack(p);
+      return OK;
+
+    case OP_SUB:
+      if (!IS_RELOC(b))
+        return OK;
+      /* The distance between two addresses is the same wherever they are */
+      if (a->section != b->section || a->import != b->import)
+        return OBJECT_NOT_RELOCATABLE;
+      a->section = -1;
+      a->import = NULL;
+      return OK;
+
+    case OP_AND:
+      if (IS_RELOC(b)) {
+        if (IS_RELOC(a) || a->value != 0xff)
+          return OBJECT_NOT_RELOCATABLE;
+        a->section = b->section;
+        a->import = b->import;
+        a->address = b->value;
       } else {
-        while (nopstack && (p->level >= op_se->level)){
-          op_se = pop_opstack();
-          a2 = pop_numstack();
-          if (op_se->unary) {
-            r = op_se->eval(a2,0);
-          } else {
-            a1 = pop_numstack();
-            r = op_se->eval(a1, a2);
-          }
-          push_numstack(r);
-        }
-        push_opstack(p);
+        if (b->value != 0xff)
+          return OBJECT_NOT_RELOCATABLE;
+        a->address = a->value;
       }
+      a->part = OBJ_RELOC_LOW;
+      return OK;
+
+    case OP_SHIFT_DOWN:
+      if (IS_RELOC(b) || b->value != 8)
+        return OBJECT_NOT_RELOCATABLE;
+      a->address = a->value;
+      a->part = OBJ_RELOC_HIGH;
+      return OK;
+  }
+  return OBJECT_NOT_RELOCATABLE;
+}
+
+/*
+ * Run compiled expression code for an object file, keeping track of
+ * what the value is relative to. Undefined symbols are imported and
+ * count as 0, PC is an address in section. Only an address plus or
+ * minus a constant, the distance between two addresses and the low
+ * (& $FF) or high (>> 8) byte of an address can be relocated.
+ */
+int expr_reloc(struct asm65_context *ac, struct expr *expr, int section,
+               struct expr_reloc *rv)
+{
+  union expr_code *pc = expr->code;
+  union expr_code *end = expr->code + expr->length;
+  struct expr_reloc stack[EXPR_MAX_STACK];
+  struct expr_reloc *a;
+  struct symbol_entry *se;
+  int sp = 0;
+  struct op_s *op;
+  int error;
+
+  while (pc < end) {
+    if (pc->op >= EC_CONST) {
+      a = &stack[sp++];
+      a->section = -1;
+      a->import = NULL;
+      a->part = OBJ_RELOC_WORD;
+    }
+    switch (pc->op) {
+      case EC_CONST:
+        a->value = pc[1].value;
+        pc += 2;
+        break;
+
+      case EC_SYMBOL:
+        se = pc[1].sym->symbol;
+        if (se && se->defined) {
+          a->value = se->value;
+          a->section = se->section;
+        } else {
+          a->value = 0;
+          a->import = pc[1].sym;
+        }
+        pc += 2;
+        break;
+
+      case EC_PC:
+        a->value = ac->PC;
+        a->section = section;
+        pc++;
+        break;
+
+      default:
+        op = &ops[pc->op];
+        if (op->unary) {
+          a = &stack[sp - 1];
+          if (IS_RELOC(a))
+            return OBJECT_NOT_RELOCATABLE;
+          a->value = op->eval(ac, a->value, 0);
+        } else {
+          sp--;
+          a = &stack[sp - 1];
+          error = reloc_binary(pc->op, a, &stack[sp]);
+          if (!error)
+            error = div_error(pc->op, a->value, stack[sp].value);
+          if (error)
+            return error;
+          a->value = op->eval(ac, a->value, stack[sp].value);
+        }
+        pc++;
+        break;
     }
-    buf += strlen(p->operator);
   }
-  
-  buf = skip_white(buf);
-
-  if (!isendofarg(*buf))
-    return eval_expr(buf, &buf, value, op_e, reg);
-    
-  DBG(printf("1: nopstack = %d, nnumstack = %d\n", nopstack, nnumstack));
-  while (nopstack) {
-    op_se = pop_opstack();
-    a2 = pop_numstack();
-    if (op_se->unary) {
-      r = op_se->eval(a2,0);
+  *rv = stack[0];
+  if (rv->part == OBJ_RELOC_WORD)
+    rv->address = rv->value;
+  return OK;
+}
+
+/*
+ * Find the first symbol that keeps compiled code from being run,
+ * NULL if all of its symbols are defined.
+ */
+struct sym_name *expr_missing(struct expr *expr)
+{
+  union expr_code *pc = expr->code;
+  union expr_code *end = expr->code + expr->length;
+
+  while (pc < end) {
+    if (pc->op == EC_SYMBOL) {
+      if (!pc[1].sym->symbol || !pc[1].sym->symbol->defined)
+        return pc[1].sym;
+      pc += 2;
     } else {
-      a1 = pop_numstack();
-      r = op_se->eval(a1,a2);
+      pc += pc->op == EC_CONST ? 2 : 1;
     }
-    push_numstack(r);
   }
-  
-  if (nnumstack) {
-    *value = pop_numstack();
-    DBG(printf("Result = %d\n", *value));
-    if (outptr)
-      *outptr = buf;
-    DBG(printf("2: nopstack = %d, nnumstack = %d\n", nopstack, nnumstack));
+  return NULL;
+}
+
+/*
+ * Does the compiled code refer to the PC
+ */
+int expr_uses_pc(struct expr *expr)
+{
+  union expr_code *pc = expr->code;
+  union expr_code *end = expr->code + expr->length;
+
+  while (pc < end) {
+    if (pc->op == EC_PC)
+      return 1;
+    pc += pc->op == EC_CONST || pc->op == EC_SYMBOL ? 2 : 1;
+  }
+  return 0;
+}
+
+/*
+ * Evaluate the expression starting at tok. On success outtok is set to
+ * the first token after the expression.
+ */
+int eval_expr(struct asm65_context *ac, struct token *tok,
+              struct token **outtok, int *value)
+{
+  struct expr_context *ctx = &ac->expr_ctx;
+  int error;
+
+  error = expr_compile(ac, tok, outtok);
+  if (error)
+    return error;
+  return expr_run(ac, ctx->code, value);
+}
+
+/*
+ * Check for a register name token
+ */
+static int is_register(struct token *tok, int reg)
+{
+  return tok->kind == TK_IDENT && tok->sym->builtin &&
+         tok->sym->builtin->id == reg;
+}
+
+/*
+ * Find the paranthesis closing the one at tok, NULL if it isn't closed
+ */
+static struct token *match_paranthesis(struct token *tok)
+{
+  int depth = 0;
+
+  for (; tok->kind != TK_END; tok++) {
+    if (is_op(tok, OP_PARANTHESIS_OPEN))
+      depth++;
+    else if (is_op(tok, OP_PARANTHESIS_CLOSE) && !--depth)
+      return tok;
+  }
+  return NULL;
+}
+
+/*
+ * Find the first comma outside of any paranthesis
+ */
+static struct token *find_comma(struct token *tok)
+{
+  int depth = 0;
+
+  for (; tok->kind != TK_END; tok++) {
+    if (is_op(tok, OP_PARANTHESIS_OPEN))
+      depth++;
+    else if (is_op(tok, OP_PARANTHESIS_CLOSE))
+      depth--;
+    else if (tok->kind == TK_COMMA && !depth)
+      return tok;
+  }
+  return NULL;
+}
+
+/*
+ * Compile the operand expression of an instruction with the given
+ * addressing mode and check that it ends where the mode says it should.
+ */
+static int compile_operand(struct asm65_context *ac, struct token *tok,
+                           int mode)
+{
+  struct token *end;
+  int error;
+
+  error = expr_compile(ac, tok, &end);
+  if (error)
+    return error;
+
+  switch (mode) {
+    case MODE_ZEROPAGE_IX:
+    case MODE_ZEROPAGE_IY:
+    case MODE_ABSOLUTE_IX:
+    case MODE_ABSOLUTE_IY:
+    case MODE_STACK:
+      return end->kind == TK_COMMA ? OK : ASM_UNEXPECTED_CHARACTER;
+
+    case MODE_INDIRECT_IX:
+    case MODE_STACK_IND_IY:
+      return end->kind == TK_COMMA ? OK : ASM_INDIRECT_MODE_INVALID;
+
+    case MODE_INDIRECT_LONG:
+    case MODE_INDIRECT_LONG_IY:
+      return end->kind == TK_BRACKET_CLOSE ? OK : ASM_INDIRECT_MODE_INVALID;
+
+    case MODE_BLOCK_MOVE:
+      /* src,dst is compiled to dst | src << 8, the order they are stored */
+      if (end->kind != TK_COMMA)
+        return ASM_UNEXPECTED_CHARACTER;
+      error = compile(ac, end + 1, &end);
+      if (error)
+        return error;
+      emit(ac)->op = OP_BANKS;
+      break;
+
+    case MODE_INDIRECT_IY:
+    case MODE_INDIRECT:
+      return is_op(end, OP_PARANTHESIS_CLOSE) ? OK : ASM_INDIRECT_MODE_INVALID;
+  }
+  return end->kind == TK_END ? OK : ASM_UNEXPECTED_CHARACTER;
+}
+
+/*
+ * Check that an operand value fits the addressing mode
+ */
+int check_operand(int mode, int value)
+{
+  switch (mode) {
+    case MODE_IMMEDIATE:
+      if ((value > 255) || (value < 0))
+        return ASM_ADDR_IMMEDIATE_TO_BIG;
+      break;
+
+    case MODE_ZEROPAGE:
+    case MODE_ZEROPAGE_IX:
+    case MODE_ZEROPAGE_IY:
+    case MODE_INDIRECT_IX:
+    case MODE_INDIRECT_IY:
+    case MODE_ZEROPAGE_IND:
+    case MODE_INDIRECT_LONG:
+    case MODE_INDIRECT_LONG_IY:
+    case MODE_STACK:
+    case MODE_STACK_IND_IY:
+      if ((value > 255) || (value < 0))
+        return ASM_ADDR_ZEROPAGE_TO_BIG;
+      break;
+
+    case MODE_ABSOLUTE:
+    case MODE_ABSOLUTE_IX:
+    case MODE_ABSOLUTE_IY:
+    case MODE_INDIRECT:
+    case MODE_ABSOLUTE_IND_IX:
+    case MODE_ABSOLUTE_IND_LONG:
+      if ((value > 0xffff) || (value < 0))
+        return ASM_ADDR_ABSOLUTE_TO_BIG;
+      break;
+
+    case MODE_LONG:
+    case MODE_LONG_IX:
+      if ((value > 0xffffff) || (value < 0))
+        return ASM_ADDR_LONG_TO_BIG;
+      break;
+
+    /* Both banks are checked by OP_BANKS */
+    case MODE_BLOCK_MOVE:
+      if ((value > 0xffff) || (value < 0))
+        return ASM_ADDR_BANK_TO_BIG;
+      break;
   }
-  
+  return OK;
+}
+
+/*
+ * Turn the operand value of an instruction at address into the up to
+ * three bytes following the opcode. Relative branches are stored as the
+ * offset from the next instruction.
+ */
+int operand_bytes(int mode, int address, int value, unsigned char *data)
+{
+  int error;
+
+  if (mode == MODE_RELATIVE) {
+    value -= address + 2;
+    if (value < -128 || value > 127)
+      return ASM_BRANCH_OUT_OF_RANGE;
+  } else if (mode == MODE_RELATIVE_LONG) {
+    value -= address + 3;
+    if (value < -32768 || value > 32767)
+      return ASM_BRANCH_OUT_OF_RANGE;
+  } else {
+    error = check_operand(mode, value);
+    if (error)
+      return error;
+  }
+  data[0] = value & 0xff;
+  data[1] = (value >> 8) & 0xff;
+  data[2] = (value >> 16) & 0xff;
   return OK;
 }
 
 /*
  * Evaluate the address section to see what addressing mode
- * it has.
+ * it has. The mode is found from the shape of the operand alone, so
+ * it is valid even when the expression refers to symbols that are not
+ * defined yet, in which case SYMBOL_NOT_FOUND is returned. The only
+ * exception is an absolute address known to be beyond 64K, which is
+ * long. The value is checked against the mode once the mnemonic has
+ * settled the final mode.
  */
-int evaluate_address(char *buf, struct address_mode *mode)
+int evaluate_address(struct asm65_context *ac, struct token *tok,
+                     struct address_mode *mode)
 {
-  int error = OK;
+  struct expr_context *ctx = &ac->expr_ctx;
+  struct token *operand = NULL;
+  struct token *close;
+  struct token *comma;
+  int error;
   
-  buf = skip_white(buf);
+  ac->stats.addresses++;
+  mode->value = 0;
+  mode->expr = NULL;
+
+  /* Nothing at all is implied addressing */
+  if (tok->kind == TK_END) {
+    mode->mode = MODE_IMPLIED;
+    return OK;
+  }
+
   /* First check for immediate addressing mode */
-  if (*buf == '#') {
+  if (tok->kind == TK_HASH) {
     mode->mode = MODE_IMMEDIATE;
-    buf++;
-    error = eval_expr(buf, &buf, &mode->value, 0, NULL);
-    /* Check for errors */
-    if (error)
-      goto exit;
-    if ((mode->value > 255) || (mode->value < 0))
-      error = ASM_ADDR_IMMEDIATE_TO_BIG;
+    operand = tok + 1;
   /* Now check for accumulator */
-  } else if ((*buf == 'A' || *buf == 'a') && isendofarg(*(buf+1))) {
+  } else if (tok->kind == TK_IDENT && tok->length == 1 &&
+             toupper(*tok->text) == 'A' && tok[1].kind == TK_END) {
     mode->mode = MODE_ACCUMULATOR;
-    buf++;
-    buf = skip_white(buf);
-    if (!isendofline(*buf))
-      error = ASM_UNEXPECTED_CHARACTER;
-  /* Check for indirect mode */
-  } else if (*buf = '(') {
-    int reg;
-    printf ("indirect mode '%s'\n", buf);
-    error = eval_expr(buf, &buf, &mode->value, 0, &reg);
-    if (error)
-      return error;
-    if (reg == BUILT_IN_X) {
-      mode->mode = MODE_INDIRECT_IX;
-    } else if (reg == BUILT_IN_Y) {
-      mode->mode = MODE_INDIRECT_IY;
-    } else {
-      error = ASM_INVALID_ADDRESSING_MODE;
+    return OK;
+  /* Indirect long, [expr] or [expr],Y */
+  } else if (tok->kind == TK_BRACKET_OPEN) {
+    for (close = tok + 1; close->kind != TK_END; close++)
+      if (close->kind == TK_BRACKET_CLOSE)
+        break;
+    if (close->kind != TK_BRACKET_CLOSE)
+      return ASM_INDIRECT_MODE_INVALID;
+    if (close[1].kind == TK_END)
+      mode->mode = MODE_INDIRECT_LONG;
+    else if (close[1].kind == TK_COMMA && is_register(close + 2, BUILT_IN_Y) &&
+             close[3].kind == TK_END)
+      mode->mode = MODE_INDIRECT_LONG_IY;
+    else
+      return ASM_INDIRECT_MODE_INVALID;
+    operand = tok + 1;
+  } else {
+    mode->mode = MODE_ABSOLUTE;
+    operand = tok;
+
+    /* Check for indirect mode, (expr,X) (expr),Y (expr,S),Y or (expr) */
+    if (is_op(tok, OP_PARANTHESIS_OPEN) && (close = match_paranthesis(tok))) {
+      if (close[1].kind == TK_END) {
+        if (close[-1].kind == TK_COMMA || is_register(close - 1, BUILT_IN_X)) {
+          if (close[-2].kind != TK_COMMA || !is_register(close - 1, BUILT_IN_X))
+            return ASM_INDIRECT_MODE_INVALID;
+          mode->mode = MODE_INDIRECT_IX;
+        } else {
+          mode->mode = MODE_INDIRECT;
+        }
+        operand = tok + 1;
+      } else if (close[1].kind == TK_COMMA) {
+        if (!is_register(close + 2, BUILT_IN_Y) || close[3].kind != TK_END)
+          return ASM_INDIRECT_MODE_INVALID;
+        if (close[-2].kind == TK_COMMA && is_register(close - 1, BUILT_IN_S))
+          mode->mode = MODE_STACK_IND_IY;
+        else
+          mode->mode = MODE_INDIRECT_IY;
+        operand = tok + 1;
+      }
+      /* Otherwise the paranthesis was just part of the expression */
+    }
+
+    /* Absolute, possibly indexed, stack relative or a block move */
+    if (mode->mode == MODE_ABSOLUTE && (comma = find_comma(tok))) {
+      if (is_register(comma + 1, BUILT_IN_X))
+        mode->mode = MODE_ABSOLUTE_IX;
+      else if (is_register(comma + 1, BUILT_IN_Y))
+        mode->mode = MODE_ABSOLUTE_IY;
+      else if (is_register(comma + 1, BUILT_IN_S))
+        mode->mode = MODE_STACK;
+      else
+        mode->mode = MODE_BLOCK_MOVE;
+      if (mode->mode != MODE_BLOCK_MOVE && comma[2].kind != TK_END)
+        return ASM_UNEXPECTED_CHARACTER;
     }
   }
-exit:
+
+  error = compile_operand(ac, operand, mode->mode);
+  if (error)
+    return error;
+  mode->expr = ctx->code;
+  error = expr_run(ac, mode->expr, &mode->value);
+  if (error)
     return error;
+
+  if (mode->value > 0xffff) {
+    if (mode->mode == MODE_ABSOLUTE)
+      mode->mode = MODE_LONG;
+    else if (mode->mode == MODE_ABSOLUTE_IX)
+      mode->mode = MODE_LONG_IX;
+  }
+  return OK;
 }
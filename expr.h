@@ -2,12 +2,115 @@
 #ifndef __EXPR_H__
 #define __EXPR_H__
 
+struct token;
+struct sym_name;
+
+enum op_ids {
+  OP_NOT_USED,
+  OP_PARANTHESIS_OPEN,
+  OP_PARANTHESIS_CLOSE,
+  OP_NOT,
+  OP_INV,
+  OP_MUL,
+  OP_DIV,
+  OP_MOD,
+  OP_ADD,
+  OP_SUB,
+  OP_SHIFT_UP,
+  OP_SHIFT_DOWN,
+  OP_AND,
+  OP_EXP,
+  OP_OR,
+  OP_XOR,
+  OP_NEG,
+  OP_BANKS,
+  OP_NUM_OPS
+};
+
+/*
+ * Compiled expressions are postfix code. A code word is either one of
+ * the operator ids above, applied to the values on top of the stack, or
+ * one of the codes below followed by its argument word.
+ */
+enum expr_codes {
+  EC_CONST = OP_NUM_OPS,  /* Push the value in the next word */
+  EC_SYMBOL,              /* Push the value of the symbol in the next word */
+  EC_PC,                  /* Push the current PC */
+};
+
+union expr_code {
+  int op;
+  int value;
+  struct sym_name *sym;
+};
+
+struct expr {
+  int length;                   /* Number of code words */
+  union expr_code code[];
+};
+
+/* Constant operands are folded, a constant expression is a single EC_CONST */
+#define EXPR_CONSTANT(expr) \
+  ((expr)->length == 2 && (expr)->code[0].op == EC_CONST)
+
+#define EXPR_MAX_DEPTH    32    /* Nesting of paranthesis */
+#define EXPR_MAX_STACK    64    /* Pending operators or operands */
+
+struct expr_operand {
+  int constant;                 /* Value is known at compile time */
+  int value;
+  int start;                    /* First code word computing the operand */
+};
+
+/*
+ * State of the expression compiler, every context has its own so that
+ * nothing is shared between separate assemblies.
+ */
+struct expr_context {
+  struct expr *code;            /* Code of the last compiled expression */
+  int max_code;
+  int nops;
+  unsigned char ops[EXPR_MAX_STACK];
+  int nnums;
+  struct expr_operand nums[EXPR_MAX_STACK];
+};
+
+/*
+ * A value in an object file and what it is relative to. A relocatable
+ * value is an address in a section or an imported symbol plus a
+ * constant, or the low or high byte of one.
+ */
+struct expr_reloc {
+  int value;
+  int address;          /* Full address the value was taken from */
+  int section;          /* Section of the address, -1 if none */
+  struct sym_name *import;  /* Imported symbol of the address */
+  int part;             /* OBJ_RELOC_WORD, OBJ_RELOC_LOW or OBJ_RELOC_HIGH */
+};
+
 struct address_mode {
   int mode;
   int value;
+  struct expr *expr;    /* Compiled operand expression, NULL if none */
 };
 
-int eval_expr(char *buf, char **outptr, int *value, int op_expected, int *reg);
-int evaluate_address(char *buf, struct address_mode *mode);
+struct asm65_context;
+
+void expr_init(struct asm65_context *ac);
+void expr_free(struct asm65_context *ac);
+int is_operator(char *buf, int *length);
+int expr_compile(struct asm65_context *ac, struct token *tok,
+                 struct token **outtok);
+int expr_run(struct asm65_context *ac, struct expr *expr, int *value);
+int expr_reloc(struct asm65_context *ac, struct expr *expr, int section,
+               struct expr_reloc *rv);
+struct sym_name *expr_missing(struct expr *expr);
+int expr_uses_pc(struct expr *expr);
+int eval_expr(struct asm65_context *ac, struct token *tok,
+              struct token **outtok, int *value);
+int check_operand(int mode, int value);
+int operand_bytes(int mode, int address, int value, unsigned char *data);
+int evaluate_address(struct asm65_context *ac, struct token *tok,
+                     struct address_mode *mode);
 
 #endif // __EXPR_H__
\ No newline at end of file
@@ -0,0 +1,222 @@
+/*
+ * Fixups of values that refer to symbols not defined yet.
+ * A reference to an undefined symbol leaves a placeholder behind and
+ * hangs a fixup on the symbol. Defining the symbol patches everything
+ * waiting for it, and an equate that gets its value that way in turn
+ * resolves whatever waits for the equate.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "global.h"
+#include "fixup.h"
+#include "expr.h"
+#include "symbols.h"
+#include "errors.h"
+#include "output.h"
+#include "context.h"
+
+#define FIXUP_ARENA_CHUNK_SIZE  (16 * 1024)
+
+/*
+ * Initialize an empty set of fixups
+ */
+void fixup_init(struct asm65_context *ac)
+{
+  arena_init(ac, &ac->fixup.arena, FIXUP_ARENA_CHUNK_SIZE);
+  ac->fixup.fixups_first = NULL;
+  ac->fixup.num_pending = 0;
+}
+
+/*
+ * Hang a fixup on the first undefined symbol of its expression
+ */
+static void fixup_wait(struct asm65_context *ac, struct fixup *fx)
+{
+  struct sym_name *name = expr_missing(fx->expr);
+
+  fx->next = name->fixups;
+  name->fixups = fx;
+  sym_touch(ac, name);
+}
+
+static struct fixup *fixup_new(struct asm65_context *ac, int kind,
+                               struct expr *expr)
+{
+  struct fixup_state *fs = &ac->fixup;
+  struct fixup *fx;
+
+  fx = (struct fixup *)arena_alloc(&fs->arena, sizeof (struct fixup));
+  memset(fx, 0, sizeof (struct fixup));
+  fx->kind = kind;
+  fx->line = ac->line;
+  fx->file = ac->cur_file;
+  fx->address = ac->PC;
+  fx->expr = expr;
+  fx->all = fs->fixups_first;
+  fs->fixups_first = fx;
+  fs->num_pending++;
+  fixup_wait(ac, fx);
+  return fx;
+}
+
+/*
+ * Give the equate se the value of expr once its symbols are defined.
+ * The expression has to stay around until then.
+ */
+int fixup_add_equate(struct asm65_context *ac, struct symbol_entry *se,
+                     struct expr *expr)
+{
+  fixup_new(ac, FIXUP_EQUATE, expr)->equate = se;
+  return OK;
+}
+
+/*
+ * Patch the operand of the instruction at PC once the symbols of expr
+ * are defined. The expression has to stay around until then.
+ */
+int fixup_add_operand(struct asm65_context *ac, struct expr *expr, int mode,
+                      int size)
+{
+  struct fixup *fx = fixup_new(ac, FIXUP_OPERAND, expr);
+
+  fx->mode = mode;
+  fx->size = size;
+  return OK;
+}
+
+/*
+ * Write the final operand bytes over the placeholder
+ */
+static int fixup_patch(struct asm65_context *ac, struct fixup *fx, int value)
+{
+  unsigned char data[3];
+  int error;
+
+  error = operand_bytes(fx->mode, fx->address, value, data);
+  if (error)
+    return error;
+  output_patch(ac, fx->address + 1, data, fx->size - 1);
+  return OK;
+}
+
+static void push_work(struct asm65_context *ac, struct sym_name *name)
+{
+  struct fixup_state *fs = &ac->fixup;
+
+  if (fs->num_work == fs->max_work) {
+    fs->max_work = fs->max_work ? fs->max_work * 2 : 64;
+    fs->worklist = (struct sym_name **)realloc(fs->worklist, fs->max_work *
+                                               sizeof (struct sym_name *));
+    if (!fs->worklist)
+      out_of_memory(ac);
+  }
+  fs->worklist[fs->num_work++] = name;
+}
+
+/*
+ * Run one fixup. A fixup whose expression still refers to an undefined
+ * symbol goes on to wait for that one instead.
+ */
+static int fixup_run(struct asm65_context *ac, struct fixup *fx)
+{
+  int value;
+  int error;
+
+  ac->PC = fx->address;
+  ac->line = fx->line;
+  ac->cur_file = fx->file;
+  error = expr_run(ac, fx->expr, &value);
+  if (error == SYMBOL_NOT_FOUND) {
+    fixup_wait(ac, fx);
+    return OK;
+  }
+  if (error)
+    return error;
+
+  fx->resolved = 1;
+  ac->fixup.num_pending--;
+  if (fx->kind == FIXUP_EQUATE) {
+    fx->equate->value = value;
+    fx->equate->defined = 1;
+    push_work(ac, fx->equate->name);
+    return OK;
+  }
+  return fixup_patch(ac, fx, value);
+}
+
+/*
+ * The symbol name was just defined, run everything waiting for it.
+ * Equates defined on the way are handled from a worklist, so a long
+ * chain of equates does not recurse. On error line is left at the
+ * line of the failing fixup.
+ */
+int fixup_resolve(struct asm65_context *ac, struct sym_name *name)
+{
+  struct fixup_state *fs = &ac->fixup;
+  struct fixup *fx;
+  struct fixup *next;
+  int saved_pc = ac->PC;
+  int saved_line = ac->line;
+  struct inc_file *saved_file = ac->cur_file;
+  int error = OK;
+
+  if (!name->fixups)
+    return OK;
+
+  fs->num_work = 0;
+  push_work(ac, name);
+  while (fs->num_work && !error) {
+    name = fs->worklist[--fs->num_work];
+    fx = name->fixups;
+    name->fixups = NULL;
+    for (; fx && !error; fx = next) {
+      next = fx->next;
+      error = fixup_run(ac, fx);
+    }
+  }
+
+  ac->PC = saved_pc;
+  if (!error) {
+    ac->line = saved_line;
+    ac->cur_file = saved_file;
+  }
+  return error;
+}
+
+/*
+ * Check that every fixup has been resolved. If not, line and cur_file
+ * are set to the first line with a reference that never got defined.
+ * The list is newest first, so that is the last one unresolved.
+ */
+int fixup_check(struct asm65_context *ac)
+{
+  struct fixup *fx;
+  struct fixup *first = NULL;
+
+  if (!ac->fixup.num_pending)
+    return OK;
+  for (fx = ac->fixup.fixups_first; fx; fx = fx->all)
+    if (!fx->resolved)
+      first = fx;
+  ac->line = first->line;
+  ac->cur_file = first->file;
+  return SYMBOL_NOT_FOUND;
+}
+
+/*
+ * Release all fixups
+ */
+void fixup_clean_up(struct asm65_context *ac)
+{
+  struct fixup_state *fs = &ac->fixup;
+
+  arena_release(&fs->arena);
+  free(fs->worklist);
+  fs->worklist = NULL;
+  fs->num_work = 0;
+  fs->max_work = 0;
+  fs->fixups_first = NULL;
+  fs->num_pending = 0;
+}
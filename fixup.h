@@ -0,0 +1,59 @@
+/*
+ * Fixups of values that refer to symbols not defined yet
+ */
+#ifndef __FIXUP_H__
+#define __FIXUP_H__
+
+#include "arena.h"
+
+struct expr;
+struct sym_name;
+struct symbol_entry;
+
+enum fixup_kinds {
+  FIXUP_EQUATE,     /* Value of an equate */
+  FIXUP_OPERAND,    /* Operand bytes of an instruction in the image */
+};
+
+/*
+ * A value waiting for a symbol. The fixup sits in the list of the first
+ * undefined symbol its expression refers to, and moves on to the next
+ * one until all of them are defined.
+ */
+struct fixup;
+struct fixup {
+  struct fixup *next;           /* Next fixup waiting for the same symbol */
+  struct fixup *all;            /* Next fixup created */
+  int kind;
+  int line;                     /* Source line of the reference */
+  struct inc_file *file;
+  int address;                  /* PC at the start of the line */
+  int mode;                     /* Addressing mode of an operand */
+  int size;                     /* Size of the instruction of an operand */
+  int resolved;
+  struct symbol_entry *equate;  /* Symbol given the value of an equate */
+  struct expr *expr;
+};
+
+struct fixup_state {
+  struct arena arena;
+  struct fixup *fixups_first;
+  int num_pending;
+  /* Symbols defined while resolving, whose fixups are still to be run */
+  struct sym_name **worklist;
+  int num_work;
+  int max_work;
+};
+
+struct asm65_context;
+
+void fixup_init(struct asm65_context *ac);
+int fixup_add_equate(struct asm65_context *ac, struct symbol_entry *se,
+                     struct expr *expr);
+int fixup_add_operand(struct asm65_context *ac, struct expr *expr, int mode,
+                      int size);
+int fixup_resolve(struct asm65_context *ac, struct sym_name *name);
+int fixup_check(struct asm65_context *ac);
+void fixup_clean_up(struct asm65_context *ac);
+
+#endif // __FIXUP_H__
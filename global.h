@@ -1,5 +1,5 @@
 /*
- * Global variables
+ * Definitions shared by all modules
  */
 #ifndef __GLOBAL_H__
 #define __GLOBAL_H__
@@ -19,11 +19,23 @@ enum addressing_modes {
   MODE_ZEROPAGE    = 0x0800,  // 11  10
   MODE_ZEROPAGE_IX = 0x1000,  // 12  11
   MODE_ZEROPAGE_IY = 0x2000,  // 13  12
+  /* 65C02 */
+  MODE_ZEROPAGE_IND      = 0x4000,     // 14  13  (zp)
+  MODE_ABSOLUTE_IND_IX   = 0x8000,     // 15  14  (abs,X)
+  /* 65C816 */
+  MODE_LONG              = 0x10000,    // 16  15  long
+  MODE_LONG_IX           = 0x20000,    // 17  16  long,X
+  MODE_INDIRECT_LONG     = 0x40000,    // 18  17  [dp]
+  MODE_INDIRECT_LONG_IY  = 0x80000,    // 19  18  [dp],Y
+  MODE_ABSOLUTE_IND_LONG = 0x100000,   // 20  19  [abs]
+  MODE_STACK             = 0x200000,   // 21  20  sr,S
+  MODE_STACK_IND_IY      = 0x400000,   // 22  21  (sr,S),Y
+  MODE_RELATIVE_LONG     = 0x800000,   // 23  22  long branch
+  MODE_BLOCK_MOVE        = 0x1000000,  // 24  23  src,dst bank
 };
 
-extern int cpu;
-extern int PC;
-extern int line;
-extern int pass;
+/* Number of real addressing modes and the index of a mode bit among them */
+#define MODE_NUM_MODES  24
+#define MODE_INDEX(mode) (__builtin_ctz(mode) - 1)
 
 #endif // __GLOBAL_H__
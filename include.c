@@ -0,0 +1,419 @@
+/*
+ * Source files, the one being assembled and the ones it includes.
+ * Every file is mapped the first time it is found and split into tokens
+ * the first time its includes are checked, then kept for the following
+ * assemblies until it changes, so a file included from many places, or
+ * assembled again, is read and lexed once. A
+ * file that is only found, like the includes of a cached result, is
+ * never lexed. The INCLUDE lines of the whole tree are resolved and
+ * checked before any line is assembled, a missing file, a cycle or too
+ * deep nesting is found up front.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <sys/stat.h>
+
+#include "global.h"
+#include "errors.h"
+#include "include.h"
+#include "context.h"
+
+/*
+ * Add a directory to the include path, it is copied.
+ * Returns 0 on success or -1 if the path is full or out of memory.
+ */
+int inc_add_path(struct asm65_context *ac, const char *dir)
+{
+  struct inc_state *is = &ac->inc;
+  char *copy;
+
+  if (is->num_paths == INC_MAX_PATHS || !(copy = strdup(dir)))
+    return -1;
+  is->paths[is->num_paths++] = copy;
+  return 0;
+}
+
+/*
+ * Empty the include path
+ */
+void inc_clear_paths(struct asm65_context *ac)
+{
+  struct inc_state *is = &ac->inc;
+
+  while (is->num_paths)
+    free(is->paths[--is->num_paths]);
+}
+
+static void *inc_grow(struct asm65_context *ac, void *array, int count,
+                      int *max, int size)
+{
+  if (count < *max)
+    return array;
+  *max = *max ? *max * 2 : 256;
+  array = realloc(array, *max * size);
+  if (!array)
+    out_of_memory(ac);
+  return array;
+}
+
+/*
+ * Split the file into lines and every line into tokens
+ */
+static void inc_tokenize(struct asm65_context *ac, struct inc_file *file)
+{
+  struct token_list tl;
+  struct source_line sl;
+  int max_lines = 0;
+  int max_first = 0;
+  int max_tokens = 0;
+  int num_tokens = 0;
+  double start = stats_now();
+
+  /* The names of a file that can be found again are kept with it */
+  ac->sym.keep = file->ino != 0;
+  lex_init(&tl);
+  while (src_next_line(&file->sf, &sl)) {
+    file->lines = inc_grow(ac, file->lines, file->num_lines, &max_lines,
+                           sizeof (struct source_line));
+    file->first_token = inc_grow(ac, file->first_token, file->num_lines,
+                                 &max_first, sizeof (int));
+    file->lines[file->num_lines] = sl;
+    file->first_token[file->num_lines++] = num_tokens;
+
+    lex_line(ac, &tl, sl.text, sl.length);
+    while (num_tokens + tl.num_tokens > max_tokens)
+      file->tokens = inc_grow(ac, file->tokens, max_tokens, &max_tokens,
+                              sizeof (struct token));
+    memcpy(&file->tokens[num_tokens], tl.tokens,
+           tl.num_tokens * sizeof (struct token));
+    num_tokens += tl.num_tokens;
+  }
+  lex_free(&tl);
+  ac->sym.keep = 0;
+  file->num_tokens = num_tokens;
+  ac->stats.tokens += num_tokens;
+
+  file->includes = (struct inc_file **)calloc(file->num_lines + 1,
+                                               sizeof (struct inc_file *));
+  if (!file->includes)
+    out_of_memory(ac);
+  stats_event(ac, file->path, "file", start);
+  LOG(ac, LOG_PARSE, LOG_DEBUG, "Read %d lines, %d tokens from %s\n",
+      file->num_lines, num_tokens, file->path);
+}
+
+/*
+ * 64 bit FNV-1a hash of the bytes of a file
+ */
+static unsigned long long inc_hash(struct source_file *sf)
+{
+  unsigned long long hash = 0xcbf29ce484222325ull;
+  unsigned char *p = (unsigned char *)sf->data;
+  size_t length = sf->size;
+
+  while (length--) {
+    hash ^= *p++;
+    hash *= 0x100000001b3ull;
+  }
+  return hash;
+}
+
+/*
+ * Tell if a kept file has changed since it was mapped, st is what the
+ * disk has now. The time has a limited resolution, so a file rewritten
+ * in place right after it was read can look the same, the mapping then
+ * shows the new bytes. Those are hashed once per assembly.
+ */
+static int inc_changed(struct inc_file *file, struct stat *st)
+{
+  if (!file->stale &&
+      (st->st_mtim.tv_sec != file->mtime.tv_sec ||
+       st->st_mtim.tv_nsec != file->mtime.tv_nsec ||
+       st->st_size != file->size ||
+       (!file->checked && inc_hash(&file->sf) != file->hash)))
+    file->stale = 1;
+  file->checked = 1;
+  return file->stale;
+}
+
+/*
+ * Get the file at path from the cache, or map it if it isn't there or
+ * has changed since. Returns NULL if it can't be opened.
+ */
+static struct inc_file *inc_load(struct asm65_context *ac, char *path)
+{
+  struct inc_file *file;
+  struct stat st;
+
+  /* Standard input can only be read once, it is never found again */
+  if (strcmp(path, "-")) {
+    if (stat(path, &st) || !S_ISREG(st.st_mode))
+      return NULL;
+    /* A file reached by two paths is the same file, for cycles too */
+    for (file = ac->inc.files; file; file = file->next)
+      if (file->ino == st.st_ino && file->dev == st.st_dev &&
+          !inc_changed(file, &st))
+        return file;
+  } else {
+    memset(&st, 0, sizeof (st));
+  }
+
+  file = (struct inc_file *)calloc(1, sizeof (struct inc_file));
+  if (!file || !(file->path = strdup(path)))
+    out_of_memory(ac);
+  if (src_open(ac, &file->sf, file->path)) {
+    free(file->path);
+    free(file);
+    return NULL;
+  }
+  file->dev = st.st_dev;
+  file->ino = st.st_ino;
+  file->mtime = st.st_mtim;
+  file->size = st.st_size;
+  file->hash = inc_hash(&file->sf);
+  file->checked = 1;
+  file->next = ac->inc.files;
+  ac->inc.files = file;
+  return file;
+}
+
+/*
+ * Open the file to assemble, it is split into tokens when its includes
+ * are checked. Returns NULL if it can't be opened.
+ */
+struct inc_file *inc_open(struct asm65_context *ac, char *name)
+{
+  return inc_load(ac, name);
+}
+
+/*
+ * Open a source held in memory to assemble, name is what its errors are
+ * reported in. Like standard input it is never found again.
+ */
+struct inc_file *inc_open_buffer(struct asm65_context *ac, char *name,
+                                 const char *data, size_t size)
+{
+  struct inc_file *file;
+
+  file = (struct inc_file *)calloc(1, sizeof (struct inc_file));
+  if (!file || !(file->path = strdup(name)))
+    out_of_memory(ac);
+  src_buffer(ac, &file->sf, file->path, data, size);
+  file->next = ac->inc.files;
+  ac->inc.files = file;
+  return file;
+}
+
+/*
+ * Find an included file, next to the file including it or else in the
+ * include path. It is mapped but not split into tokens.
+ */
+struct inc_file *inc_find(struct asm65_context *ac, char *name,
+                          struct inc_file *from)
+{
+  struct inc_state *is = &ac->inc;
+  char path[INC_PATH_LENGTH * 2];
+  struct inc_file *file;
+  char *slash;
+  int i;
+
+  if (name[0] == '/')
+    return inc_load(ac, name);
+
+  slash = strrchr(from->path, '/');
+  if (slash)
+    snprintf(path, sizeof (path), "%.*s/%s", (int)(slash - from->path),
+             from->path, name);
+  else
+    snprintf(path, sizeof (path), "%s", name);
+  if ((file = inc_load(ac, path)))
+    return file;
+
+  for (i = 0; i < is->num_paths; i++) {
+    snprintf(path, sizeof (path), "%s/%s", is->paths[i], name);
+    if ((file = inc_load(ac, path)))
+      return file;
+  }
+  return NULL;
+}
+
+/*
+ * Get the file name of an INCLUDE line, given in quotes or running to
+ * the first white space. tok is the token after the directive, the name
+ * is taken from the text as it need not be valid tokens.
+ */
+static int inc_name(struct token *tok, struct source_line *sl, char *name)
+{
+  char *end = sl->text + sl->length;
+  char *p = tok->text;
+  char *q;
+  char *rest;
+
+  if (p < end && *p == '"') {
+    p++;
+    q = memchr(p, '"', end - p);
+    if (!q)
+      return ASM_UNEXPECTED_CHARACTER;
+    rest = q + 1;
+  } else {
+    for (q = p; q < end && !isspace(*q) && *q != ';'; q++)
+      ;
+    rest = q;
+  }
+  if (q == p || q - p >= INC_PATH_LENGTH)
+    return INCLUDE_NAME_EXPECTED;
+
+  while (rest < end && isspace(*rest))
+    rest++;
+  if (rest < end && *rest != ';')
+    return ASM_UNEXPECTED_CHARACTER;
+
+  memcpy(name, p, q - p);
+  name[q - p] = '\0';
+  return OK;
+}
+
+/*
+ * Get the file name of the INCLUDE on a line of a checked file
+ */
+int inc_include_name(struct inc_file *file, int line, char *name)
+{
+  struct token *tok = INC_TOKENS(file, line);
+
+  if (tok->flags & TF_LABEL)
+    tok++;
+  return inc_name(tok + 1, &file->lines[line - 1], name);
+}
+
+/*
+ * Resolve the INCLUDE lines of a file and check the files they include,
+ * depth first. A file met again while its own includes are being
+ * checked includes itself.
+ */
+static int inc_check_file(struct asm65_context *ac, struct inc_file *file,
+                          int depth)
+{
+  char name[INC_PATH_LENGTH];
+  struct inc_file *inc;
+  struct token *tok;
+  int error = OK;
+  int i;
+
+  if (!file->includes)
+    inc_tokenize(ac, file);
+  file->depth = depth;
+  for (i = 0; i < file->num_lines && !error; i++) {
+    tok = INC_TOKENS(file, i + 1);
+    if (tok->flags & TF_LABEL)
+      tok++;
+    if (tok->kind != TK_IDENT || tok->length != 7 ||
+        strncasecmp(tok->text, "INCLUDE", 7))
+      continue;
+
+    ac->cur_file = file;
+    ac->line = i + 1;
+    error = inc_name(tok + 1, &file->lines[i], name);
+    if (error)
+      break;
+    inc = inc_find(ac, name, file);
+    if (!inc)
+      error = INCLUDE_NOT_FOUND;
+    else if (inc->depth)
+      error = INCLUDE_RECURSIVE;
+    else if (depth == INC_MAX_DEPTH)
+      error = INCLUDE_NESTED_TOO_DEEP;
+    else
+      error = inc_check_file(ac, inc, depth + 1);
+    file->includes[i] = inc;
+  }
+  file->depth = 0;
+  return error;
+}
+
+/*
+ * Check the whole tree of files included from file.
+ * On error cur_file and line are set to the INCLUDE line at fault.
+ */
+int inc_check(struct asm65_context *ac, struct inc_file *file)
+{
+  return inc_check_file(ac, file, 1);
+}
+
+static void inc_free(struct inc_file *file)
+{
+  src_close(&file->sf);
+  free(file->lines);
+  free(file->first_token);
+  free(file->tokens);
+  free(file->includes);
+  free(file->path);
+  free(file);
+}
+
+/*
+ * Intern the names of the kept files again in a new table, leaving out
+ * the names only the released files used
+ */
+static void inc_intern_names(struct asm65_context *ac)
+{
+  struct inc_file *file;
+  struct token *tok;
+
+  sym_reset_names(ac);
+  ac->sym.keep = 1;
+  for (file = ac->inc.files; file; file = file->next)
+    for (tok = file->tokens; tok < file->tokens + file->num_tokens; tok++)
+      if (tok->kind == TK_IDENT)
+        tok->sym = sym_intern(ac, tok->text, tok->length);
+  ac->sym.keep = 0;
+}
+
+/*
+ * End an assembly. The files that can't be found again, standard input
+ * and sources held in memory, and the ones changed since they were
+ * loaded are released. The others are kept with their tokens, their
+ * includes are resolved again by the next check. The symbols module has
+ * dropped the names of the assembly already, the names are interned
+ * again if a kept file used one of those or a file was released.
+ */
+void inc_clean_up(struct asm65_context *ac)
+{
+  struct inc_file **link = &ac->inc.files;
+  struct inc_file *file;
+  struct stat st;
+  int rebuild = ac->sym.rebuild;
+
+  while ((file = *link)) {
+    if (!file->ino || stat(file->path, &st) || st.st_ino != file->ino ||
+        st.st_dev != file->dev || inc_changed(file, &st)) {
+      *link = file->next;
+      rebuild |= file->num_tokens && file->ino;
+      inc_free(file);
+      continue;
+    }
+    if (file->includes)
+      memset(file->includes, 0,
+             file->num_lines * sizeof (struct inc_file *));
+    file->depth = 0;
+    file->checked = 0;
+    link = &file->next;
+  }
+  if (rebuild)
+    inc_intern_names(ac);
+}
+
+/*
+ * Release every file loaded
+ */
+void inc_clear_files(struct asm65_context *ac)
+{
+  struct inc_file *file;
+
+  while ((file = ac->inc.files)) {
+    ac->inc.files = file->next;
+    inc_free(file);
+  }
+}
@@ -0,0 +1,77 @@
+/*
+ * Source files, the one being assembled and the ones it includes
+ */
+#ifndef __INCLUDE_H__
+#define __INCLUDE_H__
+
+#include <sys/types.h>
+#include <time.h>
+
+#include "source.h"
+#include "lexer.h"
+
+#define INC_MAX_DEPTH         16
+#define INC_MAX_PATHS         16
+#define INC_PATH_LENGTH       512
+
+/*
+ * A source file, mapped when it is found and split into tokens when its
+ * includes are checked. That is done once for the context: the file is
+ * kept in a cache keyed by its inode, and shared by every INCLUDE of it,
+ * whatever path it is reached by, until its modification time, size or
+ * the hash of its bytes changes. The tokens of
+ * each line end with a TK_END token and point into the mapping, which
+ * stays until the file changes or inc_clear_files().
+ */
+struct inc_file {
+  struct inc_file *next;        /* Next file in the cache */
+  char *path;                   /* As it was first found */
+  dev_t dev;
+  ino_t ino;
+  struct timespec mtime;
+  off_t size;
+  unsigned long long hash;      /* 64 bit FNV-1a hash of the bytes */
+  int checked;                  /* Compared with the disk this assembly */
+  int stale;                    /* Changed since it was mapped */
+  struct source_file sf;
+  int num_lines;
+  struct source_line *lines;
+  int *first_token;             /* Index of the first token of each line */
+  int num_tokens;
+  struct token *tokens;
+  struct inc_file **includes;   /* File included by each line, NULL if none,
+                                   the array is NULL until it is tokenized */
+  int depth;                    /* Nesting while its includes are checked */
+};
+
+/* Tokens of a line, the first line is 1 */
+#define INC_TOKENS(file, line) \
+  (&(file)->tokens[(file)->first_token[(line) - 1]])
+
+/*
+ * The files of a context. The include path and the files are kept for
+ * every assembly, but for the ones that can't be found again.
+ */
+struct inc_state {
+  /* Directories searched for included files, after the one of the includer */
+  char *paths[INC_MAX_PATHS];
+  int num_paths;
+  /* Every file loaded */
+  struct inc_file *files;
+};
+
+struct asm65_context;
+
+int inc_add_path(struct asm65_context *ac, const char *dir);
+void inc_clear_paths(struct asm65_context *ac);
+struct inc_file *inc_open(struct asm65_context *ac, char *name);
+struct inc_file *inc_open_buffer(struct asm65_context *ac, char *name,
+                                 const char *data, size_t size);
+struct inc_file *inc_find(struct asm65_context *ac, char *name,
+                          struct inc_file *from);
+int inc_check(struct asm65_context *ac, struct inc_file *file);
+int inc_include_name(struct inc_file *file, int line, char *name);
+void inc_clean_up(struct asm65_context *ac);
+void inc_clear_files(struct asm65_context *ac);
+
+#endif // __INCLUDE_H__
@@ -0,0 +1,84 @@
+/*
+ * Intermediate representation of the parsed source lines.
+ * The lines are kept in an array in source order, compiled expressions are
+ * copied to an arena so they outlive the code buffer of the compiler.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "global.h"
+#include "ir.h"
+#include "errors.h"
+#include "expr.h"
+#include "arena.h"
+#include "object.h"
+#include "macro.h"
+#include "context.h"
+
+#define IR_INITIAL_LINES      1024
+#define IR_ARENA_CHUNK_SIZE   (64 * 1024)
+
+/*
+ * Initialize an empty IR
+ */
+void ir_init(struct asm65_context *ac)
+{
+  ac->ir.lines = NULL;
+  ac->ir.num_lines = 0;
+  ac->ir.max_lines = 0;
+  arena_init(ac, &ac->ir.arena, IR_ARENA_CHUNK_SIZE);
+}
+
+/*
+ * Add a line at the end of the IR.
+ * The pointer is only valid until the next line is added.
+ */
+struct ir_line *ir_new_line(struct asm65_context *ac, int kind)
+{
+  struct ir_state *is = &ac->ir;
+  struct ir_line *ir;
+
+  if (is->num_lines == is->max_lines) {
+    is->max_lines = is->max_lines ? is->max_lines * 2 : IR_INITIAL_LINES;
+    is->lines = (struct ir_line *)realloc(is->lines, is->max_lines *
+                                          sizeof (struct ir_line));
+    if (!is->lines)
+      out_of_memory(ac);
+  }
+
+  ir = &is->lines[is->num_lines++];
+  memset(ir, 0, sizeof (struct ir_line));
+  ir->kind = kind;
+  ir->line = ac->line;
+  ir->file = ac->cur_file;
+  ir->expansion = mac_expansion(ac);
+  ir->address = ac->PC;
+  ir->section = obj_current_section(ac);
+  return ir;
+}
+
+/*
+ * Keep a copy of a compiled expression
+ */
+struct expr *ir_store_expr(struct asm65_context *ac, struct expr *expr)
+{
+  int size = sizeof (struct expr) + expr->length * sizeof (union expr_code);
+  struct expr *copy;
+
+  copy = (struct expr *)arena_alloc(&ac->ir.arena, size);
+  memcpy(copy, expr, size);
+  return copy;
+}
+
+/*
+ * Release the IR
+ */
+void ir_clean_up(struct asm65_context *ac)
+{
+  free(ac->ir.lines);
+  arena_release(&ac->ir.arena);
+  ac->ir.lines = NULL;
+  ac->ir.num_lines = 0;
+  ac->ir.max_lines = 0;
+}
@@ -0,0 +1,59 @@
+/*
+ * Intermediate representation of the parsed source lines
+ */
+#ifndef __IR_H__
+#define __IR_H__
+
+#include "global.h"
+#include "arena.h"
+
+struct expr;
+struct symbol_entry;
+struct asm_mnemonic;
+struct asm_directive;
+
+enum ir_kinds {
+  IR_EMPTY,         /* Nothing but a label, a comment or white space */
+  IR_EQUATE,        /* label = expression */
+  IR_DIRECTIVE,     /* Assembler directive */
+  IR_INSTRUCTION,   /* Assembler mnemonic */
+};
+
+/*
+ * One parsed source line.
+ * Pass 1 fills it in, pass 2 evaluates and encodes it without looking
+ * at the source again.
+ */
+struct ir_line {
+  int kind;
+  int line;                     /* Source line number */
+  struct inc_file *file;        /* Source file of the line */
+  int expansion;                /* Macro expansion it is from, 0 if none */
+  int address;                  /* PC at the start of the line */
+  int size;                     /* Number of bytes generated */
+  int section;                  /* Object file section, -1 if none */
+  int mode;                     /* Addressing mode of an instruction */
+  unsigned char opcode;         /* Opcode for the mnemonic and mode */
+  int relaxed;                  /* Branch put as the inverse branch over a JMP */
+  struct symbol_entry *label;   /* Symbol defined on the line */
+  struct asm_directive *ad;
+  struct asm_mnemonic *am;
+  struct expr *expr;            /* Compiled operand expression, NULL if none */
+};
+
+struct ir_state {
+  /* All parsed lines in source order */
+  struct ir_line *lines;
+  int num_lines;
+  int max_lines;
+  struct arena arena;
+};
+
+struct asm65_context;
+
+void ir_init(struct asm65_context *ac);
+struct ir_line *ir_new_line(struct asm65_context *ac, int kind);
+struct expr *ir_store_expr(struct asm65_context *ac, struct expr *expr);
+void ir_clean_up(struct asm65_context *ac);
+
+#endif // __IR_H__
@@ -0,0 +1,201 @@
+/*
+ * Splits source lines into tokens.
+ * Every line is scanned exactly once: numbers are converted, names are
+ * interned and operators are identified here, so the later stages only
+ * look at tokens and never at the source text again.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "global.h"
+#include "lexer.h"
+#include "expr.h"
+#include "utils.h"
+#include "symbols.h"
+#include "errors.h"
+#include "context.h"
+
+#define LEX_INITIAL_TOKENS    32
+
+/*
+ * Initialize an empty token list
+ */
+void lex_init(struct token_list *tl)
+{
+  tl->text = NULL;
+  tl->num_tokens = 0;
+  tl->max_tokens = 0;
+  tl->tokens = NULL;
+}
+
+/*
+ * Get the next free token in the list, growing the array if needed
+ */
+static struct token *lex_new_token(struct asm65_context *ac,
+                                   struct token_list *tl)
+{
+  if (tl->num_tokens == tl->max_tokens) {
+    tl->max_tokens = tl->max_tokens ? tl->max_tokens * 2 : LEX_INITIAL_TOKENS;
+    tl->tokens = (struct token *)realloc(tl->tokens,
+                                         tl->max_tokens * sizeof (struct token));
+    if (!tl->tokens)
+      out_of_memory(ac);
+  }
+  return &tl->tokens[tl->num_tokens++];
+}
+
+/*
+ * Read a number. A number runs until the first character that can't be
+ * part of a label, a run containing anything but digits of the base is
+ * not a number. Returns the end of the run, or NULL if it isn't a number.
+ */
+static char *lex_number(char *p, char *end, int *value)
+{
+  unsigned long long v = 0;
+  int base = 10;
+  int digits = 0;
+  int d;
+
+  if (*p == '$') {
+    base = 16;
+    p++;
+  } else if (*p == '%') {
+    base = 2;
+    p++;
+  } else if (*p == '&') {
+    base = 8;
+    p++;
+  }
+
+  for (; p < end && isvalidlabel(*p); p++, digits++) {
+    if (isdigit(*p))
+      d = *p - '0';
+    else if (isxdigit(*p))
+      d = toupper(*p) - 'A' + 10;
+    else
+      d = base;
+    if (d >= base || v > 0xffffffffULL)
+      return NULL;
+    v = v * base + d;
+  }
+
+  if (!digits || v > 0xffffffffULL)
+    return NULL;
+  *value = (int)v;
+  return p;
+}
+
+/*
+ * Split a line into tokens.
+ * The prefixes %, & and * mean binary, octal and the current PC where
+ * an operand is expected and modulo, and and multiply everywhere else.
+ * The first word after the label is the directive or mnemonic, so an
+ * operand is expected after it.
+ */
+int lex_line(struct asm65_context *ac, struct token_list *tl, char *text,
+             int length)
+{
+  char *p = text;
+  char *end = text + length;
+  char *q;
+  struct token *tok;
+  int expect_operand = 1;
+  int word_seen = 0;
+  int oplen;
+
+  tl->text = text;
+  tl->num_tokens = 0;
+
+  for (;;) {
+    while (p < end && isspace(*p))
+      p++;
+
+    tok = lex_new_token(ac, tl);
+    tok->flags = 0;
+    tok->value = 0;
+    tok->text = p;
+    tok->sym = NULL;
+
+    /* End of line, or a comment running to the end of line */
+    if (p >= end || *p == ';') {
+      tok->kind = TK_END;
+      tok->length = 0;
+      break;
+    }
+
+    q = p + 1;
+    /* A name starting with @ is local to a macro expansion */
+    if (isalpha(*p) || (*p == '@' && q < end && isalpha(*q))) {
+      while (q < end && isvalidlabel(*q))
+        q++;
+      tok->kind = TK_IDENT;
+      tok->sym = sym_intern(ac, p, q - p);
+      if (p == text) {
+        tok->flags |= TF_LABEL;
+      } else if (!word_seen) {
+        word_seen = 1;
+      } else {
+        expect_operand = 0;
+      }
+    } else if (isdigit(*p) ||
+               (expect_operand && (*p == '$' || *p == '%' || *p == '&'))) {
+      q = lex_number(p, end, &tok->value);
+      if (q) {
+        tok->kind = TK_NUMBER;
+      } else {
+        /* Take the whole run, a directive may still want its text */
+        q = p + 1;
+        while (q < end && isvalidlabel(*q))
+          q++;
+        tok->kind = TK_INVALID;
+      }
+      expect_operand = 0;
+    } else if (*p == '#') {
+      tok->kind = TK_HASH;
+      expect_operand = 1;
+    } else if (*p == ',') {
+      tok->kind = TK_COMMA;
+      expect_operand = 1;
+    } else if (*p == '=') {
+      tok->kind = TK_EQUALS;
+      expect_operand = 1;
+    } else if (*p == '[') {
+      tok->kind = TK_BRACKET_OPEN;
+      expect_operand = 1;
+    } else if (*p == ']') {
+      tok->kind = TK_BRACKET_CLOSE;
+      expect_operand = 0;
+    } else if ((tok->value = is_operator(p, &oplen))) {
+      tok->kind = TK_OPERATOR;
+      q = p + oplen;
+      /* A * where an operand is expected is the PC, and thus an operand */
+      if (tok->value == OP_PARANTHESIS_CLOSE ||
+          (tok->value == OP_MUL && expect_operand))
+        expect_operand = 0;
+      else
+        expect_operand = 1;
+    } else {
+      tok->kind = TK_INVALID;
+    }
+
+    if (!(tok->flags & TF_LABEL))
+      word_seen = 1;
+    if (q - p > 0xffff)
+      q = p + 0xffff;
+    tok->length = q - p;
+    p = q;
+  }
+
+  return OK;
+}
+
+/*
+ * Release the token array
+ */
+void lex_free(struct token_list *tl)
+{
+  free(tl->tokens);
+  lex_init(tl);
+}
@@ -0,0 +1,59 @@
+/*
+ * Splits source lines into tokens
+ */
+#ifndef __LEXER_H__
+#define __LEXER_H__
+
+#include "symbols.h"
+
+enum token_kinds {
+  TK_END = 0,       /* End of line, a comment also ends the line */
+  TK_IDENT,         /* Name, sym is the interned name */
+  TK_NUMBER,        /* Number, value holds the number */
+  TK_OPERATOR,      /* Operator, value holds the operator id */
+  TK_HASH,          /* '#', immediate addressing */
+  TK_COMMA,         /* ',' */
+  TK_EQUALS,        /* '=', assignment */
+  TK_BRACKET_OPEN,  /* '[', 65C816 indirect long */
+  TK_BRACKET_CLOSE, /* ']' */
+  TK_INVALID,       /* Anything that isn't a valid token */
+  TK_MACRO_ARG,     /* Parameter in a macro body, value is its index */
+  TK_MACRO_LOCAL,   /* @ label in a macro body, value is its index */
+};
+
+enum token_flags {
+  TF_LABEL = 0x01,  /* Identifier starting in the first column */
+};
+
+/*
+ * A token. The span points into the source line, which stays
+ * available for the whole assembly.
+ */
+struct token {
+  unsigned char kind;
+  unsigned char flags;
+  unsigned short length;  /* Length of the span */
+  int value;              /* Number value or operator id */
+  char *text;             /* Start of the span */
+  struct sym_name *sym;   /* Interned name of an identifier */
+};
+
+/*
+ * The tokens of one line, the array grows as needed and is reused
+ * from line to line. It is always terminated by a TK_END token.
+ */
+struct token_list {
+  char *text;
+  int num_tokens;
+  int max_tokens;
+  struct token *tokens;
+};
+
+struct asm65_context;
+
+void lex_init(struct token_list *tl);
+int lex_line(struct asm65_context *ac, struct token_list *tl, char *text,
+             int length);
+void lex_free(struct token_list *tl);
+
+#endif // __LEXER_H__
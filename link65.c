@@ -0,0 +1,295 @@
+/*
+ * Linker for the relocatable object files written by asm65 -c.
+ * The relocatable sections are placed one after the other from the base
+ * address, in the order the files are given, and the others at the
+ * address they were assembled at. Imported symbols are resolved against
+ * the symbols exported by the other modules, and the relocations of each
+ * module are applied in one sweep over its list. The image is written
+ * in the same formats as the assembler writes.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "global.h"
+#include "errors.h"
+#include "object.h"
+#include "output.h"
+#include "symbols.h"
+#include "log.h"
+#include "context.h"
+
+#define MAX_FILENAME_LENGTH   256
+
+static struct obj_module *modules;
+static int num_modules;
+static char base_name[MAX_FILENAME_LENGTH];
+
+static void usage(char *name)
+{
+  struct output_format *of;
+
+  printf("Usage: %s [-v] [-d levels] [-b base] [-o output] [-f format[:output]] object...\n", name);
+  printf("  -b base    Address of the first relocatable section, default 0\n");
+  printf("  -o output  Binary output file\n");
+  printf("  -f format  Output file format, may be given more than once:");
+  for (of = output_formats; of->name; of++)
+    printf(" %s", of->name);
+  printf("\n");
+  printf("             The file is named after the first object unless given\n");
+  printf("  -d levels  Log levels, like output=debug or all=off\n");
+  printf("  -v         Print the placement of every section\n");
+  exit(1);
+}
+
+/*
+ * Parse an address given as $hex, 0xhex or decimal
+ */
+static int get_address(char *arg, int *address)
+{
+  char *end;
+  long value;
+
+  if (*arg == '$')
+    value = strtol(arg + 1, &end, 16);
+  else
+    value = strtol(arg, &end, 0);
+  if (end == arg || *end || value < 0 || value >= OUTPUT_IMAGE_SIZE)
+    return -1;
+  *address = value;
+  return 0;
+}
+
+static void set_base_name(char *file_name)
+{
+  char *dot;
+  char *slash;
+
+  strncpy(base_name, file_name, MAX_FILENAME_LENGTH - 1);
+  dot = strrchr(base_name, '.');
+  slash = strrchr(base_name, '/');
+  if (dot && (!slash || dot > slash))
+    *dot = '\0';
+}
+
+/*
+ * Give every section its final address
+ */
+static void place_sections(struct asm65_context *ac, int base)
+{
+  struct obj_section *sec;
+  int i, j;
+
+  for (i = 0; i < num_modules; i++) {
+    for (j = 0; j < modules[i].num_sections; j++) {
+      sec = &modules[i].sections[j];
+      if (sec->flags & OBJ_SEC_RELOCATABLE) {
+        sec->address = base;
+        base += sec->size;
+      }
+      LOG(ac, LOG_OUTPUT, LOG_DEBUG, "%s section %d at $%04x-$%04x\n",
+          modules[i].file_name, j, sec->address, sec->address + sec->size - 1);
+    }
+  }
+}
+
+/*
+ * Define the exported symbols at their final addresses. A name exported
+ * by more than one module is only an error if some module imports it.
+ */
+static void export_symbols(struct asm65_context *ac)
+{
+  struct obj_module *m;
+  struct obj_symbol *sym;
+  struct symbol_entry *se;
+  int i, j;
+
+  for (i = 0; i < num_modules; i++) {
+    m = &modules[i];
+    for (j = 0; j < m->num_symbols; j++) {
+      sym = &m->symbols[j];
+      if (sym->kind != OBJ_SYM_EXPORT)
+        continue;
+      se = sym->name->symbol;
+      if (!se)
+        se = sym_new_symbol(ac, sym->name);
+      if (!se->defined++) {
+        se->value = sym->value;
+        if (sym->section >= 0)
+          se->value += m->sections[sym->section].address -
+                       m->sections[sym->section].base;
+      }
+    }
+  }
+}
+
+/*
+ * Value of a symbol imported by a module
+ */
+static int resolve(struct asm65_context *ac, struct obj_module *m,
+                   struct obj_symbol *sym, int *value)
+{
+  struct symbol_entry *se = sym->name->symbol;
+
+  log_flush(ac);
+  if (!se || !se->defined) {
+    printf("Undefined symbol %s in %s !\n", sym->name->text, m->file_name);
+    return -1;
+  }
+  if (se->defined > 1) {
+    printf("Symbol %s used in %s is defined in more than one module !\n",
+           sym->name->text, m->file_name);
+    return -1;
+  }
+  *value = se->value;
+  return 0;
+}
+
+/*
+ * Copy the sections of a module to the image and apply its relocations
+ */
+static int link_module(struct asm65_context *ac, struct obj_module *m)
+{
+  struct output_descriptor od;
+  struct obj_section *sec;
+  struct obj_reloc *rel;
+  unsigned char data[2];
+  int value;
+  int error;
+  int i;
+
+  for (i = 0; i < m->num_sections; i++) {
+    sec = &m->sections[i];
+    if (!sec->size)
+      continue;
+    ac->PC = sec->address;
+    od.length = sec->size;
+    od.data = sec->data;
+    if ((error = output(ac, &od))) {
+      log_flush(ac);
+      printf("Error %s in %s !\n", error_msgs[error], m->file_name);
+      return -1;
+    }
+  }
+
+  for (i = 0; i < m->num_relocs; i++) {
+    rel = &m->relocs[i];
+    if (rel->symbol >= 0) {
+      if (resolve(ac, m, &m->symbols[rel->symbol], &value))
+        return -1;
+      value += rel->addend;
+    } else {
+      value = m->sections[rel->target].address + rel->addend;
+    }
+
+    sec = &m->sections[rel->section];
+    switch (rel->type) {
+      case OBJ_RELOC_WORD:
+        data[0] = value & 0xff;
+        data[1] = (value >> 8) & 0xff;
+        output_patch(ac, sec->address + rel->offset, data, 2);
+        break;
+      case OBJ_RELOC_LOW:
+        data[0] = value & 0xff;
+        output_patch(ac, sec->address + rel->offset, data, 1);
+        break;
+      case OBJ_RELOC_HIGH:
+        data[0] = (value >> 8) & 0xff;
+        output_patch(ac, sec->address + rel->offset, data, 1);
+        break;
+    }
+  }
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  struct asm65_context *ac;
+  int sinks_given = 0;
+  int base = 0;
+  int error = 0;
+  char *colon;
+  int opt;
+  int i;
+
+  ac = asm65_create(0);
+  if (!ac) {
+    printf("Could not allocate necessary memory, terminating !\n");
+    exit(1);
+  }
+  log_init(ac, stdout);
+
+  while ((opt = getopt(argc, argv, "b:o:f:d:v")) != -1) {
+    switch (opt) {
+      case 'b':
+        if (get_address(optarg, &base))
+          usage(argv[0]);
+        break;
+      case 'o':
+        if (output_add_sink(ac, "raw", optarg))
+          usage(argv[0]);
+        sinks_given = 1;
+        break;
+      case 'f':
+        colon = strchr(optarg, ':');
+        if (colon)
+          *colon++ = '\0';
+        if (output_add_sink(ac, optarg, colon))
+          usage(argv[0]);
+        sinks_given = 1;
+        break;
+      case 'd':
+        if (log_select(ac, optarg))
+          usage(argv[0]);
+        break;
+      case 'v':
+        ac->log.levels[LOG_OUTPUT] = LOG_DEBUG;
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+
+  if (optind >= argc) {
+    printf("No object files ! Pls try again.\n");
+    exit(1);
+  }
+  set_base_name(argv[optind]);
+  if (!sinks_given)
+    output_add_sink(ac, "raw", NULL);
+
+  sym_init(ac);
+  output_init(ac);
+
+  num_modules = argc - optind;
+  modules = (struct obj_module *)calloc(num_modules, sizeof (struct obj_module));
+  if (!modules) {
+    printf("Could not allocate necessary memory, terminating !\n");
+    exit(1);
+  }
+  for (i = 0; i < num_modules && !error; i++)
+    error = obj_read(ac, argv[optind + i], &modules[i]);
+
+  if (!error) {
+    place_sections(ac, base);
+    export_symbols(ac);
+    for (i = 0; i < num_modules && !error; i++)
+      error = link_module(ac, &modules[i]);
+  }
+
+  if (!error && output_write(ac, base_name))
+    error = 1;
+  log_flush(ac);
+  /* A file that could not be read or written */
+  if (error && ac->error)
+    printf("%s !\n", ac->message);
+
+  for (i = 0; i < num_modules; i++)
+    obj_free(&modules[i]);
+  free(modules);
+  sym_clean_up(ac);
+  output_clean_up(ac);
+  asm65_destroy(ac);
+  return error ? 1 : 0;
+}
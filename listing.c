@@ -0,0 +1,159 @@
+/*
+ * Listing file.
+ * The listing is made once the assembly is done, from the IR, the output
+ * image and the source, so assembling without one costs nothing. Lines
+ * are formatted into one large buffer which is written whenever it fills.
+ *
+ *  line  addr  bytes     source
+ *    12  C000  A9 05     lda #5
+ *    13 =0010            Size = $10
+ *     4+ D020  8D 20 D0  sta $d020   (line 4 of an included file)
+ *     7> C002  A9 00     lda #0      (line 7, in a macro, expanded)
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "global.h"
+#include "listing.h"
+#include "source.h"
+#include "include.h"
+#include "symbols.h"
+#include "output.h"
+#include "ir.h"
+#include "errors.h"
+#include "context.h"
+
+#define LST_MAX_BYTES       3     /* Bytes listed on a line */
+#define LST_PREFIX_LENGTH   26    /* Columns before the source text */
+
+static const char hex_digits[] = "0123456789ABCDEF";
+
+static int lst_flush(struct lst_state *ls, FILE *file)
+{
+  int length = ls->used;
+
+  ls->used = 0;
+  return fwrite(ls->buf, 1, length, file) == length ? 0 : -1;
+}
+
+static char *put_hex4(char *p, int value)
+{
+  p[0] = hex_digits[(value >> 12) & 15];
+  p[1] = hex_digits[(value >> 8) & 15];
+  p[2] = hex_digits[(value >> 4) & 15];
+  p[3] = hex_digits[value & 15];
+  return p + 4;
+}
+
+/*
+ * Format one line, the source text is a slice of the source file. Lines
+ * of included files are marked with a +, lines a macro expanded to with
+ * a >.
+ */
+static void lst_line(struct asm65_context *ac, int line_number,
+                     struct ir_line *ir, struct source_line *sl, char mark)
+{
+  struct output_state *os = &ac->output;
+  char *p = &ac->lst.buf[ac->lst.used];
+  char *q;
+  int n;
+  int i;
+
+  memset(p, ' ', LST_PREFIX_LENGTH);
+
+  /* Line number, right aligned in six columns */
+  q = p + 6;
+  for (n = line_number; n && q > p; n /= 10)
+    *--q = '0' + n % 10;
+  p[6] = mark;
+
+  if (ir && ir->kind == IR_EQUATE && ir->label->defined) {
+    p[7] = '=';
+    put_hex4(p + 8, ir->label->value);
+  } else if (ir && (ir->kind == IR_INSTRUCTION || ir->size || ir->label)) {
+    put_hex4(p + 8, ir->address);
+    q = p + 14;
+    for (i = 0; i < ir->size && i < LST_MAX_BYTES; i++) {
+      if (!output_written(ac, ir->address + i))
+        break;
+      *q++ = hex_digits[os->image[ir->address + i] >> 4];
+      *q++ = hex_digits[os->image[ir->address + i] & 15];
+      q++;
+    }
+  }
+  p += LST_PREFIX_LENGTH;
+
+  memcpy(p, sl->text, sl->length);
+  p += sl->length;
+  *p++ = '\n';
+  ac->lst.used = p - ac->lst.buf;
+}
+
+/*
+ * List the lines of a file, with the lines of the files it includes
+ * after each INCLUDE. The IR lines were made in the same order.
+ */
+static int lst_file(struct asm65_context *ac, FILE *file, struct inc_file *src,
+                    int included)
+{
+  struct lst_state *ls = &ac->lst;
+  struct source_line sl;
+  struct ir_line *ir;
+  int error = 0;
+  int i;
+
+  for (i = 0; i < src->num_lines && !error; i++) {
+    sl = src->lines[i];
+    /* Make room for the line, a very long line gets a flush of its own */
+    if (ls->used + LST_PREFIX_LENGTH + sl.length + 1 > LST_BUFFER_SIZE)
+      error = lst_flush(ls, file);
+    if (ls->used + LST_PREFIX_LENGTH + sl.length + 1 > LST_BUFFER_SIZE)
+      sl.length = LST_BUFFER_SIZE - LST_PREFIX_LENGTH - 1;
+
+    ir = NULL;
+    if (ls->next_ir < ls->end_ir && !ls->next_ir->expansion &&
+        ls->next_ir->file == src && ls->next_ir->line == i + 1)
+      ir = ls->next_ir++;
+    lst_line(ac, i + 1, ir, &sl, included ? '+' : ' ');
+
+    /* The lines a macro expanded to follow its use */
+    for (; ls->next_ir < ls->end_ir && ls->next_ir->expansion && !error;
+         ls->next_ir++) {
+      sl = ls->next_ir->file->lines[ls->next_ir->line - 1];
+      if (ls->used + LST_PREFIX_LENGTH + sl.length + 1 > LST_BUFFER_SIZE)
+        error = lst_flush(ls, file);
+      if (ls->used + LST_PREFIX_LENGTH + sl.length + 1 > LST_BUFFER_SIZE)
+        sl.length = LST_BUFFER_SIZE - LST_PREFIX_LENGTH - 1;
+      lst_line(ac, ls->next_ir->line, ls->next_ir, &sl, '>');
+    }
+    if (!error && src->includes[i])
+      error = lst_file(ac, file, src->includes[i], 1);
+  }
+  return error;
+}
+
+/*
+ * Write the listing of the source to file.
+ * Returns 0 on success or -1 if it could not be written.
+ */
+int lst_write(struct asm65_context *ac, FILE *file, struct inc_file *src)
+{
+  struct lst_state *ls = &ac->lst;
+  int error;
+
+  ls->buf = (char *)malloc(LST_BUFFER_SIZE);
+  if (!ls->buf)
+    out_of_memory(ac);
+  ls->used = 0;
+  ls->next_ir = ac->ir.lines;
+  ls->end_ir = ac->ir.lines + ac->ir.num_lines;
+
+  error = lst_file(ac, file, src, 0);
+  if (!error)
+    error = lst_flush(ls, file);
+
+  free(ls->buf);
+  ls->buf = NULL;
+  return error;
+}
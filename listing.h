@@ -0,0 +1,25 @@
+/*
+ * Listing file
+ */
+#ifndef __LISTING_H__
+#define __LISTING_H__
+
+#include <stdio.h>
+
+struct inc_file;
+struct ir_line;
+struct asm65_context;
+
+#define LST_BUFFER_SIZE     (256 * 1024)
+
+struct lst_state {
+  char *buf;
+  int used;
+  /* Next IR line to list, the lines are listed in the order they were made */
+  struct ir_line *next_ir;
+  struct ir_line *end_ir;
+};
+
+int lst_write(struct asm65_context *ac, FILE *file, struct inc_file *src);
+
+#endif // __LISTING_H__
@@ -0,0 +1,134 @@
+/*
+ * Leveled logging.
+ * Every module has its own level, set from the command line. The log
+ * goes through a large buffer of the context to the file it was given,
+ * stdout for the command line tools.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include "log.h"
+
+#include "context.h"
+
+static char *module_names[LOG_NUM_MODULES] = {
+  [LOG_EXPR]   = "expr",
+  [LOG_SYM]    = "sym",
+  [LOG_PARSE]  = "parse",
+  [LOG_OUTPUT] = "output",
+};
+
+static char *level_names[] = {
+  [LOG_OFF]   = "off",
+  [LOG_INFO]  = "info",
+  [LOG_DEBUG] = "debug",
+  [LOG_TRACE] = "trace",
+};
+
+/*
+ * Set the default levels and log to file, NULL for no log
+ */
+void log_init(struct asm65_context *ac, FILE *file)
+{
+  int i;
+
+  for (i = 0; i < LOG_NUM_MODULES; i++)
+    ac->log.levels[i] = LOG_INFO;
+  ac->log.file = file;
+  ac->log.used = 0;
+}
+
+static int find_name(char **names, int num_names, const char *name,
+                     int length)
+{
+  int i;
+
+  for (i = 0; i < num_names; i++)
+    if (!strncmp(names[i], name, length) && !names[i][length])
+      return i;
+  return -1;
+}
+
+/*
+ * Set levels from a list like expr=trace,sym=2, where all sets every
+ * module. Returns 0, or -1 if a module or level is not known.
+ */
+int log_select(struct asm65_context *ac, const char *arg)
+{
+  const char *end;
+  const char *eq;
+  int module;
+  int level;
+  int i;
+
+  while (*arg) {
+    end = arg + strcspn(arg, ",");
+    eq = memchr(arg, '=', end - arg);
+    if (!eq)
+      return -1;
+
+    if (eq[1] >= '0' && eq[1] <= '9' && eq + 2 == end)
+      level = eq[1] - '0';
+    else
+      level = find_name(level_names, LOG_TRACE + 1, eq + 1, end - eq - 1);
+    if (level < 0 || level > LOG_TRACE)
+      return -1;
+
+    if (eq - arg == 3 && !strncmp(arg, "all", 3)) {
+      for (i = 0; i < LOG_NUM_MODULES; i++)
+        ac->log.levels[i] = level;
+    } else {
+      module = find_name(module_names, LOG_NUM_MODULES, arg, eq - arg);
+      if (module < 0)
+        return -1;
+      ac->log.levels[module] = level;
+    }
+    arg = *end ? end + 1 : end;
+  }
+  return 0;
+}
+
+void log_printf(struct asm65_context *ac, char *fmt, ...)
+{
+  struct log_state *ls = &ac->log;
+  va_list ap;
+  int length;
+
+  if (!ls->file)
+    return;
+  va_start(ap, fmt);
+  length = vsnprintf(&ls->buffer[ls->used], LOG_BUFFER_SIZE - ls->used,
+                     fmt, ap);
+  va_end(ap);
+  if (length < 0)
+    return;
+  if (ls->used + length < LOG_BUFFER_SIZE) {
+    ls->used += length;
+    return;
+  }
+
+  /* It didn't fit, make room and format it again */
+  log_flush(ac);
+  va_start(ap, fmt);
+  if (length < LOG_BUFFER_SIZE)
+    ls->used = vsnprintf(ls->buffer, LOG_BUFFER_SIZE, fmt, ap);
+  else
+    vfprintf(ls->file, fmt, ap);
+  va_end(ap);
+}
+
+/*
+ * Write what is in the buffer to the file
+ */
+void log_flush(struct asm65_context *ac)
+{
+  struct log_state *ls = &ac->log;
+
+  if (!ls->file)
+    return;
+  fwrite(ls->buffer, 1, ls->used, ls->file);
+  ls->used = 0;
+  fflush(ls->file);
+}
@@ -0,0 +1,64 @@
+/*
+ * Leveled logging, with a level for every module
+ */
+#ifndef __LOG_H__
+#define __LOG_H__
+
+#include <stdio.h>
+
+enum log_modules {
+  LOG_EXPR,
+  LOG_SYM,
+  LOG_PARSE,
+  LOG_OUTPUT,
+  LOG_NUM_MODULES
+};
+
+enum log_levels {
+  LOG_OFF = 0,
+  LOG_INFO,         /* What the assembler did, on by default */
+  LOG_DEBUG,        /* Every line, symbol and instruction */
+  LOG_TRACE,        /* Every step of the expression compiler */
+};
+
+/*
+ * Levels above LOG_MAX_LEVEL are compiled away, a release build only
+ * keeps LOG_INFO.
+ */
+#ifndef LOG_MAX_LEVEL
+#define LOG_MAX_LEVEL   LOG_TRACE
+#endif
+
+#define LOG_BUFFER_SIZE   (64 * 1024)
+
+/*
+ * The log of a context. It is formatted into the buffer and written to
+ * the file when the buffer fills up and before a call of the library
+ * returns, so it stays in order with what the caller prints. Without a
+ * file nothing is logged.
+ */
+struct log_state {
+  int levels[LOG_NUM_MODULES];
+  FILE *file;
+  int used;
+  char buffer[LOG_BUFFER_SIZE];
+};
+
+struct asm65_context;
+
+#define LOG_ENABLED(ac, module, level) \
+  ((level) <= LOG_MAX_LEVEL && (level) <= (ac)->log.levels[module])
+
+#define LOG(ac, module, level, ...)           \
+  do {                                        \
+    if (LOG_ENABLED(ac, module, level))       \
+      log_printf(ac, __VA_ARGS__);            \
+  } while (0)
+
+void log_init(struct asm65_context *ac, FILE *file);
+int log_select(struct asm65_context *ac, const char *arg);
+void log_printf(struct asm65_context *ac, char *fmt, ...)
+  __attribute__ ((format (printf, 2, 3)));
+void log_flush(struct asm65_context *ac);
+
+#endif // __LOG_H__
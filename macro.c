@@ -0,0 +1,347 @@
+/*
+ * Macros.
+ * A definition takes the tokens of the body lines straight from the
+ * tokenized source file, marking parameters and @ labels on the way, so
+ * the body is never looked at as text again. An expansion copies the
+ * tokens of each line into a buffer of its own, substituting arguments
+ * and locals, and hands the line to the assembler like a line of a file.
+ * The work done is proportional to the tokens put out.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+
+#include "global.h"
+#include "errors.h"
+#include "arena.h"
+#include "include.h"
+#include "macro.h"
+#include "symbols.h"
+#include "expr.h"
+#include "context.h"
+
+#define MAC_ARENA_CHUNK_SIZE  (64 * 1024)
+#define MAC_LOCAL_LENGTH      256
+
+/*
+ * Line buffer of an expansion. Expansions nest, a macro may use another,
+ * so there is one for every level. The arguments of an inner expansion
+ * point into the buffer of the outer one.
+ */
+struct mac_frame {
+  struct token *tokens;
+  int max_tokens;
+  struct sym_name **locals;     /* Names of the locals in this expansion */
+  int max_locals;
+};
+
+void mac_init(struct asm65_context *ac)
+{
+  struct mac_state *ms = &ac->mac;
+
+  arena_init(ac, &ms->arena, MAC_ARENA_CHUNK_SIZE);
+  ms->frames = NULL;
+  ms->max_frames = 0;
+  ms->depth = 0;
+  ms->num_expansions = 0;
+  ms->current = 0;
+}
+
+static void *mac_grow(struct asm65_context *ac, void *array, int count,
+                      int *max, int size)
+{
+  if (count < *max)
+    return array;
+  while (count >= *max)
+    *max = *max ? *max * 2 : 64;
+  array = realloc(array, *max * size);
+  if (!array)
+    out_of_memory(ac);
+  return array;
+}
+
+static int is_word(struct token *tok, char *word)
+{
+  int length = strlen(word);
+
+  return tok->kind == TK_IDENT && tok->length == length &&
+         !strncasecmp(tok->text, word, length);
+}
+
+/******************************************************************************
+ *                       Definition
+ *****************************************************************************/
+/*
+ * Define the macro named by the label of the MACRO line at line of file.
+ * tok is the label, followed by MACRO and the parameter names. The body
+ * runs to the next ENDM and line is left there, so the assembly goes on
+ * after it. On error line is left at the line at fault.
+ */
+int mac_define(struct asm65_context *ac, struct token *tok,
+               struct inc_file *file, int *line)
+{
+  struct arena *arena = &ac->mac.arena;
+  struct sym_name *params[MAC_MAX_PARAMS];
+  struct sym_name **locals = NULL;
+  int num_locals = 0;
+  int max_locals = 0;
+  struct macro *mac;
+  struct token *t;
+  struct token *out;
+  int num_params = 0;
+  int num_tokens = 0;
+  int first = *line + 1;
+  int last;
+  int i;
+  int j;
+
+  if (tok->sym->symbol || tok->sym->macro)
+    return SYMBOL_ALREADY_EXIST;
+
+  /* Parameter names, separated by commas */
+  for (t = tok + 2; t->kind != TK_END; t++) {
+    if (t->kind != TK_IDENT)
+      return ASM_UNEXPECTED_CHARACTER;
+    if (num_params == MAC_MAX_PARAMS)
+      return MACRO_TOO_MANY_ARGUMENTS;
+    params[num_params++] = t->sym;
+    if (t[1].kind == TK_COMMA && t[2].kind != TK_END)
+      t++;
+    else if (t[1].kind != TK_END)
+      return ASM_UNEXPECTED_CHARACTER;
+  }
+
+  /* Find the end of the body, a macro can't be defined inside another */
+  for (last = first; last <= file->num_lines; last++) {
+    t = INC_TOKENS(file, last);
+    if (is_word(t, "ENDM"))
+      break;
+    if (t->flags & TF_LABEL)
+      t++;
+    if (is_word(t, "MACRO")) {
+      *line = last;
+      return MACRO_NESTED;
+    }
+    /* The body runs to the end of the file, there is no ENDM */
+    if (last == file->num_lines)
+      return MACRO_WITHOUT_ENDM;
+    num_tokens += file->first_token[last] - file->first_token[last - 1];
+  }
+  if (last > file->num_lines)
+    return MACRO_WITHOUT_ENDM;
+
+  mac = (struct macro *)arena_alloc(arena, sizeof (struct macro));
+  mac->name = tok->sym;
+  mac->file = file;
+  mac->first_line = first;
+  mac->num_lines = last - first;
+  mac->num_params = num_params;
+  mac->first_token = (int *)arena_alloc(arena,
+                                        (mac->num_lines + 1) * sizeof (int));
+  mac->tokens = (struct token *)arena_alloc(arena,
+                                            num_tokens * sizeof (struct token));
+  mac->active = 0;
+
+  /* Copy the body, marking the parameters and the locals */
+  out = mac->tokens;
+  for (i = 0; i < mac->num_lines; i++) {
+    mac->first_token[i] = out - mac->tokens;
+    t = INC_TOKENS(file, first + i);
+    do {
+      *out = *t;
+      if (t->kind == TK_IDENT) {
+        for (j = 0; j < num_params && params[j] != t->sym; j++)
+          ;
+        if (j < num_params) {
+          out->kind = TK_MACRO_ARG;
+          out->value = j;
+        } else if (t->sym->text[0] == '@') {
+          for (j = 0; j < num_locals && locals[j] != t->sym; j++)
+            ;
+          if (j == num_locals) {
+            locals = mac_grow(ac, locals, num_locals, &max_locals,
+                              sizeof (struct sym_name *));
+            locals[num_locals++] = t->sym;
+          }
+          out->kind = TK_MACRO_LOCAL;
+          out->value = j;
+        }
+      }
+      out++;
+    } while ((t++)->kind != TK_END);
+  }
+  mac->first_token[i] = out - mac->tokens;
+
+  mac->num_locals = num_locals;
+  mac->locals = (struct sym_name **)arena_alloc(arena,
+                                                (num_locals + 1) * sizeof (struct sym_name *));
+  memcpy(mac->locals, locals, num_locals * sizeof (struct sym_name *));
+  free(locals);
+
+  tok->sym->macro = mac;
+  sym_touch(ac, tok->sym);
+  LOG(ac, LOG_PARSE, LOG_DEBUG, "Macro %s, %d lines, %d parameters, "
+      "%d locals\n", mac->name->text, mac->num_lines, num_params, num_locals);
+  *line = last;
+  return OK;
+}
+
+/******************************************************************************
+ *                       Expansion
+ *****************************************************************************/
+static struct token *mac_push(struct asm65_context *ac,
+                              struct mac_frame *frame, int *count)
+{
+  frame->tokens = mac_grow(ac, frame->tokens, *count, &frame->max_tokens,
+                           sizeof (struct token));
+  return &frame->tokens[(*count)++];
+}
+
+/*
+ * Split the arguments at the commas outside parentheses and brackets
+ */
+static int mac_args(struct macro *mac, struct token *args,
+                    struct token **start, int *length)
+{
+  struct token *tok;
+  int num_args = 0;
+  int level = 0;
+  int i;
+
+  for (i = 0; i < mac->num_params; i++)
+    length[i] = 0;
+  if (args->kind == TK_END)
+    return OK;
+
+  start[0] = args;
+  for (tok = args; tok->kind != TK_END; tok++) {
+    if (tok->kind == TK_BRACKET_OPEN ||
+        (tok->kind == TK_OPERATOR && tok->value == OP_PARANTHESIS_OPEN))
+      level++;
+    else if (tok->kind == TK_BRACKET_CLOSE ||
+             (tok->kind == TK_OPERATOR && tok->value == OP_PARANTHESIS_CLOSE))
+      level--;
+    else if (tok->kind == TK_COMMA && !level) {
+      if (num_args + 1 >= mac->num_params)
+        return MACRO_TOO_MANY_ARGUMENTS;
+      length[num_args] = tok - start[num_args];
+      start[++num_args] = tok + 1;
+    }
+  }
+  if (num_args == mac->num_params)
+    return MACRO_TOO_MANY_ARGUMENTS;
+  length[num_args] = tok - start[num_args];
+  return OK;
+}
+
+/*
+ * Expand the macro with the arguments, the tokens after its name. Each
+ * line is handed to func with cur_file and line set to the line of the
+ * body. On error they are left there for the report.
+ */
+int mac_expand(struct asm65_context *ac, struct macro *mac,
+               struct token *args, mac_line_func func)
+{
+  struct mac_state *ms = &ac->mac;
+  struct token *start[MAC_MAX_PARAMS];
+  int length[MAC_MAX_PARAMS];
+  char name[MAC_LOCAL_LENGTH];
+  struct inc_file *saved_file = ac->cur_file;
+  int saved_line = ac->line;
+  int saved_current = ms->current;
+  struct mac_frame *frame;
+  struct token *tok;
+  struct token *out;
+  int level = ms->depth;
+  int count;
+  int error = OK;
+  int i;
+  int j;
+
+  if (mac->active)
+    return MACRO_RECURSIVE;
+  error = mac_args(mac, args, start, length);
+  if (error)
+    return error;
+
+  if (level == ms->max_frames) {
+    ms->frames = mac_grow(ac, ms->frames, level, &ms->max_frames,
+                          sizeof (struct mac_frame));
+    memset(&ms->frames[level], 0,
+           (ms->max_frames - level) * sizeof (struct mac_frame));
+  }
+  frame = &ms->frames[level];
+
+  /* Every expansion gets names of its own for the locals */
+  ms->current = ++ms->num_expansions;
+  frame->locals = mac_grow(ac, frame->locals, mac->num_locals,
+                           &frame->max_locals, sizeof (struct sym_name *));
+  for (i = 0; i < mac->num_locals; i++) {
+    snprintf(name, sizeof (name), "%s#%d", mac->locals[i]->text, ms->current);
+    frame->locals[i] = sym_intern(ac, name, strlen(name));
+  }
+
+  mac->active = 1;
+  ms->depth++;
+  for (i = 0; i < mac->num_lines; i++) {
+    frame = &ms->frames[level];
+    count = 0;
+    for (tok = &mac->tokens[mac->first_token[i]]; ; tok++) {
+      if (tok->kind == TK_MACRO_ARG) {
+        for (j = 0; j < length[tok->value]; j++) {
+          out = mac_push(ac, frame, &count);
+          *out = start[tok->value][j];
+          if (!j)
+            out->flags |= tok->flags;
+        }
+        continue;
+      }
+      out = mac_push(ac, frame, &count);
+      *out = *tok;
+      if (tok->kind == TK_MACRO_LOCAL) {
+        out->kind = TK_IDENT;
+        out->sym = frame->locals[tok->value];
+      }
+      if (tok->kind == TK_END)
+        break;
+    }
+
+    ac->cur_file = mac->file;
+    ac->line = mac->first_line + i;
+    error = func(ac, frame->tokens, &mac->file->lines[ac->line - 1]);
+    if (error)
+      break;
+  }
+  ms->depth--;
+  mac->active = 0;
+  ms->current = saved_current;
+  if (error)
+    return error;
+
+  ac->cur_file = saved_file;
+  ac->line = saved_line;
+  return OK;
+}
+
+/*
+ * Number of the expansion going on, 0 outside of macros
+ */
+int mac_expansion(struct asm65_context *ac)
+{
+  return ac->mac.current;
+}
+
+void mac_clean_up(struct asm65_context *ac)
+{
+  struct mac_state *ms = &ac->mac;
+  int i;
+
+  for (i = 0; i < ms->max_frames; i++) {
+    free(ms->frames[i].tokens);
+    free(ms->frames[i].locals);
+  }
+  free(ms->frames);
+  arena_release(&ms->arena);
+  mac_init(ac);
+}
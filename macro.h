@@ -0,0 +1,66 @@
+/*
+ * Macros, defined with MACRO and ENDM and replayed from their tokens
+ */
+#ifndef __MACRO_H__
+#define __MACRO_H__
+
+#include "lexer.h"
+#include "arena.h"
+
+struct inc_file;
+struct source_line;
+
+#define MAC_MAX_PARAMS        16
+
+/*
+ * A macro body is kept as the tokens of its lines, each line ending with
+ * a TK_END token. Parameters are TK_MACRO_ARG tokens and @ labels
+ * TK_MACRO_LOCAL tokens, with value the index of the parameter or the
+ * local. An expansion copies the tokens, putting the tokens of the
+ * argument in place of a parameter and a name unique to the expansion
+ * in place of a local, so the text is never lexed again.
+ */
+struct macro {
+  struct sym_name *name;
+  struct inc_file *file;        /* Where the body is, for reports */
+  int first_line;               /* Line of the body after the MACRO line */
+  int num_lines;
+  int num_params;
+  int num_locals;
+  struct sym_name **locals;     /* Names of the @ labels */
+  int *first_token;             /* Index of the first token of each line */
+  struct token *tokens;
+  int active;                   /* Set while it is being expanded */
+};
+
+/*
+ * The macros of a context. An expansion copies the tokens of each line
+ * into a frame of its own, expansions nest so there is one frame for
+ * every level.
+ */
+struct mac_frame;
+struct mac_state {
+  struct arena arena;
+  struct mac_frame *frames;
+  int max_frames;
+  int depth;
+  /* Expansions so far, and the one going on, 0 if none */
+  int num_expansions;
+  int current;
+};
+
+struct asm65_context;
+
+/* Handles one line of an expansion, like a line of a file */
+typedef int (*mac_line_func)(struct asm65_context *ac, struct token *tok,
+                             struct source_line *sl);
+
+void mac_init(struct asm65_context *ac);
+int mac_define(struct asm65_context *ac, struct token *tok,
+               struct inc_file *file, int *line);
+int mac_expand(struct asm65_context *ac, struct macro *mac,
+               struct token *args, mac_line_func func);
+int mac_expansion(struct asm65_context *ac);
+void mac_clean_up(struct asm65_context *ac);
+
+#endif // __MACRO_H__
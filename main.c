@@ -1,1004 +1,235 @@
 /*
- * Attempting to parse some simple assembly instructions
+ * Command line assembler, assembles a source file and writes the image,
+ * the object file and the listing
  */
 
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
-#include <ctype.h>
+#include <getopt.h>
 
-#include "global.h"
-#include "expr.h"
-#include "utils.h"
-#include "symbols.h"
-#include "errors.h"
-#include "output.h"
-
-#define DEBUG
-#if defined(DEBUG)
-#define A_(x) x
-#define PRINT_SYMBOLS
-#else
-#define A_(x)
-#endif
+#include "asm65.h"
 
 #define MAX_FILENAME_LENGTH   256
-#define MAX_LINE_LENGTH       2048
-
-enum cpu_models_id {
-  CPUUNDEF,
-  CPU6502,
-  CPU65C02,
-  CPU65C816,
-};
-
-struct cpu_models {
-  char *cpu;
-  int cpu_id;
-};
-
-struct cpu_models cm[] = {
-  { "6502", CPU6502 },
-  { "65C02", CPU65C02 },
-  { "65C816", CPU65C816 },
-  { NULL, 0 },
-};
-
-/*
- * Assembler directive
- */
-struct asm_directive {
-  char *directive;
-  int (*func)(char *buf);
-};
-
-/*
- * Assembler mnemonics
- */
-struct asm_mnemonic;
-struct asm_mnemonic {
-  char *mnemonic;
-  int (*func)(char *buf, struct asm_mnemonic *am);
-  unsigned int amodes;
-  unsigned char opcodes[13];
-};
-
-/* Assembler directive and mnemonic prototypes */
-int dir_cpu(char *buf);
-int dir_org(char *buf);
-int dir_byte(char *buf);
-int dir_word(char *buf);
-int dir_dword(char *buf);
-int dir_end(char *buf);
-
-int asm_adc(char *buf, struct asm_mnemonic *am);
-int asm_and(char *buf, struct asm_mnemonic *am);
-int asm_asl(char *buf, struct asm_mnemonic *am);
-int asm_bcc(char *buf, struct asm_mnemonic *am);
-int asm_bcs(char *buf, struct asm_mnemonic *am);
-int asm_beq(char *buf, struct asm_mnemonic *am);
-int asm_bit(char *buf, struct asm_mnemonic *am);
-int asm_bmi(char *buf, struct asm_mnemonic *am);
-int asm_bne(char *buf, struct asm_mnemonic *am);
-int asm_bpl(char *buf, struct asm_mnemonic *am);
-int asm_brk(char *buf, struct asm_mnemonic *am);
-int asm_bvc(char *buf, struct asm_mnemonic *am);
-int asm_bvs(char *buf, struct asm_mnemonic *am);
-int asm_clc(char *buf, struct asm_mnemonic *am);
-int asm_cld(char *buf, struct asm_mnemonic *am);
-int asm_cli(char *buf, struct asm_mnemonic *am);
-int asm_clv(char *buf, struct asm_mnemonic *am);
-int asm_cmp(char *buf, struct asm_mnemonic *am);
-int asm_cpx(char *buf, struct asm_mnemonic *am);
-int asm_cpy(char *buf, struct asm_mnemonic *am);
-int asm_dec(char *buf, struct asm_mnemonic *am);
-int asm_dex(char *buf, struct asm_mnemonic *am);
-int asm_dey(char *buf, struct asm_mnemonic *am);
-int asm_eor(char *buf, struct asm_mnemonic *am);
-int asm_inc(char *buf, struct asm_mnemonic *am);
-int asm_inx(char *buf, struct asm_mnemonic *am);
-int asm_iny(char *buf, struct asm_mnemonic *am);
-int asm_jmp(char *buf, struct asm_mnemonic *am);
-int asm_jsr(char *buf, struct asm_mnemonic *am);
-int asm_lda(char *buf, struct asm_mnemonic *am);
-int asm_ldx(char *buf, struct asm_mnemonic *am);
-int asm_ldy(char *buf, struct asm_mnemonic *am);
-int asm_lsr(char *buf, struct asm_mnemonic *am);
-int asm_nop(char *buf, struct asm_mnemonic *am);
-int asm_ora(char *buf, struct asm_mnemonic *am);
-int asm_pha(char *buf, struct asm_mnemonic *am);
-int asm_php(char *buf, struct asm_mnemonic *am);
-int asm_pla(char *buf, struct asm_mnemonic *am);
-int asm_plp(char *buf, struct asm_mnemonic *am);
-int asm_rol(char *buf, struct asm_mnemonic *am);
-int asm_ror(char *buf, struct asm_mnemonic *am);
-int asm_rti(char *buf, struct asm_mnemonic *am);
-int asm_rts(char *buf, struct asm_mnemonic *am);
-int asm_sbc(char *buf, struct asm_mnemonic *am);
-int asm_sec(char *buf, struct asm_mnemonic *am);
-int asm_sed(char *buf, struct asm_mnemonic *am);
-int asm_sei(char *buf, struct asm_mnemonic *am);
-int asm_sta(char *buf, struct asm_mnemonic *am);
-int asm_stx(char *buf, struct asm_mnemonic *am);
-int asm_sty(char *buf, struct asm_mnemonic *am);
-int asm_tax(char *buf, struct asm_mnemonic *am);
-int asm_tay(char *buf, struct asm_mnemonic *am);
-int asm_tsx(char *buf, struct asm_mnemonic *am);
-int asm_txa(char *buf, struct asm_mnemonic *am);
-int asm_txs(char *buf, struct asm_mnemonic *am);
-int asm_tya(char *buf, struct asm_mnemonic *am);
-
-struct asm_directive ad[] =
-{
-  { "CPU", dir_cpu },
-  { "ORG", dir_org },
-  { "BYTE", dir_byte },
-  { "WORD", dir_word },
-  { "END", dir_end },
-  { NULL, NULL },
-};
-
-struct asm_mnemonic am[] =
-{
-  { "ADC", asm_adc, MODE_IMMEDIATE |
-                    MODE_ZEROPAGE |
-                    MODE_ZEROPAGE_IX |
-                    MODE_ABSOLUTE |
-                    MODE_ABSOLUTE_IX |
-                    MODE_ABSOLUTE_IY |
-                    MODE_INDIRECT_IX |
-                    MODE_INDIRECT_IY }, // .... add with carry
-  { "AND", asm_and, MODE_IMMEDIATE |
-                    MODE_ZEROPAGE |
-                    MODE_ZEROPAGE_IX |
-                    MODE_ABSOLUTE |
-                    MODE_ABSOLUTE_IX |
-                    MODE_ABSOLUTE_IY |
-                    MODE_INDIRECT_IX |
-                    MODE_INDIRECT_IY }, // .... and (with accumulator)
-  { "ASL", asm_asl, MODE_ACCUMULATOR |
-                    MODE_ZEROPAGE |
-                    MODE_ZEROPAGE_IX |
-                    MODE_ABSOLUTE |
-                    MODE_ABSOLUTE_IX }, // .... arithmetic shift left
-  { "BCC", asm_bcc, MODE_RELATIVE }, // .... branch on carry clear
-  { "BCS", asm_bcs, MODE_RELATIVE }, // .... branch on carry set
-  { "BEQ", asm_beq, MODE_RELATIVE }, // .... branch on equal (zero set)
-  { "BIT", asm_bit, MODE_ZEROPAGE |
-                    MODE_ABSOLUTE }, // .... bit test
-  { "BMI", asm_bmi, MODE_RELATIVE }, // .... branch on minus (negative set)
-  { "BNE", asm_bne, MODE_RELATIVE }, // .... branch on not equal (zero clear)
-  { "BPL", asm_bpl, MODE_RELATIVE }, // .... branch on plus (negative clear)
-  { "BRK", asm_brk, MODE_IMPLIED }, // .... interrupt
-  { "BVC", asm_bvc, MODE_RELATIVE }, // .... branch on overflow clear
-  { "BVS", asm_bvs, MODE_RELATIVE }, // .... branch on overflow set
-  { "CLC", asm_clc, MODE_IMPLIED }, // .... clear carry
-  { "CLD", asm_cld, MODE_IMPLIED }, // .... clear decimal
-  { "CLI", asm_cli, MODE_IMPLIED }, // .... clear interrupt disable
-  { "CLV", asm_clv, MODE_IMPLIED }, // .... clear overflow
-  { "CMP", asm_cmp, MODE_IMMEDIATE |
-                    MODE_ZEROPAGE |
-                    MODE_ZEROPAGE_IX |
-                    MODE_ABSOLUTE |
-                    MODE_ABSOLUTE_IX |
-                    MODE_ABSOLUTE_IY |
-                    MODE_INDIRECT_IX |
-                    MODE_INDIRECT_IY }, // .... compare (with accumulator)
-  { "CPX", asm_cpx, MODE_IMMEDIATE |
-                    MODE_ZEROPAGE |
-                    MODE_ABSOLUTE }, // .... compare with X
-  { "CPY", asm_cpy, MODE_IMMEDIATE |
-                    MODE_ZEROPAGE |
-                    MODE_ABSOLUTE }, // .... compare with Y
-  { "DEC", asm_dec, MODE_ZEROPAGE |
-                    MODE_ZEROPAGE_IX |
-                    MODE_ABSOLUTE |
-                    MODE_ABSOLUTE_IX }, // .... decrement
-  { "DEX", asm_dex, MODE_IMPLIED }, // .... decrement X
-  { "DEY", asm_dey, MODE_IMPLIED }, // .... decrement Y
-  { "EOR", asm_eor, MODE_IMMEDIATE |
-                    MODE_ZEROPAGE |
-                    MODE_ZEROPAGE_IX |
-                    MODE_ABSOLUTE |
-                    MODE_ABSOLUTE_IX |
-                    MODE_ABSOLUTE_IY |
-                    MODE_INDIRECT_IX |
-                    MODE_INDIRECT_IY }, // .... exclusive or (with accumulator)
-  { "INC", asm_inc, MODE_ZEROPAGE |
-                    MODE_ZEROPAGE_IX |
-                    MODE_ABSOLUTE |
-                    MODE_ABSOLUTE_IX }, // .... increment
-  { "INX", asm_inx, MODE_IMPLIED }, // .... increment X
-  { "INY", asm_iny, MODE_IMPLIED }, // .... increment Y
-  { "JMP", asm_jmp, MODE_ABSOLUTE |
-                    MODE_INDIRECT }, // .... jump
-  { "JSR", asm_jsr, MODE_ABSOLUTE }, // .... jump subroutine
-  { "LDA", asm_lda, MODE_IMMEDIATE |
-                    MODE_ZEROPAGE |
-                    MODE_ZEROPAGE_IX |
-                    MODE_ABSOLUTE |
-                    MODE_ABSOLUTE_IX |
-                    MODE_ABSOLUTE_IY |
-                    MODE_INDIRECT_IX |
-                    MODE_INDIRECT_IY,
-                    { 0x00, 0xAD, 0xBD, 0xB9, 0xA9, 0x00, 0x00, 
-                      0xA1, 0xB1, 0x00, 0xA5, 0xB5, 0x00} }, // .... load accumulator
-  { "LDX", asm_ldx, MODE_IMMEDIATE |
-                    MODE_ZEROPAGE |
-                    MODE_ZEROPAGE_IY |
-                    MODE_ABSOLUTE |
-                    MODE_ABSOLUTE_IY,
-                    { 0x00, 0xAE, 0x00, 0xBE, 0xA2, 0x00, 0x00, 
-                      0x00, 0x00, 0x00, 0xA6, 0x00, 0xB6} }, // .... load X
-  { "LDY", asm_ldy, MODE_IMMEDIATE |
-                    MODE_ZEROPAGE |
-                    MODE_ZEROPAGE_IX |
-                    MODE_ABSOLUTE |
-                    MODE_ABSOLUTE_IX }, // .... load Y
-  { "LSR", asm_lsr, MODE_ACCUMULATOR |
-                    MODE_ZEROPAGE |
-                    MODE_ZEROPAGE_IX |
-                    MODE_ABSOLUTE |
-                    MODE_ABSOLUTE_IX }, // .... logical shift right
-  { "NOP", asm_nop, MODE_IMPLIED }, // .... no operation
-  { "ORA", asm_ora, MODE_IMMEDIATE |
-                    MODE_ZEROPAGE |
-                    MODE_ZEROPAGE_IX |
-                    MODE_ABSOLUTE |
-                    MODE_ABSOLUTE_IX |
-                    MODE_ABSOLUTE_IY |
-                    MODE_INDIRECT_IX |
-                    MODE_INDIRECT_IY }, // .... or with accumulator
-  { "PHA", asm_pha, MODE_IMPLIED }, // .... push accumulator
-  { "PHP", asm_php, MODE_IMPLIED }, // .... push processor status (SR)
-  { "PLA", asm_pla, MODE_IMPLIED }, // .... pull accumulator
-  { "PLP", asm_plp, MODE_IMPLIED }, // .... pull processor status (SR)
-  { "ROL", asm_rol, MODE_ACCUMULATOR |
-                    MODE_ZEROPAGE |
-                    MODE_ZEROPAGE_IX |
-                    MODE_ABSOLUTE |
-                    MODE_ABSOLUTE_IX }, // .... rotate left
-  { "ROR", asm_ror, MODE_ACCUMULATOR |
-                    MODE_ZEROPAGE |
-                    MODE_ZEROPAGE_IX |
-                    MODE_ABSOLUTE |
-                    MODE_ABSOLUTE_IX }, // .... rotate right
-  { "RTI", asm_rti, MODE_IMPLIED }, // .... return from interrupt
-  { "RTS", asm_rts, MODE_IMPLIED }, // .... return from subroutine
-  { "SBC", asm_sbc, MODE_IMMEDIATE |
-                    MODE_ZEROPAGE |
-                    MODE_ZEROPAGE_IX |
-                    MODE_ABSOLUTE |
-                    MODE_ABSOLUTE_IX |
-                    MODE_ABSOLUTE_IY |
-                    MODE_INDIRECT_IX |
-                    MODE_INDIRECT_IY }, // .... subtract with carry
-  { "SEC", asm_sec, MODE_IMPLIED }, // .... set carry
-  { "SED", asm_sed, MODE_IMPLIED }, // .... set decimal
-  { "SEI", asm_sei, MODE_IMPLIED }, // .... set interrupt disable
-  { "STA", asm_sta, MODE_ZEROPAGE |
-                    MODE_ZEROPAGE_IX |
-                    MODE_ABSOLUTE |
-                    MODE_ABSOLUTE_IX |
-                    MODE_ABSOLUTE_IY |
-                    MODE_INDIRECT_IX |
-                    MODE_INDIRECT_IY }, // .... store accumulator
-  { "STX", asm_stx, MODE_ZEROPAGE |
-                    MODE_ZEROPAGE_IY |
-                    MODE_ABSOLUTE }, // .... store X
-  { "STY", asm_sty, MODE_ZEROPAGE |
-                    MODE_ZEROPAGE_IX |
-                    MODE_ABSOLUTE }, // .... store Y
-  { "TAX", asm_tax, MODE_IMPLIED }, // .... transfer accumulator to X
-  { "TAY", asm_tay, MODE_IMPLIED }, // .... transfer accumulator to Y
-  { "TSX", asm_tsx, MODE_IMPLIED }, // .... transfer stack pointer to X
-  { "TXA", asm_txa, MODE_IMPLIED }, // .... transfer X to accumulator
-  { "TXS", asm_txs, MODE_IMPLIED }, // .... transfer X to stack pointer
-  { "TYA", asm_tya, MODE_IMPLIED }, // .... transfer Y to accumulator
-  { NULL, NULL },
-};
 
 /* Variables used */
-FILE *src_file;
-FILE *lst_file;
-FILE *obj_file;
 char src_file_name[MAX_FILENAME_LENGTH];
-char buf[MAX_LINE_LENGTH];
-int cpu = CPUUNDEF;
-int PC = 0;
-int line = 1;
-int pass = 1;
-
-/******************************************************************************
- *                    Assembler directive handlers
- *****************************************************************************/
-/* The cpu directive */
-int dir_cpu(char *buf)
-{
-  char cpustr[64];
-  int i = -1;
-
-  getarg(cpustr, buf);
-  
-  /* See if the CPU is found in the table of supported cpu's */
-  while(cm[++i].cpu) {
-    if (!strncmp(cpustr, cm[i].cpu, strlen(cm[i].cpu))) {
-      cpu = cm[i].cpu_id;
-      return OK;
-    }
-  }
-  /* CPU not found in table */
-  return CPU_NOT_SUPPORTED;
-}
-
-/* The org directive */
-int dir_org(char *buf) 
-{
-  char orgarg[256];
-  int base = 10;
-  int pos = 0;
-  
-  /* Get the argument for the org directive */
-  getarg(orgarg, buf);
-  
-  /* The first character is significant for determining
-     the type of data here */
-  if (isdigit(orgarg[0]) || orgarg[0] == '$') {
-    /* it's a number, read it */
-    if (orgarg[pos] == '$') {
-      base = 16;
-      pos++;
-    }
-    PC = strtoul(&orgarg[pos], NULL, base);
-  }
-  printf("ORG directive set PC to $%x\n", PC);
-     
-  return 0;
-}
-
-int dir_byte(char *buf)
-{
-  *buf = 0;
-  printf("Reached %s !\n", __FUNCTION__);
-  return 0;
-}
-
-int dir_word(char *buf)
-{
-  *buf = 0;
-  printf("Reached %s !\n", __FUNCTION__);
-  return 0;
-}
-
-int dir_end(char *buf)
-{
-  *buf = 0;
-  printf("Reached %s !\n", __FUNCTION__);
-  return 0;
-}
-
-/******************************************************************************
- *                       Assembler mnemonics
- *****************************************************************************/
-int asm_adc(char *buf, struct asm_mnemonic *am)
-{
-  *buf = 0;
-  printf("Reached %s !\n", __FUNCTION__);
-  return 0;
-}
-
-int asm_and(char *buf, struct asm_mnemonic *am)
-{
-  *buf = 0;
-  printf("Reached %s !\n", __FUNCTION__);
-  return 0;
-}
-
-int asm_asl(char *buf, struct asm_mnemonic *am)
-{
-  int error = OK;
-  struct address_mode mode;
-  
-  error = evaluate_address(buf, &mode);
-  if (error) {
-    goto exit;
-  } else {
-    /* Check that it is a valid addressing mode */
-    if (!(mode.mode & am->amodes)) {
-      printf("Not a valid addressing mode\n");
-      error = ASM_INVALID_ADDRESSING_MODE;
-    } 
-  }
-exit:
-  return error;
-}
-
-int asm_bcc(char *buf, struct asm_mnemonic *am)
-{
-  *buf = 0;
-  printf("Reached %s !\n", __FUNCTION__);
-  return 0;
-}
-
-int asm_bcs(char *buf, struct asm_mnemonic *am)
-{
-  *buf = 0;
-  printf("Reached %s !\n", __FUNCTION__);
-  return 0;
-}
-
-int asm_beq(char *buf, struct asm_mnemonic *am)
-{
-  *buf = 0;
-  printf("Reached %s !\n", __FUNCTION__);
-  return 0;
-}
-
-int asm_bit(char *buf, struct asm_mnemonic *am)
-{
-  *buf = 0;
-  printf("Reached %s !\n", __FUNCTION__);
-  return 0;
-}
-
-int asm_bmi(char *buf, struct asm_mnemonic *am)
-{
-  *buf = 0;
-  printf("Reached %s !\n", __FUNCTION__);
-  return 0;
-}
-
-int asm_bne(char *buf, struct asm_mnemonic *am)
-{
-  *buf = 0;
-  printf("Reached %s !\n", __FUNCTION__);
-  return 0;
-}
-
-int asm_bpl(char *buf, struct asm_mnemonic *am)
-{
-  *buf = 0;
-  printf("Reached %s !\n", __FUNCTION__);
-  return 0;
-}
-
-int asm_brk(char *buf, struct asm_mnemonic *am)
-{
-  *buf = 0;
-  printf("Reached %s !\n", __FUNCTION__);
-  return 0;
-}
-
-int asm_bvc(char *buf, struct asm_mnemonic *am)
-{
-  *buf = 0;
-  printf("Reached %s !\n", __FUNCTION__);
-  return 0;
-}
-
-int asm_bvs(char *buf, struct asm_mnemonic *am)
-{
-  *buf = 0;
-  printf("Reached %s !\n", __FUNCTION__);
-  return 0;
-}
-
-int asm_clc(char *buf, struct asm_mnemonic *am)
-{
-  *buf = 0;
-  printf("Reached %s !\n", __FUNCTION__);
-  return 0;
-}
-
-int asm_cld(char *buf, struct asm_mnemonic *am)
-{
-  *buf = 0;
-  printf("Reached %s !\n", __FUNCTION__);
-  return 0;
-}
-
-int asm_cli(char *buf, struct asm_mnemonic *am)
-{
-  *buf = 0;
-  printf("Reached %s !\n", __FUNCTION__);
-  return 0;
-}
-
-int asm_clv(char *buf, struct asm_mnemonic *am)
-{
-  *buf = 0;
-  printf("Reached %s !\n", __FUNCTION__);
-  return 0;
-}
-
-int asm_cmp(char *buf, struct asm_mnemonic *am)
-{
-  *buf = 0;
-  printf("Reached %s !\n", __FUNCTION__);
-  return 0;
-}
-
-int asm_cpx(char *buf, struct asm_mnemonic *am)
-{
-  *buf = 0;
-  printf("Reached %s !\n", __FUNCTION__);
-  return 0;
-}
-
-int asm_cpy(char *buf, struct asm_mnemonic *am)
-{
-  *buf = 0;
-  printf("Reached %s !\n", __FUNCTION__);
-  return 0;
-}
-
-int asm_dec(char *buf, struct asm_mnemonic *am)
-{
-  *buf = 0;
-  printf("Reached %s !\n", __FUNCTION__);
-  return 0;
-}
-
-int asm_dex(char *buf, struct asm_mnemonic *am)
-{
-  *buf = 0;
-  printf("Reached %s !\n", __FUNCTION__);
-  return 0;
-}
-
-int asm_dey(char *buf, struct asm_mnemonic *am)
-{
-  *buf = 0;
-  printf("Reached %s !\n", __FUNCTION__);
-  return 0;
-}
-
-int asm_eor(char *buf, struct asm_mnemonic *am)
-{
-  *buf = 0;
-  printf("Reached %s !\n", __FUNCTION__);
-  return 0;
-}
-
-int asm_inc(char *buf, struct asm_mnemonic *am)
-{
-  *buf = 0;
-  printf("Reached %s !\n", __FUNCTION__);
-  return 0;
-}
-
-int asm_inx(char *buf, struct asm_mnemonic *am)
-{
-  *buf = 0;
-  printf("Reached %s !\n", __FUNCTION__);
-  return 0;
-}
+char base_name[MAX_FILENAME_LENGTH];
 
-int asm_iny(char *buf, struct asm_mnemonic *am)
-{
-  *buf = 0;
-  printf("Reached %s !\n", __FUNCTION__);
-  return 0;
-}
-
-int asm_jmp(char *buf, struct asm_mnemonic *am)
-{
-  *buf = 0;
-  printf("Reached %s !\n", __FUNCTION__);
-  return 0;
-}
-
-int asm_jsr(char *buf, struct asm_mnemonic *am)
-{
-  *buf = 0;
-  printf("Reached %s !\n", __FUNCTION__);
-  return 0;
-}
-
-int asm_lda(char *buf, struct asm_mnemonic *am)
-{
-  int error = OK;
-  struct address_mode mode;
-  struct output_descriptor od;
-  unsigned char data[4];
-  
-  od.data = &data[0];
-  error = evaluate_address(buf, &mode);
-  if (error) {
-    goto exit;
-  } else {
-    /* Check that it is a valid addressing mode */
-    printf("Addressing mode %d, value = %d\n", mode.mode, mode.value);
-    if (!(mode.mode & am->amodes)) {
-      error = ASM_INVALID_ADDRESSING_MODE;
-    } else {
-      int decmode = mode2dec(mode.mode);
-      data[0] = am->opcodes[decmode];
-      switch (mode.mode) {
-        case MODE_IMMEDIATE:
-          od.length = 2;
-          data[1] = mode.value;
-          output(&od);
-          break;
-        case MODE_ZEROPAGE:
-          break;
-        case MODE_ZEROPAGE_IX:
-          break;
-        case MODE_ABSOLUTE:
-          break;
-        case MODE_ABSOLUTE_IX:
-          break;
-        case MODE_ABSOLUTE_IY:
-          break;
-        case MODE_INDIRECT_IX:
-          break;
-        case MODE_INDIRECT_IY:
-          break;
-        default:
-          printf("ERROR, an internal error occured, terminating !\n");
-          exit(1);
-          break;
-      }
-    }
-  }
-exit:
-  return error;
-}
-
-int asm_ldx(char *buf, struct asm_mnemonic *am)
-{
-  int error = OK;
-  struct address_mode mode;
-  struct output_descriptor od;
-  unsigned char data[4];
-  
-  od.data = &data[0];
-  error = evaluate_address(buf, &mode);
-  if (error) {
-    goto exit;
-  } else {
-    /* Check that it is a valid addressing mode */
-    printf("Addressing mode %d, value = %d\n", mode.mode, mode.value);
-    if (!(mode.mode & am->amodes)) {
-      error = ASM_INVALID_ADDRESSING_MODE;
-    } else {
-      int decmode = mode2dec(mode.mode);
-      data[0] = am->opcodes[decmode];
-      switch (mode.mode) {
-        case MODE_IMMEDIATE:
-          od.length = 2;
-          data[1] = mode.value;
-          output(&od);
-          break;
-        case MODE_ZEROPAGE:
-          break;
-        case MODE_ZEROPAGE_IY:
-          break;
-        case MODE_ABSOLUTE:
-          break;
-        case MODE_ABSOLUTE_IY:
-          break;
-        default:
-          printf("ERROR, an internal error occured, terminating !\n");
-          exit(1);
-          break;
-      }
-    }
-  }
-exit:
-  return error;
-}
-
-int asm_ldy(char *buf, struct asm_mnemonic *am)
-{
-  *buf = 0;
-  printf("Reached %s !\n", __FUNCTION__);
-  return 0;
-}
-
-int asm_lsr(char *buf, struct asm_mnemonic *am)
-{
-  *buf = 0;
-  printf("Reached %s !\n", __FUNCTION__);
-  return 0;
-}
-
-int asm_nop(char *buf, struct asm_mnemonic *am)
-{
-  *buf = 0;
-  printf("Reached %s !\n", __FUNCTION__);
-  return 0;
-}
-
-int asm_ora(char *buf, struct asm_mnemonic *am)
-{
-  *buf = 0;
-  printf("Reached %s !\n", __FUNCTION__);
-  return 0;
-}
-
-int asm_pha(char *buf, struct asm_mnemonic *am)
-{
-  *buf = 0;
-  printf("Reached %s !\n", __FUNCTION__);
-  return 0;
-}
-
-int asm_php(char *buf, struct asm_mnemonic *am)
-{
-  *buf = 0;
-  printf("Reached %s !\n", __FUNCTION__);
-  return 0;
-}
-
-int asm_pla(char *buf, struct asm_mnemonic *am)
-{
-  *buf = 0;
-  printf("Reached %s !\n", __FUNCTION__);
-  return 0;
-}
-
-int asm_plp(char *buf, struct asm_mnemonic *am)
-{
-  *buf = 0;
-  printf("Reached %s !\n", __FUNCTION__);
-  return 0;
-}
-
-int asm_rol(char *buf, struct asm_mnemonic *am)
-{
-  *buf = 0;
-  printf("Reached %s !\n", __FUNCTION__);
-  return 0;
-}
-
-int asm_ror(char *buf, struct asm_mnemonic *am)
-{
-  *buf = 0;
-  printf("Reached %s !\n", __FUNCTION__);
-  return 0;
-}
-
-int asm_rti(char *buf, struct asm_mnemonic *am)
-{
-  *buf = 0;
-  printf("Reached %s !\n", __FUNCTION__);
-  return 0;
-}
-
-int asm_rts(char *buf, struct asm_mnemonic *am)
-{
-  *buf = 0;
-  printf("Reached %s !\n", __FUNCTION__);
-  return 0;
-}
-
-int asm_sbc(char *buf, struct asm_mnemonic *am)
-{
-  *buf = 0;
-  printf("Reached %s !\n", __FUNCTION__);
-  return 0;
-}
-
-int asm_sec(char *buf, struct asm_mnemonic *am)
-{
-  *buf = 0;
-  printf("Reached %s !\n", __FUNCTION__);
-  return 0;
-}
-
-int asm_sed(char *buf, struct asm_mnemonic *am)
-{
-  *buf = 0;
-  printf("Reached %s !\n", __FUNCTION__);
-  return 0;
-}
-
-int asm_sei(char *buf, struct asm_mnemonic *am)
-{
-  int error = OK;
-  struct output_descriptor od;
-  unsigned char data;
-  
-  /* Implied addressing mode, we need to make sure no argument is
-     specified */
-  buf = skip_white(buf);
-  if (!isendofline(*buf)) {
-    error = ASM_UNEXPECTED_CHARACTER;
-  } else {
-    od.length = 1;
-    od.data = &data;
-    output(&od);
-  }
-  return error;
-}
-
-int asm_sta(char *buf, struct asm_mnemonic *am)
-{
-  *buf = 0;
-  printf("Reached %s !\n", __FUNCTION__);
-  return 0;
-}
-
-int asm_stx(char *buf, struct asm_mnemonic *am)
-{
-  *buf = 0;
-  printf("Reached %s !\n", __FUNCTION__);
-  return 0;
-}
-
-int asm_sty(char *buf, struct asm_mnemonic *am)
-{
-  *buf = 0;
-  printf("Reached %s !\n", __FUNCTION__);
-  return 0;
-}
-
-int asm_tax(char *buf, struct asm_mnemonic *am)
-{
-  *buf = 0;
-  printf("Reached %s !\n", __FUNCTION__);
-  return 0;
-}
-
-int asm_tay(char *buf, struct asm_mnemonic *am)
-{
-  *buf = 0;
-  printf("Reached %s !\n", __FUNCTION__);
-  return 0;
-}
-
-int asm_tsx(char *buf, struct asm_mnemonic *am)
-{
-  *buf = 0;
-  printf("Reached %s !\n", __FUNCTION__);
-  return 0;
-}
-
-int asm_txa(char *buf, struct asm_mnemonic *am)
+/*
+ * Output files not named are named after the source, with its extension
+ * replaced by the one of the format
+ */
+static void set_base_name(void)
 {
-  *buf = 0;
-  printf("Reached %s !\n", __FUNCTION__);
-  return 0;
-}
+  char *dot;
+  char *slash;
 
-int asm_txs(char *buf, struct asm_mnemonic *am)
-{
-  *buf = 0;
-  printf("Reached %s !\n", __FUNCTION__);
-  return 0;
+  strncpy(base_name, src_file_name, MAX_FILENAME_LENGTH - 1);
+  dot = strrchr(base_name, '.');
+  slash = strrchr(base_name, '/');
+  if (dot && (!slash || dot > slash))
+    *dot = '\0';
 }
 
-int asm_tya(char *buf, struct asm_mnemonic *am)
-{
-  *buf = 0;
-  printf("Reached %s !\n", __FUNCTION__);
-  return 0;
-}
-
-
 /*
- * Parse current line
+ * Add an output file from a format[:file] argument
  */
-static int parse(char *buf)
-{
-  int i = -1;
-
-  //printf("Parsing: '%s'\n", buf);
-  while (ad[++i].directive) {
-//    printf ("Checking against %s\n", ad[i].directive);
-    if (!strncmp(buf, ad[i].directive, strlen(ad[i].directive))) {
-      if (ad[i].func) {
-        return ad[i].func((char *)(buf + strlen(ad[i].directive)));
-      } else {
-        printf("A seriouos error occured in the application, terminating !\n");
-        printf("Could not find a function to call for the %s directive.\n", ad[i].directive);
-        exit(1);
-      }
-    }
-  }
-  /* No assembler directives were found so now we look for assembler mnemonics */
-  i = -1;
-  while (am[++i].mnemonic) {
-    char temp[10];
-    /* Convert mnemonic to upper case before comparing */
-    strntoupper(temp, buf, 10);
-    /* The strlen in the next line assumes that no mnemonic is longer than 10 characters */
-    if (!strncmp(temp, am[i].mnemonic, strlen(am[i].mnemonic))) {
-      if (am[i].func) {
-        return am[i].func((char *)(buf + strlen(am[i].mnemonic)), &am[i]);
-      } else {
-        printf("A seriouos error occured in the application, terminating !\n");
-        printf("Could not find a function to call for the %s mnemonic.\n", am[i].mnemonic);
-        exit(1);
-      }
-    }
-  }
-  return NO_VALID_DIRECTIVE_OR_MNEMONIC;
+static int add_output(struct asm65_context *ac, char *arg)
+{
+  char *colon = strchr(arg, ':');
+
+  if (colon)
+    *colon++ = '\0';
+  return asm65_add_output(ac, arg, colon);
+}
+
+static void usage(char *name)
+{
+  const char *format;
+  int i;
+
+  printf("Usage: %s [-1] [-c] [-r] [-v] [-d levels] [-o output] [-f format[:output]] [-l listing] [-I dir] [-C dir] [-M kbytes] [--stats] [--trace file] source\n", name);
+  printf("  -1         Assemble in a single pass, patching forward references,\n");
+  printf("             not with -c or -r\n");
+  printf("  -c         Write a relocatable object file for link65\n");
+  printf("  -r         Relax branches out of range into a JMP, reporting each one,\n");
+  printf("             not with -1\n");
+  printf("  -o output  Binary output file, or the object file with -c\n");
+  printf("  -f format  Output file format, may be given more than once:");
+  for (i = 0; (format = asm65_output_format(i)); i++)
+    printf(" %s", format);
+  printf("\n");
+  printf("             The file is named after the source unless given\n");
+  printf("  -l listing Listing file\n");
+  printf("  -I dir     Look for included files in dir, may be given more than once\n");
+  printf("  -C dir     Cache the results in dir, an unchanged source isn't assembled again\n");
+  printf("  -M kbytes  Size limit of the cache, default %d\n",
+         ASM65_CACHE_DEFAULT_SIZE);
+  printf("  -d levels  Log levels, like expr=trace,sym=debug or all=off\n");
+  printf("             Modules expr sym parse output, levels off info debug trace\n");
+  printf("  -v         Print the code of every instruction, same as -d output=debug\n");
+  printf("  --stats    Print the time of every phase and what was counted\n");
+  printf("  --trace file  Write the phases and the files read as a Chrome trace\n");
+  exit(1);
 }
 
 /*
- * Process incomming line
+ * Report the last error, on the line it occurred on if there is one
  */
-static int process_line(char *buf)
+static void report_error(struct asm65_context *ac)
 {
+  const char *file;
+  const char *text;
   int error;
-  
-  /* Check first character to see if we have a
-     label defined here. */
-
-  if (isalpha(*buf)) {
-    struct symbol_entry *se = read_and_store_label(buf);
-    if (!se)
-      return SYMBOL_ALREADY_EXIST;
-    buf = skiptowhite(buf);
-    buf = skip_white(buf);
-    /* Check if we have an assignment here */
-    if (*buf == '=' || !strncmp(buf, "EQU", 3)) {
-      /* Move to next white space character */
-      buf = skiptowhite(buf);
-      /* And get the value */
-      printf ("Evaluating expression %s!\n", buf);
-      return eval_expr(buf, NULL, &se->value, 0, NULL);
-    }
-  }
-
-  buf = skip_white(buf);
-  /* Is it a comment or end of line ? */
-  if (*buf == ';' || *buf == '\n' || *buf == '\r' || !*buf)
-    return;
+  int line;
+
+  error = asm65_error_detail(ac, &text, &line, &file);
+  if (!line)
+    printf("%s !\n", text);
+  else if (file)
+    printf ("Error %s (error %d), occurred on line %d of %s, terminating execution !\n",
+        text, error, line, file);
+  else
+    printf ("Error %s (error %d), occurred on line %d, terminating execution !\n",
+        text, error, line);
+}
+
+/* Options with only a long name */
+enum long_options {
+  OPT_STATS = 256,
+  OPT_TRACE,
+};
 
-  return parse(buf);
-}
+static struct option long_options[] = {
+  { "stats", no_argument,       NULL, OPT_STATS },
+  { "trace", required_argument, NULL, OPT_TRACE },
+  { NULL,    0,                 NULL, 0 }
+};
 
 int main (int argc, char **argv)
 {
+  struct asm65_context *ac;
   int error;
+  int flags = 0;
+  int sinks_given = 0;
+  char *out_file_name = NULL;
+  char *cache_dir = NULL;
+  long cache_size = ASM65_CACHE_DEFAULT_SIZE;
+  int print_stats = 0;
+  char *end;
+  int line;
+  int opt;
   
-  printf ("Mag6502 Assembler V0.0001\n");
+  ac = asm65_create(0);
+  if (!ac) {
+    printf("Could not allocate necessary memory, terminating !\n");
+    exit(1);
+  }
+  asm65_set_log(ac, stdout);
+
+  while ((opt = getopt_long(argc, argv, "1cro:f:l:I:C:M:d:v", long_options,
+                            NULL)) != -1) {
+    switch (opt) {
+      case '1':
+        flags |= ASM65_SINGLE_PASS;
+        break;
+      case 'c':
+        flags |= ASM65_OBJECT;
+        break;
+      case 'r':
+        flags |= ASM65_RELAX;
+        break;
+      case 'o':
+        out_file_name = optarg;
+        break;
+      case 'f':
+        if (add_output(ac, optarg))
+          usage(argv[0]);
+        sinks_given = 1;
+        break;
+      case 'l':
+        if (asm65_set_listing(ac, optarg))
+          usage(argv[0]);
+        break;
+      case 'I':
+        if (asm65_add_include_path(ac, optarg))
+          usage(argv[0]);
+        break;
+      case 'C':
+        cache_dir = optarg;
+        break;
+      case 'M':
+        cache_size = strtol(optarg, &end, 10);
+        if (end == optarg || *end || cache_size <= 0)
+          usage(argv[0]);
+        break;
+      case 'd':
+        if (asm65_set_log_levels(ac, optarg))
+          usage(argv[0]);
+        break;
+      case 'v':
+        asm65_set_log_levels(ac, "output=debug");
+        break;
+      case OPT_STATS:
+        print_stats = 1;
+        break;
+      case OPT_TRACE:
+        if (asm65_set_trace(ac, optarg))
+          usage(argv[0]);
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
 
-  if (argc < 2) {
+  if (optind >= argc) {
     printf("No source file ! Pls try again.\n");
     exit(1);
   }
-
-  strncpy(src_file_name, argv[1], MAX_FILENAME_LENGTH);
-  printf("Assembling source file %s\n", src_file_name);
-
-  src_file =  fopen(src_file_name, "r");
-  if (!src_file) {
-    printf("Could not find file !\n");
+  /* Relocation and relaxation need all symbols known, forward ones too */
+  if ((flags & (ASM65_OBJECT | ASM65_RELAX)) && (flags & ASM65_SINGLE_PASS)) {
+    printf("Option -1 can't be used with -%c, it needs all symbols known before\n"
+           "anything is output. Pls try again.\n",
+           flags & ASM65_OBJECT ? 'c' : 'r');
     exit(1);
   }
-
-  /* Initialize the symbol table */
-  sym_init();
-  
-  while (fgets(buf, MAX_LINE_LENGTH, src_file)!= NULL) {
-    if ((error = process_line(buf))) {
-      printf ("Error %s (error %d), occurred on line %d, terminating execution !\n", 
-          error_msgs[error], error, line);
-      break;
-    }
-    line++;
+  asm65_set_flags(ac, flags);
+  if (out_file_name && (flags & ASM65_OBJECT)) {
+    if (asm65_set_object_file(ac, out_file_name))
+      usage(argv[0]);
+  } else if (out_file_name) {
+    if (asm65_add_output(ac, "raw", out_file_name))
+      usage(argv[0]);
+    sinks_given = 1;
   }
+  if (!sinks_given)
+    asm65_add_output(ac, "raw", NULL);
+  if (cache_dir && asm65_set_cache(ac, cache_dir, cache_size))
+    usage(argv[0]);
 
-#if defined(PRINT_SYMBOLS)
-  {
-    struct symbol_entry *se;
-    int cnt = num_symbols;
-    
-    se = se_first;
-    
-    while (cnt--) {
-      printf ("Symbol: %s, name length: %d, Value 0x%x\n", se->symbol_name, se->name_length, se->value);
-      se = sym_next_symbol(se);
-    }
+  strncpy(src_file_name, argv[optind], MAX_FILENAME_LENGTH - 1);
+  set_base_name();
+
+  error = asm65_assemble_file(ac, src_file_name);
+  if (error) {
+    report_error(ac);
+    /* The source or the cache couldn't be opened, there is nothing more */
+    asm65_error_detail(ac, NULL, &line, NULL);
+    if (!line)
+      exit(1);
+  }
+  if (!error && asm65_write(ac, base_name)) {
+    report_error(ac);
+    error = 1;
   }
-#endif
-  /* Clean up the symbol table */
-  sym_clean_up();
 
-  fclose(src_file);
-  return 0;
+  if (print_stats)
+    asm65_report_stats(ac);
+  if (asm65_write_trace(ac)) {
+    report_error(ac);
+    error = 1;
+  }
+  asm65_destroy(ac);
+  return error ? 1 : 0;
 }
@@ -0,0 +1,398 @@
+/*
+ * Relocatable object files.
+ * The assembler collects the sections and relocations while assembling
+ * and writes them with the symbols and the code from the output image
+ * at the end. The linker reads them back in one go.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "global.h"
+#include "errors.h"
+#include "object.h"
+#include "output.h"
+#include "symbols.h"
+#include "context.h"
+
+/*
+ * Make room for one more element in a growing array
+ */
+static void *obj_grow(struct asm65_context *ac, void *array, int count,
+                      int *max, int size)
+{
+  if (count < *max)
+    return array;
+  *max = *max ? *max * 2 : 64;
+  array = realloc(array, *max * size);
+  if (!array)
+    out_of_memory(ac);
+  return array;
+}
+
+/******************************************************************************
+ *                       Assembler side
+ *****************************************************************************/
+/*
+ * Start without any sections
+ */
+void obj_init(struct asm65_context *ac)
+{
+  struct obj_state *os = &ac->obj;
+
+  os->sections = NULL;
+  os->num_sections = os->max_sections = 0;
+  os->relocs = NULL;
+  os->num_relocs = os->max_relocs = 0;
+  os->imports = NULL;
+  os->num_imports = os->max_imports = 0;
+}
+
+/*
+ * End the current section at PC and start a new one at address
+ */
+void obj_section(struct asm65_context *ac, int address, int relocatable)
+{
+  struct obj_state *os = &ac->obj;
+  struct obj_section *sec;
+
+  obj_end(ac);
+  os->sections = obj_grow(ac, os->sections, os->num_sections,
+                          &os->max_sections, sizeof (struct obj_section));
+  sec = &os->sections[os->num_sections++];
+  sec->flags = relocatable ? OBJ_SEC_RELOCATABLE : 0;
+  sec->base = address;
+  sec->size = -1;
+  sec->data = NULL;
+}
+
+/*
+ * End the current section at PC
+ */
+void obj_end(struct asm65_context *ac)
+{
+  struct obj_section *sec;
+
+  if (!ac->obj.num_sections)
+    return;
+  sec = &ac->obj.sections[ac->obj.num_sections - 1];
+  if (sec->size < 0)
+    sec->size = ac->PC > sec->base ? ac->PC - sec->base : 0;
+}
+
+/*
+ * Make a section reach at least up to end, code in it grew after it
+ * was ended
+ */
+void obj_extend(struct asm65_context *ac, int section, int end)
+{
+  struct obj_section *sec = &ac->obj.sections[section];
+
+  if (end - sec->base > sec->size)
+    sec->size = end - sec->base;
+}
+
+/*
+ * The section code is being assembled in, -1 without sections
+ */
+int obj_current_section(struct asm65_context *ac)
+{
+  return ac->obj.num_sections - 1;
+}
+
+/*
+ * Index of an imported symbol in the symbol table of the object file,
+ * the imports come first
+ */
+int obj_import(struct asm65_context *ac, struct sym_name *name)
+{
+  struct obj_state *os = &ac->obj;
+  struct symbol_entry *se = name->symbol;
+
+  if (!se)
+    se = sym_new_symbol(ac, name);
+  if (!se->import) {
+    os->imports = obj_grow(ac, os->imports, os->num_imports,
+                           &os->max_imports, sizeof (struct symbol_entry *));
+    os->imports[os->num_imports++] = se;
+    se->import = os->num_imports;
+  }
+  return se->import - 1;
+}
+
+/*
+ * Add a relocation of the bytes at address in section. The target is
+ * an imported symbol, or a section of this module if symbol is -1, and
+ * value the address in it assembled into the bytes.
+ */
+int obj_add_reloc(struct asm65_context *ac, int section, int address,
+                  int type, int symbol, int target, int value)
+{
+  struct obj_state *os = &ac->obj;
+  struct obj_reloc *rel;
+
+  os->relocs = obj_grow(ac, os->relocs, os->num_relocs, &os->max_relocs,
+                        sizeof (struct obj_reloc));
+  rel = &os->relocs[os->num_relocs++];
+  rel->section = section;
+  rel->offset = address - os->sections[section].base;
+  rel->type = type;
+  rel->symbol = symbol;
+  rel->target = symbol < 0 ? target : -1;
+  rel->addend = symbol < 0 ? value - os->sections[target].base : value;
+  LOG(ac, LOG_OUTPUT, LOG_DEBUG, "Relocation at $%04x type %d\n", address,
+      type);
+  return OK;
+}
+
+static void put_word(FILE *file, int value)
+{
+  putc(value & 0xff, file);
+  putc((value >> 8) & 0xff, file);
+  putc((value >> 16) & 0xff, file);
+  putc((value >> 24) & 0xff, file);
+}
+
+static void put_symbol(FILE *file, int kind, int section, int value,
+                       struct sym_name *name)
+{
+  put_word(file, kind);
+  put_word(file, section);
+  put_word(file, value);
+  put_word(file, name->length);
+  fwrite(name->text, 1, name->length, file);
+}
+
+/*
+ * Write the object file, every defined symbol is exported.
+ * Returns OK, or FILE_ACCESS_FAILED if it can't be written.
+ */
+int obj_write(struct asm65_context *ac, char *file_name)
+{
+  struct obj_state *os = &ac->obj;
+  struct symbol_entry *se;
+  struct obj_section *sec;
+  struct obj_reloc *rel;
+  int num_exports = 0;
+  FILE *file;
+  int i;
+
+  obj_end(ac);
+  for (se = ac->sym.se_first; se; se = se->next)
+    if (se->defined)
+      num_exports++;
+
+  file = fopen(file_name, "wb");
+  if (!file)
+    return error_report(ac, "Could not write object file %s", file_name);
+
+  fwrite(OBJ_MAGIC, 1, 4, file);
+  put_word(file, OBJ_VERSION);
+  put_word(file, os->num_sections);
+  put_word(file, os->num_imports + num_exports);
+  put_word(file, os->num_relocs);
+
+  for (i = 0; i < os->num_sections; i++) {
+    sec = &os->sections[i];
+    put_word(file, sec->flags);
+    put_word(file, sec->base);
+    put_word(file, sec->size);
+    fwrite(&ac->output.image[sec->base], 1, sec->size, file);
+  }
+
+  for (i = 0; i < os->num_imports; i++)
+    put_symbol(file, OBJ_SYM_IMPORT, -1, 0, os->imports[i]->name);
+  for (se = ac->sym.se_first; se; se = se->next)
+    if (se->defined)
+      put_symbol(file, OBJ_SYM_EXPORT, se->section, se->value, se->name);
+
+  for (i = 0; i < os->num_relocs; i++) {
+    rel = &os->relocs[i];
+    put_word(file, rel->section);
+    put_word(file, rel->offset);
+    put_word(file, rel->type);
+    put_word(file, rel->symbol);
+    put_word(file, rel->target);
+    put_word(file, rel->addend);
+  }
+
+  if (ferror(file) | fclose(file))
+    return error_report(ac, "Could not write object file %s", file_name);
+  LOG(ac, LOG_OUTPUT, LOG_INFO, "Wrote %d sections, %d symbols and "
+      "%d relocations to %s\n", os->num_sections, os->num_imports + num_exports, os->num_relocs,
+      file_name);
+  return OK;
+}
+
+void obj_clean_up(struct asm65_context *ac)
+{
+  free(ac->obj.sections);
+  free(ac->obj.relocs);
+  free(ac->obj.imports);
+  obj_init(ac);
+}
+
+/******************************************************************************
+ *                       Linker side
+ *****************************************************************************/
+struct reader {
+  unsigned char *p;
+  unsigned char *end;
+  int error;
+};
+
+static int get_word(struct reader *rd)
+{
+  unsigned char *p = rd->p;
+
+  if (rd->end - p < 4) {
+    rd->error = 1;
+    return 0;
+  }
+  rd->p += 4;
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+static unsigned char *get_bytes(struct reader *rd, int length)
+{
+  unsigned char *p = rd->p;
+
+  if (length < 0 || rd->end - p < length) {
+    rd->error = 1;
+    return NULL;
+  }
+  rd->p += length;
+  return p;
+}
+
+static void *obj_alloc(struct asm65_context *ac, int count, int size)
+{
+  void *p = calloc(count ? count : 1, size);
+
+  if (!p)
+    out_of_memory(ac);
+  return p;
+}
+
+/*
+ * Read an object file. Section data points into the file contents,
+ * which are kept until the module is freed. Symbol names are interned.
+ * Returns 0 on success or -1 with the message kept in the context.
+ */
+int obj_read(struct asm65_context *ac, char *file_name,
+             struct obj_module *module)
+{
+  struct reader rd;
+  struct obj_section *sec;
+  struct obj_symbol *sym;
+  struct obj_reloc *rel;
+  unsigned char *name;
+  unsigned char *buf;
+  FILE *file;
+  long size;
+  int length;
+  int i;
+
+  memset(module, 0, sizeof (struct obj_module));
+  module->file_name = file_name;
+
+  file = fopen(file_name, "rb");
+  if (!file || fseek(file, 0, SEEK_END) || (size = ftell(file)) < 0 ||
+      fseek(file, 0, SEEK_SET)) {
+    error_report(ac, "Could not read object file %s", file_name);
+    if (file)
+      fclose(file);
+    return -1;
+  }
+  buf = obj_alloc(ac, size, 1);
+  if (fread(buf, 1, size, file) != size) {
+    error_report(ac, "Could not read object file %s", file_name);
+    fclose(file);
+    free(buf);
+    return -1;
+  }
+  fclose(file);
+  module->data = buf;
+
+  rd.p = buf;
+  rd.end = buf + size;
+  rd.error = 0;
+  name = get_bytes(&rd, 4);
+  if (!name || memcmp(name, OBJ_MAGIC, 4) || get_word(&rd) != OBJ_VERSION) {
+    error_report(ac, "%s is not an object file", file_name);
+    return -1;
+  }
+
+  module->num_sections = get_word(&rd);
+  module->num_symbols = get_word(&rd);
+  module->num_relocs = get_word(&rd);
+  if (rd.error || module->num_sections < 0 || module->num_symbols < 0 ||
+      module->num_relocs < 0 || module->num_sections > size ||
+      module->num_symbols > size || module->num_relocs > size) {
+    error_report(ac, "Object file %s is corrupt", file_name);
+    return -1;
+  }
+  module->sections = obj_alloc(ac, module->num_sections,
+                               sizeof (struct obj_section));
+  module->symbols = obj_alloc(ac, module->num_symbols,
+                              sizeof (struct obj_symbol));
+  module->relocs = obj_alloc(ac, module->num_relocs,
+                             sizeof (struct obj_reloc));
+
+  for (i = 0; i < module->num_sections; i++) {
+    sec = &module->sections[i];
+    sec->flags = get_word(&rd);
+    sec->base = get_word(&rd);
+    sec->size = get_word(&rd);
+    sec->data = get_bytes(&rd, sec->size);
+    sec->address = sec->base;
+  }
+
+  for (i = 0; i < module->num_symbols && !rd.error; i++) {
+    sym = &module->symbols[i];
+    sym->kind = get_word(&rd);
+    sym->section = get_word(&rd);
+    sym->value = get_word(&rd);
+    length = get_word(&rd);
+    name = get_bytes(&rd, length);
+    if (name)
+      sym->name = sym_intern(ac, (char *)name, length);
+    if (sym->section < -1 || sym->section >= module->num_sections)
+      rd.error = 1;
+  }
+
+  for (i = 0; i < module->num_relocs && !rd.error; i++) {
+    rel = &module->relocs[i];
+    rel->section = get_word(&rd);
+    rel->offset = get_word(&rd);
+    rel->type = get_word(&rd);
+    rel->symbol = get_word(&rd);
+    rel->target = get_word(&rd);
+    rel->addend = get_word(&rd);
+    if (rel->section < 0 || rel->section >= module->num_sections ||
+        rel->offset < 0 ||
+        rel->offset + (rel->type == OBJ_RELOC_WORD ? 2 : 1) >
+        module->sections[rel->section].size ||
+        rel->symbol >= module->num_symbols ||
+        (rel->symbol < 0 && (rel->target < 0 ||
+                             rel->target >= module->num_sections)))
+      rd.error = 1;
+  }
+
+  if (rd.error) {
+    error_report(ac, "Object file %s is corrupt", file_name);
+    return -1;
+  }
+  LOG(ac, LOG_OUTPUT, LOG_DEBUG, "Read %d sections, %d symbols and "
+      "%d relocations from %s\n", module->num_sections, module->num_symbols, module->num_relocs, file_name);
+  return 0;
+}
+
+void obj_free(struct obj_module *module)
+{
+  free(module->sections);
+  free(module->symbols);
+  free(module->relocs);
+  free(module->data);
+  memset(module, 0, sizeof (struct obj_module));
+}
@@ -0,0 +1,119 @@
+/*
+ * Relocatable object files, written by the assembler and read by the linker
+ */
+#ifndef __OBJECT_H__
+#define __OBJECT_H__
+
+#define OBJ_MAGIC             "A65\x1a"
+#define OBJ_VERSION           1
+#define OBJ_EXTENSION         ".obj"
+
+struct asm65_context;
+struct sym_name;
+struct symbol_entry;
+
+/*
+ * The object file is a header followed by the section table with the
+ * bytes of each section, the symbol table and the relocation list. All
+ * numbers are stored as 32 bit little endian words, a symbol name as its
+ * length followed by the characters.
+ */
+enum obj_section_flags {
+  OBJ_SEC_RELOCATABLE = 0x01,   /* Placed by the linker, else at base */
+};
+
+enum obj_symbol_kinds {
+  OBJ_SYM_EXPORT,               /* Defined in this module */
+  OBJ_SYM_IMPORT,               /* Used but defined in another module */
+};
+
+enum obj_reloc_types {
+  OBJ_RELOC_WORD,               /* Two bytes, low byte first */
+  OBJ_RELOC_LOW,                /* Low byte of the value */
+  OBJ_RELOC_HIGH,               /* High byte of the value */
+};
+
+/*
+ * A block of code assembled from base. The section a line belongs to is
+ * given by the last ORG before it, code before any ORG is relocatable.
+ */
+struct obj_section {
+  int flags;
+  int base;                     /* Address it was assembled at */
+  int size;
+  int address;                  /* Where the linker placed it */
+  unsigned char *data;          /* Only used by the linker */
+};
+
+/*
+ * A symbol, value is an address in the section or absolute if section
+ * is -1
+ */
+struct obj_symbol {
+  int kind;
+  int section;
+  int value;
+  struct sym_name *name;
+};
+
+/*
+ * Bytes at offset in section to be patched with the address of
+ * target section or symbol plus addend. An imported symbol has a
+ * symbol index, -1 if the target is a section of the module.
+ */
+struct obj_reloc {
+  int section;
+  int offset;
+  int type;
+  int symbol;
+  int target;
+  int addend;
+};
+
+/*
+ * The contents of one object file
+ */
+struct obj_module {
+  char *file_name;
+  int num_sections;
+  int num_symbols;
+  int num_relocs;
+  struct obj_section *sections;
+  struct obj_symbol *symbols;
+  struct obj_reloc *relocs;
+  unsigned char *data;          /* Contents of the file */
+};
+
+/*
+ * What the assembler collects for the object file
+ */
+struct obj_state {
+  struct obj_section *sections;
+  int num_sections;
+  int max_sections;
+  struct obj_reloc *relocs;
+  int num_relocs;
+  int max_relocs;
+  struct symbol_entry **imports;
+  int num_imports;
+  int max_imports;
+};
+
+/* Assembler side */
+void obj_init(struct asm65_context *ac);
+void obj_section(struct asm65_context *ac, int address, int relocatable);
+void obj_end(struct asm65_context *ac);
+void obj_extend(struct asm65_context *ac, int section, int end);
+int obj_current_section(struct asm65_context *ac);
+int obj_import(struct asm65_context *ac, struct sym_name *name);
+int obj_add_reloc(struct asm65_context *ac, int section, int address,
+                  int type, int symbol, int target, int value);
+int obj_write(struct asm65_context *ac, char *file_name);
+void obj_clean_up(struct asm65_context *ac);
+
+/* Linker side */
+int obj_read(struct asm65_context *ac, char *file_name,
+             struct obj_module *module);
+void obj_free(struct obj_module *module);
+
+#endif // __OBJECT_H__
@@ -1,44 +1,402 @@
 /*
- * Handles outputting the binary code
+ * Handles outputting the binary code.
+ * The code is collected in an image of the target address space and
+ * written to the files in one go when the assembly is done, in the
+ * formats asked for.
  */
- #include <stdlib.h>
+#include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
-#include <ctype.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
 
 #include "global.h"
-#include "expr.h"
-#include "utils.h"
-#include "symbols.h"
 #include "errors.h"
 #include "output.h"
+#include "context.h"
 
-#ifdef DEBUG_EXPR
-#define DBG(x) x
-#else
-#define DBG(x)
-#endif
+/* Two upper case hex digits for every byte value */
+#define HEX_PAIRS(h) \
+  h "0" h "1" h "2" h "3" h "4" h "5" h "6" h "7" \
+  h "8" h "9" h "A" h "B" h "C" h "D" h "E" h "F"
 
-int send_to_file(struct output_descriptor *od)
+static const char hex_pairs[] =
+  HEX_PAIRS("0") HEX_PAIRS("1") HEX_PAIRS("2") HEX_PAIRS("3")
+  HEX_PAIRS("4") HEX_PAIRS("5") HEX_PAIRS("6") HEX_PAIRS("7")
+  HEX_PAIRS("8") HEX_PAIRS("9") HEX_PAIRS("A") HEX_PAIRS("B")
+  HEX_PAIRS("C") HEX_PAIRS("D") HEX_PAIRS("E") HEX_PAIRS("F");
+
+/*
+ * Start with an empty image
+ */
+void output_init(struct asm65_context *ac)
 {
-  return OK;
+  struct output_state *os = &ac->output;
+
+  if (!os->image) {
+    os->image = (unsigned char *)malloc(OUTPUT_IMAGE_SIZE);
+    os->written = (unsigned char *)malloc(OUTPUT_IMAGE_SIZE / 8);
+    if (!os->image || !os->written)
+      out_of_memory(ac);
+  }
+  memset(os->image, 0, OUTPUT_IMAGE_SIZE);
+  memset(os->written, 0, OUTPUT_IMAGE_SIZE / 8);
+  os->low = OUTPUT_IMAGE_SIZE;
+  os->high = -1;
 }
 
-int output(struct output_descriptor *od)
+/*
+ * Release the image, the sinks are kept
+ */
+void output_clean_up(struct asm65_context *ac)
 {
+  free(ac->output.image);
+  free(ac->output.written);
+  ac->output.image = NULL;
+  ac->output.written = NULL;
+}
+
+/*
+ * Output the bytes at PC and advance PC past them
+ */
+int output(struct asm65_context *ac, struct output_descriptor *od)
+{
+  struct output_state *os = &ac->output;
+  unsigned char *written = os->written;
+  int pc = ac->PC;
+  int end = pc + od->length;
   int i;
-  int error = OK;
-  
-  printf ("PC %04x: ", PC);
-  for(i=0;i<od->length;i++) {
-    printf(" %02x", od->data[i]);
-  }
-  printf("\n");
-  
-  error = send_to_file(od);
+
+  if (pc < 0 || end > OUTPUT_IMAGE_SIZE)
+    return OUTPUT_OUT_OF_RANGE;
+  for (i = pc; i < end; i++) {
+    if (written[i >> 3] & (1 << (i & 7)))
+      return OUTPUT_OVERLAP;
+    written[i >> 3] |= 1 << (i & 7);
+  }
+  memcpy(&os->image[pc], od->data, od->length);
+  ac->stats.bytes += od->length;
+  if (pc < os->low)
+    os->low = pc;
+  if (end - 1 > os->high)
+    os->high = end - 1;
+
+  if (LOG_ENABLED(ac, LOG_OUTPUT, LOG_DEBUG)) {
+    log_printf (ac, "PC %04x: ", pc);
+    for(i=0;i<od->length;i++) {
+      log_printf(ac, " %02x", od->data[i]);
+    }
+    log_printf(ac, "\n");
+  }
+
   /* Update the address pointer */
-  PC += od->length;
-  
+  ac->PC = end;
+  return OK;
+}
+
+/*
+ * Check if code has been output at the address
+ */
+int output_written(struct asm65_context *ac, int address)
+{
+  return ac->output.written[address >> 3] & (1 << (address & 7));
+}
+
+/*
+ * Overwrite bytes already in the image, used for backpatching
+ */
+void output_patch(struct asm65_context *ac, int address, unsigned char *data,
+                  int length)
+{
+  int i;
+
+  for (i = 0; i < length; i++)
+    ac->output.image[(address + i) & 0xffff] = data[i];
+}
+
+/******************************************************************************
+ *                       Output formats
+ *****************************************************************************/
+
+/*
+ * Write all of data, normally in one write unless it is interrupted.
+ * Returns 0 on success or -1 with errno set.
+ */
+static int write_all(int fd, void *data, size_t length)
+{
+  char *p = (char *)data;
+  ssize_t count;
+
+  while (length > 0) {
+    count = write(fd, p, length);
+    if (count < 0) {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+    p += count;
+    length -= count;
+  }
+  return 0;
+}
+
+static int writer_flush(struct writer *w)
+{
+  int error = write_all(w->fd, w->buf, w->used);
+
+  w->used = 0;
   return error;
-}
\ No newline at end of file
+}
+
+/*
+ * Make room for length characters at the end of the buffer
+ */
+static char *writer_reserve(struct writer *w, int length)
+{
+  if (w->used + length > OUTPUT_BUFFER_SIZE && writer_flush(w))
+    return NULL;
+  return &w->buf[w->used];
+}
+
+static char *put_hex(char *p, int byte)
+{
+  memcpy(p, &hex_pairs[(byte & 0xff) * 2], 2);
+  return p + 2;
+}
+
+/*
+ * Call record() for every run of at most OUTPUT_RECORD_LENGTH written
+ * bytes, gaps in the image are left out.
+ */
+static int for_each_record(struct asm65_context *ac,
+                           int (*record)(struct asm65_context *ac,
+                                         int address, int length))
+{
+  unsigned char *written = ac->output.written;
+  int high = ac->output.high;
+  int address = ac->output.low;
+  int length;
+  int error;
+
+  while (address <= high) {
+    if (!(written[address >> 3] & (1 << (address & 7)))) {
+      address++;
+      continue;
+    }
+    for (length = 1; length < OUTPUT_RECORD_LENGTH &&
+                     address + length <= high &&
+                     (written[(address + length) >> 3] &
+                      (1 << ((address + length) & 7))); length++)
+      ;
+    error = record(ac, address, length);
+    if (error)
+      return error;
+    address += length;
+  }
+  return 0;
+}
+
+/*
+ * Plain binary from the lowest to the highest address written
+ */
+static int write_raw(struct asm65_context *ac, int fd)
+{
+  struct output_state *os = &ac->output;
+
+  return write_all(fd, &os->image[os->low], os->high - os->low + 1);
+}
+
+/*
+ * Commodore PRG, the binary preceded by its load address
+ */
+static int write_prg(struct asm65_context *ac, int fd)
+{
+  struct output_state *os = &ac->output;
+  unsigned char header[2];
+  struct iovec iov[2];
+  ssize_t length = os->high - os->low + 3;
+  ssize_t count;
+
+  header[0] = os->low & 0xff;
+  header[1] = os->low >> 8;
+  iov[0].iov_base = header;
+  iov[0].iov_len = 2;
+  iov[1].iov_base = &os->image[os->low];
+  iov[1].iov_len = length - 2;
+  /* Only a write interrupted part way needs a second try */
+  do {
+    count = writev(fd, iov, 2);
+  } while (count < 0 && errno == EINTR);
+  if (count < 0)
+    return -1;
+  if (count < 2)
+    return write_all(fd, header + count, 2 - count) ||
+           write_raw(ac, fd);
+  if (count < length)
+    return write_all(fd, &os->image[os->low + count - 2], length - count);
+  return 0;
+}
+
+/*
+ * Intel HEX record, :LLAAAATT data CC
+ */
+static int ihex_record(struct asm65_context *ac, int type, int address,
+                       unsigned char *data, int length)
+{
+  struct writer *w = &ac->output.writer;
+  char *p = writer_reserve(w, 1 + 2 * (length + 5) + 1);
+  unsigned char sum = length + (address >> 8) + address + type;
+  int i;
+
+  if (!p)
+    return -1;
+  *p++ = ':';
+  p = put_hex(p, length);
+  p = put_hex(p, address >> 8);
+  p = put_hex(p, address);
+  p = put_hex(p, type);
+  for (i = 0; i < length; i++) {
+    p = put_hex(p, data[i]);
+    sum += data[i];
+  }
+  p = put_hex(p, -sum);
+  *p++ = '\n';
+  w->used = p - w->buf;
+  return 0;
+}
+
+static int ihex_data(struct asm65_context *ac, int address, int length)
+{
+  return ihex_record(ac, 0x00, address, &ac->output.image[address], length);
+}
+
+static int write_ihex(struct asm65_context *ac, int fd)
+{
+  struct writer *w = &ac->output.writer;
+
+  w->fd = fd;
+  w->used = 0;
+  if (for_each_record(ac, ihex_data) || ihex_record(ac, 0x01, 0, NULL, 0))
+    return -1;
+  return writer_flush(w);
+}
+
+/*
+ * Motorola S-record, Stcc AAAA data CC
+ */
+static int srec_record(struct asm65_context *ac, int type, int address,
+                       unsigned char *data, int length)
+{
+  struct writer *w = &ac->output.writer;
+  char *p = writer_reserve(w, 2 + 2 * (length + 4) + 1);
+  unsigned char sum = length + 3 + (address >> 8) + address;
+  int i;
+
+  if (!p)
+    return -1;
+  *p++ = 'S';
+  *p++ = '0' + type;
+  p = put_hex(p, length + 3);
+  p = put_hex(p, address >> 8);
+  p = put_hex(p, address);
+  for (i = 0; i < length; i++) {
+    p = put_hex(p, data[i]);
+    sum += data[i];
+  }
+  p = put_hex(p, ~sum);
+  *p++ = '\n';
+  w->used = p - w->buf;
+  return 0;
+}
+
+static int srec_data(struct asm65_context *ac, int address, int length)
+{
+  return srec_record(ac, 1, address, &ac->output.image[address], length);
+}
+
+static int write_srec(struct asm65_context *ac, int fd)
+{
+  struct writer *w = &ac->output.writer;
+
+  w->fd = fd;
+  w->used = 0;
+  if (srec_record(ac, 0, 0, NULL, 0) || for_each_record(ac, srec_data) ||
+      srec_record(ac, 9, ac->output.low, NULL, 0))
+    return -1;
+  return writer_flush(w);
+}
+
+struct output_format output_formats[] = {
+  { "raw",  ".bin", write_raw },
+  { "ihex", ".hex", write_ihex },
+  { "srec", ".s19", write_srec },
+  { "prg",  ".prg", write_prg },
+  { NULL, NULL, NULL },
+};
+
+/******************************************************************************
+ *                       Output sinks
+ *****************************************************************************/
+/*
+ * Add a file to write the image to in the named format. Without a file
+ * name the file is named when the image is written.
+ * Returns 0, or -1 if the format is unknown or there are too many files.
+ */
+int output_add_sink(struct asm65_context *ac, const char *format,
+                    const char *file_name)
+{
+  struct output_format *of;
+  struct output_sink *os;
+
+  for (of = output_formats; of->name; of++)
+    if (!strcmp(of->name, format))
+      break;
+  if (!of->name || ac->output.num_sinks == OUTPUT_MAX_SINKS)
+    return -1;
+
+  os = &ac->output.sinks[ac->output.num_sinks++];
+  os->format = of;
+  os->file_name[0] = '\0';
+  if (file_name)
+    strncpy(os->file_name, file_name, sizeof (os->file_name) - 1);
+  return 0;
+}
+
+/*
+ * Write the image to every sink, a sink without a file name gets
+ * base_name with the extension of its format.
+ * Returns OK, or FILE_ACCESS_FAILED if a file could not be written.
+ */
+int output_write(struct asm65_context *ac, const char *base_name)
+{
+  struct output_state *state = &ac->output;
+  char file_name[sizeof (state->sinks[0].file_name)];
+  struct output_sink *os;
+  int error;
+  int fd;
+  int i;
+
+  for (i = 0; i < state->num_sinks; i++) {
+    os = &state->sinks[i];
+    if (os->file_name[0])
+      strcpy(file_name, os->file_name);
+    else
+      snprintf(file_name, sizeof (file_name), "%s%s", base_name,
+               os->format->extension);
+
+    fd = open(file_name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+      return error_report(ac, "Could not write output file %s", file_name);
+    error = 0;
+    if (state->high >= state->low)
+      error = os->format->write(ac, fd);
+    if (close(fd) || error)
+      return error_report(ac, "Could not write output file %s", file_name);
+    if (state->high >= state->low)
+      LOG(ac, LOG_OUTPUT, LOG_INFO, "Wrote $%04x-$%04x to %s\n", state->low,
+          state->high, file_name);
+  }
+  return OK;
+}
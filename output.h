@@ -1,9 +1,75 @@
 /*
  * Handles outputting the binary code
  */
+#ifndef __OUTPUT_H__
+#define __OUTPUT_H__
+
+#include "global.h"
+
+#define OUTPUT_IMAGE_SIZE     0x10000
+#define OUTPUT_BUFFER_SIZE    (64 * 1024)
+#define OUTPUT_RECORD_LENGTH  16      /* Data bytes in a hex record */
+#define OUTPUT_MAX_SINKS      8
+
 struct output_descriptor {
   int length;
   unsigned char *data;
 };
 
-int output(struct output_descriptor *od);
+struct asm65_context;
+
+/*
+ * A file format, write() writes the image from low to high and returns 0
+ * on success or -1 with errno set.
+ */
+struct output_format {
+  char *name;
+  char *extension;              /* Of a file named after the source */
+  int (*write)(struct asm65_context *ac, int fd);
+};
+
+/*
+ * A file the image is written to
+ */
+struct output_sink {
+  struct output_format *format;
+  char file_name[256];
+};
+
+/*
+ * Text formats are formatted straight from the image into one buffer,
+ * which is written whenever it fills up.
+ */
+struct writer {
+  int fd;
+  int used;
+  char buf[OUTPUT_BUFFER_SIZE];
+};
+
+struct output_state {
+  /* The 64K address space of the target */
+  unsigned char *image;
+  /* Lowest and highest address written, low > high while nothing is */
+  int low;
+  int high;
+  /* One bit for every address written, to find overlapping code */
+  unsigned char *written;
+  /* Files the image is written to, kept for every assembly */
+  struct output_sink sinks[OUTPUT_MAX_SINKS];
+  int num_sinks;
+  struct writer writer;
+};
+
+extern struct output_format output_formats[];
+
+void output_init(struct asm65_context *ac);
+void output_clean_up(struct asm65_context *ac);
+int output(struct asm65_context *ac, struct output_descriptor *od);
+int output_written(struct asm65_context *ac, int address);
+void output_patch(struct asm65_context *ac, int address, unsigned char *data,
+                  int length);
+int output_add_sink(struct asm65_context *ac, const char *format,
+                    const char *file_name);
+int output_write(struct asm65_context *ac, const char *base_name);
+
+#endif // __OUTPUT_H__
@@ -0,0 +1,534 @@
+/*
+ * Sizing of instructions with a short and a long form, zero page and
+ * absolute operands, and branches that may have to be relaxed.
+ * Pass 1 puts such an instruction in its short form whenever it may do,
+ * also when the operand refers to symbols not defined yet, and tracks
+ * it. Once every symbol is defined the tracked instructions are checked
+ * in rounds. A round checks the instructions against the addresses and
+ * values as they stand and grows the ones that don't fit, all of them
+ * against the same state, so the result doesn't depend on the order they
+ * are looked at in. The next round first moves the code after the
+ * instructions grown and evaluates the equates and the ORG lines whose
+ * values changed again, until nothing moves any more.
+ * Every line depending on a symbol is hung on the symbol, and only the
+ * lines depending on a value that changed, or on an address that moved,
+ * are looked at again instead of the whole source. The code is moved by
+ * one walk per round over the lines that matter: the tracked ones, the
+ * labels something depends on, the equates using the PC and the ORG
+ * lines. Lines where nothing moves are skipped. The other lines get their
+ * addresses once at the end. Instructions only ever grow, so this
+ * settles.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "global.h"
+#include "sizing.h"
+#include "errors.h"
+#include "ir.h"
+#include "expr.h"
+#include "symbols.h"
+#include "object.h"
+#include "context.h"
+
+#define SIZE_ARENA_CHUNK_SIZE (16 * 1024)
+
+/* What a line is to the walk moving the code, and whether it is queued */
+enum size_flags {
+  SIZE_QUEUED = 0x01,
+  SIZE_MARK = 0x02,             /* Visited by the walk */
+  SIZE_MOVER = 0x04,            /* A branch, depends on its own address */
+  SIZE_WATCHED = 0x08,          /* Defines a label something depends on */
+  SIZE_USES_PC = 0x10,          /* An equate using the PC */
+  SIZE_ORG = 0x20,
+};
+
+/*
+ * An ORG line. One with a constant address stops the code moved by an
+ * instruction growing before it. One computed from the PC or from
+ * symbols is evaluated again when it moves or they change, the code
+ * after it moves as far as its value does.
+ */
+struct size_org {
+  int line;
+  int fixed;
+  int value;                    /* Address the code after it starts at */
+};
+
+/* Instructions grown in a round, in source order once it is over */
+struct size_growth {
+  int line;
+  int growth;
+};
+
+static void *size_grow(struct asm65_context *ac, void *array, int count,
+                       int *max, int size)
+{
+  if (count < *max)
+    return array;
+  *max = *max ? *max * 2 : 256;
+  array = realloc(array, *max * size);
+  if (!array)
+    out_of_memory(ac);
+  return array;
+}
+
+void size_init(struct asm65_context *ac)
+{
+  struct size_state *ss = &ac->size;
+
+  arena_init(ac, &ss->arena, SIZE_ARENA_CHUNK_SIZE);
+  ss->tracked = NULL;
+  ss->num_tracked = ss->max_tracked = 0;
+  ss->movers = ss->distances = NULL;
+  ss->num_movers = ss->max_movers = 0;
+  ss->orgs = NULL;
+  ss->num_orgs = ss->max_orgs = 0;
+  ss->marks = NULL;
+  ss->num_marks = ss->max_marks = 0;
+  ss->flags = NULL;
+  ss->equates = ss->work = ss->org_work = NULL;
+  ss->num_equates = ss->max_equates = 0;
+  ss->num_work = ss->max_work = 0;
+  ss->num_org_work = ss->max_org_work = 0;
+  ss->growths = NULL;
+  ss->num_growths = ss->max_growths = 0;
+}
+
+/*
+ * Track an instruction put in its short form in pass 1. moves is set for
+ * a branch, which depends on its own address.
+ */
+void size_track(struct asm65_context *ac, struct ir_line *ir, int moves)
+{
+  struct size_state *ss = &ac->size;
+
+  ss->tracked = size_grow(ac, ss->tracked, ss->num_tracked, &ss->max_tracked,
+                          sizeof (int));
+  ss->tracked[ss->num_tracked++] = ir - ac->ir.lines;
+  if (moves) {
+    ss->movers = size_grow(ac, ss->movers, ss->num_movers, &ss->max_movers,
+                           sizeof (int));
+    ss->movers[ss->num_movers++] = ir - ac->ir.lines;
+  }
+}
+
+/*
+ * Note an ORG line, fixed if it sets a constant address. Its expression
+ * gives the address the code after it continues at.
+ */
+void size_org(struct asm65_context *ac, struct ir_line *ir, int fixed)
+{
+  struct size_state *ss = &ac->size;
+
+  ss->orgs = size_grow(ac, ss->orgs, ss->num_orgs, &ss->max_orgs,
+                       sizeof (struct size_org));
+  ss->orgs[ss->num_orgs].line = ir - ac->ir.lines;
+  ss->orgs[ss->num_orgs++].fixed = fixed;
+}
+
+/*
+ * Hang a line on every symbol its expression refers to
+ */
+static void size_depend(struct asm65_context *ac, int i)
+{
+  struct size_state *ss = &ac->size;
+  struct expr *expr = ac->ir.lines[i].expr;
+  union expr_code *pc = expr->code;
+  union expr_code *end = expr->code + expr->length;
+  struct size_dep *dep;
+
+  while (pc < end) {
+    if (pc->op == EC_SYMBOL) {
+      dep = (struct size_dep *)arena_alloc(&ss->arena,
+                                           sizeof (struct size_dep));
+      dep->line = i;
+      dep->next = pc[1].sym->deps;
+      pc[1].sym->deps = dep;
+      sym_touch(ac, pc[1].sym);
+      pc += 2;
+    } else {
+      pc += pc->op == EC_CONST ? 2 : 1;
+    }
+  }
+}
+
+static void size_undepend(struct asm65_context *ac, int i)
+{
+  struct expr *expr = ac->ir.lines[i].expr;
+  union expr_code *pc = expr->code;
+  union expr_code *end = expr->code + expr->length;
+
+  while (pc < end) {
+    if (pc->op == EC_SYMBOL) {
+      pc[1].sym->deps = NULL;
+      pc += 2;
+    } else {
+      pc += pc->op == EC_CONST ? 2 : 1;
+    }
+  }
+}
+
+static void size_queue(struct asm65_context *ac, int i)
+{
+  struct size_state *ss = &ac->size;
+
+  if (ss->flags[i] & SIZE_QUEUED)
+    return;
+  ss->flags[i] |= SIZE_QUEUED;
+  if (ac->ir.lines[i].kind == IR_EQUATE) {
+    ss->equates = size_grow(ac, ss->equates, ss->num_equates,
+                            &ss->max_equates, sizeof (int));
+    ss->equates[ss->num_equates++] = i;
+  } else if (ss->flags[i] & SIZE_ORG) {
+    ss->org_work = size_grow(ac, ss->org_work, ss->num_org_work,
+                             &ss->max_org_work, sizeof (int));
+    ss->org_work[ss->num_org_work++] = i;
+  } else {
+    ss->work = size_grow(ac, ss->work, ss->num_work, &ss->max_work,
+                         sizeof (int));
+    ss->work[ss->num_work++] = i;
+  }
+}
+
+/*
+ * Queue the lines depending on a symbol whose value changed
+ */
+static void size_notify(struct asm65_context *ac, struct sym_name *name)
+{
+  struct size_dep *dep;
+
+  for (dep = name->deps; dep; dep = dep->next)
+    size_queue(ac, dep->line);
+}
+
+/*
+ * Index of the first of the lines in source order after line i
+ */
+static int size_after(int *lines, int count, int i)
+{
+  int lo = 0;
+  int hi = count;
+  int mid;
+
+  while (lo < hi) {
+    mid = (lo + hi) / 2;
+    if (lines[mid] <= i)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+static struct size_org *size_find_org(struct asm65_context *ac, int i)
+{
+  struct size_state *ss = &ac->size;
+  int lo = 0;
+  int hi = ss->num_orgs;
+  int mid;
+
+  while (lo + 1 < hi) {
+    mid = (lo + hi) / 2;
+    if (ss->orgs[mid].line <= i)
+      lo = mid;
+    else
+      hi = mid;
+  }
+  return &ss->orgs[lo];
+}
+
+/*
+ * A marked line moved by delta bytes. Its label moves with it, a branch
+ * and an equate using the PC are looked at again.
+ */
+static void size_moved(struct asm65_context *ac, int i, int delta)
+{
+  struct size_state *ss = &ac->size;
+  struct ir_line *ir = &ac->ir.lines[i];
+
+  ir->address += delta;
+  if (ss->flags[i] & SIZE_WATCHED) {
+    ir->label->value = ir->address;
+    size_notify(ac, ir->label->name);
+  }
+  if (ss->flags[i] & (SIZE_MOVER | SIZE_USES_PC))
+    size_queue(ac, i);
+}
+
+/*
+ * First line from which something has to be moved or evaluated again:
+ * the next instruction grown, or the first ORG queued. -1 if none.
+ */
+static int size_next_event(struct asm65_context *ac, int g)
+{
+  struct size_state *ss = &ac->size;
+  int first = g < ss->num_growths ? ss->growths[g].line : -1;
+  int j;
+
+  for (j = 0; j < ss->num_org_work; j++)
+    if (first < 0 || ss->org_work[j] < first)
+      first = ss->org_work[j];
+  return first;
+}
+
+/*
+ * Evaluate an ORG again at its current address.
+ * Returns how far the code after it moves.
+ */
+static int size_org_moved(struct asm65_context *ac, int i)
+{
+  struct size_state *ss = &ac->size;
+  struct size_org *org = size_find_org(ac, i);
+  int value;
+  int delta;
+  int j;
+
+  if (ss->flags[i] & SIZE_QUEUED) {
+    ss->flags[i] &= ~SIZE_QUEUED;
+    for (j = 0; ss->org_work[j] != i; j++)
+      ;
+    ss->org_work[j] = ss->org_work[--ss->num_org_work];
+  }
+  if (org->fixed)
+    return 0;
+  /* It was evaluated in pass 1 already, it can't fail */
+  ac->PC = ac->ir.lines[i].address;
+  expr_run(ac, ac->ir.lines[i].expr, &value);
+  delta = value - org->value;
+  org->value = value;
+  return delta;
+}
+
+/*
+ * Bring the addresses and the values up to date with the instructions
+ * grown in the last round. The code after each grown instruction moves,
+ * and so does the code after an ORG whose value changes. The equates
+ * queued are evaluated, which may change the value of an ORG, until
+ * nothing moves or changes. The instructions depending on what did are
+ * left queued for the next round.
+ */
+static void size_layout(struct asm65_context *ac, size_func func)
+{
+  struct size_state *ss = &ac->size;
+  int delta;
+  int first;
+  int g = 0;
+  int i;
+  int k;
+
+  for (;;) {
+    first = size_next_event(ac, g);
+    if (first < 0 && !ss->num_equates)
+      break;
+
+    /* One walk from the first change, skipping what doesn't move */
+    delta = 0;
+    k = first < 0 ? ss->num_marks :
+                    size_after(ss->marks, ss->num_marks, first - 1);
+    while (k < ss->num_marks) {
+      i = ss->marks[k];
+      if (delta)
+        size_moved(ac, i, delta);
+      if (g < ss->num_growths && ss->growths[g].line == i)
+        delta += ss->growths[g++].growth;
+      else if (ss->flags[i] & SIZE_ORG)
+        delta = size_org_moved(ac, i);
+      if (delta) {
+        k++;
+        continue;
+      }
+      first = size_next_event(ac, g);
+      if (first < 0)
+        break;
+      k = size_after(ss->marks, ss->num_marks, first - 1);
+    }
+
+    while (ss->num_equates) {
+      i = ss->equates[--ss->num_equates];
+      ss->flags[i] &= ~SIZE_QUEUED;
+      ac->PC = ac->ir.lines[i].address;
+      if (func(ac, &ac->ir.lines[i]))
+        size_notify(ac, ac->ir.lines[i].label->name);
+    }
+  }
+  ss->num_growths = 0;
+}
+
+static int size_by_line(const void *a, const void *b)
+{
+  return ((const struct size_growth *)a)->line -
+         ((const struct size_growth *)b)->line;
+}
+
+/*
+ * Distance from a branch to a single symbol it is to reach, or 0 if its
+ * operand is anything else. In an object file the section of the
+ * symbol counts too, the distance alone doesn't tell.
+ */
+static int size_distance(struct asm65_context *ac, struct ir_line *ir)
+{
+  struct expr *expr = ir->expr;
+
+  if (ac->object_mode || expr->length != 2 || expr->code[0].op != EC_SYMBOL ||
+      !expr->code[1].sym->symbol)
+    return 0;
+  return expr->code[1].sym->symbol->value - ir->address;
+}
+
+/*
+ * Give every line its final address and every label its final value
+ */
+static void size_sweep(struct asm65_context *ac)
+{
+  struct size_state *ss = &ac->size;
+  struct ir_line *ir;
+  int address = ac->ir.lines[0].address;
+  int org = 0;
+  int i;
+
+  for (i = 0; i < ac->ir.num_lines; i++) {
+    ir = &ac->ir.lines[i];
+    ir->address = address;
+    if (ir->label && ir->kind != IR_EQUATE)
+      ir->label->value = address;
+    if (ir->section >= 0)
+      obj_extend(ac, ir->section, address + ir->size);
+    if (org < ss->num_orgs && ss->orgs[org].line == i) {
+      address = ss->orgs[org++].value;
+    } else {
+      address += ir->size;
+    }
+  }
+  ac->PC = address;
+}
+
+/*
+ * Check the tracked instructions with all symbols defined and grow the
+ * ones that don't fit, until none does any more. The equates are looked
+ * at again too, they may depend on labels that move. func does the
+ * looking, for both, with the PC at the address of the line.
+ */
+void size_settle(struct asm65_context *ac, size_func func)
+{
+  struct size_state *ss = &ac->size;
+  struct ir_line *ir;
+  int checked = 0;
+  int grown = 0;
+  int rounds = 0;
+  int distance;
+  int size;
+  int i;
+  int j;
+
+  if (!ss->num_tracked)
+    return;
+  ss->flags = (unsigned char *)calloc(ac->ir.num_lines, 1);
+  ss->distances = (int *)malloc((ss->num_movers + 1) * sizeof (int));
+  if (!ss->flags || !ss->distances)
+    out_of_memory(ac);
+
+  for (i = 0; i < ss->num_movers; i++) {
+    ss->flags[ss->movers[i]] |= SIZE_MOVER;
+    ss->distances[i] = 0;
+  }
+  for (i = 0; i < ss->num_tracked; i++) {
+    ss->flags[ss->tracked[i]] |= SIZE_MARK;
+    size_depend(ac, ss->tracked[i]);
+    size_queue(ac, ss->tracked[i]);
+  }
+  for (i = 0; i < ss->num_orgs; i++) {
+    j = ss->orgs[i].line;
+    ss->flags[j] |= SIZE_MARK | SIZE_ORG;
+    ss->orgs[i].value = j + 1 < ac->ir.num_lines ?
+                        ac->ir.lines[j + 1].address : ac->PC;
+    if (!ss->orgs[i].fixed)
+      size_depend(ac, j);
+  }
+  for (i = 0; i < ac->ir.num_lines; i++) {
+    ir = &ac->ir.lines[i];
+    if (ir->kind == IR_EQUATE) {
+      if (expr_uses_pc(ir->expr))
+        ss->flags[i] |= SIZE_MARK | SIZE_USES_PC;
+      size_depend(ac, i);
+      size_queue(ac, i);
+    }
+  }
+  for (i = 0; i < ac->ir.num_lines; i++) {
+    ir = &ac->ir.lines[i];
+    if (ir->label && ir->kind != IR_EQUATE && ir->label->name->deps)
+      ss->flags[i] |= SIZE_MARK | SIZE_WATCHED;
+    if (ss->flags[i] & SIZE_MARK) {
+      ss->marks = size_grow(ac, ss->marks, ss->num_marks, &ss->max_marks,
+                            sizeof (int));
+      ss->marks[ss->num_marks++] = i;
+    }
+  }
+
+  for (;;) {
+    size_layout(ac, func);
+    if (!ss->num_work)
+      break;
+    rounds++;
+
+    /* Every check sees the state the round started with */
+    while (ss->num_work) {
+      i = ss->work[--ss->num_work];
+      ss->flags[i] &= ~SIZE_QUEUED;
+      ir = &ac->ir.lines[i];
+      if (ss->flags[i] & SIZE_MOVER) {
+        j = size_after(ss->movers, ss->num_movers, i) - 1;
+        distance = size_distance(ac, ir);
+        if (distance && distance == ss->distances[j])
+          continue;
+        ss->distances[j] = distance;
+      }
+      size = ir->size;
+      ac->PC = ir->address;
+      func(ac, ir);
+      checked++;
+      if (ir->size > size) {
+        ss->growths = size_grow(ac, ss->growths, ss->num_growths,
+                                &ss->max_growths, sizeof (struct size_growth));
+        ss->growths[ss->num_growths].line = i;
+        ss->growths[ss->num_growths++].growth = ir->size - size;
+        grown++;
+      }
+    }
+    qsort(ss->growths, ss->num_growths, sizeof (struct size_growth),
+          size_by_line);
+  }
+  size_sweep(ac);
+  LOG(ac, LOG_PARSE, LOG_INFO,
+      "Sized %d instructions, %d checks, %d grown in %d rounds\n",
+      ss->num_tracked, checked, grown, rounds);
+
+  for (i = 0; i < ss->num_tracked; i++)
+    size_undepend(ac, ss->tracked[i]);
+  for (i = 0; i < ss->num_orgs; i++)
+    if (!ss->orgs[i].fixed)
+      size_undepend(ac, ss->orgs[i].line);
+  for (i = 0; i < ac->ir.num_lines; i++)
+    if (ac->ir.lines[i].kind == IR_EQUATE)
+      size_undepend(ac, i);
+  free(ss->flags);
+  ss->flags = NULL;
+}
+
+void size_clean_up(struct asm65_context *ac)
+{
+  struct size_state *ss = &ac->size;
+
+  free(ss->tracked);
+  free(ss->movers);
+  free(ss->distances);
+  free(ss->orgs);
+  free(ss->marks);
+  free(ss->equates);
+  free(ss->work);
+  free(ss->org_work);
+  free(ss->growths);
+  arena_release(&ss->arena);
+  size_init(ac);
+}
@@ -0,0 +1,85 @@
+/*
+ * Sizing of instructions whose size depends on the value of the operand,
+ * or on the distance to it for a branch
+ */
+#ifndef __SIZING_H__
+#define __SIZING_H__
+
+#include "arena.h"
+
+struct ir_line;
+struct size_org;
+struct size_growth;
+
+/*
+ * A line that depends on the value of a symbol, hung on the name of the
+ * symbol while the sizes are settled
+ */
+struct size_dep {
+  struct size_dep *next;
+  int line;                     /* Index of the IR line */
+};
+
+/*
+ * The sizing of a context, for one assembly
+ */
+struct size_state {
+  struct arena arena;
+
+  /* Instructions that may still grow, in source order */
+  int *tracked;
+  int num_tracked;
+  int max_tracked;
+
+  /*
+   * The tracked instructions that depend on their own address. A branch
+   * to a single symbol keeps the distance it was last checked at, it
+   * reaches the same as long as that doesn't change.
+   */
+  int *movers;
+  int num_movers;
+  int max_movers;
+  int *distances;
+
+  struct size_org *orgs;
+  int num_orgs;
+  int max_orgs;
+
+  /* Lines the walk visits, in source order */
+  int *marks;
+  int num_marks;
+  int max_marks;
+  unsigned char *flags;
+
+  /* Lines to look at again */
+  int *equates;
+  int num_equates;
+  int max_equates;
+  int *work;
+  int num_work;
+  int max_work;
+  int *org_work;
+  int num_org_work;
+  int max_org_work;
+
+  struct size_growth *growths;
+  int num_growths;
+  int max_growths;
+};
+
+struct asm65_context;
+
+/*
+ * Looks at a line again with the current symbol values, the PC is the
+ * address of the line. An instruction may grow, an equate may get a new
+ * value. Returns non-zero if the line changed.
+ */
+typedef int (*size_func)(struct asm65_context *ac, struct ir_line *ir);
+
+void size_init(struct asm65_context *ac);
+void size_track(struct asm65_context *ac, struct ir_line *ir, int moves);
+void size_org(struct asm65_context *ac, struct ir_line *ir, int fixed);
+void size_settle(struct asm65_context *ac, size_func func);
+void size_clean_up(struct asm65_context *ac);
+
+#endif // __SIZING_H__
@@ -0,0 +1,179 @@
+/*
+ * Source file input.
+ * Regular files are mapped read only and handed out as line slices
+ * pointing straight into the mapping, so lines are never copied and
+ * have no length limit. Anything that can't be mapped (pipes, empty
+ * files) is read into a buffer instead, as is a source held in memory.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "source.h"
+#include "errors.h"
+
+#define SRC_READ_CHUNK        (64 * 1024)
+
+/*
+ * Read the whole file into a zero terminated buffer.
+ */
+static int src_read(struct asm65_context *ac, struct source_file *sf, int fd)
+{
+  size_t size = 0;
+  size_t alloc = SRC_READ_CHUNK;
+  char *data = (char *)malloc(alloc + 1);
+  ssize_t n;
+
+  if (!data)
+    out_of_memory(ac);
+
+  while ((n = read(fd, data + size, alloc - size)) > 0) {
+    size += n;
+    if (size == alloc) {
+      alloc *= 2;
+      data = (char *)realloc(data, alloc + 1);
+      if (!data)
+        out_of_memory(ac);
+    }
+  }
+  if (n < 0) {
+    free(data);
+    return -1;
+  }
+  data[size] = '\0';
+
+  sf->data = data;
+  sf->size = size;
+  sf->mapped = 0;
+  return 0;
+}
+
+/*
+ * Open a source file, "-" is standard input.
+ */
+int src_open(struct asm65_context *ac, struct source_file *sf, char *name)
+{
+  struct stat st;
+  long page_size = sysconf(_SC_PAGESIZE);
+  int fd;
+  int error;
+
+  sf->name = name;
+  sf->data = NULL;
+  sf->size = 0;
+  sf->mapped = 0;
+
+  if (!strcmp(name, "-"))
+    fd = dup(STDIN_FILENO);
+  else
+    fd = open(name, O_RDONLY);
+  if (fd < 0)
+    return -1;
+
+  if (fstat(fd, &st) < 0) {
+    close(fd);
+    return -1;
+  }
+
+  /*
+   * The mapping can only be used if every line is followed by a readable
+   * terminator. That holds when the file ends with a new line, or when
+   * the last page is partial and thus zero filled past the end of file.
+   */
+  if (S_ISREG(st.st_mode) && st.st_size > 0) {
+    sf->data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (sf->data == MAP_FAILED) {
+      sf->data = NULL;
+    } else if (sf->data[st.st_size - 1] != '\n' &&
+               !(st.st_size % page_size)) {
+      munmap(sf->data, st.st_size);
+      sf->data = NULL;
+    } else {
+      sf->size = st.st_size;
+      sf->mapped = 1;
+#if defined(MADV_SEQUENTIAL)
+      madvise(sf->data, sf->size, MADV_SEQUENTIAL);
+#endif
+    }
+  }
+
+  error = 0;
+  if (!sf->data)
+    error = src_read(ac, sf, fd);
+  close(fd);
+
+  sf->pos = sf->data;
+  return error;
+}
+
+/*
+ * Open a source held in memory. The text is copied into a zero
+ * terminated buffer, so the caller's needn't outlive the file.
+ */
+void src_buffer(struct asm65_context *ac, struct source_file *sf, char *name,
+                const char *data, size_t size)
+{
+  sf->name = name;
+  sf->data = (char *)malloc(size + 1);
+  if (!sf->data)
+    out_of_memory(ac);
+  memcpy(sf->data, data, size);
+  sf->data[size] = '\0';
+  sf->size = size;
+  sf->mapped = 0;
+  sf->pos = sf->data;
+}
+
+/*
+ * Get the next line of the file.
+ * Returns 0 at the end of the file.
+ */
+int src_next_line(struct source_file *sf, struct source_line *sl)
+{
+  char *end = sf->data + sf->size;
+  char *nl;
+
+  if (sf->pos >= end)
+    return 0;
+
+  sl->text = sf->pos;
+  nl = memchr(sf->pos, '\n', end - sf->pos);
+  if (nl) {
+    sf->pos = nl + 1;
+  } else {
+    nl = end;
+    sf->pos = end;
+  }
+  /* Leave a DOS line ending out of the line */
+  if (nl > sl->text && nl[-1] == '\r')
+    nl--;
+  sl->length = nl - sl->text;
+
+  return 1;
+}
+
+/*
+ * Start reading from the beginning of the file again
+ */
+void src_rewind(struct source_file *sf)
+{
+  sf->pos = sf->data;
+}
+
+/*
+ * Close the file and release its contents
+ */
+void src_close(struct source_file *sf)
+{
+  if (sf->mapped)
+    munmap(sf->data, sf->size);
+  else
+    free(sf->data);
+  sf->data = NULL;
+  sf->size = 0;
+  sf->pos = NULL;
+}
@@ -0,0 +1,40 @@
+/*
+ * Source file input
+ */
+#ifndef __SOURCE_H__
+#define __SOURCE_H__
+
+#include <stddef.h>
+
+/*
+ * An open source file. The whole file is available in memory, either
+ * mapped read only or, when it can't be mapped, read into a buffer.
+ */
+struct source_file {
+  char *name;
+  char *data;       /* Start of the file contents */
+  size_t size;      /* Size of the file contents */
+  char *pos;        /* Start of the next line */
+  int mapped;       /* Set if data is mmapped, otherwise it is malloced */
+};
+
+/*
+ * A line in a source file. The text is not a copy, it points into the
+ * file contents and is always followed by a line terminator ('\n', '\r'
+ * or '\0'), so scanning can stop on the terminator as well as on length.
+ */
+struct source_line {
+  char *text;
+  int length;       /* Length of the line without the terminator */
+};
+
+struct asm65_context;
+
+int src_open(struct asm65_context *ac, struct source_file *sf, char *name);
+void src_buffer(struct asm65_context *ac, struct source_file *sf, char *name,
+                const char *data, size_t size);
+int src_next_line(struct source_file *sf, struct source_line *sl);
+void src_rewind(struct source_file *sf);
+void src_close(struct source_file *sf);
+
+#endif // __SOURCE_H__
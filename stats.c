@@ -0,0 +1,242 @@
+/*
+ * Counters and phase timing.
+ * The phases are timed with the monotonic clock when they begin and end,
+ * which is a few times a run, and the counters are bumped in place, so
+ * the hot paths never pay for more than an increment. With a trace file
+ * the phases and the files read are also kept as events and written at
+ * the end in the trace event format of Chrome, which chrome://tracing
+ * and Perfetto show as a timeline.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include "stats.h"
+#include "errors.h"
+#include "context.h"
+
+static char *phase_names[STATS_NUM_PHASES] = {
+  [STATS_READ]   = "read",
+  [STATS_PASS1]  = "pass1",
+  [STATS_SIZING] = "sizing",
+  [STATS_PASS2]  = "pass2",
+  [STATS_WRITE]  = "write",
+};
+
+/* Contexts that timed an assembly, they are threads of the trace */
+static atomic_int stats_contexts;
+
+/* A span of the timeline, in seconds since stats_init() */
+struct stats_event {
+  char *name;
+  char *category;
+  double start;
+  double end;
+};
+
+double stats_now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * Start the counters and the timeline of an assembly, the trace file is
+ * kept. The events are written for this process and a number the context
+ * gets the first time, so traces of contexts on different threads can be
+ * told apart.
+ */
+void stats_init(struct asm65_context *ac)
+{
+  struct stats_trace *st = &ac->trace;
+
+  memset(&ac->stats, 0, sizeof (ac->stats));
+  st->pid = getpid();
+  if (!st->tid)
+    st->tid = atomic_fetch_add(&stats_contexts, 1) + 1;
+  st->epoch = stats_now();
+  st->events = NULL;
+  st->num_events = st->max_events = 0;
+}
+
+/*
+ * Keep the events, to be written to the file at the end, NULL for no
+ * trace. Returns 0, or -1 if out of memory.
+ */
+int stats_trace(struct asm65_context *ac, const char *file_name)
+{
+  char *copy = NULL;
+
+  if (file_name && !(copy = strdup(file_name)))
+    return -1;
+  free(ac->trace.file_name);
+  ac->trace.file_name = copy;
+  return 0;
+}
+
+void stats_begin(struct asm65_context *ac, int phase)
+{
+  ac->trace.phase_start[phase] = stats_now();
+}
+
+void stats_end(struct asm65_context *ac, int phase)
+{
+  double start = ac->trace.phase_start[phase];
+
+  ac->stats.phase_time[phase] += stats_now() - start;
+  stats_event(ac, phase_names[phase], "phase", start);
+}
+
+/*
+ * A span from start to now, kept only for the trace. The name is copied.
+ */
+void stats_event(struct asm65_context *ac, char *name, char *category,
+                 double start)
+{
+  struct stats_trace *st = &ac->trace;
+  struct stats_event *ev;
+
+  if (!st->file_name)
+    return;
+  if (st->num_events == st->max_events) {
+    st->max_events = st->max_events ? st->max_events * 2 : 64;
+    st->events = realloc(st->events,
+                         st->max_events * sizeof (struct stats_event));
+    if (!st->events)
+      out_of_memory(ac);
+  }
+  ev = &st->events[st->num_events++];
+  ev->name = strdup(name);
+  if (!ev->name)
+    out_of_memory(ac);
+  ev->category = category;
+  ev->start = start - st->epoch;
+  ev->end = stats_now() - st->epoch;
+}
+
+static long stats_peak_rss(void)
+{
+  struct rusage usage;
+
+  if (getrusage(RUSAGE_SELF, &usage))
+    return 0;
+  return usage.ru_maxrss;
+}
+
+static double stats_ratio(long a, long b)
+{
+  return b ? (double)a / b : 0;
+}
+
+/*
+ * Print the phase times and the counters
+ */
+void stats_report(struct asm65_context *ac)
+{
+  struct stats *stats = &ac->stats;
+  double total = 0;
+  int i;
+
+  log_printf(ac, "Phase      Seconds\n");
+  for (i = 0; i < STATS_NUM_PHASES; i++) {
+    log_printf(ac, "%-10s %9.6f\n", phase_names[i], stats->phase_time[i]);
+    total += stats->phase_time[i];
+  }
+  log_printf(ac, "%-10s %9.6f\n", "total", total);
+  log_printf(ac, "Lines %ld, tokens %ld\n", stats->lines, stats->tokens);
+  log_printf(ac, "Symbol look ups %ld, %.2f probes each, longest %d\n",
+             stats->sym_lookups,
+             stats_ratio(stats->sym_probes, stats->sym_lookups),
+             stats->sym_max_probe);
+  log_printf(ac, "Expressions compiled %ld, evaluated %ld, operands %ld\n",
+             stats->expr_compiles, stats->expr_runs, stats->addresses);
+  log_printf(ac, "Bytes emitted %ld\n", stats->bytes);
+  log_printf(ac, "Arena chunks %ld, %ld bytes, peak memory %ld KB\n",
+             stats->arena_chunks, stats->arena_bytes, stats_peak_rss());
+}
+
+/*
+ * Write a string of JSON, only quotes, backslashes and control
+ * characters need escaping
+ */
+static void stats_json_string(FILE *f, char *s)
+{
+  fputc('"', f);
+  for (; *s; s++) {
+    if (*s == '"' || *s == '\\')
+      fprintf(f, "\\%c", *s);
+    else if ((unsigned char)*s < 0x20)
+      fprintf(f, "\\u%04x", *s);
+    else
+      fputc(*s, f);
+  }
+  fputc('"', f);
+}
+
+/*
+ * Write the events and the counters to the trace file, if one was asked
+ * for. Returns OK, or FILE_ACCESS_FAILED if it can't be written.
+ */
+int stats_write_trace(struct asm65_context *ac)
+{
+  struct stats_trace *st = &ac->trace;
+  struct stats *stats = &ac->stats;
+  struct stats_event *ev;
+  FILE *f;
+  int error;
+  int i;
+
+  if (!st->file_name)
+    return OK;
+  f = fopen(st->file_name, "w");
+  if (!f)
+    return error_report(ac, "Could not open trace file %s", st->file_name);
+
+  fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+  fprintf(f, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"asm65\"}}",
+          st->pid, st->tid);
+  for (i = 0; i < st->num_events; i++) {
+    ev = &st->events[i];
+    fprintf(f, ",\n{\"name\":");
+    stats_json_string(f, ev->name);
+    fprintf(f, ",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d}",
+            ev->category, ev->start * 1e6, (ev->end - ev->start) * 1e6,
+            st->pid, st->tid);
+  }
+  fprintf(f, ",\n{\"name\":\"counters\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":%d,\"tid\":%d,\"args\":{"
+          "\"lines\":%ld,\"tokens\":%ld,\"sym_lookups\":%ld,\"sym_probes\":%ld,"
+          "\"sym_max_probe\":%d,\"expr_compiles\":%ld,\"expr_runs\":%ld,"
+          "\"addresses\":%ld,\"bytes\":%ld,\"arena_chunks\":%ld,\"arena_bytes\":%ld,"
+          "\"peak_rss_kb\":%ld}}\n]}\n",
+          (stats_now() - st->epoch) * 1e6, st->pid, st->tid, stats->lines,
+          stats->tokens, stats->sym_lookups, stats->sym_probes,
+          stats->sym_max_probe, stats->expr_compiles, stats->expr_runs,
+          stats->addresses, stats->bytes, stats->arena_chunks,
+          stats->arena_bytes, stats_peak_rss());
+
+  error = ferror(f);
+  if (fclose(f) || error)
+    return error_report(ac, "Could not write trace file %s", st->file_name);
+  return OK;
+}
+
+/*
+ * Drop the events of the assembly
+ */
+void stats_clean_up(struct asm65_context *ac)
+{
+  struct stats_trace *st = &ac->trace;
+  int i;
+
+  for (i = 0; i < st->num_events; i++)
+    free(st->events[i].name);
+  free(st->events);
+  stats_init(ac);
+}
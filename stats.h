@@ -0,0 +1,66 @@
+/*
+ * Counters and phase timing, printed with --stats and written as a
+ * Chrome trace with --trace
+ */
+#ifndef __STATS_H__
+#define __STATS_H__
+
+enum stats_phases {
+  STATS_READ,                   /* Reading and lexing the files */
+  STATS_PASS1,                  /* Parsing into the IR */
+  STATS_SIZING,                 /* Settling the instruction sizes */
+  STATS_PASS2,                  /* Encoding from the IR */
+  STATS_WRITE,                  /* Writing the output, object and listing */
+  STATS_NUM_PHASES
+};
+
+/*
+ * The counters are plain fields bumped where the work is done, nothing
+ * is checked or formatted until the report. All of them are counted all
+ * the time, --stats only decides whether they are printed.
+ */
+struct stats {
+  long lines;                   /* Lines assembled, macro lines too */
+  long tokens;                  /* Tokens lexed */
+  long sym_lookups;             /* Look ups in the name table */
+  long sym_probes;              /* Slots looked at by the look ups */
+  int sym_max_probe;
+  long expr_compiles;           /* Expressions compiled by eval_expr */
+  long expr_runs;               /* Compiled expressions evaluated */
+  long addresses;               /* Operands passed to evaluate_address */
+  long bytes;                   /* Bytes put in the output image */
+  long arena_chunks;            /* Arena chunks allocated */
+  long arena_bytes;             /* Bytes in them */
+  double phase_time[STATS_NUM_PHASES];
+};
+
+/*
+ * The timeline of an assembly, the events are only kept with a trace
+ * file to write them to
+ */
+struct stats_event;
+struct stats_trace {
+  char *file_name;              /* Trace file, NULL if none */
+  int pid;                      /* Process the events are written for */
+  int tid;                      /* Context, numbered from 1 in the process */
+  double epoch;
+  double phase_start[STATS_NUM_PHASES];
+  struct stats_event *events;
+  int num_events;
+  int max_events;
+};
+
+struct asm65_context;
+
+void stats_init(struct asm65_context *ac);
+int stats_trace(struct asm65_context *ac, const char *file_name);
+double stats_now(void);
+void stats_begin(struct asm65_context *ac, int phase);
+void stats_end(struct asm65_context *ac, int phase);
+void stats_event(struct asm65_context *ac, char *name, char *category,
+                 double start);
+void stats_report(struct asm65_context *ac);
+int stats_write_trace(struct asm65_context *ac);
+void stats_clean_up(struct asm65_context *ac);
+
+#endif // __STATS_H__
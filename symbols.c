@@ -5,104 +5,312 @@
 
 #include "symbols.h"
 #include "global.h"
+#include "errors.h"
 #include "utils.h"
+#include "context.h"
 
-//#define DEBUG_SYM
-#ifdef DEBUG_SYM
-#define DBG(x) x
-#else
-#define DBG(x)
-#endif
+#define NAME_TABLE_INITIAL_SIZE 1024
+#define SYM_ARENA_CHUNK_SIZE    (64 * 1024)
 
-/* Pointer to the first entry in the list */
-struct symbol_entry *se_first;
-/* Pointer to the last entry in the list */
-struct symbol_entry *se_last;
-/* The number of symbols in the list */
-int num_symbols;
-
-int bis_getx(void);
-int bis_gety(void);
-int bis_getpc(void);
+int bis_getx(struct asm65_context *ac);
+int bis_gety(struct asm65_context *ac);
+int bis_getpc(struct asm65_context *ac);
+int bis_gets(struct asm65_context *ac);
 
 struct built_in_symbol bis[] = {
-  { "X", bis_getx   },
-  { "x", bis_getx   },
-  { "Y", bis_gety   },
-  { "y", bis_gety   },
-  { "*", bis_getpc  },
-  { "PC", bis_getpc },
-  { "pc", bis_getpc },
-  { NULL, NULL },
+  { "X", BUILT_IN_X, bis_getx   },
+  { "x", BUILT_IN_X, bis_getx   },
+  { "Y", BUILT_IN_Y, bis_gety   },
+  { "y", BUILT_IN_Y, bis_gety   },
+  { "PC", BUILT_IN_PC, bis_getpc },
+  { "pc", BUILT_IN_PC, bis_getpc },
+  { "S", BUILT_IN_S, bis_gets   },
+  { "s", BUILT_IN_S, bis_gets   },
+  { NULL, 0, NULL },
 };
 
 /******************************************************************************
  *                       Built in symbol return value getters
  *****************************************************************************/
-int bis_getx(void)
+int bis_getx(struct asm65_context *ac)
 {
   return BUILT_IN_X;
 }
 
-int bis_gety(void)
+int bis_gety(struct asm65_context *ac)
 {
   return BUILT_IN_Y;
 }
 
-int bis_getpc(void)
+int bis_getpc(struct asm65_context *ac)
+{
+  return ac->PC;
+}
+
+int bis_gets(struct asm65_context *ac)
 {
-  return PC;
+  return BUILT_IN_S;
 }
 
 /******************************************************************************
  *                       Symbol management
  *****************************************************************************/
 /*
- * initialize the symbol management
+ * Create the name table and intern the names of the built in symbols,
+ * which are always kept
+ */
+static void sym_new_table(struct asm65_context *ac)
+{
+  struct sym_state *ss = &ac->sym;
+  struct built_in_symbol *lbis;
+  int keep = ss->keep;
+
+  arena_init(ac, &ss->name_arena, SYM_ARENA_CHUNK_SIZE);
+  ss->name_table = (struct sym_name **)calloc(NAME_TABLE_INITIAL_SIZE,
+                                              sizeof (struct sym_name *));
+  if (!ss->name_table)
+    out_of_memory(ac);
+  ss->name_table_mask = NAME_TABLE_INITIAL_SIZE - 1;
+  ss->num_names = 0;
+  ss->rebuild = 0;
+
+  /* Built in symbols are found through their interned names */
+  ss->keep = 1;
+  for (lbis = &bis[0]; lbis->name; lbis++)
+    sym_intern(ac, lbis->name, strlen(lbis->name))->builtin = lbis;
+  ss->keep = keep;
+}
+
+/*
+ * initialize the symbol management, the kept names of the previous
+ * assembly are still there
+ */
+void sym_init(struct asm65_context *ac)
+{
+  struct sym_state *ss = &ac->sym;
+
+  ss->se_first = NULL;
+  ss->se_last = NULL;
+  ss->num_symbols = 0;
+  ss->touched = NULL;
+  ss->transient = NULL;
+  ss->keep = 0;
+
+  arena_init(ac, &ss->arena, SYM_ARENA_CHUNK_SIZE);
+  if (!ss->name_table)
+    sym_new_table(ac);
+}
+
+/*
+ * FNV-1a hash of a symbol name
+ */
+static unsigned int sym_hash(char *name, int length)
+{
+  unsigned int hash = 2166136261u;
+
+  while (length--) {
+    hash ^= (unsigned char)*name++;
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+/*
+ * Length of the symbol name at the start of the buffer.
+ */
+static int sym_name_length(char *buf)
+{
+  char *end = buf;
+
+  if (isalpha(*end))
+    while (isvalidlabel(*++end));
+  return end - buf;
+}
+
+/*
+ * Find the slot for a name, either the one holding the interned name or
+ * the empty slot where it should go.
  */
-void sym_init(void)
+static struct sym_name **sym_find_slot(struct asm65_context *ac, char *name,
+                                       int length, unsigned int hash)
 {
-  se_first = NULL;
-  se_last = NULL;
-  num_symbols = 0;
+  struct sym_state *ss = &ac->sym;
+  unsigned int i = hash & ss->name_table_mask;
+  struct sym_name *sn;
+  int probes = 1;
+
+  while ((sn = ss->name_table[i])) {
+    if (sn->hash == hash && sn->length == length &&
+        !memcmp(sn->text, name, length))
+      break;
+    i = (i + 1) & ss->name_table_mask;
+    probes++;
+  }
+  ac->stats.sym_lookups++;
+  ac->stats.sym_probes += probes;
+  if (probes > ac->stats.sym_max_probe)
+    ac->stats.sym_max_probe = probes;
+  return &ss->name_table[i];
 }
 
 /*
- * Add a new symbol at the end of the symbol table
+ * Double the size of the name table and rehash all names.
  */
-struct symbol_entry *sym_new_symbol(char *buf)
+static void sym_grow_table(struct asm65_context *ac)
 {
+  struct sym_state *ss = &ac->sym;
+  struct sym_name **old_table = ss->name_table;
+  unsigned int old_size = ss->name_table_mask + 1;
+  unsigned int i, j;
+
+  ss->name_table = (struct sym_name **)calloc(old_size * 2,
+                                              sizeof (struct sym_name *));
+  if (!ss->name_table)
+    out_of_memory(ac);
+  ss->name_table_mask = old_size * 2 - 1;
+
+  for (i = 0; i < old_size; i++) {
+    if (!old_table[i])
+      continue;
+    j = old_table[i]->hash & ss->name_table_mask;
+    while (ss->name_table[j])
+      j = (j + 1) & ss->name_table_mask;
+    ss->name_table[j] = old_table[i];
+  }
+  free(old_table);
+}
+
+/*
+ * Intern a name. Every distinct name is stored once, the same text always
+ * gives the same pointer back. A name is kept in the name arena if it is
+ * interned while keep is set, else it goes with the symbol arena at the
+ * end of the assembly.
+ */
+struct sym_name *sym_intern(struct asm65_context *ac, char *buf, int length)
+{
+  unsigned int hash = sym_hash(buf, length);
+  struct sym_name **slot = sym_find_slot(ac, buf, length, hash);
+  struct sym_name *sn = *slot;
+  struct sym_state *ss = &ac->sym;
+
+  if (sn) {
+    /* A kept token can't point to a name about to be dropped */
+    if (sn->transient && ss->keep)
+      ss->rebuild = 1;
+    return sn;
+  }
+
+  sn = (struct sym_name *)arena_alloc(ss->keep ? &ss->name_arena : &ss->arena,
+                                      sizeof (struct sym_name) + length + 1);
+  sn->hash = hash;
+  sn->length = length;
+  sn->symbol = NULL;
+  sn->builtin = NULL;
+  sn->fixups = NULL;
+  sn->deps = NULL;
+  sn->macro = NULL;
+  sn->next_touched = NULL;
+  sn->touched = 0;
+  sn->transient = !ss->keep;
+  sn->next_transient = NULL;
+  if (sn->transient) {
+    sn->next_transient = ss->transient;
+    ss->transient = sn;
+  }
+  memcpy(sn->text, buf, length);
+  sn->text[length] = '\0';
+
+  /* Index the new name, growing the table before it gets too full */
+  *slot = sn;
+  if (++ss->num_names * 2 > ss->name_table_mask)
+    sym_grow_table(ac);
+
+  return sn;
+}
+
+/*
+ * Drop a name from the table. The names after it in its run move back
+ * into the hole, unless that would put them before their home slot.
+ */
+static void sym_remove(struct asm65_context *ac, struct sym_name *sn)
+{
+  struct sym_state *ss = &ac->sym;
+  unsigned int mask = ss->name_table_mask;
+  unsigned int hole = sn->hash & mask;
+  unsigned int i, home;
+
+  while (ss->name_table[hole] != sn)
+    hole = (hole + 1) & mask;
+  for (i = (hole + 1) & mask; ss->name_table[i]; i = (i + 1) & mask) {
+    home = ss->name_table[i]->hash & mask;
+    if (((i - home) & mask) >= ((i - hole) & mask)) {
+      ss->name_table[hole] = ss->name_table[i];
+      hole = i;
+    }
+  }
+  ss->name_table[hole] = NULL;
+  ss->num_names--;
+}
+
+/*
+ * Note that something of the assembly now hangs off a name, it is
+ * cleared at the end of the assembly
+ */
+void sym_touch(struct asm65_context *ac, struct sym_name *sn)
+{
+  if (sn->touched)
+    return;
+  sn->touched = 1;
+  sn->next_touched = ac->sym.touched;
+  ac->sym.touched = sn;
+}
+
+/*
+ * Add a new symbol at the end of the symbol table.
+ * Returns NULL if a symbol with the name already exists.
+ */
+struct symbol_entry *sym_new_symbol(struct asm65_context *ac,
+                                    struct sym_name *sn)
+{
+  struct sym_state *ss = &ac->sym;
   struct symbol_entry *se;
 
   /* First we should make sure the symbol doesn't already exist */
-  if (sym_look_for_symbol(buf, NULL))
+  if (sn->symbol)
     return NULL;
   
   /* Now, create a new entry */
-  se = (struct symbol_entry *)malloc(sizeof (struct symbol_entry));
-  
-  if (!se) {
-    printf ("Could not allocate necessary memory, exiting !\n");
-    exit(1);
-  }
+  se = (struct symbol_entry *)arena_alloc(&ss->arena,
+                                          sizeof (struct symbol_entry));
+  se->name = sn;
+  se->symbol_name = sn->text;
+  se->name_length = sn->length;
+  se->value = 0;
+  se->defined = 0;
+  se->section = -1;
+  se->import = 0;
+  sn->symbol = se;
+  sym_touch(ac, sn);
   
   /* First entry in table need special treatment */
-  if (!num_symbols) {
-    se_first = se;
-    se_last = se;
+  if (!ss->num_symbols) {
+    ss->se_first = se;
+    ss->se_last = se;
     se->prev = NULL;
     se->next = NULL;
   } else {
     /* Change the previously last entry to point to this one */
-    se_last->next = se;
+    ss->se_last->next = se;
     /* The new entry prev pointer shall point to the previously last one */
-    se->prev = se_last;
+    se->prev = ss->se_last;
     /* The new entry is the current last */
-    se_last = se;
+    ss->se_last = se;
     /* There is no next in the new last entry */
     se->next = NULL;
   }
-  num_symbols++;
+  ss->num_symbols++;
+
+  return se;
 }
 
 /*
@@ -117,81 +325,90 @@ struct symbol_entry *sym_next_symbol(struct symbol_entry *entry)
 }
 
 /*
- * Read a symbol name and zero terminate it.
- * Only uses the first 255 characters of the symbol name.
+ * Look for a symbol in the symbol table.
+ * The name has to match exactly, on success outptr is moved past it.
  */
-char *sym_read_name(char *result, char *buf)
+struct symbol_entry *sym_look_for_symbol(struct asm65_context *ac, char *buf,
+                                         char **outptr)
 {
-  int i = 1;
-  
-  *result++ = *buf++;
-  while (isvalidlabel(*buf) && (i++ < 255))
-    *result++ = *buf++;
-  *result = '\0';
+  struct sym_name *sn;
+  int length;
   
-  return buf;
+  buf = skip_white(buf);
+  length = sym_name_length(buf);
+  if (!length)
+    return NULL;
+
+  sn = *sym_find_slot(ac, buf, length, sym_hash(buf, length));
+  if (!sn || !sn->symbol)
+    return NULL;
+  if (outptr)
+    *outptr = buf + length;
+  return sn->symbol;
 }
 
 /*
- * Look for a symbol in the symbol list.
+ * Clean up after using the symbol table.
+ * The entries and the names of the assembly all live in the symbol arena,
+ * so this is a single release once those names are out of the table.
+ * The kept names forget the symbols, fixups, macros and lines of the
+ * assembly that hang off them.
  */
-struct symbol_entry *sym_look_for_symbol(char *buf, char **outptr)
+int sym_clean_up(struct asm65_context *ac)
 {
-  struct symbol_entry *se = se_first;
-  struct built_in_symbol *lbis = &bis[0];
-  int cnt = num_symbols;
-  char symbol[256];
-  
-  /* get next section */
-  getarg(symbol, buf);
-  while (cnt--) {
-    if (!strncmp(symbol, se->symbol_name, strlen(symbol))) {
-      if (outptr)
-        *outptr += se->name_length;
-      return se;
-    }
-    se = se->next;
+  struct sym_state *ss = &ac->sym;
+  struct sym_name *sn;
+
+  for (sn = ss->touched; sn; sn = sn->next_touched) {
+    sn->symbol = NULL;
+    sn->fixups = NULL;
+    sn->macro = NULL;
+    sn->deps = NULL;
+    sn->touched = 0;
   }
-  return NULL;
+  for (sn = ss->transient; sn; sn = sn->next_transient)
+    sym_remove(ac, sn);
+  ss->touched = NULL;
+  ss->transient = NULL;
+  arena_release(&ss->arena);
+  ss->se_first = NULL;
+  ss->se_last = NULL;
+  ss->num_symbols = 0;
+  return SYM_OK;
 }
 
 /*
- * Clean up after using the symbol table
+ * Release the names, once nothing points to them
  */
-int sym_clean_up(void)
+void sym_clear_names(struct asm65_context *ac)
 {
-  struct symbol_entry *se = se_first;
-  struct symbol_entry *next;
-  int cnt = num_symbols;
-  
-  while (cnt--) {
-    /* Get the pointer to the next entry before freeing */
-    next = se->next;
-    free(se->symbol_name);
-    free(se);
-    se = next;
-  }
-  return SYM_OK;
+  struct sym_state *ss = &ac->sym;
+
+  if (!ss->name_table)
+    return;
+  arena_release(&ss->name_arena);
+  free(ss->name_table);
+  ss->name_table = NULL;
+  ss->num_names = 0;
 }
 
-struct built_in_symbol *check_built_in_symbol(char *buf, char **outptr)
+/*
+ * Start the kept names over, the caller interns again the ones still
+ * pointed to
+ */
+void sym_reset_names(struct asm65_context *ac)
 {
-  struct built_in_symbol *lbis = &bis[0];
-  char symbol[256];
+  sym_clear_names(ac);
+  sym_new_table(ac);
+}
 
-  DBG(printf("i"));
-  if (outptr)
-    *outptr = getarg(symbol, buf);
-  else
-    getarg(symbol, buf);
-    
-  while (*lbis->name) {
-    if (!strncmp(symbol, lbis->name, strlen(lbis->name))) {
-      DBG(printf("o(%s)\n", lbis->name));
-      return lbis;
-    }
-    lbis++;
-  }
-  DBG(printf("x\n"));
-  return NULL;
+/*
+ * Report the memory used by the symbol table
+ */
+void sym_report(struct asm65_context *ac)
+{
+  log_printf(ac, "Symbols: %d symbols, %d interned names\n",
+             ac->sym.num_symbols, ac->sym.num_names);
+  arena_report(&ac->sym.arena, "Symbol");
+  arena_report(&ac->sym.name_arena, "Name");
 }
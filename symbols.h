@@ -1,3 +1,8 @@
+#ifndef __SYMBOLS_H__
+#define __SYMBOLS_H__
+
+#include "arena.h"
+
 /*
  * Result codes for the symbol library
  */
@@ -5,6 +10,28 @@ enum symbol_results {
   SYM_OK,
 };
 
+/*
+ * Interned symbol name. Every distinct name is stored exactly once,
+ * so two names are equal if and only if their pointers are.
+ */
+struct fixup;
+struct macro;
+struct size_dep;
+struct sym_name {
+  unsigned int hash;
+  int length;
+  struct symbol_entry *symbol;  /* The symbol defined with this name */
+  struct built_in_symbol *builtin;
+  struct fixup *fixups;         /* Values waiting for the symbol */
+  struct macro *macro;          /* The macro defined with this name */
+  struct size_dep *deps;        /* Lines sized on the value of the symbol */
+  struct sym_name *next_touched;   /* Next name used by the assembly */
+  struct sym_name *next_transient; /* Next name dropped after it */
+  int touched;                  /* Something of the assembly hangs off it */
+  int transient;                /* Only lives for the assembly */
+  char text[];
+};
+
 /*
  * Symbol entry descriptor
  */
@@ -12,32 +39,72 @@ struct symbol_entry;
 struct symbol_entry {
   struct symbol_entry *prev;
   struct symbol_entry *next;
+  struct sym_name *name;
   char *symbol_name;
   int name_length;
   int value;
+  int defined;                  /* Set once the value is known */
+  int section;                  /* Object file section, -1 if absolute */
+  int import;                   /* Index among the imports + 1, 0 if none */
 };
 
+struct asm65_context;
 struct built_in_symbol {
   char *name;
-  int (*getvalue)(void);
+  int id;
+  int (*getvalue)(struct asm65_context *ac);
 };
 
 enum built_in_descriptors {
   BUILT_IN_X = 1,
   BUILT_IN_Y,
+  BUILT_IN_PC,
+  BUILT_IN_S,
 };
   
-/* Pointer to the first entry in the list */
-extern struct symbol_entry *se_first;
-/* Pointer to the last entry in the list */
-extern struct symbol_entry *se_last;
-/* The number of symbols in the list */
-extern int num_symbols;
-
-void sym_init(void);
-struct symbol_entry *sym_new_symbol(char *buf);
+/*
+ * The symbol table of a context. Open addressing hash table of interned
+ * names, the symbol defined with a name hangs off its entry. The size is
+ * always a power of two and kept at most half full. The names met in
+ * the files kept by the include module are kept with them, their tokens
+ * point to them. The others only live for one assembly, like what hangs
+ * off the names.
+ */
+struct sym_state {
+  /* Pointer to the first entry in the list */
+  struct symbol_entry *se_first;
+  /* Pointer to the last entry in the list */
+  struct symbol_entry *se_last;
+  /* The number of symbols in the list */
+  int num_symbols;
+  struct sym_name **name_table;
+  unsigned int name_table_mask;
+  int num_names;
+  /* Arena owning all symbol entries */
+  struct arena arena;
+  /* Arena owning the kept names, the others live in the symbol arena */
+  struct arena name_arena;
+  /* The names something was hung off during the assembly */
+  struct sym_name *touched;
+  /* The names to drop from the table after the assembly */
+  struct sym_name *transient;
+  /* Set while the names interned are kept */
+  int keep;
+  /* A kept name was first interned for one assembly only */
+  int rebuild;
+};
+
+void sym_init(struct asm65_context *ac);
+struct sym_name *sym_intern(struct asm65_context *ac, char *buf, int length);
+void sym_touch(struct asm65_context *ac, struct sym_name *sn);
+struct symbol_entry *sym_new_symbol(struct asm65_context *ac,
+                                    struct sym_name *sn);
 struct symbol_entry *sym_next_symbol(struct symbol_entry *entry);
-struct symbol_entry *sym_look_for_symbol(char *buf, char **out_ptr);
-int sym_get_symbol_value(char *buf, char **out);
-struct built_in_symbol *check_built_in_symbol(char *buf, char **out_ptr);
-int sym_clean_up(void);
+struct symbol_entry *sym_look_for_symbol(struct asm65_context *ac, char *buf,
+                                         char **out_ptr);
+int sym_clean_up(struct asm65_context *ac);
+void sym_reset_names(struct asm65_context *ac);
+void sym_clear_names(struct asm65_context *ac);
+void sym_report(struct asm65_context *ac);
+
+#endif // __SYMBOLS_H__
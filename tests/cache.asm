@@ -0,0 +1,4 @@
+; A source whose cached result depends on an included file
+		ORG $1000
+START		INCLUDE inc/second.inc
+		JMP START
@@ -0,0 +1,17 @@
+; Two runs of code with a gap, the hex formats leave the gap out and
+; split the first run into records of 16 bytes
+		ORG $1000
+START		LDX #$00
+LOOP		LDA $1100,X
+		BEQ DONE
+		STA $0400,X
+		INX
+		BNE LOOP
+		LDY #$10
+WAIT		DEY
+		BNE WAIT
+DONE		RTS
+
+		ORG $1020
+		JMP START
+		JMP DONE
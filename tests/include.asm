@@ -0,0 +1,6 @@
+; Includes found next to the includer, in the include path and by a
+; quoted name
+		ORG $1000
+		INCLUDE inc/first.inc
+		INCLUDE "lib.inc"
+		JMP START
@@ -0,0 +1,3 @@
+; Includes a file that includes it back
+		ORG $1000
+		INCLUDE inc/cycle.inc
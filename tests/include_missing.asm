@@ -0,0 +1,4 @@
+; The second file isn't anywhere
+		ORG $1000
+		INCLUDE inc/second.inc
+		INCLUDE nowhere.inc
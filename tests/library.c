@@ -0,0 +1,144 @@
+/*
+ * Test of the library, run by tests/library.test in its work directory.
+ * It assembles sources held in memory and prints what comes back, the
+ * output is compared like the one of any other test.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "asm65.h"
+#include "context.h"
+
+#define NUM_THREADS     4
+#define NUM_ROUNDS      200
+
+static int assemble(struct asm65_context *ac, const char *source)
+{
+  return asm65_assemble(ac, source, strlen(source));
+}
+
+/*
+ * Print the image and the symbols of the last assembly, or its error
+ */
+static void show(struct asm65_context *ac)
+{
+  const struct asm65_symbol *symbols;
+  const unsigned char *image;
+  const char *message;
+  int low, high;
+  int count;
+  int line;
+  int i;
+
+  if ((message = asm65_error(ac, &line))) {
+    printf("error line %d: %s\n", line, message);
+    return;
+  }
+  image = asm65_get_image(ac, &low, &high);
+  printf("$%04X-$%04X:", low, high);
+  for (i = low; i <= high; i++)
+    printf(" %02X", image[i]);
+  printf("\n");
+  count = asm65_get_symbols(ac, &symbols);
+  for (i = 0; i < count; i++)
+    printf("%s = $%04X\n", symbols[i].name, symbols[i].value);
+}
+
+static void write_file(const char *name, const char *text)
+{
+  FILE *file = fopen(name, "w");
+
+  if (!file) {
+    perror(name);
+    exit(1);
+  }
+  fputs(text, file);
+  fclose(file);
+}
+
+/*
+ * Every thread assembles with its own context, the bytes depend on the
+ * thread so a context seeing another one's state shows up
+ */
+static void *thread_main(void *arg)
+{
+  int *result = (int *)arg;
+  int thread = *result;
+  struct asm65_context *ac = asm65_create(0);
+  const unsigned char *image;
+  char source[256];
+  int round;
+  int low;
+
+  *result = 0;
+  for (round = 0; round < NUM_ROUNDS && ac; round++) {
+    snprintf(source, sizeof (source),
+             "\tORG $%04X\nloop%d_%d\tLDA #%d\n\tJMP loop%d_%d\n",
+             0x1000 * (thread + 1), thread, round, round & 0xff, thread,
+             round);
+    if (assemble(ac, source))
+      break;
+    image = asm65_get_image(ac, &low, NULL);
+    if (low != 0x1000 * (thread + 1) || image[low + 1] != (round & 0xff) ||
+        image[low + 3] != (low & 0xff) || image[low + 4] != low >> 8)
+      break;
+  }
+  *result = round == NUM_ROUNDS;
+  asm65_destroy(ac);
+  return NULL;
+}
+
+int main(void)
+{
+  struct asm65_context *ac = asm65_create(0);
+  pthread_t threads[NUM_THREADS];
+  int results[NUM_THREADS];
+  char source[256];
+  int num_names;
+  int i;
+
+  printf("# Image and symbols\n");
+  assemble(ac, "\tORG $1000\nstart\tLDA #$12\n\tSTA $0200\n\tJMP start\n"
+           "end\n");
+  show(ac);
+
+  printf("# Error, then the same context again\n");
+  assemble(ac, "\tORG $1000\n\tLDA #1\n\tJMP nowhere\n");
+  show(ac);
+  assemble(ac, "\tORG $2000\nhere\tJMP here\n");
+  show(ac);
+
+  printf("# Include rewritten right after it was read\n");
+  asm65_add_include_path(ac, ".");
+  write_file("regs.inc", "VAL = $11\n");
+  assemble(ac, "\tORG $1000\n\tINCLUDE regs.inc\n\tLDA #VAL\n");
+  show(ac);
+  write_file("regs.inc", "VAL = $22\n");
+  assemble(ac, "\tORG $1000\n\tINCLUDE regs.inc\n\tLDA #VAL\n");
+  show(ac);
+
+  printf("# Names of earlier assemblies\n");
+  num_names = ac->sym.num_names;
+  for (i = 0; i < 1000; i++) {
+    snprintf(source, sizeof (source), "\tORG $1000\nlabel%d\tNOP\n", i);
+    assemble(ac, source);
+  }
+  printf("%d names more\n", ac->sym.num_names - num_names);
+  asm65_destroy(ac);
+
+  printf("# Contexts on %d threads\n", NUM_THREADS);
+  for (i = 0; i < NUM_THREADS; i++) {
+    results[i] = i;
+    if (pthread_create(&threads[i], NULL, thread_main, &results[i])) {
+      printf("could not start thread %d\n", i);
+      return 1;
+    }
+  }
+  for (i = 0; i < NUM_THREADS; i++) {
+    pthread_join(threads[i], NULL);
+    printf("thread %d %s\n", i, results[i] ? "ok" : "FAILED");
+  }
+  return 0;
+}
@@ -0,0 +1,5 @@
+; A relocatable section exporting PRINT and one assembled at $C000
+PRINT		LDY #$00
+		JMP LOOP
+		ORG $C000
+LOOP		RTS
@@ -0,0 +1,7 @@
+; Relocatable module importing PRINT, with the low and high byte of an
+; address and a word of another module
+START		LDA #MSG & $FF
+		LDX #MSG >> 8
+		JSR PRINT
+		JMP START
+MSG		NOP
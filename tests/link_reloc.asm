@@ -0,0 +1,2 @@
+; Twice an address can't be relocated
+START		LDA START * 2
@@ -0,0 +1,2 @@
+; Exports PRINT a second time
+PRINT		RTS
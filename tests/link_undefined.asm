@@ -0,0 +1,3 @@
+; Imports a symbol no module defines
+		JSR MISSING
+		RTS
@@ -0,0 +1,17 @@
+; Parameters, locals renamed in every expansion and a macro expanding
+; another one
+		ORG $2000
+DELAY		MACRO COUNT
+		LDX #COUNT
+@LOOP		DEX
+		BNE @LOOP
+		ENDM
+
+PAUSE		MACRO FIRST, SECOND
+		DELAY FIRST
+		DELAY (SECOND + 1)
+		ENDM
+
+START		DELAY $10
+		PAUSE 2, 3
+		JMP START
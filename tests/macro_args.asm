@@ -0,0 +1,6 @@
+; One argument more than parameters
+		ORG $2000
+ONE		MACRO VALUE
+		LDA #VALUE
+		ENDM
+		ONE 1, 2
@@ -0,0 +1,5 @@
+; The body runs to the end of the file
+		ORG $2000
+BODY		MACRO
+		NOP
+		NOP
@@ -0,0 +1,6 @@
+; A macro can't be defined inside another
+		ORG $2000
+OUTER		MACRO
+INNER		MACRO
+		ENDM
+		ENDM
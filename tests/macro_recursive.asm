@@ -0,0 +1,9 @@
+; A macro may not expand itself, not even through another one
+		ORG $2000
+OUTER		MACRO
+		INNER
+		ENDM
+INNER		MACRO
+		OUTER
+		ENDM
+		OUTER
@@ -0,0 +1,88 @@
+#!/bin/sh
+#
+# Runs the tests, make check runs every one of them:
+#   tests/run.sh [name...]
+# A test is a shell script tests/<name>.test run in an empty directory,
+# what it prints is compared with tests/<name>.out. UPDATE=1 writes what
+# it printed to tests/<name>.out instead.
+#
+TESTS=$(cd "$(dirname "$0")" && pwd)
+ROOT=$(dirname "$TESTS")
+WORK=$TESTS/work
+
+# Copy fixtures from the tests directory into the current one
+fixture()
+{
+  for f in "$@"; do
+    cp "$TESTS/$f" . || exit 1
+  done
+}
+
+# Run a program, a failure is printed with its exit status
+run()
+{
+  "$@"
+  status=$?
+  [ $status -eq 0 ] || echo "exit $status"
+}
+
+asm65()
+{
+  run "$ROOT/asm65" "$@"
+}
+
+link65()
+{
+  run "$ROOT/link65" "$@"
+}
+
+# Generate a source with bench/gensrc
+gensrc()
+{
+  run "$ROOT/bench/gensrc" "$@"
+}
+
+# Print a binary file in hex, runs of the same line are shown as *
+dump()
+{
+  for f in "$@"; do
+    echo "--- $f"
+    od -An -tx1 "$f"
+  done
+}
+
+# Print a text file
+show()
+{
+  for f in "$@"; do
+    echo "--- $f"
+    cat "$f"
+  done
+}
+
+if [ $# -eq 0 ]; then
+  set -- $(cd "$TESTS" && ls *.test | sed 's/\.test$//')
+fi
+
+failed=0
+for name in "$@"; do
+  rm -rf "$WORK/$name"
+  mkdir -p "$WORK/$name"
+  (cd "$WORK/$name" && . "$TESTS/$name.test") > "$WORK/$name.log" 2>&1
+  if [ -n "$UPDATE" ]; then
+    cp "$WORK/$name.log" "$TESTS/$name.out"
+    echo "updated $name"
+  elif cmp -s "$WORK/$name.log" "$TESTS/$name.out"; then
+    echo "ok      $name"
+  else
+    echo "FAILED  $name"
+    diff -u "$TESTS/$name.out" "$WORK/$name.log"
+    failed=$((failed + 1))
+  fi
+done
+
+if [ $failed -ne 0 ]; then
+  echo "$failed of $# tests failed"
+  exit 1
+fi
+echo "All $# tests passed"
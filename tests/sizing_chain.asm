@@ -0,0 +1,13 @@
+; A chain of growths, each one pushes the next label past $FF. The
+; labels are at $FD, $FE and $FF until the code before them grows, one
+; instruction more grows in every round.
+		ORG $F4
+		LDA FAR
+		LDA L3
+		LDA L2
+		LDA L1
+		NOP
+L3		NOP
+L2		NOP
+L1		NOP
+FAR = $1234
@@ -0,0 +1,12 @@
+; Forward references are put in zero page first, the ones that turn
+; out not to fit grow to absolute
+		ORG $1000
+		LDA SMALL
+		LDA LARGE
+		STA TABLE,X
+		LDX NEAR,Y
+		RTS
+TABLE		NOP
+SMALL = $12
+LARGE = $1234
+NEAR = SMALL + $10
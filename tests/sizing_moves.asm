@@ -0,0 +1,13 @@
+; Code moved by a growth: an equate computed from labels, one using the
+; PC, an ORG computed from a label, and a branch relaxed with -r. Each
+; is evaluated again wherever it ends up.
+		ORG $E0
+START		LDA DATA
+		LDA SIZE
+HERE = *
+		BNE START
+		JMP HERE
+END		NOP
+		ORG END + $20
+DATA		BRK
+SIZE = DATA - START
@@ -3,19 +3,24 @@
 #include <string.h>
 #include <ctype.h>
 
+#include "global.h"
 #include "symbols.h"
+#include "lexer.h"
+#include "utils.h"
 #include "errors.h"
+#include "fixup.h"
+#include "object.h"
+#include "context.h"
 
-extern int PC;
 /******************************************************************************
  *                       Support functions
  *****************************************************************************/
 /*
- * Skip white space characters
+ * Skip white space characters, stopping at the end of the line
  */
 char *skip_white(char *buf)
 {
-  while (isspace(*buf))
+  while (isspace(*buf) && *buf != '\n' && *buf != '\r')
     buf++;
 
   return buf;
@@ -26,7 +31,7 @@ char *skip_white(char *buf)
  */
 char *skiptowhite(char *buf)
 {
-  while (!isspace(*buf))
+  while (*buf && !isspace(*buf))
     buf++;
 
   return buf;  
@@ -57,7 +62,7 @@ char isendofline(char c)
 void strntoupper(char* result, char *buf, int n)
 {
   buf = skip_white(buf);
-  while (!isspace(*buf) && *buf != ';' && n--)
+  while (*buf && !isspace(*buf) && *buf != ';' && n--)
     *result++ = toupper(*buf++);
   *result = '\0';
 }
@@ -113,44 +118,45 @@ int isvalidlabel(int c)
 }
 
 /*
- * Read and store the current label.
- * The function returns a pointer to the created symbol entry
- * so that the caller can modify the value property if needed.
+ * Pack the next word into a keyword key, upper casing it on the way.
+ * Returns 0 if the word can not be a keyword, that is if it is empty,
+ * longer than KEY_MAX_LENGTH or contains anything but letters.
  */
-struct symbol_entry *read_and_store_label(char *buf)
+unsigned long long keyword_key(char *buf, char **outptr)
 {
-  char label[256];
-  char *labptr;
-  struct symbol_entry *se;
-  int i=1;
+  unsigned long long key = 0;
+  int i = 0;
 
-  label[0] = *buf++;
+  buf = skip_white(buf);
+  while (isalpha(*buf) && (i++ < KEY_MAX_LENGTH))
+    key = (key << 5) | KEYC(*buf++);
+  if (isvalidlabel(*buf))
+    return 0;
 
-  while (isvalidlabel(*buf) && (i < 255))
-    label[i++] = *buf++;
-  label[i] = '\0';
-  
-  printf ("LAB: '%s'\n", label);
-  
-  /* Create storage for the new label */
-  labptr = (char *)malloc(i+1);
-  if (!labptr) {
-    printf("Could not allocate necessary memory, terminating !\n");
-    exit(1);
-  }
-  strcpy(labptr, label);
-  /* Create a new symbol entry */
-  se = sym_new_symbol(labptr);
-  if (!se)
-    return NULL;
-  se->symbol_name = labptr;
-  se->name_length = i;
-  se->value = PC;
-
-  /* In case the label name was longer than max num characters */
-  while (!isspace(*buf++));
-  
-  return se;
+  if (outptr)
+    *outptr = buf;
+  return key;
+}
+
+/*
+ * Read and store the current label.
+ * se is set to the created symbol entry so that the caller can modify
+ * the value property if needed. Values waiting for the label are
+ * patched right away.
+ */
+int read_and_store_label(struct asm65_context *ac, struct token *tok,
+                         struct symbol_entry **se)
+{
+  /* Create a new symbol entry, the name was interned by the lexer */
+  *se = sym_new_symbol(ac, tok->sym);
+  if (!*se)
+    return SYMBOL_ALREADY_EXIST;
+  LOG(ac, LOG_SYM, LOG_DEBUG, "LAB: '%s'\n", (*se)->symbol_name);
+  (*se)->value = ac->PC;
+  (*se)->section = obj_current_section(ac);
+  (*se)->defined = 1;
+
+  return fixup_resolve(ac, tok->sym);
 }
 
 /*
@@ -176,22 +182,3 @@ int getvalue(char *buf)
   }
   return value;
 }
-
-/*
- * Converts a power of 2 addressing mode to its decimal
- * representation. Only use this function for addressing modes.
- */
-int mode2dec(unsigned int val)
-{
-  int i = 0;
-  
-  /* Sanity check */
-  if (!val) return -1;
-  
-  while (val) {
-    i++;
-    val >>= 1;
-  }
-  
-  return (i - 2);
-}
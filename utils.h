@@ -2,14 +2,31 @@
 #ifndef __UTILS_H__
 #define __UTILS_H__
 
+struct asm65_context;
+struct token;
+struct symbol_entry;
+
+/*
+ * Keywords (directives and mnemonics) are packed five bits per character
+ * into a 64 bit key. Masking with 0x1f makes the key case insensitive.
+ */
+#define KEY_MAX_LENGTH        12
+#define KEYC(c)               ((unsigned long long)((c) & 0x1f))
+#define KEY3(a, b, c)         ((KEYC(a) << 10) | (KEYC(b) << 5) | KEYC(c))
+#define KEY4(a, b, c, d)      ((KEY3(a, b, c) << 5) | KEYC(d))
+#define KEY5(a, b, c, d, e)   ((KEY4(a, b, c, d) << 5) | KEYC(e))
+#define KEY7(a, b, c, d, e, f, g) ((KEY4(a, b, c, d) << 15) | KEY3(e, f, g))
+
 char *skip_white(char *buf);
 char *skiptowhite(char *buf);
 char isendofline(char c);
+char isendofarg(char c);
 void strntoupper(char* result, char *buf, int n);
 char *getarg(char *result, char* buf);
 int isvalidlabel(int c);
-struct symbol_entry *read_and_store_label(char *buf);
+unsigned long long keyword_key(char *buf, char **outptr);
+int read_and_store_label(struct asm65_context *ac, struct token *tok,
+                         struct symbol_entry **se);
 int getvalue(char *buf);
-int mode2dec(unsigned int val);
 
 #endif // __UTILS_H__
\ No newline at end of file